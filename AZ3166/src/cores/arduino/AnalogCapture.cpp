@@ -0,0 +1,381 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#include "mbed.h"
+#include "pinmap.h"
+#include "PeripheralPins.h"
+#include "us_ticker_api.h"
+#include "AnalogCapture.h"
+#include "wiring_digital.h"
+
+// ADC1 requests are served by DMA2 stream 0 or 4 on channel 0, stream 4 is taken by the audio codec
+#define CAPTURE_DMA_STREAM      DMA2_Stream0
+#define CAPTURE_DMA_IRQ         DMA2_Stream0_IRQn
+#define CAPTURE_SAMPLE_TIME     ADC_SAMPLETIME_56CYCLES
+
+#define ADC_CHANNEL_UNKNOWN     0x00
+#define ADC_CHANNEL_NONE        0xFF
+
+static ADC_HandleTypeDef adcHandle;
+static DMA_HandleTypeDef dmaHandle;
+static Mutex adcMutex;
+static bool adcReady = false;
+
+// ADC channel + 1 of every pin, resolved on first use
+static uint8_t adcChannels[DIGITAL_PIN_COUNT];
+// Pins currently in analog mode
+static uint8_t analogPins[DIGITAL_PIN_COUNT / 8];
+
+static uint32_t capturePins[ANALOG_CAPTURE_MAX_CHANNELS];
+static int capturePinCount = 0;
+static uint16_t *captureBuffer = NULL;
+static int captureFrames = 0;
+static ANALOG_CAPTURE_CALLBACK captureCallback = NULL;
+static void *captureContext = NULL;
+
+static volatile ANALOG_CAPTURE_STATS captureStats;
+static uint32_t captureStartUs;
+static volatile uint32_t captureLastUs;
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ADC
+static int GetChannel(uint32_t pin)
+{
+    if (pin >= DIGITAL_PIN_COUNT)
+    {
+        return -1;
+    }
+
+    if (adcChannels[pin] == ADC_CHANNEL_UNKNOWN)
+    {
+        uint32_t function = pinmap_find_function((PinName)pin, PinMap_ADC);
+        if (function == (uint32_t)NC || pinmap_find_peripheral((PinName)pin, PinMap_ADC) != (uint32_t)ADC_1)
+        {
+            adcChannels[pin] = ADC_CHANNEL_NONE;
+        }
+        else
+        {
+            adcChannels[pin] = STM_PIN_CHANNEL(function) + 1;
+        }
+    }
+
+    if (adcChannels[pin] == ADC_CHANNEL_NONE)
+    {
+        return -1;
+    }
+
+    // The pin is set to analog once, and again after a digital access
+    if ((analogPins[pin >> 3] & (1 << (pin & 7))) == 0 || digitalPinModes[pin] != 0)
+    {
+        pinModeReset(pin);
+        pinmap_pinout((PinName)pin, PinMap_ADC);
+        analogPins[pin >> 3] |= (1 << (pin & 7));
+    }
+    return adcChannels[pin] - 1;
+}
+
+static void SetSampleTime(int channel)
+{
+    if (channel > 9)
+    {
+        int shift = 3 * (channel - 10);
+        ADC1->SMPR1 = (ADC1->SMPR1 & ~(0x7UL << shift)) | (CAPTURE_SAMPLE_TIME << shift);
+    }
+    else
+    {
+        int shift = 3 * channel;
+        ADC1->SMPR2 = (ADC1->SMPR2 & ~(0x7UL << shift)) | (CAPTURE_SAMPLE_TIME << shift);
+    }
+}
+
+static int ConfigADC(uint32_t trigger, int conversions)
+{
+    __HAL_RCC_ADC1_CLK_ENABLE();
+
+    adcHandle.Instance = ADC1;
+    adcHandle.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+    adcHandle.Init.Resolution = ADC_RESOLUTION_12B;
+    adcHandle.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+    adcHandle.Init.ScanConvMode = ENABLE;
+    adcHandle.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+    adcHandle.Init.ContinuousConvMode = DISABLE;
+    adcHandle.Init.NbrOfConversion = conversions;
+    adcHandle.Init.DiscontinuousConvMode = DISABLE;
+    adcHandle.Init.NbrOfDiscConversion = 0;
+    adcHandle.Init.ExternalTrigConv = trigger;
+    adcHandle.Init.ExternalTrigConvEdge = (trigger == ADC_SOFTWARE_START ? ADC_EXTERNALTRIGCONVEDGE_NONE : ADC_EXTERNALTRIGCONVEDGE_RISING);
+    adcHandle.Init.DMAContinuousRequests = (trigger == ADC_SOFTWARE_START ? DISABLE : ENABLE);
+    if (HAL_ADC_Init(&adcHandle) != HAL_OK)
+    {
+        return -1;
+    }
+
+    if ((ADC1->CR2 & ADC_CR2_ADON) == 0)
+    {
+        ADC1->CR2 |= ADC_CR2_ADON;
+        // tSTAB of the ADC
+        wait_us(3);
+    }
+    adcReady = true;
+    return 0;
+}
+
+// Single conversion on the injected group, which preempts the triggered regular scans
+static int ConvertInjected(int channel)
+{
+    SetSampleTime(channel);
+    ADC1->JSQR = (uint32_t)channel << 15;
+    ADC1->SR = ~(ADC_SR_JEOC | ADC_SR_JSTRT);
+    ADC1->CR2 |= ADC_CR2_JSWSTART;
+
+    uint32_t start = us_ticker_read();
+    while ((ADC1->SR & ADC_SR_JEOC) == 0)
+    {
+        if (us_ticker_read() - start > 100)
+        {
+            return -1;
+        }
+    }
+    ADC1->SR = ~ADC_SR_JEOC;
+    return (int)(ADC1->JDR1 & 0xFFF);
+}
+
+int analogReadRaw(uint32_t pin)
+{
+    int value = -1;
+
+    adcMutex.lock();
+    int channel = GetChannel(pin);
+    if (channel >= 0 && (adcReady || ConfigADC(ADC_SOFTWARE_START, 1) == 0))
+    {
+        if (captureStats.running)
+        {
+            // The pin is captured, take the latest complete scan
+            for (int i = 0; i < capturePinCount; i++)
+            {
+                if (capturePins[i] == pin)
+                {
+                    int total = 2 * captureFrames;
+                    int position = (total * capturePinCount - CAPTURE_DMA_STREAM->NDTR) / capturePinCount;
+                    if (position > 0 || captureStats.frames > 0)
+                    {
+                        int scan = (position + total - 1) % total;
+                        value = captureBuffer[scan * capturePinCount + i];
+                    }
+                    break;
+                }
+            }
+        }
+        if (value < 0)
+        {
+            value = ConvertInjected(channel);
+        }
+    }
+    adcMutex.unlock();
+
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Capture
+static void OnHalfFilled(const uint16_t *samples)
+{
+    uint32_t now = us_ticker_read();
+
+    if (captureStats.frames > 0)
+    {
+        uint32_t nominal = (uint32_t)((uint64_t)captureFrames * 1000000 / captureStats.nominal_rate);
+        uint32_t period = now - captureLastUs;
+        uint32_t jitter = (period > nominal ? period - nominal : nominal - period);
+        if (jitter > captureStats.max_jitter_us)
+        {
+            captureStats.max_jitter_us = jitter;
+        }
+    }
+    captureLastUs = now;
+    captureStats.frames += captureFrames;
+
+    if (captureCallback != NULL)
+    {
+        captureCallback(samples, captureFrames * capturePinCount, captureContext);
+        // The DMA keeps writing, the callback must finish within one half
+        uint32_t half = (uint32_t)((uint64_t)captureFrames * 1000000 / captureStats.nominal_rate);
+        if (us_ticker_read() - now > half)
+        {
+            captureStats.overruns++;
+        }
+    }
+}
+
+static void DMAHalfCplt(DMA_HandleTypeDef *hdma)
+{
+    OnHalfFilled(captureBuffer);
+}
+
+static void DMACplt(DMA_HandleTypeDef *hdma)
+{
+    OnHalfFilled(captureBuffer + captureFrames * capturePinCount);
+}
+
+static void DMAIrqHandler(void)
+{
+    HAL_DMA_IRQHandler(&dmaHandle);
+}
+
+static uint32_t GetTimerClock(void)
+{
+    // APB2 timers run at twice PCLK2 when the bus is divided
+    uint32_t clock = HAL_RCC_GetPCLK2Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE2_2) != 0)
+    {
+        clock *= 2;
+    }
+    return clock;
+}
+
+static void StopCapture(void)
+{
+    TIM8->CR1 &= ~TIM_CR1_CEN;
+    NVIC_DisableIRQ(CAPTURE_DMA_IRQ);
+    ADC1->CR2 &= ~(ADC_CR2_DMA | ADC_CR2_DDS);
+    HAL_DMA_Abort(&dmaHandle);
+    captureStats.running = 0;
+
+    // Back to the single conversions
+    ConfigADC(ADC_SOFTWARE_START, 1);
+}
+
+int analogCaptureStart(const uint32_t *pins, int pinCount, uint32_t sampleRate, uint16_t *buffer, int frames, ANALOG_CAPTURE_CALLBACK callback, void *context)
+{
+    if (pins == NULL || pinCount <= 0 || pinCount > ANALOG_CAPTURE_MAX_CHANNELS
+        || sampleRate == 0 || sampleRate > ANALOG_CAPTURE_MAX_RATE
+        || buffer == NULL || frames <= 0 || 2 * frames * pinCount > 0xFFFF)
+    {
+        return -1;
+    }
+
+    adcMutex.lock();
+    if (captureStats.running)
+    {
+        StopCapture();
+    }
+
+    // TIM8 may have been taken by a PWM output
+    __HAL_RCC_TIM8_CLK_ENABLE();
+    if ((TIM8->CR1 & TIM_CR1_CEN) != 0)
+    {
+        adcMutex.unlock();
+        return -1;
+    }
+
+    int channels[ANALOG_CAPTURE_MAX_CHANNELS];
+    for (int i = 0; i < pinCount; i++)
+    {
+        channels[i] = GetChannel(pins[i]);
+        if (channels[i] < 0)
+        {
+            adcMutex.unlock();
+            return -1;
+        }
+        capturePins[i] = pins[i];
+    }
+    capturePinCount = pinCount;
+    captureBuffer = buffer;
+    captureFrames = frames;
+    captureCallback = callback;
+    captureContext = context;
+
+    // Trigger timer, prescaled to keep the period within 16 bits
+    uint32_t clock = GetTimerClock();
+    uint32_t ticks = clock / sampleRate;
+    uint32_t prescaler = ticks / 0x10000 + 1;
+    uint32_t period = (ticks + prescaler / 2) / prescaler;
+
+    memset((void *)&captureStats, 0, sizeof(captureStats));
+    captureStats.requested_rate = sampleRate;
+    captureStats.nominal_rate = clock / (prescaler * period);
+
+    // DMA, circular over both halves
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    dmaHandle.Instance = CAPTURE_DMA_STREAM;
+    dmaHandle.Init.Channel = DMA_CHANNEL_0;
+    dmaHandle.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    dmaHandle.Init.PeriphInc = DMA_PINC_DISABLE;
+    dmaHandle.Init.MemInc = DMA_MINC_ENABLE;
+    dmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    dmaHandle.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    dmaHandle.Init.Mode = DMA_CIRCULAR;
+    dmaHandle.Init.Priority = DMA_PRIORITY_HIGH;
+    dmaHandle.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&dmaHandle) != HAL_OK)
+    {
+        adcMutex.unlock();
+        return -1;
+    }
+    dmaHandle.XferHalfCpltCallback = DMAHalfCplt;
+    dmaHandle.XferCpltCallback = DMACplt;
+    NVIC_SetVector(CAPTURE_DMA_IRQ, (uint32_t)DMAIrqHandler);
+    NVIC_EnableIRQ(CAPTURE_DMA_IRQ);
+
+    // ADC, one regular scan of all the pins per trigger
+    if (ConfigADC(ADC_EXTERNALTRIGCONV_T8_TRGO, pinCount) != 0)
+    {
+        NVIC_DisableIRQ(CAPTURE_DMA_IRQ);
+        adcMutex.unlock();
+        return -1;
+    }
+    for (int i = 0; i < pinCount; i++)
+    {
+        ADC_ChannelConfTypeDef config = { 0 };
+        config.Channel = channels[i];
+        config.Rank = i + 1;
+        config.SamplingTime = CAPTURE_SAMPLE_TIME;
+        HAL_ADC_ConfigChannel(&adcHandle, &config);
+    }
+    HAL_DMA_Start_IT(&dmaHandle, (uint32_t)&ADC1->DR, (uint32_t)buffer, 2 * frames * pinCount);
+    ADC1->SR = ~(ADC_SR_OVR | ADC_SR_EOC | ADC_SR_STRT);
+    ADC1->CR2 |= ADC_CR2_DMA | ADC_CR2_DDS;
+
+    TIM8->CR1 = 0;
+    TIM8->PSC = prescaler - 1;
+    TIM8->ARR = period - 1;
+    TIM8->EGR = TIM_EGR_UG;
+    // Update event as TRGO
+    TIM8->CR2 = (TIM8->CR2 & ~TIM_CR2_MMS) | TIM_CR2_MMS_1;
+
+    captureStartUs = us_ticker_read();
+    captureLastUs = captureStartUs;
+    captureStats.running = 1;
+    TIM8->CR1 = TIM_CR1_CEN;
+    adcMutex.unlock();
+
+    return 0;
+}
+
+void analogCaptureStop(void)
+{
+    adcMutex.lock();
+    if (captureStats.running)
+    {
+        StopCapture();
+    }
+    adcMutex.unlock();
+}
+
+void analogCaptureStats(ANALOG_CAPTURE_STATS *stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    __disable_irq();
+    memcpy(stats, (const void *)&captureStats, sizeof(ANALOG_CAPTURE_STATS));
+    uint32_t elapsed = captureLastUs - captureStartUs;
+    __enable_irq();
+
+    if (elapsed > 0)
+    {
+        stats->achieved_rate = (uint32_t)((uint64_t)stats->frames * 1000000 / elapsed);
+    }
+}
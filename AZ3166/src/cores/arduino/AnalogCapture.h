@@ -0,0 +1,85 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __ANALOG_CAPTURE_H__
+#define __ANALOG_CAPTURE_H__
+
+#include <stdint.h>
+
+#define ANALOG_CAPTURE_MAX_CHANNELS     8
+#define ANALOG_CAPTURE_MAX_RATE         200000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief    Called every time one half of the double buffer is filled.
+**
+* @param    samples           Raw 12-bit samples of the filled half, one scan after another, each
+*                             scan holds one sample per pin in the order given to analogCaptureStart.
+* @param    count             Number of the samples, frames * pin count.
+* @param    context           The context given to analogCaptureStart.
+*
+* @remarks  Called in the interrupt context, the other half is being filled meanwhile.
+*/
+typedef void (*ANALOG_CAPTURE_CALLBACK)(const uint16_t *samples, int count, void *context);
+
+typedef struct
+{
+    int running;
+    uint32_t requested_rate;    // Scans per second asked for
+    uint32_t nominal_rate;      // Scans per second the trigger timer was set to
+    uint32_t achieved_rate;     // Scans per second measured between the buffer interrupts
+    uint32_t frames;            // Scans delivered to the callback
+    uint32_t overruns;          // Halves refilled before the callback returned
+    uint32_t max_jitter_us;     // Worst deviation of the buffer interrupt period from the nominal one
+} ANALOG_CAPTURE_STATS;
+
+/**
+* @brief    Start the continuous acquisition of one or more analog pins.
+**
+* @param    pins              The analog pins, scanned in this order at every trigger.
+* @param    pinCount          Number of the pins, up to ANALOG_CAPTURE_MAX_CHANNELS.
+* @param    sampleRate        Scans per second, up to ANALOG_CAPTURE_MAX_RATE.
+* @param    buffer            Double buffer of 2 * frames * pinCount samples, filled by DMA.
+* @param    frames            Number of the scans in each half of the buffer.
+* @param    callback          Called when one half is filled.
+* @param    context           Passed to the callback.
+*
+* @return   Return 0 on success. Return -1 on fail.
+*
+* @remarks  The scans are triggered by TIM8. While the acquisition is running analogRead() of
+*           a captured pin returns its latest sample, and other pins are converted in between
+*           the scans. mbed AnalogIn objects must not be used at the same time.
+*/
+int analogCaptureStart(const uint32_t *pins, int pinCount, uint32_t sampleRate, uint16_t *buffer, int frames, ANALOG_CAPTURE_CALLBACK callback, void *context);
+
+/**
+* @brief    Stop the continuous acquisition.
+*/
+void analogCaptureStop(void);
+
+/**
+* @brief    Retrieve the rate and jitter of the acquisition.
+**
+* @param    stats             Buffer to receive the statistics.
+*/
+void analogCaptureStats(ANALOG_CAPTURE_STATS *stats);
+
+/**
+* @brief    Convert one analog pin.
+**
+* @param    pin               The analog pin.
+*
+* @return   Raw 12-bit value. Return -1 if the pin has no ADC channel.
+*
+* @remarks  The ADC and the pin are configured on first use only.
+*/
+int analogReadRaw(uint32_t pin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
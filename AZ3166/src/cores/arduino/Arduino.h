@@ -31,9 +31,11 @@
 #include "mbed_stats.h"
 #include "PinNames.h"
 
+#include "AnalogCapture.h"
 #include "AttachInterrupt.h"
 #include "EEPROMInterface.h"
 #include "floatIO.h" 
+#include "PwmChannel.h"
 #include "Stream.h"	
 #include "SystemFunc.h"
 #include "SystemVersion.h"
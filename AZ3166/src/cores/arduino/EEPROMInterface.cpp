@@ -100,19 +100,25 @@ int EEPROMInterface::enableHostSecureChannel(int level, uint8_t* key)
 }
 
 int EEPROMInterface::write(uint8_t* dataBuff, int buffSize, uint8_t dataZoneIndex)
+{
+    return write(dataBuff, buffSize, 0x00, dataZoneIndex);
+}
+
+int EEPROMInterface::write(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex)
 {
     Init_HAL(STSAFE_I2C_ADDRESS, &handle);
-    if (dataBuff == NULL || checkZoneSize(dataZoneIndex, buffSize, true))
+    int size = buffSize + offset;
+    if (dataBuff == NULL || buffSize <= 0 || checkZoneSize(dataZoneIndex, size, true))
     {
         return -1;
     }
     if (isHostSecureChannelEnabled())
     {
-        return writeWithEnvelope(dataBuff, buffSize, dataZoneIndex);
+        return writeWithEnvelope(dataBuff, buffSize, offset, dataZoneIndex);
     }
     else
     {
-        return writeWithoutEnvelope(dataBuff, buffSize, dataZoneIndex);
+        return writeWithoutEnvelope(dataBuff, buffSize, offset, dataZoneIndex);
     }
 }
 
@@ -138,9 +144,9 @@ int EEPROMInterface::read(uint8_t* dataBuff, int buffSize, uint16_t offset, uint
     }
 }
 
-int EEPROMInterface::writeWithEnvelope(uint8_t* dataBuff, int buffSize, uint8_t dataZoneIndex)
+int EEPROMInterface::writeWithEnvelope(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex)
 {
-    int readSize = min(DATA_SEGMENT_LENGTH[dataZoneIndex], ((buffSize - 1) / MAX_ENCRYPT_DATA_SIZE + 1) * MAX_ENCRYPT_DATA_SIZE);
+    int readSize = min(DATA_SEGMENT_LENGTH[dataZoneIndex], ((offset + buffSize - 1) / MAX_ENCRYPT_DATA_SIZE + 1) * MAX_ENCRYPT_DATA_SIZE);
     uint8_t* buf = (uint8_t*)malloc(MAX_BUFFER_SIZE);
     int readResult = readWithEnvelope(buf, readSize, 0, dataZoneIndex);
     if (readResult != readSize)
@@ -148,7 +154,7 @@ int EEPROMInterface::writeWithEnvelope(uint8_t* dataBuff, int buffSize, uint8_t
         free(buf);
         return -1;
     }
-    memcpy(buf, dataBuff, buffSize);
+    memcpy(buf + offset, dataBuff, buffSize);
     for (int i = 0; i * MAX_ENCRYPT_DATA_SIZE < readSize; i++)
     {
         int dataSize = min(readSize - i * MAX_ENCRYPT_DATA_SIZE, MAX_ENCRYPT_DATA_SIZE);
@@ -162,9 +168,9 @@ int EEPROMInterface::writeWithEnvelope(uint8_t* dataBuff, int buffSize, uint8_t
     return 0;
 }
 
-int EEPROMInterface::writeWithoutEnvelope(uint8_t* dataBuff, int buffSize, uint8_t dataZoneIndex)
+int EEPROMInterface::writeWithoutEnvelope(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex)
 {
-    if (HAL_Store_Data_Zone(handle, dataZoneIndex, buffSize, dataBuff, 0x0))
+    if (HAL_Store_Data_Zone(handle, dataZoneIndex, buffSize, dataBuff, offset))
     {
         return -1;
     }
@@ -36,11 +36,16 @@
 #define WIFI_SSID_ZONE_IDX      STSAFE_ZONE_3_IDX
 #define WIFI_PWD_ZONE_IDX       STSAFE_ZONE_10_IDX
 #define AZ_IOT_HUB_ZONE_IDX     STSAFE_ZONE_5_IDX
+#define WIFI_CACHE_ZONE_IDX     STSAFE_ZONE_2_IDX
+#define DPS_CACHE_ZONE_IDX      STSAFE_ZONE_6_IDX   // After the DPS UDS string
 
 #define WIFI_SSID_MAX_LEN       32
 #define WIFI_PWD_MAX_LEN        64
 #define AZ_IOT_HUB_MAX_LEN      512
 #define DPS_UDS_MAX_LEN         64
+#define WIFI_CACHE_MAX_LEN      STSAFE_ZONE_2_SIZE
+#define DPS_CACHE_OFFSET        128
+#define DPS_CACHE_MAX_LEN       (STSAFE_ZONE_6_SIZE - DPS_CACHE_OFFSET)
 #define EEPROM_DEFAULT_LEN      200
 #define AZ_IOT_X509_MAX_LEN 	(STSAFE_ZONE_0_SIZE + STSAFE_ZONE_7_SIZE + STSAFE_ZONE_8_SIZE - 1)	// Zone 0, 7, 8
 
@@ -60,13 +65,20 @@ public:
     * @param    dataBuff            The data to be written secure chip.
     * @param    buffSize            The size of written data. The valid range of different data zone is different.
     * @param    dataZoneIndex       The index of zone written data to. The valid input is {0, 2, 3, 5, 6, 7, 8, 10}.
-    *                               {3, 5, 10} are used for wifi and iot hub connection string. {0, 2, 6} are reserved for later mini solutions.
+    *                               {3, 5, 10} are used for wifi and iot hub connection string, {2} caches the last Wi-Fi connection. {0, 6} are reserved for later mini solutions.
     *                               So we recommend user to use {7, 8}
     *
     * @return   Return 0 on success, otherwise return -1. The failure might be caused by input dataSize bigger than data zone could write.
     */
     int write(uint8_t* dataBuff, int buffSize, uint8_t dataZoneIndex);
 
+    /**
+    * @brief    Write data to secure chip at an offset in the zone, the data before and after it is kept.
+    *
+    * @return   Return 0 on success, otherwise return -1. The failure might be caused by the data going past the end of the data zone.
+    */
+    int write(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex);
+
     /**
     * @brief    Read data from secure chip.
     *
@@ -74,7 +86,7 @@ public:
     * @param    buffSize            The size of data need to be read.
     * @param    offset              The offset of data in data zone to start read data from.
     * @param    dataZoneIndex       The index of zone to read data from. The valid input is {0, 2, 3, 5, 6, 7, 8, 10}.
-    *                               {3, 5, 10} are used for wifi and iot hub connection string. {0, 2, 6} are reserved for later mini solutions.
+    *                               {3, 5, 10} are used for wifi and iot hub connection string, {2} caches the last Wi-Fi connection. {0, 6} are reserved for later mini solutions.
     *                               So we recommend user to use {7, 8}
     *
     * @return   Return read buffer size on success, otherwise return -1.
@@ -164,8 +176,8 @@ private:
     bool PCROPCheck(int sector);
     bool checkZoneSize(int dataZoneIndex, int &size, bool write);
     bool isHostSecureChannelEnabled();
-    int writeWithEnvelope(uint8_t* dataBuff, int buffSize, uint8_t dataZoneIndex);
-    int writeWithoutEnvelope(uint8_t* dataBuff, int buffSize, uint8_t dataZoneIndex);
+    int writeWithEnvelope(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex);
+    int writeWithoutEnvelope(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex);
     int readWithEnvelope(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex);
     int readWithoutEnvelope(uint8_t* dataBuff, int buffSize, uint16_t offset, uint8_t dataZoneIndex);
 
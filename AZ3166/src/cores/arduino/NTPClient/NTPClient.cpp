@@ -23,6 +23,7 @@
 
 #include "mbed.h" //time() and set_time()
 #include "def.h"
+#include "SystemTickCounter.h"
 
 #define NTP_PORT 123
 #define NTP_CLIENT_PORT 0 //Random port
@@ -133,3 +134,149 @@ NTPResult NTPClient::setTime(const char* host, uint16_t port, uint32_t timeout)
     return NTP_OK;
 }
 
+//NTP timestamp to UTC ms since Epoch, keeping the sub-second part from the fraction
+static int64_t ntpToMs(uint32_t s, uint32_t f)
+{
+    return ((int64_t)s - (int64_t)NTP_TIMESTAMP_DELTA) * 1000 + (int64_t)(((uint64_t)f * 1000) >> 32);
+}
+
+//NTP short format (16.16 fixed point seconds) to ms
+static uint32_t ntpShortToMs(uint32_t v)
+{
+    return (uint32_t)(((uint64_t)v * 1000) >> 16);
+}
+
+NTPResult NTPClient::query(const char* const* hosts, int count, int64_t *offset_ms, uint32_t *distance_ms, uint32_t timeout)
+{
+    if (hosts == NULL || count <= 0 || offset_ms == NULL)
+    {
+        return NTP_DNS;
+    }
+    if (count > NTP_MAX_SERVERS)
+    {
+        count = NTP_MAX_SERVERS;
+    }
+
+    SocketAddress servers[NTP_MAX_SERVERS];
+    uint64_t sentMs[NTP_MAX_SERVERS];
+    uint32_t nonce[NTP_MAX_SERVERS];
+    bool answered[NTP_MAX_SERVERS];
+    int pending = 0;
+    NTPResult result = NTP_DNS;
+
+    struct NTPPacket pkt;
+    uint32_t seed = (uint32_t)rand();
+
+    //Send one request to each server, the transmit fraction identifies the request in the echoed origin timestamp
+    for (int i = 0; i < count; i++)
+    {
+        answered[i] = true;
+        if (hosts[i] == NULL || hosts[i][0] == 0 || m_net->gethostbyname(hosts[i], &servers[i]) != 0)
+        {
+            continue;
+        }
+        servers[i].set_port(NTP_DEFAULT_PORT);
+
+        memset(&pkt, 0, sizeof(pkt));
+        pkt.vn = 4; //Version Number : 4
+        pkt.mode = 3; //Client mode
+        nonce[i] = (seed + i * 0x9E3779B9) | 1;
+        pkt.txTm_s = htonl( NTP_TIMESTAMP_DELTA + time(NULL) );
+        pkt.txTm_f = htonl( nonce[i] );
+
+        sentMs[i] = SystemTickCounterRead();
+        if (m_sock.sendto(servers[i], (char*)&pkt, sizeof(NTPPacket)) < 0)
+        {
+            result = NTP_CONN;
+            continue;
+        }
+        answered[i] = false;
+        pending++;
+    }
+
+    if (pending == 0)
+    {
+        m_sock.close();
+        return result;
+    }
+
+    result = NTP_TIMEOUT;
+    uint32_t bestDistance = 0xFFFFFFFF;
+    uint64_t startMs = SystemTickCounterRead();
+
+    while (pending > 0)
+    {
+        int elapsed = (int)(SystemTickCounterRead() - startMs);
+        if (elapsed >= (int)timeout)
+        {
+            break;
+        }
+        m_sock.set_timeout(timeout - elapsed);
+
+        SocketAddress from;
+        int ret = m_sock.recvfrom(&from, (char*)&pkt, sizeof(NTPPacket));
+        uint64_t recvMs = SystemTickCounterRead();
+        if (ret < (int)sizeof(NTPPacket))
+        {
+            if (ret < 0 && ret != NSAPI_ERROR_WOULD_BLOCK)
+            {
+                result = NTP_CONN;
+                break;
+            }
+            continue;
+        }
+
+        //Match the response with the request
+        int i = 0;
+        for (; i < count; i++)
+        {
+            if (!answered[i] && ntohl(pkt.origTm_f) == nonce[i] && strcmp(from.get_ip_address(), servers[i].get_ip_address()) == 0)
+            {
+                break;
+            }
+        }
+        if (i == count)
+        {
+            continue;
+        }
+        answered[i] = true;
+        pending--;
+
+        //Kiss of death, unsynchronized server or not a server reply
+        if (pkt.stratum == 0 || pkt.li == 3 || (pkt.mode != 4 && pkt.mode != 5))
+        {
+            if (result == NTP_TIMEOUT)
+            {
+                result = NTP_PRTCL;
+            }
+            continue;
+        }
+
+        //T1, T4 are on the local monotonic clock; T2, T3 are UTC on the server, see RFC 4330 p.13
+        int64_t t1 = (int64_t)sentMs[i];
+        int64_t t2 = ntpToMs(ntohl(pkt.rxTm_s), ntohl(pkt.rxTm_f));
+        int64_t t3 = ntpToMs(ntohl(pkt.txTm_s), ntohl(pkt.txTm_f));
+        int64_t t4 = (int64_t)recvMs;
+
+        int64_t delay = (t4 - t1) - (t3 - t2);
+        if (delay < 0)
+        {
+            delay = 0;
+        }
+        uint32_t distance = (uint32_t)(delay / 2) + ntpShortToMs(ntohl(pkt.rootDelay)) / 2 + ntpShortToMs(ntohl(pkt.rootDispersion));
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            *offset_ms = ((t2 - t1) + (t3 - t4)) / 2;
+            result = NTP_OK;
+        }
+    }
+
+    m_sock.close();
+
+    if (result == NTP_OK && distance_ms != NULL)
+    {
+        *distance_ms = bestDistance;
+    }
+    return result;
+}
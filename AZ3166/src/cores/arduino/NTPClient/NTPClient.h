@@ -29,6 +29,7 @@ NTP Client header file
 
 #define NTP_DEFAULT_PORT 123
 #define NTP_DEFAULT_TIMEOUT 1000
+#define NTP_MAX_SERVERS 8
 
 ///NTP client results
 enum NTPResult
@@ -61,6 +62,18 @@ public:
     */
     NTPResult setTime(const char* host, uint16_t port = NTP_DEFAULT_PORT, uint32_t timeout = NTP_DEFAULT_TIMEOUT); //Blocking
 
+    /**Query several servers in parallel (blocking)
+    Sends one request to every server over the same socket, then keeps the sample with the
+    lowest synchronization distance (half of the round trip delay plus the root delay and dispersion of the server)
+    @param hosts NTP server IPv4 addresses or hostnames (will be resolved via DNS)
+    @param count number of servers, up to NTP_MAX_SERVERS
+    @param offset_ms returns the offset in ms from the local monotonic clock (SystemTickCounterRead) to UTC ms since Epoch
+    @param distance_ms returns the synchronization distance of the selected sample in ms
+    @param timeout waiting timeout in ms for all the responses
+    @return 0 on success, NTP error code (<0) on failure
+    */
+    NTPResult query(const char* const* hosts, int count, int64_t *offset_ms, uint32_t *distance_ms = NULL, uint32_t timeout = NTP_DEFAULT_TIMEOUT); //Blocking
+
 private:
     struct NTPPacket //See RFC 4330 for Simple NTP
     {
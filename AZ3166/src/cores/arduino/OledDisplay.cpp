@@ -6,8 +6,27 @@
 #include "oled.h"
 #include "OledDisplay.h"
 
+// Column of the controller RAM shown at x = 0, as OLED_ShowString addresses it
+#define OLED_COLUMN_OFFSET  1
+
+// The 8x16 font of the OLED driver
+extern "C" const unsigned char F8X16[];
+const OLED_FONT OLED_FONT_8X16 = { F8X16, 8, 16, ' ', '~' };
+
+// One flush on the bus at a time, and the framebuffer is not changed while a page is copied out
+static Mutex bufferMutex;
+static Mutex busMutex;
+static Thread *flushThread = NULL;
+static Semaphore flushRequest(0);
+static volatile bool flushQueued = false;
+static volatile bool flushRunning = false;
+
 OLEDDisplay::OLEDDisplay()
 {
+    memset(_buffer, 0, sizeof(_buffer));
+    memset(_dirtyStart, OLED_WIDTH - 1, sizeof(_dirtyStart));
+    memset(_dirtyEnd, 0, sizeof(_dirtyEnd));
+    memset(&_stats, 0, sizeof(_stats));
 }
 
 OLEDDisplay::~OLEDDisplay()
@@ -16,13 +35,23 @@ OLEDDisplay::~OLEDDisplay()
 
 void OLEDDisplay::init()
 {
+    busMutex.lock();
     OLED_Init();
     OLED_Clear();
+    busMutex.unlock();
+
+    // The screen is blank, so is the framebuffer
+    bufferMutex.lock();
+    memset(_buffer, 0, sizeof(_buffer));
+    memset(_dirtyStart, OLED_WIDTH - 1, sizeof(_dirtyStart));
+    memset(_dirtyEnd, 0, sizeof(_dirtyEnd));
+    bufferMutex.unlock();
 }
 
 void OLEDDisplay::clean()
 {
-    OLED_Clear();
+    clear();
+    flush();
 }
 
 int OLEDDisplay::print(const char *s, bool wrap)
@@ -67,13 +96,30 @@ int OLEDDisplay::print(unsigned int line, const char *s, bool wrap)
             offset++;
         }
     }
-    
+
+    // Only the characters that changed go to the screen
+    flush();
     return ln;
 }
 
 void OLEDDisplay::draw(unsigned char x0, unsigned char y0, unsigned char x1, unsigned char y1, unsigned char BMP[])
 {
-    OLED_DrawBMP(x0, y0, x1, y1, BMP);
+    if (BMP == NULL || x1 > OLED_WIDTH || y1 > OLED_PAGES || x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    int j = 0;
+    bufferMutex.lock();
+    for (int page = y0; page < y1; page++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            setByte(page, x, BMP[j++]);
+        }
+    }
+    bufferMutex.unlock();
+    flush();
 }
 
 int OLEDDisplay::println(unsigned int line, const char *s, int len, bool wrap)
@@ -111,8 +157,8 @@ int OLEDDisplay::println(unsigned int line, const char *s, int len, bool wrap)
             oled_show_line[i] = ' ';
         }
         oled_show_line[i] = 0;
-        OLED_ShowString(OLED_DISPLAY_COLUMN_START, lineNumber[line ++], oled_show_line);
-        
+        drawText(OLED_DISPLAY_COLUMN_START, lineNumber[line ++] * 8, oled_show_line);
+
         if (wrap && left > OLED_DISPLAY_MAX_CHAR_PER_ROW)
         {
             start += OLED_DISPLAY_MAX_CHAR_PER_ROW;
@@ -126,3 +172,329 @@ int OLEDDisplay::println(unsigned int line, const char *s, int len, bool wrap)
     
     return line;
 }
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Framebuffer
+void OLEDDisplay::markDirty(int page, int x0, int x1)
+{
+    if (x0 < _dirtyStart[page])
+    {
+        _dirtyStart[page] = x0;
+    }
+    if (x1 > _dirtyEnd[page])
+    {
+        _dirtyEnd[page] = x1;
+    }
+}
+
+void OLEDDisplay::setByte(int page, int x, unsigned char value)
+{
+    if (_buffer[page][x] != value)
+    {
+        _buffer[page][x] = value;
+        markDirty(page, x, x);
+    }
+}
+
+void OLEDDisplay::clear()
+{
+    bufferMutex.lock();
+    for (int page = 0; page < OLED_PAGES; page++)
+    {
+        for (int x = 0; x < OLED_WIDTH; x++)
+        {
+            setByte(page, x, 0);
+        }
+    }
+    bufferMutex.unlock();
+}
+
+void OLEDDisplay::setPixel(int x, int y, bool on)
+{
+    if (x < 0 || x >= OLED_WIDTH || y < 0 || y >= OLED_HEIGHT)
+    {
+        return;
+    }
+
+    bufferMutex.lock();
+    unsigned char value = _buffer[y >> 3][x];
+    setByte(y >> 3, x, on ? (value | (1 << (y & 7))) : (value & ~(1 << (y & 7))));
+    bufferMutex.unlock();
+}
+
+bool OLEDDisplay::getPixel(int x, int y)
+{
+    if (x < 0 || x >= OLED_WIDTH || y < 0 || y >= OLED_HEIGHT)
+    {
+        return false;
+    }
+    return (_buffer[y >> 3][x] & (1 << (y & 7))) != 0;
+}
+
+void OLEDDisplay::drawLine(int x0, int y0, int x1, int y1, bool on)
+{
+    // Bresenham
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int sx = (x0 < x1 ? 1 : -1);
+    int sy = (y0 < y1 ? 1 : -1);
+    int err = dx + dy;
+
+    bufferMutex.lock();
+    while (true)
+    {
+        setPixel(x0, y0, on);
+        if (x0 == x1 && y0 == y1)
+        {
+            break;
+        }
+        int e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y0 += sy;
+        }
+    }
+    bufferMutex.unlock();
+}
+
+void OLEDDisplay::drawRect(int x, int y, int w, int h, bool on)
+{
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    bufferMutex.lock();
+    drawLine(x, y, x + w - 1, y, on);
+    drawLine(x, y + h - 1, x + w - 1, y + h - 1, on);
+    drawLine(x, y, x, y + h - 1, on);
+    drawLine(x + w - 1, y, x + w - 1, y + h - 1, on);
+    bufferMutex.unlock();
+}
+
+void OLEDDisplay::fillRect(int x, int y, int w, int h, bool on)
+{
+    int x0 = max(x, 0);
+    int x1 = min(x + w, OLED_WIDTH);
+    int y0 = max(y, 0);
+    int y1 = min(y + h, OLED_HEIGHT);
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    // A whole byte per column and page
+    bufferMutex.lock();
+    for (int page = y0 >> 3; page <= (y1 - 1) >> 3; page++)
+    {
+        int top = max(y0 - page * 8, 0);
+        int bottom = min(y1 - page * 8, 8);
+        unsigned char mask = (unsigned char)(((1 << bottom) - 1) & ~((1 << top) - 1));
+        for (int i = x0; i < x1; i++)
+        {
+            unsigned char value = _buffer[page][i];
+            setByte(page, i, on ? (value | mask) : (value & ~mask));
+        }
+    }
+    bufferMutex.unlock();
+}
+
+void OLEDDisplay::drawBitmap(int x, int y, int w, int h, const unsigned char *bitmap, bool on)
+{
+    if (bitmap == NULL || w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    int pages = (h + 7) / 8;
+    bufferMutex.lock();
+    if ((y & 7) == 0 && (h & 7) == 0 && on)
+    {
+        // Page aligned, copy the bytes
+        for (int p = 0; p < pages; p++)
+        {
+            int page = (y >> 3) + p;
+            if (page < 0 || page >= OLED_PAGES)
+            {
+                continue;
+            }
+            for (int i = 0; i < w; i++)
+            {
+                if (x + i >= 0 && x + i < OLED_WIDTH)
+                {
+                    setByte(page, x + i, bitmap[p * w + i]);
+                }
+            }
+        }
+    }
+    else
+    {
+        for (int row = 0; row < h; row++)
+        {
+            for (int i = 0; i < w; i++)
+            {
+                bool bit = (bitmap[(row >> 3) * w + i] & (1 << (row & 7))) != 0;
+                setPixel(x + i, y + row, on ? bit : !bit);
+            }
+        }
+    }
+    bufferMutex.unlock();
+}
+
+int OLEDDisplay::drawText(int x, int y, const char *s, const OLED_FONT *font, bool on)
+{
+    if (s == NULL || font == NULL)
+    {
+        return x;
+    }
+
+    int size = font->width * ((font->height + 7) / 8);
+    int space = (' ' >= font->first && ' ' <= font->last ? ' ' : font->first);
+    bufferMutex.lock();
+    for (; *s != '\0'; s++)
+    {
+        int c = (*s >= font->first && *s <= font->last ? *s : space);
+        drawBitmap(x, y, font->width, font->height, font->glyphs + (c - font->first) * size, on);
+        x += font->width;
+    }
+    bufferMutex.unlock();
+    return x;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Flush
+int OLEDDisplay::flushPages()
+{
+    unsigned char data[OLED_WIDTH];
+    int bytes = 0;
+    uint32_t start = us_ticker_read();
+
+    busMutex.lock();
+    for (int page = 0; page < OLED_PAGES; page++)
+    {
+        bufferMutex.lock();
+        int x0 = _dirtyStart[page];
+        int x1 = _dirtyEnd[page];
+        if (x0 > x1)
+        {
+            bufferMutex.unlock();
+            continue;
+        }
+        memcpy(data, &_buffer[page][x0], x1 - x0 + 1);
+        _dirtyStart[page] = OLED_WIDTH - 1;
+        _dirtyEnd[page] = 0;
+        bufferMutex.unlock();
+
+        int column = x0 + OLED_COLUMN_OFFSET;
+        unsigned char position[3] = { (unsigned char)(0xB0 + page), (unsigned char)(0x10 | (column >> 4)), (unsigned char)(column & 0x0F) };
+        OLED_WR_Bytes(position, sizeof(position), OLED_CMD);
+        OLED_WR_Bytes(data, x1 - x0 + 1, OLED_DATA);
+        // Control byte and payload of both writes
+        bytes += 1 + sizeof(position) + 1 + (x1 - x0 + 1);
+    }
+    busMutex.unlock();
+
+    if (bytes > 0)
+    {
+        uint32_t elapsed = us_ticker_read() - start;
+        _stats.frames++;
+        _stats.bytes += bytes;
+        _stats.last_bytes = bytes;
+        _stats.last_us = elapsed;
+        if (elapsed > _stats.max_us)
+        {
+            _stats.max_us = elapsed;
+        }
+    }
+    return bytes;
+}
+
+void OLEDDisplay::flushWorker(OLEDDisplay *display)
+{
+    while (true)
+    {
+        flushRequest.wait();
+        flushRunning = true;
+        flushQueued = false;
+        display->flushPages();
+        flushRunning = false;
+    }
+}
+
+int OLEDDisplay::flush(bool async)
+{
+    if (!async)
+    {
+        return flushPages();
+    }
+
+    if (flushThread == NULL)
+    {
+        flushThread = new Thread(osPriorityBelowNormal, 0x400);
+        if (flushThread == NULL)
+        {
+            return flushPages();
+        }
+        flushThread->start(callback(flushWorker, this));
+    }
+    // Requests made while a flush is queued are covered by it, not the ones made while it is running
+    if (!flushQueued)
+    {
+        flushQueued = true;
+        flushRequest.release();
+    }
+    return 0;
+}
+
+void OLEDDisplay::waitFlush()
+{
+    while (flushQueued || flushRunning)
+    {
+        wait_ms(1);
+    }
+}
+
+void OLEDDisplay::getStats(OLED_STATS *stats, bool reset)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    busMutex.lock();
+    memcpy(stats, &_stats, sizeof(OLED_STATS));
+    if (reset)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+    busMutex.unlock();
+}
+
+void OLEDDisplay::dumpPBM(Print &out)
+{
+    out.print("P1\n");
+    out.print(OLED_WIDTH);
+    out.print(" ");
+    out.print(OLED_HEIGHT);
+    out.print("\n");
+
+    char row[OLED_WIDTH + 2];
+    for (int y = 0; y < OLED_HEIGHT; y++)
+    {
+        bufferMutex.lock();
+        for (int x = 0; x < OLED_WIDTH; x++)
+        {
+            row[x] = (getPixel(x, y) ? '1' : '0');
+        }
+        bufferMutex.unlock();
+        row[OLED_WIDTH] = '\n';
+        row[OLED_WIDTH + 1] = 0;
+        out.print(row);
+    }
+}
@@ -4,17 +4,50 @@
 #ifndef __OLED_DISPLAY_H__
 #define __OLED_DISPLAY_H__
 
+#include <stdint.h>
+
+#define OLED_WIDTH      128
+#define OLED_HEIGHT     64
+#define OLED_PAGES      (OLED_HEIGHT / 8)
+
+/**
+* Glyphs are stored like the BMP images of draw(): for every 8 rows of the glyph, one byte per
+* column with the top pixel in bit 0.
+*/
+typedef struct
+{
+    const unsigned char *glyphs;
+    uint8_t width;
+    uint8_t height;                 // Multiple of 8
+    char first;
+    char last;
+} OLED_FONT;
+
+typedef struct
+{
+    uint32_t frames;                // Flushes that sent something
+    uint32_t bytes;                 // Bytes sent over the bus, commands included
+    uint32_t last_bytes;            // Bytes sent by the last flush
+    uint32_t last_us;               // Duration of the last flush
+    uint32_t max_us;                // Longest flush
+} OLED_STATS;
+
 #ifdef __cplusplus
 
+class Print;
+
+// The 8x16 font of print()
+extern const OLED_FONT OLED_FONT_8X16;
+
 class OLEDDisplay
 {
 public:
     OLEDDisplay();
     ~OLEDDisplay();
-    
+
     void init();
     void clean();
-    
+
     virtual int print(const char *s, bool wrap = false);
     virtual int print(unsigned int line, const char *s, bool wrap = false);
 
@@ -31,13 +64,64 @@ public:
     *            valid value is [1, 8]
     * @param BMP: BMP image pixel byte array. Every array element is an 8-bit binary data that
     *             draws 8-connected pixels in the same column
-    * 
+    *
     * @return none
     */
     virtual void draw(unsigned char x0, unsigned char y0, unsigned char x1, unsigned char y1, unsigned char BMP[]);
-        
+
+    /**
+    * The functions below draw into the framebuffer only, flush() sends what changed to the screen.
+    * print(), draw() and clean() draw into the framebuffer as well and flush it right away.
+    */
+    void clear();
+    void setPixel(int x, int y, bool on = true);
+    bool getPixel(int x, int y);
+    void drawLine(int x0, int y0, int x1, int y1, bool on = true);
+    void drawRect(int x, int y, int w, int h, bool on = true);
+    void fillRect(int x, int y, int w, int h, bool on = true);
+
+    /**
+    * @brief draw a bitmap in the format of the BMP images of draw() at any pixel position
+    *
+    * @param h: Height of the bitmap, rounded up to a multiple of 8 for the layout of the bytes
+    */
+    void drawBitmap(int x, int y, int w, int h, const unsigned char *bitmap, bool on = true);
+
+    /**
+    * @brief draw a string at any pixel position, the characters out of the font are drawn as spaces
+    *
+    * @return the X position after the last character
+    */
+    int drawText(int x, int y, const char *s, const OLED_FONT *font = &OLED_FONT_8X16, bool on = true);
+
+    /**
+    * @brief send the changed parts of the framebuffer to the screen
+    *
+    * @param async: Send them on the display worker thread and return at once
+    *
+    * @return the bytes sent over the bus, 0 for an asynchronous flush
+    */
+    int flush(bool async = false);
+    void waitFlush();
+    void getStats(OLED_STATS *stats, bool reset = false);
+
+    /**
+    * @brief write the framebuffer as a plain (P1) PBM image, e.g. to the serial port
+    */
+    void dumpPBM(Print &out);
+
 private:
     int println(unsigned int line, const char *s, int len, bool wrap);
+    void setByte(int page, int x, unsigned char value);
+    void markDirty(int page, int x0, int x1);
+    int flushPages();
+    static void flushWorker(OLEDDisplay *display);
+
+    unsigned char _buffer[OLED_PAGES][OLED_WIDTH];
+    // Changed columns of every page, start > end when the page is clean
+    uint8_t _dirtyStart[OLED_PAGES];
+    uint8_t _dirtyEnd[OLED_PAGES];
+    OLED_STATS _stats;
 };
 
 #endif  // __cplusplus
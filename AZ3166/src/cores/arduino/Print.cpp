@@ -224,68 +224,17 @@ size_t Print::println(const Printable& x) {
 
 // Private Methods /////////////////////////////////////////////////////////////
 
-size_t Print::printNumber(unsigned long n, uint8_t base) {
-    char buf[8 * sizeof(long) + 1]; // Assumes 8-bit chars plus zero byte.
-    char *str = &buf[sizeof(buf) - 1];
-
-    *str = '\0';
-
-    // prevent crash if called with base == 1
-    if(base < 2)
-        base = 10;
+// both are formatted by floatIO and written with one call
 
-    do {
-        unsigned long m = n;
-        n /= base;
-        char c = m - base * n;
-        *--str = c < 10 ? c + '0' : c + 'A' - 10;
-    } while(n);
-
-    return write(str);
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+    char buf[FLOAT_IO_INTEGER_SIZE];
+    int len = formatUnsigned(buf, n, base, 1);
+    return write(buf, len);
 }
 
 size_t Print::printFloat(double number, uint8_t digits) {
-    size_t n = 0;
-
-    if(isnan(number))
-        return print("nan");
-    if(isinf(number))
-        return print("inf");
-    if(number > 4294967040.0)
-        return print("ovf");  // constant determined empirically
-    if(number < -4294967040.0)
-        return print("ovf");  // constant determined empirically
-
-    // Handle negative numbers
-    if(number < 0.0) {
-        n += print('-');
-        number = -number;
-    }
-
-    // Round correctly so that print(1.999, 2) prints as "2.00"
-    double rounding = 0.5;
-    for(uint8_t i = 0; i < digits; ++i)
-        rounding /= 10.0;
-
-    number += rounding;
-
-    // Extract the integer part of the number and print it
-    unsigned long int_part = (unsigned long) number;
-    double remainder = number - (double) int_part;
-    n += print(int_part);
-
-    // Print the decimal point, but only if there are digits beyond
-    if(digits > 0) {
-        n += print(".");
-    }
-
-    // Extract digits from the remainder one at a time
-    while(digits-- > 0) {
-        remainder *= 10.0;
-        int toPrint = int(remainder);
-        n += print(toPrint);
-        remainder -= toPrint;
-    }
-
-    return n;
+    // exact digits, and no "ovf" above 2^32 any more
+    char buf[FLOAT_IO_FIXED_SIZE(FLOAT_IO_MAX_DECIMALS)];
+    int len = formatFixed(buf, number, digits);
+    return write(buf, len);
 }
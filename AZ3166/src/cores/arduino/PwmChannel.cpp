@@ -0,0 +1,426 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#include <math.h>
+#include "mbed.h"
+#include "pinmap.h"
+#include "pwmout_api.h"
+#include "PeripheralPins.h"
+#include "PwmChannel.h"
+#include "wiring_digital.h"
+
+typedef struct
+{
+    pwmout_t pwm;
+    uint32_t periodUs;
+} PWM_CHANNEL;
+
+typedef struct
+{
+    TIM_TypeDef *timer;             // Pacing timer, its update event requests the DMA
+    DMA_Stream_TypeDef *stream;
+    uint32_t request;
+    IRQn_Type irq;
+    int apb2;
+} WAVEFORM_TRACK_CONFIG;
+
+typedef struct
+{
+    DMA_HandleTypeDef dma;
+    uint32_t pin;
+    volatile int busy;
+    volatile int remaining;         // Plays left, 0 for forever
+} WAVEFORM_TRACK;
+
+// DMA1 stream 3 and 4 are taken by the audio codec, DMA2 stream 0 by the ADC capture. TIM1 also
+// drives PWM pins, so track 2 is refused while one of them is attached, and the other way around.
+static const WAVEFORM_TRACK_CONFIG trackConfigs[PWM_WAVEFORM_TRACKS] =
+{
+    { TIM6, DMA1_Stream1, DMA_CHANNEL_7, DMA1_Stream1_IRQn, 0 },
+    { TIM7, DMA1_Stream2, DMA_CHANNEL_1, DMA1_Stream2_IRQn, 0 },
+    { TIM1, DMA2_Stream5, DMA_CHANNEL_6, DMA2_Stream5_IRQn, 1 },
+};
+
+static PWM_CHANNEL pwmChannels[PWM_CHANNEL_MAX];
+static int pwmChannelCount = 0;
+// Index + 1 in pwmChannels of every pin
+static uint8_t pwmChannelIndex[DIGITAL_PIN_COUNT];
+static WAVEFORM_TRACK tracks[PWM_WAVEFORM_TRACKS];
+static Mutex pwmMutex;
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Channels
+static PWM_CHANNEL *FindChannel(uint32_t pin)
+{
+    if (pin >= DIGITAL_PIN_COUNT || pwmChannelIndex[pin] == 0)
+    {
+        return NULL;
+    }
+    PWM_CHANNEL *channel = &pwmChannels[pwmChannelIndex[pin] - 1];
+
+    // The pin is given back to the timer after a digital access
+    if (digitalPinModes[pin] != 0)
+    {
+        pinModeReset(pin);
+        pinmap_pinout((PinName)pin, PinMap_PWM);
+    }
+    return channel;
+}
+
+static inline TIM_TypeDef *GetTimer(PWM_CHANNEL *channel)
+{
+    return (TIM_TypeDef *)channel->pwm.pwm;
+}
+
+static inline volatile uint32_t *GetCompare(PWM_CHANNEL *channel)
+{
+    return &GetTimer(channel)->CCR1 + (channel->pwm.channel - 1);
+}
+
+// Whether a PWM channel or a busy waveform track runs on the timer
+static bool TimerTaken(TIM_TypeDef *timer, bool byChannels, bool byTracks)
+{
+    for (int i = 0; byChannels && i < pwmChannelCount; i++)
+    {
+        if (GetTimer(&pwmChannels[i]) == timer)
+        {
+            return true;
+        }
+    }
+    for (int i = 0; byTracks && i < PWM_WAVEFORM_TRACKS; i++)
+    {
+        if (tracks[i].busy && trackConfigs[i].timer == timer)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t ToTicks(PWM_CHANNEL *channel, uint32_t value, uint32_t maxValue)
+{
+    if (maxValue == 0 || value >= maxValue)
+    {
+        return GetTimer(channel)->ARR + 1;
+    }
+    return (uint32_t)((uint64_t)value * (GetTimer(channel)->ARR + 1) / maxValue);
+}
+
+int pwmChannelAttach(uint32_t pin, uint32_t periodUs)
+{
+    if (pin >= DIGITAL_PIN_COUNT || periodUs == 0 || pinmap_find_peripheral((PinName)pin, PinMap_PWM) == (uint32_t)NC)
+    {
+        return -1;
+    }
+
+    pwmMutex.lock();
+    PWM_CHANNEL *channel = FindChannel(pin);
+    if (channel == NULL)
+    {
+        if (pwmChannelCount >= PWM_CHANNEL_MAX)
+        {
+            pwmMutex.unlock();
+            return -1;
+        }
+        // Setting up the channel would reprogram the pacing timer of a playing track
+        if (TimerTaken((TIM_TypeDef *)pinmap_find_peripheral((PinName)pin, PinMap_PWM), false, true))
+        {
+            pwmMutex.unlock();
+            return -1;
+        }
+        channel = &pwmChannels[pwmChannelCount];
+        pinModeReset(pin);
+        pwmout_init(&channel->pwm, (PinName)pin);
+        pwmout_write(&channel->pwm, 0.0f);
+        channel->periodUs = 0;
+        pwmChannelIndex[pin] = ++pwmChannelCount;
+    }
+    if (channel->periodUs != periodUs)
+    {
+        pwmout_period_us(&channel->pwm, periodUs);
+        channel->periodUs = periodUs;
+    }
+    pwmMutex.unlock();
+
+    return 0;
+}
+
+void pwmChannelDetach(uint32_t pin)
+{
+    pwmMutex.lock();
+    PWM_CHANNEL *channel = FindChannel(pin);
+    if (channel != NULL)
+    {
+        for (int i = 0; i < PWM_WAVEFORM_TRACKS; i++)
+        {
+            if (tracks[i].busy && tracks[i].pin == pin)
+            {
+                pwmWaveformStop(i);
+            }
+        }
+        pwmout_free(&channel->pwm);
+
+        // Keep the table packed
+        int index = pwmChannelIndex[pin] - 1;
+        pwmChannelIndex[pin] = 0;
+        pwmChannelCount--;
+        if (index != pwmChannelCount)
+        {
+            pwmChannels[index] = pwmChannels[pwmChannelCount];
+            pwmChannelIndex[pwmChannels[index].pwm.pin] = index + 1;
+        }
+    }
+    pwmMutex.unlock();
+}
+
+int pwmChannelWrite(uint32_t pin, uint32_t value, uint32_t maxValue)
+{
+    // Attach, detach and the tracks move the channels in the table
+    pwmMutex.lock();
+    PWM_CHANNEL *channel = FindChannel(pin);
+    if (channel == NULL)
+    {
+        if (pwmChannelAttach(pin, PWM_CHANNEL_DEFAULT_PERIOD_US) != 0)
+        {
+            pwmMutex.unlock();
+            return -1;
+        }
+        channel = FindChannel(pin);
+    }
+
+    for (int i = 0; i < PWM_WAVEFORM_TRACKS; i++)
+    {
+        if (tracks[i].busy && tracks[i].pin == pin)
+        {
+            pwmWaveformStop(i);
+        }
+    }
+
+    *GetCompare(channel) = ToTicks(channel, value, maxValue);
+    pwmMutex.unlock();
+    return 0;
+}
+
+uint32_t pwmChannelTicks(uint32_t pin, uint32_t value, uint32_t maxValue)
+{
+    pwmMutex.lock();
+    PWM_CHANNEL *channel = FindChannel(pin);
+    uint32_t ticks = (channel == NULL ? 0 : ToTicks(channel, value, maxValue));
+    pwmMutex.unlock();
+    return ticks;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Waveforms
+static void StopTrack(WAVEFORM_TRACK *track, const WAVEFORM_TRACK_CONFIG *config)
+{
+    config->timer->CR1 &= ~TIM_CR1_CEN;
+    config->timer->DIER &= ~TIM_DIER_UDE;
+    track->busy = 0;
+}
+
+static void DMATransferCplt(DMA_HandleTypeDef *hdma)
+{
+    WAVEFORM_TRACK *track = (WAVEFORM_TRACK *)hdma->Parent;
+
+    if (track->remaining > 0 && --track->remaining == 0)
+    {
+        // Played the last time, the pin holds the last value
+        StopTrack(track, &trackConfigs[track - tracks]);
+        HAL_DMA_Abort_IT(hdma);
+    }
+}
+
+static void Track0IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&tracks[0].dma);
+}
+
+static void Track1IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&tracks[1].dma);
+}
+
+static void Track2IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&tracks[2].dma);
+}
+
+static void (* const trackIRQHandlers[PWM_WAVEFORM_TRACKS])(void) =
+{
+    Track0IRQHandler,
+    Track1IRQHandler,
+    Track2IRQHandler,
+};
+
+static uint32_t EnableTimer(int index)
+{
+    uint32_t clock;
+    uint32_t divided;
+
+    if (trackConfigs[index].apb2)
+    {
+        __HAL_RCC_DMA2_CLK_ENABLE();
+        clock = HAL_RCC_GetPCLK2Freq();
+        divided = (RCC->CFGR & RCC_CFGR_PPRE2_2);
+    }
+    else
+    {
+        __HAL_RCC_DMA1_CLK_ENABLE();
+        clock = HAL_RCC_GetPCLK1Freq();
+        divided = (RCC->CFGR & RCC_CFGR_PPRE1_2);
+    }
+
+    switch (index)
+    {
+    case 0:
+        __HAL_RCC_TIM6_CLK_ENABLE();
+        break;
+    case 1:
+        __HAL_RCC_TIM7_CLK_ENABLE();
+        break;
+    default:
+        __HAL_RCC_TIM1_CLK_ENABLE();
+        break;
+    }
+
+    // Timers run at twice the bus clock when the bus is divided
+    return (divided != 0 ? clock * 2 : clock);
+}
+
+int pwmWaveformStart(int track, uint32_t pin, const uint32_t *ticks, int count, uint32_t stepUs, int repeat)
+{
+    if (track < 0 || track >= PWM_WAVEFORM_TRACKS || ticks == NULL || count <= 0 || count > 0xFFFF
+        || stepUs < PWM_WAVEFORM_MIN_STEP_US || repeat < 0)
+    {
+        return -1;
+    }
+    if (FindChannel(pin) == NULL && pwmChannelAttach(pin, PWM_CHANNEL_DEFAULT_PERIOD_US) != 0)
+    {
+        return -1;
+    }
+
+    pwmMutex.lock();
+    PWM_CHANNEL *channel = FindChannel(pin);
+    // DMA1 cannot reach the APB2 timers, so the waveforms are limited to the APB1 ones
+    if ((uint32_t)GetTimer(channel) >= APB2PERIPH_BASE)
+    {
+        pwmMutex.unlock();
+        return -1;
+    }
+    for (int i = 0; i < PWM_WAVEFORM_TRACKS; i++)
+    {
+        if (tracks[i].busy && (i == track || tracks[i].pin == pin))
+        {
+            pwmWaveformStop(i);
+        }
+    }
+
+    const WAVEFORM_TRACK_CONFIG *config = &trackConfigs[track];
+    WAVEFORM_TRACK *t = &tracks[track];
+
+    // The pacing timer must not be running PWM outputs, of PwmChannel or of a PwmOut of its own
+    uint32_t clock = EnableTimer(track);
+    if (TimerTaken(config->timer, true, false) || (config->timer->CR1 & TIM_CR1_CEN) != 0)
+    {
+        pwmMutex.unlock();
+        return -1;
+    }
+
+    // Pacing timer, prescaled to keep the period within 16 bits
+    uint64_t ticksPerStep = (uint64_t)clock * stepUs / 1000000;
+    uint32_t prescaler = (uint32_t)(ticksPerStep / 0x10000) + 1;
+    if (prescaler > 0x10000)
+    {
+        pwmMutex.unlock();
+        return -1;
+    }
+    uint32_t period = (uint32_t)((ticksPerStep + prescaler / 2) / prescaler);
+
+    t->pin = pin;
+    t->remaining = repeat;
+    t->dma.Instance = config->stream;
+    t->dma.Init.Channel = config->request;
+    t->dma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    t->dma.Init.PeriphInc = DMA_PINC_DISABLE;
+    t->dma.Init.MemInc = DMA_MINC_ENABLE;
+    // Word on both sides, TIM2 and TIM5 have 32-bit compare registers
+    t->dma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    t->dma.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    t->dma.Init.Mode = DMA_CIRCULAR;
+    t->dma.Init.Priority = DMA_PRIORITY_LOW;
+    t->dma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    t->dma.Parent = t;
+    if (HAL_DMA_Init(&t->dma) != HAL_OK)
+    {
+        pwmMutex.unlock();
+        return -1;
+    }
+    t->dma.XferCpltCallback = DMATransferCplt;
+    NVIC_SetVector(config->irq, (uint32_t)trackIRQHandlers[track]);
+    NVIC_EnableIRQ(config->irq);
+    HAL_DMA_Start_IT(&t->dma, (uint32_t)ticks, (uint32_t)GetCompare(channel), count);
+
+    config->timer->CR1 = 0;
+    config->timer->PSC = prescaler - 1;
+    config->timer->ARR = period - 1;
+    t->busy = 1;
+    // The update event of UG applies the first value right away
+    config->timer->DIER = TIM_DIER_UDE;
+    config->timer->EGR = TIM_EGR_UG;
+    config->timer->CR1 = TIM_CR1_CEN;
+    pwmMutex.unlock();
+
+    return 0;
+}
+
+void pwmWaveformStop(int track)
+{
+    if (track < 0 || track >= PWM_WAVEFORM_TRACKS)
+    {
+        return;
+    }
+
+    pwmMutex.lock();
+    if (tracks[track].busy)
+    {
+        StopTrack(&tracks[track], &trackConfigs[track]);
+        HAL_DMA_Abort(&tracks[track].dma);
+    }
+    pwmMutex.unlock();
+}
+
+int pwmWaveformBusy(int track)
+{
+    if (track < 0 || track >= PWM_WAVEFORM_TRACKS)
+    {
+        return 0;
+    }
+    return tracks[track].busy;
+}
+
+int pwmWaveformFade(uint32_t pin, uint32_t *ticks, int count, int from, int to)
+{
+    if (ticks == NULL || count <= 0)
+    {
+        return -1;
+    }
+    pwmMutex.lock();
+    if (FindChannel(pin) == NULL && pwmChannelAttach(pin, PWM_CHANNEL_DEFAULT_PERIOD_US) != 0)
+    {
+        pwmMutex.unlock();
+        return -1;
+    }
+
+    PWM_CHANNEL *channel = FindChannel(pin);
+    uint32_t full = GetTimer(channel)->ARR + 1;
+    pwmMutex.unlock();
+    float start = sqrtf(constrain(from, 0, 255) / 255.0f);
+    float end = sqrtf(constrain(to, 0, 255) / 255.0f);
+    for (int i = 0; i < count; i++)
+    {
+        float level = (count == 1 ? end : start + (end - start) * i / (count - 1));
+        ticks[i] = (uint32_t)(level * level * full + 0.5f);
+    }
+    return 0;
+}
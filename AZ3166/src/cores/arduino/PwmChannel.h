@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __PWM_CHANNEL_H__
+#define __PWM_CHANNEL_H__
+
+#include <stdint.h>
+
+#define PWM_CHANNEL_MAX                 8
+#define PWM_CHANNEL_DEFAULT_PERIOD_US   1000
+
+// Waveform tracks, each paced by its own timer and fed by its own DMA stream
+#define PWM_WAVEFORM_TRACKS             3
+#define PWM_WAVEFORM_MIN_STEP_US        10
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief    Configure a PWM pin and keep it configured.
+**
+* @param    pin               The PWM pin.
+* @param    periodUs          PWM period in us, shared by all the pins on the same timer.
+*
+* @return   Return 0 on success. Return -1 if the pin has no timer, all the channels are taken or
+*           its timer paces a playing waveform track.
+*
+* @remarks  The timer is set up on the first call only, a call with the same period does nothing.
+*/
+int pwmChannelAttach(uint32_t pin, uint32_t periodUs);
+
+/**
+* @brief    Stop the PWM output of a pin and release its channel.
+*/
+void pwmChannelDetach(uint32_t pin);
+
+/**
+* @brief    Set the duty cycle of a PWM pin, attached with the default period on first use.
+**
+* @param    pin               The PWM pin.
+* @param    value             Duty cycle from 0 to maxValue.
+* @param    maxValue          Value for 100% duty cycle.
+*
+* @return   Return 0 on success. Return -1 on fail.
+*
+* @remarks  Only the compare register is written, the new duty cycle applies from the next period.
+*           A waveform playing on the pin is stopped.
+*/
+int pwmChannelWrite(uint32_t pin, uint32_t value, uint32_t maxValue);
+
+/**
+* @brief    Convert a duty cycle to timer ticks, the unit of the waveform samples.
+**
+* @return   The compare value. Return 0 if the pin is not attached.
+*/
+uint32_t pwmChannelTicks(uint32_t pin, uint32_t value, uint32_t maxValue);
+
+/**
+* @brief    Play a sequence of duty cycles on a PWM pin without CPU involvement.
+**
+* @param    track             Waveform track, 0 to PWM_WAVEFORM_TRACKS - 1.
+* @param    pin               The PWM pin, on a timer of the APB1 bus.
+* @param    ticks             Compare values, see pwmChannelTicks() and pwmWaveformFade().
+*                             The buffer must stay valid while the waveform is playing.
+* @param    count             Number of the compare values.
+* @param    stepUs            Time each compare value is held, in us.
+* @param    repeat            Times to play the sequence, 0 means forever.
+*
+* @return   Return 0 on success. Return -1 on fail, also for track 2 while a PWM output runs on
+*           TIM1, which paces it.
+*
+* @remarks  The last value is held when the sequence ends. While track 2 plays, the PWM pins of
+*           TIM1 can't be attached.
+*/
+int pwmWaveformStart(int track, uint32_t pin, const uint32_t *ticks, int count, uint32_t stepUs, int repeat);
+
+/**
+* @brief    Stop a waveform track, the pin holds its current duty cycle.
+*/
+void pwmWaveformStop(int track);
+
+/**
+* @brief    Check whether a waveform track is still playing.
+**
+* @return   Return 1 if playing, or 0.
+*/
+int pwmWaveformBusy(int track);
+
+/**
+* @brief    Fill a buffer with a brightness fade for pwmWaveformStart().
+**
+* @param    pin               The PWM pin driving the LED.
+* @param    ticks             Buffer to receive the compare values.
+* @param    count             Number of the steps.
+* @param    from              Start duty cycle, 0 to 255.
+* @param    to                End duty cycle, 0 to 255.
+*
+* @return   Return 0 on success. Return -1 on fail.
+*
+* @remarks  The steps are even in the square root of the duty cycle, a cheap gamma curve so that
+*           the fade looks even to the eye.
+*/
+int pwmWaveformFade(uint32_t pin, uint32_t *ticks, int count, int from, int to);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
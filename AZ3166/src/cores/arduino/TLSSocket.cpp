@@ -118,6 +118,12 @@ static int my_verify(void *data, mbedtls_x509_crt *crt, int depth, uint32_t *fla
 TLSSocket::TLSSocket(const char *ssl_ca_pem, NetworkInterface* net_iface)
 {
     _ssl_ca_pem = ssl_ca_pem;
+    _net_iface = net_iface;
+    _tls_ready = false;
+    _has_session = false;
+    _connected = false;
+    _closed = false;
+    memset(&_stats, 0, sizeof(_stats));
     
     if (net_iface)
     {
@@ -136,6 +142,7 @@ TLSSocket::TLSSocket(const char *ssl_ca_pem, NetworkInterface* net_iface)
         mbedtls_x509_crt_init(&_cacert);
         mbedtls_ssl_init(&_ssl);
         mbedtls_ssl_config_init(&_ssl_conf);
+        mbedtls_ssl_session_init(&_session);
     }
 }
 
@@ -148,6 +155,7 @@ TLSSocket::~TLSSocket()
         mbedtls_x509_crt_free(&_cacert);
         mbedtls_ssl_free(&_ssl);
         mbedtls_ssl_config_free(&_ssl_conf);
+        mbedtls_ssl_session_free(&_session);
     }
     
     if (_tcp_socket)
@@ -157,20 +165,31 @@ TLSSocket::~TLSSocket()
     }
 }
 
-nsapi_error_t TLSSocket::connect(const char *host, uint16_t port)
+int TLSSocket::bio_send(void *ctx, const unsigned char *buf, size_t len)
 {
-    if (_tcp_socket == NULL)
+    TLSSocket *socket = static_cast<TLSSocket *>(ctx);
+    int ret = ssl_send(socket->_tcp_socket, buf, len);
+    if (ret > 0)
     {
-        return NSAPI_ERROR_NO_SOCKET;
+        socket->_stats.bytes_sent += ret;
     }
-    
-    if (_ssl_ca_pem == NULL)
+    return ret;
+}
+
+int TLSSocket::bio_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    TLSSocket *socket = static_cast<TLSSocket *>(ctx);
+    int ret = ssl_recv(socket->_tcp_socket, buf, len);
+    if (ret > 0)
     {
-        // No SSL
-        return _tcp_socket->connect(host, port);
+        socket->_stats.bytes_received += ret;
     }
-    
-    // Initialize TLS-related stuf.
+    return ret;
+}
+
+// Seeds the DRBG, parses the CA certificates and sets up the SSL context, once for all connects
+int TLSSocket::setup()
+{
     int ret;
     if ((ret = mbedtls_ctr_drbg_seed(&_ctr_drbg, mbedtls_entropy_func, &_entropy,
                       (const unsigned char *) TLS_CUNSTOM,
@@ -211,10 +230,62 @@ nsapi_error_t TLSSocket::connect(const char *host, uint16_t port)
     {
         return -1;
     }
+    return 0;
+}
+
+nsapi_error_t TLSSocket::connect(const char *host, uint16_t port)
+{
+    if (_tcp_socket == NULL)
+    {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (_connected)
+    {
+        return NSAPI_ERROR_IS_CONNECTED;
+    }
+
+    int ret;
+    if (_closed)
+    {
+        // Connect again after close()
+        if ((ret = _tcp_socket->open(_net_iface)) != NSAPI_ERROR_OK)
+        {
+            return ret;
+        }
+        _closed = false;
+    }
     
+    if (_ssl_ca_pem == NULL)
+    {
+        // No SSL
+        return _tcp_socket->connect(host, port);
+    }
+    
+    if (!_tls_ready)
+    {
+        if (setup() != 0)
+        {
+            return -1;
+        }
+        _tls_ready = true;
+    }
+    else if (mbedtls_ssl_session_reset(&_ssl) != 0)
+    {
+        return -1;
+    }
+
+    // Offer the last session only to the host it came from
+    bool resume = (_has_session && _ssl.hostname != NULL && strcmp(_ssl.hostname, host) == 0);
     mbedtls_ssl_set_hostname(&_ssl, host);
+    if (resume && mbedtls_ssl_set_session(&_ssl, &_session) != 0)
+    {
+        resume = false;
+    }
     
-    mbedtls_ssl_set_bio(&_ssl, static_cast<void *>(_tcp_socket), ssl_send, ssl_recv, NULL );
+    mbedtls_ssl_set_bio(&_ssl, static_cast<void *>(this), bio_send, bio_recv, NULL );
+
+    uint32_t start = us_ticker_read();
+    uint32_t bytes = _stats.bytes_sent + _stats.bytes_received;
     
     /* Connect to the server */
     ret = _tcp_socket->connect(host, port);
@@ -223,18 +294,44 @@ nsapi_error_t TLSSocket::connect(const char *host, uint16_t port)
         return ret;
     }
 
-   /* Start the handshake */
-    ret = mbedtls_ssl_handshake(&_ssl);
+   /* Start the handshake, a read or write timing out with the socket timeout only pauses it */
+    do
+    {
+        ret = mbedtls_ssl_handshake(&_ssl);
+    } while ((ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+        && (us_ticker_read() - start) / 1000 < TLS_HANDSHAKE_TIMEOUT_MS);
     if (ret < 0) 
     {
         if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
             ret != MBEDTLS_ERR_SSL_WANT_WRITE) 
         {
+            // The next connect starts over with a new session
+            _has_session = false;
             ret = -1;
         }
-        
+        else
+        {
+            ret = NSAPI_ERROR_TIMEOUT;
+        }
+        // and a new TCP socket
+        _tcp_socket->close();
+        _closed = true;
         return ret;
     }
+    _connected = true;
+
+    _stats.handshakes++;
+    _stats.last_connect_ms = (us_ticker_read() - start) / 1000;
+    _stats.last_handshake_bytes = _stats.bytes_sent + _stats.bytes_received - bytes;
+    // A resumed session goes on with the master secret of the offered one
+    if (resume && memcmp(_ssl.session->master, _session.master, sizeof(_session.master)) == 0)
+    {
+        _stats.resumed++;
+    }
+
+    // Keep the session for the next connect
+    mbedtls_ssl_session_free(&_session);
+    _has_session = (mbedtls_ssl_get_session(&_ssl, &_session) == 0);
     
     return NSAPI_ERROR_OK;
 }
@@ -245,6 +342,19 @@ nsapi_error_t TLSSocket::close()
     {
         return NSAPI_ERROR_NO_SOCKET;
     }
+    if (_connected)
+    {
+        _connected = false;
+        if (_ssl_ca_pem)
+        {
+            mbedtls_ssl_close_notify(&_ssl);
+        }
+    }
+    if (_closed)
+    {
+        return NSAPI_ERROR_OK;
+    }
+    _closed = true;
     return _tcp_socket->close();
 }
 
@@ -260,7 +370,7 @@ nsapi_size_or_error_t TLSSocket::send(const void *data, nsapi_size_t size)
         // No SSL
         const unsigned char *ptr = (const unsigned char *)data;
         int result, data_size = size;
-        while((result = ssl_send(_tcp_socket, ptr, data_size)) > 0)
+        while((result = bio_send(this, ptr, data_size)) > 0)
         {
             ptr += result;
             data_size -= result;
@@ -269,7 +379,12 @@ nsapi_size_or_error_t TLSSocket::send(const void *data, nsapi_size_t size)
         return result;
     }
 
-    return mbedtls_ssl_write(&_ssl, (const unsigned char*)data, size);
+    int ret = mbedtls_ssl_write(&_ssl, (const unsigned char*)data, size);
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    }
+    return ret;
 }
 
 nsapi_size_or_error_t TLSSocket::recv(void *data, nsapi_size_t size)
@@ -282,8 +397,40 @@ nsapi_size_or_error_t TLSSocket::recv(void *data, nsapi_size_t size)
     if (_ssl_ca_pem == NULL)
     {
         // No SSL
-        return _tcp_socket->recv(data, size);
+        int ret = _tcp_socket->recv(data, size);
+        if (ret > 0)
+        {
+            _stats.bytes_received += ret;
+        }
+        return ret;
     }
 
-    return mbedtls_ssl_read(&_ssl, (unsigned char*)data, size);
+    int ret = mbedtls_ssl_read(&_ssl, (unsigned char*)data, size);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ)
+    {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    }
+    return ret;
+}
+
+void TLSSocket::set_timeout(int timeout)
+{
+    if (_tcp_socket)
+    {
+        _tcp_socket->set_timeout(timeout);
+    }
+}
+
+void TLSSocket::get_stats(TLS_STATS *stats, bool reset)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    memcpy(stats, &_stats, sizeof(TLS_STATS));
+    if (reset)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
 }
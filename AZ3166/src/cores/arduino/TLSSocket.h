@@ -16,26 +16,65 @@
 #include "mbedtls/debug.h"
 #endif
 
+// connect() goes on with the handshake while a read or write of it times out, up to this long
+#define TLS_HANDSHAKE_TIMEOUT_MS 20000
+
+typedef struct
+{
+    uint32_t handshakes;            // Successful handshakes
+    uint32_t resumed;               // Handshakes that resumed the previous session
+    uint32_t last_connect_ms;       // TCP connect and handshake of the last connect()
+    uint32_t last_handshake_bytes;  // Bytes sent and received by the last handshake
+    uint32_t bytes_sent;            // Bytes on the wire, TLS records included
+    uint32_t bytes_received;
+} TLS_STATS;
+
 class TLSSocket
 {
 public:
     TLSSocket(const char *ssl_ca_pem, NetworkInterface* net_iface);
     virtual ~TLSSocket();
 
+    /**
+    * @brief connect to the server, the socket can connect again after close()
+    *
+    * @remarks The CA certificates are parsed by the first connect only. A later connect to the
+    *          same host offers the session of the previous one, so that the server can skip
+    *          the certificate exchange and the key agreement. The handshake gives up with
+    *          NSAPI_ERROR_TIMEOUT after TLS_HANDSHAKE_TIMEOUT_MS.
+    */
     nsapi_error_t connect(const char *host, uint16_t port);
     nsapi_error_t close();
     nsapi_size_or_error_t send(const void *data, nsapi_size_t size);
+
+    /**
+    * @return the bytes received, NSAPI_ERROR_WOULD_BLOCK when nothing arrived within the timeout
+    */
     nsapi_size_or_error_t recv(void *data, nsapi_size_t size);
+    void set_timeout(int timeout);
+
+    void get_stats(TLS_STATS *stats, bool reset = false);
 
 private:
+    static int bio_send(void *ctx, const unsigned char *buf, size_t len);
+    static int bio_recv(void *ctx, unsigned char *buf, size_t len);
+    int setup();
+
     mbedtls_entropy_context _entropy;
     mbedtls_ctr_drbg_context _ctr_drbg;
     mbedtls_x509_crt _cacert;
     mbedtls_ssl_context _ssl;
     mbedtls_ssl_config _ssl_conf;
+    mbedtls_ssl_session _session;
     
     const char *_ssl_ca_pem;
+    NetworkInterface *_net_iface;
     TCPSocket *_tcp_socket;
+    bool _tls_ready;                // setup() done
+    bool _has_session;              // _session holds the session of the last handshake
+    bool _connected;                // Handshake done, until close()
+    bool _closed;                   // The TCP socket has to be opened again
+    TLS_STATS _stats;
     bool check_mbedtls_ssl_write(int ret);
 };
 
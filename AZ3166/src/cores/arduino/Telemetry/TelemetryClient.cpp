@@ -4,6 +4,7 @@
 #include "Arduino.h"
 #include "http_client.h"
 #include "mbedtls/md5.h"
+#include "SystemBoot.h"
 #include "SystemTime.h"
 #include "SystemVariables.h"
 #include "SystemVersion.h"
@@ -17,31 +18,165 @@
 #define CORRELATIONID           "0000000000000000000000000000000000000000000000000000000000000000"
 #endif
 
-#define CORRELATION_ID_LENGTH   64
 #define CHECK_INTERVAL_MS       5000
+// "2017-10-18T12:34:56.789Z"
+#define TIME_LENGTH             24
 
 static const char *EVENT = "AIEVENT";
-static const char *BODY_TEMPLATE = 
-"{"
-    "\"data\": {"
-        "\"baseType\": \"EventData\","
-        "\"baseData\": {"
-            "\"properties\": {"
-                "\"keyword\": \"%s\","
-                "\"hardware_version\": \"%s\","
-                "\"mcu\": \"%s\","
-                "\"message\":\"%s\","
-                "\"hash_mac_address\": \"%s\","
-                "\"hash_iothub_name\":\"%s\","
-                "\"correlation_id\": \"%s\""
-            "},"
-            "\"name\": \"%s\""
-        "}"
-    "},"
-    "\"time\": \"%s\","
-    "\"name\": \"%s\","
-    "\"iKey\": \"%s\""
-"}";
+
+// The event is rendered as
+//  {
+//      "data": {
+//          "baseType": "EventData",
+//          "baseData": {
+//              "properties": {
+//                  "keyword": BOARD_NAME, "hardware_version": ..., "mcu": BOARD_MCU, "message": ...,
+//                  "hash_mac_address": ..., "hash_iothub_name": ..., "correlation_id": CORRELATIONID
+//              },
+//              "name": ...
+//          }
+//      },
+//      "time": ..., "name": EVENT, "iKey": ...
+//  }
+// and a batch of events is sent as a JSON array of them
+static const char *PREFIX_TEMPLATE =
+    "{\"data\":{\"baseType\":\"EventData\",\"baseData\":{\"properties\":{"
+    "\"keyword\":\"%s\",\"hardware_version\":\"%s\",\"mcu\":\"%s\",\"message\":\"";
+static const char *HASHES_TEMPLATE =
+    "\",\"hash_mac_address\":\"%s\",\"hash_iothub_name\":\"%s\",\"correlation_id\":\"%s\"},\"name\":\"";
+static const char TIME_PART[] = "\"}},\"time\":\"";
+static const char *SUFFIX_TEMPLATE = "\",\"name\":\"%s\",\"iKey\":\"%s\"}";
+
+// snprintf() returns the length it wanted to write, the parts are sized so that nothing is cut
+static int part_length(int length, int size)
+{
+    return (length < 0 ? 0 : (length >= size ? size - 1 : length));
+}
+
+static char *write_raw(char *p, char *end, const char *s, int length)
+{
+    if (p == NULL || end - p < length)
+    {
+        return NULL;
+    }
+    memcpy(p, s, length);
+    return p + length;
+}
+
+// Writes s as the content of a JSON string, up to max bytes, the rest is cut
+static char *write_escaped(char *p, char *end, const char *s, int max)
+{
+    static const char HEX_STR[] = "0123456789abcdef";
+
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    if (end - p > max)
+    {
+        end = p + max;
+    }
+
+    char *start = p;
+    for (; *s; s++)
+    {
+        unsigned char c = *s;
+        char escape = 0;
+        switch (c)
+        {
+        case '"':  escape = '"';  break;
+        case '\\': escape = '\\'; break;
+        case '\b': escape = 'b';  break;
+        case '\f': escape = 'f';  break;
+        case '\n': escape = 'n';  break;
+        case '\r': escape = 'r';  break;
+        case '\t': escape = 't';  break;
+        }
+
+        if (escape)
+        {
+            if (end - p < 2)
+            {
+                break;
+            }
+            p[0] = '\\';
+            p[1] = escape;
+            p += 2;
+        }
+        else if (c < 0x20)
+        {
+            if (end - p < 6)
+            {
+                break;
+            }
+            memcpy(p, "\\u00", 4);
+            p[4] = HEX_STR[c >> 4];
+            p[5] = HEX_STR[c & 0x0F];
+            p += 6;
+        }
+        else
+        {
+            if (p == end)
+            {
+                break;
+            }
+            *p++ = c;
+        }
+    }
+
+    if (*s)
+    {
+        // Cut, don't leave a partial UTF-8 sequence at the end
+        char *lead = p;
+        while (lead > start && (lead[-1] & 0xC0) == 0x80)
+        {
+            lead--;
+        }
+        if (lead > start && (lead[-1] & 0xC0) == 0xC0)
+        {
+            unsigned char c = lead[-1];
+            int expected = (c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : 2));
+            if (p - lead + 1 < expected)
+            {
+                p = lead - 1;
+            }
+        }
+    }
+    return p;
+}
+
+static void write_2digits(char *s, int value)
+{
+    s[0] = '0' + value / 10;
+    s[1] = '0' + value % 10;
+}
+
+// ISO 8601 UTC time with milliseconds
+static void write_time(char *s, uint64_t ms)
+{
+    time_t t = (time_t)(ms / 1000);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    int year = tm.tm_year + 1900;
+    write_2digits(s, year / 100);
+    write_2digits(s + 2, year % 100);
+    s[4] = '-';
+    write_2digits(s + 5, tm.tm_mon + 1);
+    s[7] = '-';
+    write_2digits(s + 8, tm.tm_mday);
+    s[10] = 'T';
+    write_2digits(s + 11, tm.tm_hour);
+    s[13] = ':';
+    write_2digits(s + 14, tm.tm_min);
+    s[16] = ':';
+    write_2digits(s + 17, tm.tm_sec);
+    s[19] = '.';
+    int millis = (int)(ms % 1000);
+    s[20] = '0' + millis / 100;
+    write_2digits(s + 21, millis % 100);
+    s[23] = 'Z';
+}
 
 TelemetryClient::TelemetryClient(const char *ai_endoint, const char *ai_ikey)
     : m_telemetry_thread(osPriorityNormal, STACK_SIZE, NULL)
@@ -51,7 +186,20 @@ TelemetryClient::TelemetryClient(const char *ai_endoint, const char *ai_ikey)
 
     memset(m_hash_mac, 0, sizeof(m_hash_mac));
     memset(m_hash_iothub_name, 0, sizeof(m_hash_iothub_name));
-    m_base_size = strlen(BODY_TEMPLATE) + sizeof(BOARD_NAME) + strlen(getDevkitVersion()) + sizeof(BOARD_MCU) + strlen(EVENT) + strlen(m_ai_ikey) - 20 + sizeof(m_hash_mac) + CORRELATION_ID_LENGTH + sizeof(m_hash_iothub_name);
+
+    m_prefix_length = part_length(
+        snprintf(m_prefix, sizeof(m_prefix), PREFIX_TEMPLATE, BOARD_NAME, getDevkitVersion(), BOARD_MCU), sizeof(m_prefix));
+    m_suffix_length = part_length(
+        snprintf(m_suffix, sizeof(m_suffix), SUFFIX_TEMPLATE, EVENT, m_ai_ikey), sizeof(m_suffix));
+    m_hashes_length = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        m_batch[i][0] = '[';
+        m_batch_length[i] = 1;
+        m_batch_count[i] = 0;
+    }
+    m_active = 0;
 
     m_telemetry_thread.start(callback(this, &TelemetryClient::telemetry_worker));
 }
@@ -77,7 +225,7 @@ void TelemetryClient::hash(char *result, const char *input)
     result[i * 2] = 0;
 }
 
-void TelemetryClient::send_data_to_ai(const char* data, int size)
+bool TelemetryClient::send_data_to_ai(const char* data, int size)
 {
     HTTPClient client(HTTP_POST, m_ai_endoint);
     client.set_header("mem","good");
@@ -87,73 +235,139 @@ void TelemetryClient::send_data_to_ai(const char* data, int size)
         if(response->status_code >= 400)
         {
             Serial.printf(">>> Failed to send telemetry data: %d.\r\n", response->status_code);
+            return false;
         }
     }
     else
     {
         Serial.printf(">>> Failed to send telemetry data: Http fault.\r\n");
+        return false;
+    }
+
+    if (!SystemIsReady(BOOT_READY_TELEMETRY))
+    {
+        // The first telemetry data is delivered, this is the last milestone of the boot sequence
+        SystemSetReady(BOOT_READY_TELEMETRY);
+        SystemBootReport();
     }
+    return true;
 }
 
-void TelemetryClient::do_trace_telemetry(const char *iothub, const char *event, const char *message, bool async)
+void TelemetryClient::render_hashes(void)
 {
-    // Prepare the hash data
-    if (m_hash_mac[0] == 0)
+    m_hashes_length = part_length(
+        snprintf(m_hashes, sizeof(m_hashes), HASHES_TEMPLATE, m_hash_mac, m_hash_iothub_name, CORRELATIONID), sizeof(m_hashes));
+}
+
+int TelemetryClient::write_event(char *dst, int size, const char *event, const char *message, const char *timestamp)
+{
+    char *end = dst + size;
+    char *p = write_raw(dst, end, m_prefix, m_prefix_length);
+    p = write_escaped(p, end, message, TELEMETRY_MESSAGE_MAX_SIZE);
+    p = write_raw(p, end, m_hashes, m_hashes_length);
+    p = write_escaped(p, end, event, TELEMETRY_EVENT_MAX_SIZE);
+    p = write_raw(p, end, TIME_PART, sizeof(TIME_PART) - 1);
+    p = write_raw(p, end, timestamp, TIME_LENGTH);
+    p = write_raw(p, end, m_suffix, m_suffix_length);
+    return (p == NULL ? -1 : p - dst);
+}
+
+bool TelemetryClient::append_event(const char *event, const char *message, const char *timestamp)
+{
+    // The batch is "[" event ("," event)*, the room for the closing "]" is kept
+    char *batch = m_batch[m_active];
+    int length = m_batch_length[m_active];
+    int separator = (m_batch_count[m_active] > 0 ? 1 : 0);
+
+    int size = write_event(batch + length + separator, TELEMETRY_BATCH_SIZE - length - separator - 1, event, message, timestamp);
+    if (size < 0)
     {
-        hash(m_hash_mac, WiFiInterface()->get_mac_address());
+        return false;
     }
-    if (m_hash_iothub_name[0] == 0 && iothub[0] != '\0')
+    if (separator)
     {
-        hash(m_hash_iothub_name, iothub);
+        batch[length] = ',';
     }
+    m_batch_length[m_active] = length + separator + size;
+    m_batch_count[m_active]++;
+    return true;
+}
 
-    // Time
-    time_t t = time(NULL);
-    char *_ctime = ctime(&t);
-    // There is a new line character ('\n') at the end of the string which will disturb the json string, so remove it
-    int tlen = strlen(_ctime) - 1;
-    _ctime[tlen] = 0;
-
-    // Calculate the size of the event (json) string
-    int size = m_base_size + strlen(message) + strlen(event) + tlen + 1;
-    
-    // Send
-    char* data = new char[size];
-    sprintf(data, BODY_TEMPLATE, BOARD_NAME, getDevkitVersion(), BOARD_MCU, message, m_hash_mac, m_hash_iothub_name, CORRELATIONID, event, _ctime, EVENT, m_ai_ikey);
+bool TelemetryClient::flush(void)
+{
+    m_send_lock.lock();
 
-    if (async)
+    // Take the active batch, new events go to the other one while it is being sent
+    m_lock.lock();
+    int index = m_active;
+    int count = m_batch_count[index];
+    if (count > 0)
     {
-       if (!push_msg(data))
-       {
-            // Buffer is full, throw away this message
-            delete [] data;
-       }
+        m_active = 1 - index;
     }
-    else
+    m_lock.unlock();
+
+    if (count > 0)
     {
-        send_data_to_ai(data, strlen(data));
-        delete [] data;
+        char *batch = m_batch[index];
+        int length = m_batch_length[index];
+        if (count == 1)
+        {
+            send_data_to_ai(batch + 1, length - 1);
+        }
+        else
+        {
+            batch[length++] = ']';
+            send_data_to_ai(batch, length);
+        }
+        m_batch_length[index] = 1;
+        m_batch_count[index] = 0;
     }
+
+    m_send_lock.unlock();
+    return (count > 0);
 }
 
-bool TelemetryClient::push_msg(char* message)
+void TelemetryClient::do_trace_telemetry(const char *iothub, const char *event, const char *message, bool async)
 {
-    if (!m_pool.full()) // Not perfect but the easiest way
+    char timestamp[TIME_LENGTH];
+    write_time(timestamp, SystemTimeMs());
+
+    m_lock.lock();
+    // Prepare the hash data
+    if (m_hash_mac[0] == 0 || (m_hash_iothub_name[0] == 0 && iothub[0] != '\0'))
+    {
+        if (m_hash_mac[0] == 0)
+        {
+            hash(m_hash_mac, WiFiInterface()->get_mac_address());
+        }
+        if (m_hash_iothub_name[0] == 0 && iothub[0] != '\0')
+        {
+            hash(m_hash_iothub_name, iothub);
+        }
+        render_hashes();
+    }
+    bool queued = append_event(event, message, timestamp);
+    m_lock.unlock();
+
+    if (async)
     {
-        m_pool.push(message);
-        return true;
+        // If the batch is full, throw away this event
+        return;
     }
-    return false;
-}
 
-char* TelemetryClient::pop_msg(void)
-{
-    char* result;
-    if (m_pool.pop(result))
+    if (!queued)
     {
-        return result;
+        // Make room by sending what is queued
+        flush();
+        m_lock.lock();
+        queued = append_event(event, message, timestamp);
+        m_lock.unlock();
+    }
+    if (queued)
+    {
+        flush();
     }
-    return NULL;
 }
 
 void TelemetryClient::telemetry_worker(void)
@@ -167,13 +381,8 @@ void TelemetryClient::telemetry_worker(void)
             continue;
         }
         
-        char* msg = pop_msg();
-        if (msg != NULL)
-        {
-            send_data_to_ai(msg, strlen(msg));
-            delete [] msg;
-        }
-        else
+        // The events queued while waiting go out in one batch
+        if (!flush())
         {
             wait_ms(CHECK_INTERVAL_MS);
         }
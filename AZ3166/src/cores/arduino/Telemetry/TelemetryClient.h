@@ -5,9 +5,13 @@
 #define __TELEMERTY_H__
 
 #include "mbed.h"
-#include "CircularBuffer.h"
 
-#define MESSAGE_QUEUE_SIZE  5
+// Size of each of the two batch buffers, the events waiting for the next POST are written into one
+// while the other one is being sent
+#define TELEMETRY_BATCH_SIZE        2048
+// Longest message and event name sent, longer ones are cut
+#define TELEMETRY_MESSAGE_MAX_SIZE  512
+#define TELEMETRY_EVENT_MAX_SIZE    64
 
 /** Client to collect device telemetry data and send to Azure Application Insights 
 *
@@ -27,6 +31,8 @@ public:
     @param event the event name of the telemetry data.
     @param message the extra information of the telemetry data.
     @param iothub this is the iot hub name if the device connects with Azure IoT Hub, the name will be hashed before send to Azure Application Insights.
+    @param async queue the event for the next batch of the worker thread, otherwise it is sent right away
+           together with the events queued so far.
     */
     void Send(const char *event, const char *message = NULL, const char *iothub = NULL, bool async = true);
 
@@ -34,11 +40,13 @@ private:
     void telemetry_worker(void);
 
     void hash(char *result, const char *input);
-    void send_data_to_ai(const char* data, int size);
+    bool send_data_to_ai(const char* data, int size);
     void do_trace_telemetry(const char *iothub, const char *event, const char *message, bool async);
 
-    bool push_msg(char* message);
-    char* pop_msg(void);
+    void render_hashes(void);
+    int write_event(char *dst, int size, const char *event, const char *message, const char *timestamp);
+    bool append_event(const char *event, const char *message, const char *timestamp);
+    bool flush(void);
 
 private:
     const char* m_ai_endoint;
@@ -46,10 +54,28 @@ private:
 
     char m_hash_mac[36];
     char m_hash_iothub_name[36];
-    int m_base_size;
 
-    CircularBuffer<char*, MESSAGE_QUEUE_SIZE> m_pool;
-        
+    // The constant parts of an event, rendered once:
+    // {"data":{"baseType":"EventData","baseData":{"properties":{..."message":"   <message>
+    // ","hash_mac_address":...,"correlation_id":"..."},"name":"                  <event>
+    // "}},"time":"                                                               <time>
+    // ","name":"AIEVENT","iKey":"..."}
+    char m_prefix[192];
+    char m_hashes[224];
+    char m_suffix[96];
+    int m_prefix_length;
+    int m_hashes_length;
+    int m_suffix_length;
+
+    // JSON arrays of events, m_batch[m_active] takes the new ones
+    char m_batch[2][TELEMETRY_BATCH_SIZE];
+    int m_batch_length[2];
+    int m_batch_count[2];
+    int m_active;
+
+    Mutex m_lock;           // The active batch and the rendered parts
+    Mutex m_send_lock;      // The batch being sent
+
     Thread m_telemetry_thread;
 };
 
@@ -42,6 +42,15 @@ char* dtostrf (double val, signed char width, unsigned char prec, char *s);
 
 void reverse(char* begin, char* end);
 
+static unsigned int numberLength(unsigned long num, unsigned char base) {
+    unsigned int n = 1;
+    while(num >= base) {
+        num /= base;
+        n++;
+    }
+    return n;
+}
+
 /*********************************************/
 /*  Constructors                             */
 /*********************************************/
@@ -62,7 +71,6 @@ String::String(const __FlashStringHelper *pstr) {
     *this = pstr; // see operator =
 }
 
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
 String::String(String &&rval) {
     init();
     move(rval);
@@ -72,68 +80,50 @@ String::String(StringSumHelper &&rval) {
     init();
     move(rval);
 }
-#endif
 
 String::String(char c) {
     init();
-    char buf[2];
-    buf[0] = c;
-    buf[1] = 0;
-    *this = buf;
+    copy(&c, 1);
 }
 
+// the numbers are formatted straight into the buffer, a failed allocation leaves the string invalid
 String::String(unsigned char value, unsigned char base) {
     init();
-    char buf[1 + 8 * sizeof(unsigned char)];
-    utoa(value, buf, base);
-    *this = buf;
+    concatNumber(value, false, base);
 }
 
 String::String(int value, unsigned char base) {
     init();
-    char buf[2 + 8 * sizeof(int)];
-    itoa(value, buf, base);
-    *this = buf;
+    concatNumber((value < 0 && base == 10) ? -(unsigned long) value : (unsigned int) value, value < 0 && base == 10, base);
 }
 
 String::String(unsigned int value, unsigned char base) {
     init();
-    char buf[1 + 8 * sizeof(unsigned int)];
-    utoa(value, buf, base);
-    *this = buf;
+    concatNumber(value, false, base);
 }
 
 String::String(long value, unsigned char base) {
     init();
-    char buf[2 + 8 * sizeof(long)];
-    ltoa(value, buf, base);
-    *this = buf;
+    concatNumber((value < 0 && base == 10) ? -(unsigned long) value : (unsigned long) value, value < 0 && base == 10, base);
 }
 
 String::String(unsigned long value, unsigned char base) {
     init();
-    char buf[1 + 8 * sizeof(unsigned long)];
-    ultoa(value, buf, base);
-    *this = buf;
+    concatNumber(value, false, base);
 }
 
 String::String(float value, unsigned char decimalPlaces) {
     init();
-    char buf[33];
-    *this = dtostrf(value, (decimalPlaces + 2), decimalPlaces, buf);
+    concat(value, decimalPlaces);
 }
 
 String::String(double value, unsigned char decimalPlaces) {
     init();
-    char buf[33];
-    *this = dtostrf(value, (decimalPlaces + 2), decimalPlaces, buf);
+    concat(value, decimalPlaces);
 }
 
 String::~String() {
-    if(buffer) {
-        free(buffer);
-    }
-    init();
+    release();
 }
 
 // /*********************************************/
@@ -147,7 +137,11 @@ inline void String::init(void) {
 }
 
 void String::invalidate(void) {
-    if(buffer)
+    release();
+}
+
+void String::release(void) {
+    if(buffer && buffer != sso)
         free(buffer);
     init();
 }
@@ -164,19 +158,31 @@ unsigned char String::reserve(unsigned int size) {
 }
 
 unsigned char String::changeBuffer(unsigned int maxStrLen) {
-    size_t newSize = (maxStrLen + 16) & (~0xf);
-    char *newbuffer = (char *) realloc(buffer, newSize);
+    if(!buffer && maxStrLen < STRING_SSO_SIZE) {
+        buffer = sso;
+        capacity = STRING_SSO_SIZE - 1;
+        return 1;
+    }
+
+    // double the size at least, so that appending in a loop reallocates only now and then
+    size_t newSize = maxStrLen + 1;
+    if(buffer && newSize < 2 * (capacity + 1))
+        newSize = 2 * (capacity + 1);
+    newSize = (newSize + 15) & (~0xf);
+
+    char *newbuffer;
+    if(buffer == sso) {
+        newbuffer = (char *) malloc(newSize);
+        if(newbuffer)
+            memcpy(newbuffer, sso, len + 1);
+    } else {
+        newbuffer = (char *) realloc(buffer, newSize);
+    }
     if(newbuffer) {
-        size_t oldSize = capacity + 1; // include NULL.
-        if (newSize > oldSize)
-        {
-            memset(newbuffer + oldSize, 0, newSize - oldSize);
-        }
         capacity = newSize - 1;
         buffer = newbuffer;
         return 1;
     }
-    buffer = newbuffer;
     return 0;
 }
 
@@ -190,7 +196,8 @@ String & String::copy(const char *cstr, unsigned int length) {
         return *this;
     }
     len = length;
-    strcpy(buffer, cstr);
+    memmove(buffer, cstr, length);
+    buffer[len] = 0;
     return *this;
 }
 
@@ -204,26 +211,24 @@ String & String::copy(const __FlashStringHelper *pstr, unsigned int length) {
     return *this;
 }
 
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
 void String::move(String &rhs) {
-    if(buffer) {
-        if(capacity >= rhs.len) {
-            strcpy(buffer, rhs.buffer);
-            len = rhs.len;
-            rhs.len = 0;
-            return;
-        } else {
-            free(buffer);
-        }
+    if(!rhs.buffer) {
+        invalidate();
+        return;
+    }
+    if(rhs.buffer == rhs.sso) {
+        // nothing to take over, the characters are inside rhs
+        copy(rhs.sso, rhs.len);
+        rhs.len = 0;
+        rhs.sso[0] = 0;
+        return;
     }
+    release();
     buffer = rhs.buffer;
     capacity = rhs.capacity;
     len = rhs.len;
-    rhs.buffer = NULL;
-    rhs.capacity = 0;
-    rhs.len = 0;
+    rhs.init();
 }
-#endif
 
 String & String::operator =(const String &rhs) {
     if(this == &rhs)
@@ -237,7 +242,6 @@ String & String::operator =(const String &rhs) {
     return *this;
 }
 
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
 String & String::operator =(String &&rval) {
     if(this != &rval)
         move(rval);
@@ -249,7 +253,6 @@ String & String::operator =(StringSumHelper &&rval) {
         move(rval);
     return *this;
 }
-#endif
 
 String & String::operator =(const char *cstr) {
     if(cstr)
@@ -282,10 +285,18 @@ unsigned char String::concat(const char *cstr, unsigned int length) {
         return 0;
     if(length == 0)
         return 1;
-    if(!reserve(newlen))
+    // s += s, the buffer may move
+    if(buffer && cstr >= buffer && cstr <= buffer + len) {
+        unsigned int offset = cstr - buffer;
+        if(!reserve(newlen))
+            return 0;
+        cstr = buffer + offset;
+    } else if(!reserve(newlen)) {
         return 0;
-    strcpy(buffer + len, cstr);
+    }
+    memcpy(buffer + len, cstr, length);
     len = newlen;
+    buffer[len] = 0;
     return 1;
 }
 
@@ -296,52 +307,58 @@ unsigned char String::concat(const char *cstr) {
 }
 
 unsigned char String::concat(char c) {
-    char buf[2];
-    buf[0] = c;
-    buf[1] = 0;
-    return concat(buf, 1);
+    return concat(&c, 1);
 }
 
 unsigned char String::concat(unsigned char num) {
-    char buf[1 + 3 * sizeof(unsigned char)];
-    itoa(num, buf, 10);
-    return concat(buf, strlen(buf));
+    return concatNumber(num, false, 10);
 }
 
 unsigned char String::concat(int num) {
-    char buf[2 + 3 * sizeof(int)];
-    itoa(num, buf, 10);
-    return concat(buf, strlen(buf));
+    return concatNumber(num < 0 ? -(unsigned long) num : num, num < 0, 10);
 }
 
 unsigned char String::concat(unsigned int num) {
-    char buf[1 + 3 * sizeof(unsigned int)];
-    utoa(num, buf, 10);
-    return concat(buf, strlen(buf));
+    return concatNumber(num, false, 10);
 }
 
 unsigned char String::concat(long num) {
-    char buf[2 + 3 * sizeof(long)];
-    ltoa(num, buf, 10);
-    return concat(buf, strlen(buf));
+    return concatNumber(num < 0 ? -(unsigned long) num : num, num < 0, 10);
 }
 
 unsigned char String::concat(unsigned long num) {
-    char buf[1 + 3 * sizeof(unsigned long)];
-    ultoa(num, buf, 10);
-    return concat(buf, strlen(buf));
+    return concatNumber(num, false, 10);
 }
 
 unsigned char String::concat(float num) {
-    char buf[20];
-    char* string = dtostrf(num, 4, 2, buf);
-    return concat(string, strlen(string));
+    return concat((double) num, 2);
 }
 
 unsigned char String::concat(double num) {
-    char buf[20];
-    char* string = dtostrf(num, 4, 2, buf);
-    return concat(string, strlen(string));
+    return concat(num, 2);
+}
+
+// the numbers are formatted by floatIO straight into the buffer. Integers reserve their exact
+// length, so short strings stay in sso, floats the longest output of their decimals.
+
+unsigned char String::concat(double num, unsigned char decimalPlaces) {
+    unsigned int decimals = (decimalPlaces < FLOAT_IO_MAX_DECIMALS ? decimalPlaces : FLOAT_IO_MAX_DECIMALS);
+    if(!reserve(len + FLOAT_IO_FIXED_SIZE(decimals) - 1))
+        return 0;
+    len += formatFixed(buffer + len, num, decimals);
+    return 1;
+}
+
+unsigned char String::concatNumber(unsigned long num, bool negative, unsigned char base) {
+    // as formatUnsigned() does
+    if(base < 2 || base > 36)
+        base = 10;
+    if(!reserve(len + negative + numberLength(num, base)))
+        return 0;
+    if(negative)
+        buffer[len++] = '-';
+    len += formatUnsigned(buffer + len, num, base, 0);
+    return 1;
 }
 
 unsigned char String::concat(const __FlashStringHelper * str) {
@@ -632,10 +649,7 @@ String String::substring(unsigned int left, unsigned int right) const {
         return out;
     if(right > len)
         right = len;
-    char temp = buffer[right];  // save the replaced character
-    buffer[right] = '\0';
-    out = buffer + left;  // pointer arithmetic
-    buffer[right] = temp;  //restore character
+    out.copy(buffer + left, right - left);
     return out;
 }
 
@@ -766,3 +780,88 @@ float String::toFloat(void) const {
         return atof(buffer);
     return 0;
 }
+
+// /*********************************************/
+// /*  Builder                                  */
+// /*********************************************/
+
+String::Builder::Builder(char *arena, unsigned int size) :
+        arena(arena), size(size) {
+    clear();
+}
+
+void String::Builder::clear(void) {
+    len = 0;
+    overflowed = 0;
+    if(arena && size)
+        arena[0] = 0;
+}
+
+// returns where length more characters go, or NULL if they do not fit
+char *String::Builder::append(unsigned int length) {
+    if(!arena || len + length >= size) {
+        overflowed = 1;
+        return NULL;
+    }
+    char *p = arena + len;
+    len += length;
+    arena[len] = 0;
+    return p;
+}
+
+unsigned char String::Builder::concat(const char *cstr) {
+    if(!cstr)
+        return 0;
+    return concat(cstr, strlen(cstr));
+}
+
+unsigned char String::Builder::concat(const char *cstr, unsigned int length) {
+    if(!cstr)
+        return 0;
+    char *p = append(length);
+    if(!p)
+        return 0;
+    memcpy(p, cstr, length);
+    return 1;
+}
+
+unsigned char String::Builder::concat(const String &str) {
+    return concat(str.c_str(), str.length());
+}
+
+unsigned char String::Builder::concat(char c) {
+    return concat(&c, 1);
+}
+
+unsigned char String::Builder::concat(int num) {
+    return concat((long) num);
+}
+
+unsigned char String::Builder::concat(unsigned int num) {
+    return concat((unsigned long) num);
+}
+
+unsigned char String::Builder::concat(long num) {
+    char buf[FLOAT_IO_INTEGER_SIZE];
+    return concat(buf, formatInteger(buf, num));
+}
+
+unsigned char String::Builder::concat(unsigned long num) {
+    char buf[FLOAT_IO_INTEGER_SIZE];
+    return concat(buf, formatUnsigned(buf, num, 10, 0));
+}
+
+unsigned char String::Builder::concat(double num, unsigned char decimalPlaces) {
+    char buf[FLOAT_IO_FIXED_SIZE(FLOAT_IO_MAX_DECIMALS)];
+    return concat(buf, formatFixed(buf, num, decimalPlaces));
+}
+
+unsigned char String::Builder::concatShortest(double num) {
+    char buf[FLOAT_IO_SHORTEST_SIZE];
+    return concat(buf, formatShortest(buf, num));
+}
+
+unsigned char String::Builder::concatShortest(float num) {
+    char buf[FLOAT_IO_SHORTEST_SIZE];
+    return concat(buf, formatShortestFloat(buf, num));
+}
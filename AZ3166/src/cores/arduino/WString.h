@@ -38,6 +38,9 @@ class __FlashStringHelper;
 #define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
 #define F(string_literal) (FPSTR(PSTR(string_literal)))
 
+// strings shorter than this are kept inside the String object, without heap allocation
+#define STRING_SSO_SIZE     16
+
 // The string class
 class String {
         // use a function pointer to allow for "if (s)" without the
@@ -56,10 +59,8 @@ class String {
         String(const char *cstr = "");
         String(const String &str);
         String(const __FlashStringHelper *str);
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
         String(String &&rval);
         String(StringSumHelper &&rval);
-#endif
         explicit String(char c);
         explicit String(unsigned char, unsigned char base = 10);
         explicit String(int, unsigned char base = 10);
@@ -89,10 +90,8 @@ class String {
         String & operator =(const String &rhs);
         String & operator =(const char *cstr);
         String & operator = (const __FlashStringHelper *str);
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
         String & operator =(String &&rval);
         String & operator =(StringSumHelper &&rval);
-#endif
 
         // concatenate (works w/ built-in types)
 
@@ -109,6 +108,7 @@ class String {
         unsigned char concat(unsigned long num);
         unsigned char concat(float num);
         unsigned char concat(double num);
+        unsigned char concat(double num, unsigned char decimalPlaces);
         unsigned char concat(const __FlashStringHelper * str);
 
         // if there's not enough memory for the concatenated value, the string
@@ -241,22 +241,62 @@ class String {
         long toInt(void) const;
         float toFloat(void) const;
 
+        // builds a string in a buffer of the caller, e.g. on the stack, without any heap
+        // allocation.  what does not fit is dropped and overflow() is true afterwards.
+        class Builder {
+            public:
+                Builder(char *arena, unsigned int size);
+
+                void clear(void);
+                unsigned char concat(const char *cstr);
+                unsigned char concat(const char *cstr, unsigned int length);
+                unsigned char concat(const String &str);
+                unsigned char concat(char c);
+                unsigned char concat(int num);
+                unsigned char concat(unsigned int num);
+                unsigned char concat(long num);
+                unsigned char concat(unsigned long num);
+                unsigned char concat(double num, unsigned char decimalPlaces = 2);
+                // as few digits as read back to the same value, for JSON
+                unsigned char concatShortest(double num);
+                unsigned char concatShortest(float num);
+
+                template<typename T> Builder & operator +=(const T &value) {
+                    concat(value);
+                    return (*this);
+                }
+
+                const char* c_str() const { return arena; }
+                unsigned int length(void) const { return len; }
+                unsigned char overflow(void) const { return overflowed; }
+                String toString(void) const { return String(arena); }
+
+            private:
+                char *append(unsigned int length);
+
+                char *arena;
+                unsigned int size;
+                unsigned int len;
+                unsigned char overflowed;
+        };
+
     protected:
-        char *buffer;	        // the actual char array
+        char *buffer;	        // the actual char array, sso or on the heap
         unsigned int capacity;  // the array length minus one (for the '\0')
         unsigned int len;       // the String length (not counting the '\0')
+        char sso[STRING_SSO_SIZE];
     protected:
         void init(void);
         void invalidate(void);
+        void release(void);
         unsigned char changeBuffer(unsigned int maxStrLen);
         unsigned char concat(const char *cstr, unsigned int length);
+        unsigned char concatNumber(unsigned long num, bool negative, unsigned char base);
 
         // copy and move
         String & copy(const char *cstr, unsigned int length);
         String & copy(const __FlashStringHelper *pstr, unsigned int length);
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
         void move(String &rhs);
-#endif
 };
 
 class StringSumHelper: public String {
@@ -264,6 +304,9 @@ class StringSumHelper: public String {
         StringSumHelper(const String &s) :
                 String(s) {
         }
+        StringSumHelper(String &&s) :
+                String(static_cast<String &&>(s)) {
+        }
         StringSumHelper(const char *p) :
                 String(p) {
         }
@@ -6,76 +6,709 @@
 #include <math.h>
 #include "floatIO.h"
 #define iSize 10                 // number of buffers, one for each float before wrapping around
- 
-/* float to string
- * f is the float to turn into a string
- * p is the precision (number of decimals)
- * return a string representation of the float.
- */
-char *f2s(float f, int p){
-    char * pBuff;                         // use to remember which part of the buffer to use for dtostrf
-    static char sBuff[iSize][20];         // space for 20 characters including NULL terminator for each float
-    static int iCount = 0;                // keep a tab of next place in sBuff to use
-    pBuff = sBuff[iCount];                // use this buffer
-    if(iCount >= iSize -1){               // check for wrap
-        iCount = 0;                       // if wrapping start again and reset
+
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*********************************************/
+/*  Integers                                 */
+/*********************************************/
+
+static int decimalLength(uint32_t v)
+{
+    if (v < 10) return 1;
+    if (v < 100) return 2;
+    if (v < 1000) return 3;
+    if (v < 10000) return 4;
+    if (v < 100000) return 5;
+    if (v < 1000000) return 6;
+    if (v < 10000000) return 7;
+    if (v < 100000000) return 8;
+    if (v < 1000000000) return 9;
+    return 10;
+}
+
+// Writes the n digits of v, two at a time from the end
+static void writeDecimal(char *s, uint32_t v, int n)
+{
+    char *p = s + n;
+    while (v >= 100)
+    {
+        uint32_t i = (v % 100) * 2;
+        v /= 100;
+        *--p = digitPairs[i + 1];
+        *--p = digitPairs[i];
+    }
+    if (v >= 10)
+    {
+        *--p = digitPairs[v * 2 + 1];
+        *--p = digitPairs[v * 2];
+    }
+    else
+    {
+        *--p = '0' + v;
     }
-    else{
-        iCount++;                         // advance the counter
+    // Leading zeros when n is longer than v
+    while (p > s)
+    {
+        *--p = '0';
     }
-    return dtostrf(f, 0, p, pBuff);       // call the library function
 }
 
-/*
- * As there is a problem of sprintf %f in Arduino,
-   follow https://github.com/blynkkk/blynk-library/issues/14 to implement dtostrf
- */
-char * dtostrf(double number, signed char width, unsigned char prec, char *s) {
-    if(isnan(number)) {
+static int formatDecimal(char *s, unsigned long long value)
+{
+    if (value <= 0xFFFFFFFFULL)
+    {
+        int n = decimalLength((uint32_t)value);
+        writeDecimal(s, (uint32_t)value, n);
+        s[n] = 0;
+        return n;
+    }
+
+    // One 64-bit division per 9 digits, the rest is 32-bit
+    unsigned long long high = value / 1000000000;
+    int n = formatDecimal(s, high);
+    writeDecimal(s + n, (uint32_t)(value - high * 1000000000), 9);
+    s[n + 9] = 0;
+    return n + 9;
+}
+
+int formatUnsigned(char *s, unsigned long long value, int base, int upper)
+{
+    if (base < 2 || base > 36)
+    {
+        base = 10;
+    }
+    if (base == 10)
+    {
+        return formatDecimal(s, value);
+    }
+
+    const char *digits = (upper ? "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ" : "0123456789abcdefghijklmnopqrstuvwxyz");
+    char buf[FLOAT_IO_INTEGER_SIZE];
+    char *p = buf + sizeof(buf);
+    if ((base & (base - 1)) == 0)
+    {
+        int shift = 0;
+        while ((1 << shift) < base)
+        {
+            shift++;
+        }
+        do
+        {
+            *--p = digits[value & (base - 1)];
+            value >>= shift;
+        } while (value);
+    }
+    else
+    {
+        do
+        {
+            *--p = digits[value % base];
+            value /= base;
+        } while (value);
+    }
+
+    int n = buf + sizeof(buf) - p;
+    memcpy(s, p, n);
+    s[n] = 0;
+    return n;
+}
+
+int formatInteger(char *s, long long value)
+{
+    if (value < 0)
+    {
+        *s = '-';
+        return 1 + formatDecimal(s + 1, -(unsigned long long)value);
+    }
+    return formatDecimal(s, value);
+}
+
+/*********************************************/
+/*  Shortest, Grisu2                         */
+/*********************************************/
+
+// Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers", 2010,
+// the variant with the boundaries of the source type, so that floats get their own shortest digits
+
+typedef struct
+{
+    uint64_t f;
+    int e;
+} diyfp;
+
+typedef struct
+{
+    uint64_t f;
+    int e;
+    int k;
+} cachedPower;
+
+// 10^k normalized to 64 bits, for k = -300, -292, ..., 324
+static const cachedPower cachedPowers[] =
+{
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+};
+
+#define CACHED_POWERS_MIN_DEC_EXP   (-300)
+#define CACHED_POWERS_DEC_STEP      8
+// Range of the binary exponent of the scaled numbers, so that the digits come out of 32-bit parts
+#define GRISU_ALPHA                 (-60)
+
+static diyfp diyfpMul(diyfp x, diyfp y)
+{
+    uint64_t xl = x.f & 0xFFFFFFFFu, xh = x.f >> 32;
+    uint64_t yl = y.f & 0xFFFFFFFFu, yh = y.f >> 32;
+    uint64_t p0 = xl * yl;
+    uint64_t p1 = xl * yh;
+    uint64_t p2 = xh * yl;
+    uint64_t p3 = xh * yh;
+    uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu) + (1u << 31);
+    diyfp r = { p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32), x.e + y.e + 64 };
+    return r;
+}
+
+static diyfp diyfpNormalize(diyfp x)
+{
+    while ((x.f >> 63) == 0)
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+// The value f * 2^e and its neighbours halfway to the next values of the source type
+static void computeBoundaries(uint64_t f, int e, int lowerCloser, diyfp *minus, diyfp *v, diyfp *plus)
+{
+    diyfp value = { f, e };
+    diyfp p = { 2 * f + 1, e - 1 };
+    diyfp m;
+    if (lowerCloser)
+    {
+        m.f = 4 * f - 1;
+        m.e = e - 2;
+    }
+    else
+    {
+        m.f = 2 * f - 1;
+        m.e = e - 1;
+    }
+
+    *plus = diyfpNormalize(p);
+    m.f <<= (m.e - plus->e);
+    m.e = plus->e;
+    *minus = m;
+    *v = diyfpNormalize(value);
+}
+
+static int largestPow10(uint32_t n, uint32_t *pow10)
+{
+    static const uint32_t powers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+    int k = decimalLength(n);
+    *pow10 = powers[k - 1];
+    return k;
+}
+
+static void grisuRound(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenK)
+{
+    // Move the last digit towards the exact value while staying inside the boundaries
+    while (rest < dist && delta - rest >= tenK && (rest + tenK < dist || dist - rest > rest + tenK - dist))
+    {
+        buf[len - 1]--;
+        rest += tenK;
+    }
+}
+
+static int grisu2(char *buf, int *decimalExponent, diyfp minus, diyfp v, diyfp plus)
+{
+    int f = GRISU_ALPHA - plus.e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    const cachedPower *cached = &cachedPowers[(-CACHED_POWERS_MIN_DEC_EXP + k + (CACHED_POWERS_DEC_STEP - 1)) / CACHED_POWERS_DEC_STEP];
+    diyfp c = { cached->f, cached->e };
+
+    diyfp w = diyfpMul(v, c);
+    diyfp wMinus = diyfpMul(minus, c);
+    diyfp wPlus = diyfpMul(plus, c);
+    // Stay inside the boundaries despite the rounding of the multiplications
+    uint64_t low = wMinus.f + 1;
+    uint64_t high = wPlus.f - 1;
+    *decimalExponent = -cached->k;
+
+    uint64_t delta = high - low;
+    uint64_t dist = high - w.f;
+    int shift = -wPlus.e;
+    uint64_t one = (uint64_t)1 << shift;
+    uint32_t p1 = (uint32_t)(high >> shift);
+    uint64_t p2 = high & (one - 1);
+
+    int len = 0;
+    uint32_t pow10;
+    int n = largestPow10(p1, &pow10);
+    while (n > 0)
+    {
+        uint32_t d = p1 / pow10;
+        p1 %= pow10;
+        buf[len++] = '0' + d;
+        n--;
+
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta)
+        {
+            *decimalExponent += n;
+            grisuRound(buf, len, dist, delta, rest, (uint64_t)pow10 << shift);
+            return len;
+        }
+        pow10 /= 10;
+    }
+
+    int m = 0;
+    for (;;)
+    {
+        p2 *= 10;
+        buf[len++] = '0' + (char)(p2 >> shift);
+        p2 &= one - 1;
+        m++;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta)
+        {
+            break;
+        }
+    }
+    *decimalExponent -= m;
+    grisuRound(buf, len, dist, delta, p2, one);
+    return len;
+}
+
+static int formatSpecial(char *s, double value)
+{
+    if (isnan(value))
+    {
         strcpy(s, "nan");
-        return s;
+        return 3;
+    }
+    if (isinf(value))
+    {
+        strcpy(s, value < 0 ? "-inf" : "inf");
+        return value < 0 ? 4 : 3;
+    }
+    return 0;
+}
+
+// Lays out len digits with the decimal point after position point (which may be out of the digits)
+static int formatDigits(char *s, const char *digits, int len, int point)
+{
+    char *p = s;
+    if (point > 0 && point <= 15)
+    {
+        if (len <= point)
+        {
+            memcpy(p, digits, len);
+            memset(p + len, '0', point - len);
+            p += point;
+        }
+        else
+        {
+            memcpy(p, digits, point);
+            p[point] = '.';
+            memcpy(p + point + 1, digits + point, len - point);
+            p += len + 1;
+        }
     }
-    if(isinf(number)) {
-        strcpy(s, "inf");
-        return s;
+    else if (point <= 0 && point > -5)
+    {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, digits, len);
+        p += len;
     }
+    else
+    {
+        *p++ = digits[0];
+        if (len > 1)
+        {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        int exponent = point - 1;
+        *p++ = 'e';
+        if (exponent < 0)
+        {
+            *p++ = '-';
+            exponent = -exponent;
+        }
+        else
+        {
+            *p++ = '+';
+        }
+        p += formatDecimal(p, exponent);
+    }
+    *p = 0;
+    return p - s;
+}
 
-    if(number > 4294967040.0 || number < -4294967040.0) {
-        strcpy(s, "ovf");
-        return s;
+static int formatShortestBits(char *s, int negative, uint64_t f, int e, int lowerCloser)
+{
+    char *p = s;
+    if (negative)
+    {
+        *p++ = '-';
     }
-    char* out = s;
-    // Handle negative numbers
-    if(number < 0.0) {
-        *out = '-';
-        ++out;
-        number = -number;
+    if (f == 0)
+    {
+        strcpy(p, "0");
+        return p + 1 - s;
+    }
+
+    diyfp minus, v, plus;
+    computeBoundaries(f, e, lowerCloser, &minus, &v, &plus);
+    char digits[20];
+    int decimalExponent;
+    int len = grisu2(digits, &decimalExponent, minus, v, plus);
+    return (p - s) + formatDigits(p, digits, len, len + decimalExponent);
+}
+
+int formatShortest(char *s, double value)
+{
+    int n = formatSpecial(s, value);
+    if (n > 0)
+    {
+        return n;
     }
-    // Round correctly so that print(1.999, 2) prints as "2.00"
-    double rounding = 0.5;
-    for(unsigned char i = 0; i < prec; ++i) {
-      rounding /= 10.0;
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7FF);
+    uint64_t fraction = bits & 0xFFFFFFFFFFFFFULL;
+    if (exponent == 0)
+    {
+        return formatShortestBits(s, (int)(bits >> 63), fraction, 1 - 1075, 0);
     }
-    number += rounding;
+    return formatShortestBits(s, (int)(bits >> 63), fraction | (1ULL << 52), exponent - 1075, fraction == 0 && exponent > 1);
+}
 
-    // Extract the integer part of the number and print it
-    unsigned long int_part = (unsigned long) number;
-    double remainder = number - (double) int_part;
-    out += sprintf(out, "%lu", int_part);
+int formatShortestFloat(char *s, float value)
+{
+    int n = formatSpecial(s, value);
+    if (n > 0)
+    {
+        return n;
+    }
 
-    // Print the decimal point, but only if there are digits beyond
-    if(prec > 0) {
-        *out = '.';
-        ++out;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = (int)((bits >> 23) & 0xFF);
+    uint32_t fraction = bits & 0x7FFFFF;
+    if (exponent == 0)
+    {
+        return formatShortestBits(s, (int)(bits >> 31), fraction, 1 - 150, 0);
     }
+    return formatShortestBits(s, (int)(bits >> 31), fraction | (1u << 23), exponent - 150, fraction == 0 && exponent > 1);
+}
+
+/*********************************************/
+/*  Fixed decimals                           */
+/*********************************************/
 
-    while(prec-- > 0) {
-        remainder *= 10.0;
-        if((int)remainder == 0){
-                *out = '0';
-                 ++out;
+// Fraction bits above this are kept in a multiword number
+#define FIXED_FAST_BITS     60
+#define FIXED_WORDS         ((1074 + 4 + 31) / 32 + 1)
+
+// The decimals of the fraction n / 2^bits, returns the rounding: 1 above half, 0 at half, -1 below
+static int fractionDigits(char *digits, int decimals, uint64_t n, int bits)
+{
+    if (bits <= FIXED_FAST_BITS)
+    {
+        uint64_t mask = ((uint64_t)1 << bits) - 1;
+        for (int i = 0; i < decimals; i++)
+        {
+            n *= 10;
+            digits[i] = '0' + (char)(n >> bits);
+            n &= mask;
         }
+        uint64_t half = (uint64_t)1 << (bits - 1);
+        return (n > half ? 1 : (n == half ? 0 : -1));
+    }
+
+    // Only subnormals and tiny or long fractions get here
+    uint32_t w[FIXED_WORDS];
+    int words = (bits + 4 + 31) / 32;
+    memset(w, 0, sizeof(w));
+    w[0] = (uint32_t)n;
+    w[1] = (uint32_t)(n >> 32);
+    int top = bits / 32;
+    int topShift = bits % 32;
+    for (int i = 0; i < decimals; i++)
+    {
+        uint64_t carry = 0;
+        for (int j = 0; j < words; j++)
+        {
+            uint64_t t = (uint64_t)w[j] * 10 + carry;
+            w[j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        // The digit is the 4 bits from bit 'bits' on
+        uint64_t d = w[top] >> topShift;
+        if (top + 1 < words && topShift > 0)
+        {
+            d |= (uint64_t)w[top + 1] << (32 - topShift);
+        }
+        digits[i] = '0' + (char)(d & 0xF);
+        w[top] &= ((uint32_t)1 << topShift) - 1;
+        for (int j = top + 1; j < words; j++)
+        {
+            w[j] = 0;
+        }
+    }
+
+    // Compare with the half, bit bits - 1
+    int halfWord = (bits - 1) / 32;
+    uint32_t halfBit = (uint32_t)1 << ((bits - 1) % 32);
+    if ((w[halfWord] & halfBit) == 0)
+    {
+        return -1;
+    }
+    if (w[halfWord] & (halfBit - 1))
+    {
+        return 1;
+    }
+    for (int j = 0; j < halfWord; j++)
+    {
+        if (w[j])
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int formatFixed(char *s, double value, int decimals)
+{
+    int n = formatSpecial(s, value);
+    if (n > 0)
+    {
+        return n;
+    }
+    if (decimals < 0)
+    {
+        decimals = 0;
+    }
+    if (decimals > FLOAT_IO_MAX_DECIMALS)
+    {
+        decimals = FLOAT_IO_MAX_DECIMALS;
+    }
+    if (fabs(value) >= 18446744073709551616.0)
+    {
+        return formatShortest(s, value);
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7FF);
+    uint64_t m = bits & 0xFFFFFFFFFFFFFULL;
+    int e;
+    if (exponent == 0)
+    {
+        e = 1 - 1075;
     }
-    sprintf(out, "%d", (int) remainder);
+    else
+    {
+        m |= (1ULL << 52);
+        e = exponent - 1075;
+    }
+
+    // value = integer + fraction / 2^fractionBits
+    uint64_t integer;
+    uint64_t fraction = 0;
+    int fractionBits = 0;
+    if (e >= 0)
+    {
+        integer = m << e;
+    }
+    else
+    {
+        fractionBits = -e;
+        integer = (fractionBits < 64 ? m >> fractionBits : 0);
+        fraction = (fractionBits < 64 ? m & (((uint64_t)1 << fractionBits) - 1) : m);
+    }
+
+    char digits[FLOAT_IO_MAX_DECIMALS];
+    int round = -1;
+    if (fractionBits > 0)
+    {
+        round = fractionDigits(digits, decimals, fraction, fractionBits);
+    }
+    else
+    {
+        memset(digits, '0', decimals);
+    }
+
+    // Ties to even, like printf
+    int last = (decimals > 0 ? digits[decimals - 1] - '0' : (int)(integer & 1));
+    if (round > 0 || (round == 0 && (last & 1)))
+    {
+        int i = decimals - 1;
+        while (i >= 0 && digits[i] == '9')
+        {
+            digits[i--] = '0';
+        }
+        if (i >= 0)
+        {
+            digits[i]++;
+        }
+        else
+        {
+            integer++;
+        }
+    }
+
+    char *p = s;
+    if (bits >> 63)
+    {
+        *p++ = '-';
+    }
+    p += formatDecimal(p, integer);
+    if (decimals > 0)
+    {
+        *p++ = '.';
+        memcpy(p, digits, decimals);
+        p += decimals;
+    }
+    *p = 0;
+    return p - s;
+}
+
+/*********************************************/
+/*  Legacy                                   */
+/*********************************************/
+
+/* float to string
+ * f is the float to turn into a string
+ * p is the precision (number of decimals)
+ * return a string representation of the float.
+ */
+char *f2s(float f, int p){
+    static char sBuff[iSize][FLOAT_IO_FIXED_SIZE(6)];
+    static int iCount = 0;                // keep a tab of next place in sBuff to use
+    // Every caller gets a buffer of its own, even from different threads
+    unsigned int i = (unsigned int)__sync_fetch_and_add(&iCount, 1) % iSize;
+    if (p > 6)
+    {
+        p = 6;
+    }
+    formatFixed(sBuff[i], f, p);
+    return sBuff[i];
+}
+
+/*
+ * avr-libc dtostrf, the result is right aligned in width characters, or left aligned when width
+ * is negative
+ */
+char * dtostrf(double number, signed char width, unsigned char prec, char *s) {
+    char buf[FLOAT_IO_FIXED_SIZE(FLOAT_IO_MAX_DECIMALS)];
+    int n = formatFixed(buf, number, prec);
+    int w = (width < 0 ? -width : width);
+    int pad = (w > n ? w - n : 0);
+
+    if (width < 0) {
+        memcpy(s, buf, n);
+        memset(s + n, ' ', pad);
+    } else {
+        memset(s, ' ', pad);
+        memcpy(s + pad, buf, n);
+    }
+    s[n + pad] = 0;
     return s;
-}
\ No newline at end of file
+}
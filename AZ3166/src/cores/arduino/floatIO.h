@@ -3,10 +3,74 @@
 #ifndef __FLOAT_IO_H__
 #define __FLOAT_IO_H__
 
+#include <stdint.h>
+
+// Decimals of formatFixed() beyond this are cut
+#define FLOAT_IO_MAX_DECIMALS       20
+// Buffer for formatFixed() with the given decimals, the longest formatShortest() output included
+#define FLOAT_IO_FIXED_SIZE(d)      (26 + (d))
+// Buffer for formatShortest() and formatShortestFloat(), e.g. "-2.2250738585072014e-308"
+#define FLOAT_IO_SHORTEST_SIZE      26
+// Buffer for formatUnsigned() and formatInteger() in any base
+#define FLOAT_IO_INTEGER_SIZE       66
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
+
+/**
+* @brief    Write an unsigned integer in base 2 to 36.
+**
+* @param    s                 Buffer of FLOAT_IO_INTEGER_SIZE bytes, or 21 bytes for base 10.
+* @param    upper             Write the digits above 9 in upper case.
+*
+* @return   The length of the string written to s, without the NULL terminator.
+*/
+int formatUnsigned(char *s, unsigned long long value, int base, int upper);
+
+/**
+* @brief    Write a signed integer in base 10.
+**
+* @return   The length of the string written to s, without the NULL terminator.
+*/
+int formatInteger(char *s, long long value);
+
+/**
+* @brief    Write a number with a fixed count of decimals, like printf("%.*f").
+**
+* @param    s                 Buffer of FLOAT_IO_FIXED_SIZE(decimals) bytes.
+* @param    decimals          Digits after the decimal point, 0 to FLOAT_IO_MAX_DECIMALS.
+*
+* @return   The length of the string written to s, without the NULL terminator.
+*
+* @remarks  The digits are exact and ties round to even. Numbers from 2^64 on are written as
+*           formatShortest() does.
+*/
+int formatFixed(char *s, double value, int decimals);
+
+/**
+* @brief    Write the shortest decimal that reads back as the same double.
+**
+* @param    s                 Buffer of FLOAT_IO_SHORTEST_SIZE bytes.
+*
+* @return   The length of the string written to s, without the NULL terminator.
+*
+* @remarks  Plain notation from 1e-5 to 1e15, "1.5e+20" style outside, "nan" and "inf" for the
+*           special values. The output is valid JSON for finite numbers.
+*/
+int formatShortest(char *s, double value);
+
+/**
+* @brief    Write the shortest decimal that reads back as the same float, e.g. "23.45" for 23.45f
+*           where formatShortest() gives "23.450000762939453".
+*/
+int formatShortestFloat(char *s, float value);
+
+/**
+* @brief    Kept for existing sketches: returns one of 10 rotating static buffers, the string
+*           is overwritten by the 10th call after. Use formatFixed() with a buffer of your own.
+*/
 char *f2s(float f, int p);
 
 char* dtostrf (double val, signed char width, unsigned char prec, char *s);
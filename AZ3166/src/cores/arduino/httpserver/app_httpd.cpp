@@ -35,6 +35,7 @@
 #include "EEPROMInterface.h"
 #include "EMW10xxInterface.h"
 #include "httpd.h"
+#include "httpd_form.h"
 #include "OledDisplay.h"
 #include "SystemVariables.h"
 #include "SystemWeb.h"
@@ -43,6 +44,8 @@
 
 #define DEFAULT_PAGE_SIZE (10*1024)
 
+#define app_httpd_log(M, ...) custom_log("app_httpd", M, ##__VA_ARGS__)
+
 static const char * page_head = "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\"><meta http-equiv=\"X-UA-Compatible\" content=\"ie=edge\"><title>AZ3166 WiFi Config</title><style>@charset \"UTF-8\";/*Flavor name:Default (mini-default)Author:Angelos Chalaris (chalarangelo@gmail.com)Maintainers:Angelos Chalarismini.css version:v2.1.5 (Fermion)*//*Browsers resets and base typography.*/html{font-size:16px;}html, *{font-family:-apple-system, BlinkMacSystemFont,\"Segoe UI\",\"Roboto\", \"Droid Sans\",\"Helvetica Neue\", Helvetica, Arial, sans-serif;line-height:1.5;-webkit-text-size-adjust:100%;}*{font-size:1rem;}body{margin:0;color:#212121;background:#f8f8f8;}section{display:block;}input{overflow:visible;}[type=\"radio\"]{position:absolute;left:-2rem;}h1, h2{line-height:1.2em;margin:0.75rem 0.5rem;font-weight:500;}h2 small{color:#424242;display:block;margin-top:-0.25rem;}h1{font-size:2rem;}h2{font-size:1.6875rem;}p{margin:0.5rem;}small{font-size:0.75em;}a{color:#0277bd;text-decoration:underline;opacity:1;transition:opacity 0.3s;}a:visited{color:#01579b;}a:hover, a:focus{opacity:0.75;}/*Definitions for the grid system.*/.container{margin:0 auto;padding:0 0.75rem;}.row{box-sizing:border-box;display:-webkit-box;-webkit-box-flex:0;-webkit-box-orient:horizontal;-webkit-box-direction:normal;display:-webkit-flex;display:flex;-webkit-flex:0 1 auto;flex:0 1 auto;-webkit-flex-flow:row wrap;flex-flow:row wrap;}[class^='col-sm-']{box-sizing:border-box;-webkit-box-flex:0;-webkit-flex:0 0 auto;flex:0 0 auto;padding:0 0.25rem;}.col-sm-10{max-width:83.33333%;-webkit-flex-basis:83.33333%;flex-basis:83.33333%;}.col-sm-offset-1{margin-left:8.33333%;}@media screen and (min-width:768px){.col-md-4{max-width:33.33333%;-webkit-flex-basis:33.33333%;flex-basis:33.33333%;}.col-md-offset-4{margin-left:33.33333%;}}/*Definitions for navigation elements.*/header{display:block;height:2.75rem;background:#1e6bb8;color:#f5f5f5;padding:0.125rem 0.5rem;white-space:nowrap;overflow-x:auto;overflow-y:hidden;}header .logo{color:#f5f5f5;font-size:1.35rem;line-height:1.8125em;margin:0.0625rem 0.375rem 0.0625rem 0.0625rem;transition:opacity 0.3s;}header .logo{text-decoration:none;}/*Definitions for forms and input elements.*/form{background:#eeeeee;border:1px solid #c9c9c9;margin:0.5rem;padding:0.75rem 0.5rem 1.125rem;}.input-group{display:inline-block;margin-left:2rem;position:relative;}.input-group.fluid{display:-webkit-box;-webkit-box-pack:justify;display:-webkit-flex;display:flex;-webkit-align-items:center;align-items:center;-webkit-justify-content:center;justify-content:center;}.input-group.fluid>input:not([type=\"radio\"]),.input-group.fluid>textarea{-webkit-box-flex:1;width:100%;-webkit-flex-grow:1;flex-grow:1;-webkit-flex-basis:0;flex-basis:0;}@media screen and (max-width:767px){.input-group.fluid{-webkit-box-orient:vertical;-webkit-align-items:stretch;align-items:stretch;-webkit-flex-direction:column;flex-direction:column;}}[type=\"password\"],[type=\"text\"],select,textarea{width:100%;box-sizing:border-box;background:#fafafa;color:#212121;border:1px solid #c9c9c9;border-radius:2px;margin:0.25rem 0;padding:0.5rem 0.75rem;}input:not([type=\"button\"]):not([type=\"submit\"]):not([type=\"reset\"]):hover, input:not([type=\"button\"]):not([type=\"submit\"]):not([type=\"reset\"]):focus, select:hover, select:focus{border-color:#0288d1;box-shadow:none;}input:not([type=\"button\"]):not([type=\"submit\"]):not([type=\"reset\"]):disabled, select:disabled{cursor:not-allowed;opacity:0.75;}::-webkit-input-placeholder{opacity:1;color:#616161;}::-moz-placeholder{opacity:1;color:#616161;}::-ms-placeholder{opacity:1;color:#616161;}::placeholder{opacity:1;color:#616161;}button::-moz-focus-inner, [type=\"submit\"]::-moz-focus-inner{border-style:none;padding:0;}button, [type=\"submit\"]{-webkit-appearance:button;}button{overflow:visible;text-transform:none;}button, [type=\"submit\"], a.button, .button{display:inline-block;background:rgba(208, 208, 208, 0.75);color:#212121;border:0;border-radius:2px;padding:0.5rem 0.75rem;margin:0.5rem;text-decoration:none;transition:background 0.3s;cursor:pointer;}button:hover, button:focus, [type=\"submit\"]:hover, [type=\"submit\"]:focus, a.button:hover, a.button:focus, .button:hover, .button:focus{background:#d0d0d0;opacity:1;}button:disabled, [type=\"submit\"]:disabled, a.button:disabled, .button:disabled{cursor:not-allowed;opacity:0.75;}/*Custom elements for forms and input elements.*/button.primary, [type=\"submit\"].primary, .button.primary{background:rgba(30, 107, 184, 0.9);color:#fafafa;}button.primary:hover, button.primary:focus, [type=\"submit\"].primary:hover, [type=\"submit\"].primary:focus, .button.primary:hover, .button.primary:focus{background:#0277bd;}#content{margin-top:2em;} table, th, td {border:1px solid #c9c9c9; border-collapse:collapse;} th, td {padding:5px;padding-left:10px} td {text-align: left;} th {background-color:#EEEEEE;color: #616161;} tr {background-color: #EEEEEE;color: #616161;}</style></head>";
 static const char * wifi_setting_a = "<body><header><h1 class=\"logo\">IoT DevKit Settings</h1></header><section class=\"container\"><div id=\"content\" class=\"row\"><div class=\"col-sm-10 col-sm-offset-1 col-md-4 col-md-offset-4\" style=\"text-align:center;\"><form action=\"result\" method=\"post\" enctype=\"multipart/form-data\"><div class=\"input-group fluid\"><input type=\"radio\" name=\"input_ssid_method\" value=\"select\" onclick=\"changeSSIDInput()\" checked><select name=\"SSID\" id=\"SSID-select\"> ";
 static const char * wifi_setting_b = "</select></div><div class=\"input-group fluid\"><input type=\"radio\" name=\"input_ssid_method\" value=\"text\" onclick=\"changeSSIDInput()\"><input type=\"text\" id=\"SSID-text\" placeholder=\"SSID\" disabled></div><div class=\"input-group fluid\"><input type=\"password\" value=\"\" name=\"PASS\" id=\"password\" placeholder=\"Password\"></div>";
@@ -257,17 +260,74 @@ exit:
     return err;
 }
 
+typedef struct
+{
+    const char *name;
+    char *value;
+    int size;
+    int length;
+    bool found;
+} SETTING_FIELD;
+
+enum
+{
+    SETTING_SSID,
+    SETTING_PASS,
+    SETTING_CONN_STRING,
+    SETTING_CERT,
+    SETTING_COUNT
+};
+
+// Copies the settings out of the form as they arrive, so the POST body is never held as a whole
+static int setting_form_cb(void *arg, httpd_form_event_t event, const char *name, const char *data, int len)
+{
+    SETTING_FIELD *fields = (SETTING_FIELD *)arg;
+    SETTING_FIELD *field = NULL;
+
+    for (int i = 0; i < SETTING_COUNT; i++)
+    {
+        if (fields[i].value && strcmp(fields[i].name, name) == 0)
+        {
+            field = &fields[i];
+            break;
+        }
+    }
+    if (field == NULL)
+    {
+        return kNoErr;
+    }
+
+    switch (event)
+    {
+    case HTTPD_FORM_FIELD_START:
+        field->found = true;
+        field->length = 0;
+        break;
+    case HTTPD_FORM_FIELD_DATA:
+        if (field->length + len >= field->size)
+        {
+            app_httpd_log("The value of %s is longer than %d", name, field->size - 1);
+            return kNoSpaceErr;
+        }
+        memcpy(&field->value[field->length], data, len);
+        field->length += len;
+        break;
+    case HTTPD_FORM_FIELD_END:
+        field->value[field->length] = 0;
+        break;
+    }
+    return kNoErr;
+}
+
 int web_system_setting_result_page(httpd_request_t *req)
 {
     OSStatus err = kNoErr;
     bool retry = false;
-    int buf_size;
-    char *buf = NULL;
     char value_ssid[WIFI_SSID_MAX_LEN + 1];
     char value_pass[WIFI_PWD_MAX_LEN + 1];
     char *value_device_connection_string = NULL;
     char *value_x509 = NULL;
-    char *boundary = NULL;
+    SETTING_FIELD fields[SETTING_COUNT];
     char *result_page = NULL;
     int len = 0;
     int ret;
@@ -275,74 +335,42 @@ int web_system_setting_result_page(httpd_request_t *req)
     memset(value_ssid, 0, sizeof(value_ssid));
     memset(value_pass, 0, sizeof(value_pass));
 
-    buf_size = 512 + WIFI_SSID_MAX_LEN + WIFI_PWD_MAX_LEN;
     if (web_settings & WEB_SETTING_IOT_DEVICE_CONN_STRING)
     {
         value_device_connection_string = (char*)calloc(AZ_IOT_HUB_MAX_LEN + 1, 1);
-        buf_size += AZ_IOT_HUB_MAX_LEN;
+        if (value_device_connection_string == NULL)
+        {
+            err = kGeneralErr;
+            goto _exit;
+        }
     }
     if (web_settings & WEB_SETTING_IOT_CERT)
     {
         value_x509 = (char*)calloc(AZ_IOT_X509_MAX_LEN + 1, 1);
-        buf_size += AZ_IOT_X509_MAX_LEN;
-    }
-    buf = (char *)calloc(buf_size, 1);
-    if (buf == NULL)
-    {
-        err = kGeneralErr;
-        goto _exit;
-    }
-
-    // Get data
-    err = httpd_get_data(req, buf, buf_size - 1);
-    require_noerr(err, _exit);
-    // Extract settings
-    if (strstr(req->content_type, "multipart/form-data") != NULL) // Post data is multipart encoded
-    {
-        boundary = strstr(req->content_type, "boundary=");
-        boundary += 9;
-
-        err = httpd_get_tag_from_multipart_form(buf, boundary, "SSID", value_ssid, WIFI_SSID_MAX_LEN);
-        require_noerr(err, _exit);
-
-        err = httpd_get_tag_from_multipart_form(buf, boundary, "PASS", value_pass, WIFI_PWD_MAX_LEN);
-        require_noerr(err, _exit);
-
-        if (value_device_connection_string)
-        {
-            err = httpd_get_tag_from_multipart_form(buf, boundary, "DeviceConnectionString", value_device_connection_string, AZ_IOT_HUB_MAX_LEN);
-            require_noerr(err, _exit);
-        }
-
-        if (value_x509)
+        if (value_x509 == NULL)
         {
-            err = httpd_get_tag_from_multipart_form(buf, boundary, "certificate", value_x509, AZ_IOT_X509_MAX_LEN);
-            require_noerr(err, _exit);
+            err = kGeneralErr;
+            goto _exit;
         }
     }
-    else // Post data is URL encoded
-    {
-        err = httpd_get_tag_from_post_data(buf, "SSID", value_ssid, WIFI_SSID_MAX_LEN);
-        require_noerr(err, _exit);
-
-        err = httpd_get_tag_from_post_data(buf, "PASS", value_pass, WIFI_PWD_MAX_LEN);
-        require_noerr(err, _exit);
-
-        if (value_device_connection_string)
-        {
-            err = httpd_get_tag_from_post_data(buf, "DeviceConnectionString", value_device_connection_string, AZ_IOT_HUB_MAX_LEN);
-            require_noerr(err, _exit);
-        }
 
-        if (value_x509)
+    // Extract settings, multipart or URL encoded
+    memset(fields, 0, sizeof(fields));
+    fields[SETTING_SSID] = { "SSID", value_ssid, WIFI_SSID_MAX_LEN };
+    fields[SETTING_PASS] = { "PASS", value_pass, WIFI_PWD_MAX_LEN };
+    fields[SETTING_CONN_STRING] = { "DeviceConnectionString", value_device_connection_string, AZ_IOT_HUB_MAX_LEN };
+    fields[SETTING_CERT] = { "certificate", value_x509, AZ_IOT_X509_MAX_LEN };
+    err = httpd_form_read(req, setting_form_cb, fields);
+    require_noerr(err, _exit);
+    for (int i = 0; i < SETTING_COUNT; i++)
+    {
+        if (fields[i].value && !fields[i].found)
         {
-            err = httpd_get_tag_from_post_data(buf, "certificate", value_x509, AZ_IOT_X509_MAX_LEN);
-            require_noerr(err, _exit);
+            app_httpd_log("No %s in the form", fields[i].name);
+            err = kNotFoundErr;
+            goto _exit;
         }
     }
-    // Free the data buffer
-    free(buf);
-    buf = NULL;
 
     // Prepare the result page
     result_page = (char*)calloc(DEFAULT_PAGE_SIZE, 1);
@@ -454,14 +482,14 @@ int web_system_setting_result_page(httpd_request_t *req)
     require_noerr(err, _exit);
 
 _exit:
-    if (buf)
-    {
-        free(buf);
-    }
     if (value_device_connection_string)
     {
         free(value_device_connection_string);
     }
+    if (value_x509)
+    {
+        free(value_x509);
+    }
     if (result_page)
     {
         free(result_page);
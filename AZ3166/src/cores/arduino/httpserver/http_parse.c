@@ -55,6 +55,7 @@
 #include <stdbool.h>
 
 #include "http_parse.h"
+#include "http_parser.h"
 #include "httpd_sys.h"
 #include "httpd_wsgi.h"
 #include "httpd_handle.h"
@@ -357,6 +358,10 @@ int httpd_parse_hdr_tags(httpd_request_t *req, int sock, char *buffer, int len)
   int err;
   uint8_t done = 0;
   
+  /* httpd_parse_request() has read them already */
+  if (req->hdr_parsed)
+    return kNoErr;
+  
   while (true) {
     req_line_len = htsys_getln_soc(sock, buffer, len);
     if (req_line_len == -kInProgressErr) {
@@ -394,6 +399,224 @@ int httpd_parse_hdr_tags(httpd_request_t *req, int sock, char *buffer, int len)
 }
 
 
+/* State of the http_parser callbacks while the head of a request is parsed */
+typedef struct {
+  httpd_request_t *req;
+  int filename_len;
+  /* The last callback was on_header_value */
+  bool in_value;
+  int err;
+} httpd_parse_state_t;
+
+static int httpd_on_url(http_parser *parser, const char *at, size_t length)
+{
+  httpd_parse_state_t *state = parser->data;
+  
+  if (state->filename_len + length > HTTPD_MAX_URI_LENGTH) {
+    httpd_set_error("Error processing token: filename. "
+                    "Filename missing or too long?");
+    state->err = -WM_E_HTTPD_HDR_FNAME;
+    return 1;
+  }
+  memcpy(&state->req->filename[state->filename_len], at, length);
+  state->filename_len += length;
+  state->req->filename[state->filename_len] = 0;
+  return 0;
+}
+
+/* The whole head is in the receive buffer, so the pieces of a name or a value
+* the parser reports are contiguous and the slices just grow. */
+static int httpd_on_header_field(http_parser *parser, const char *at, size_t length)
+{
+  httpd_parse_state_t *state = parser->data;
+  httpd_request_t *req = state->req;
+  httpd_header_t *header;
+  
+  if (state->in_value || req->header_count == 0) {
+    state->in_value = false;
+    if (req->header_count == HTTPD_MAX_HEADERS) {
+      httpd_d("Too many headers, ignoring %.*s", (int)length, at);
+      return 0;
+    }
+    header = &req->headers[req->header_count++];
+    header->name = at;
+    header->name_len = 0;
+    header->value = at + length;
+    header->value_len = 0;
+  } else if (req->header_count == HTTPD_MAX_HEADERS) {
+    return 0;
+  }
+  header = &req->headers[req->header_count - 1];
+  header->name_len = at + length - header->name;
+  return 0;
+}
+
+static int httpd_on_header_value(http_parser *parser, const char *at, size_t length)
+{
+  httpd_parse_state_t *state = parser->data;
+  httpd_request_t *req = state->req;
+  httpd_header_t *header;
+  
+  if (req->header_count == 0)
+    return 0;
+  header = &req->headers[req->header_count - 1];
+  if (!state->in_value) {
+    state->in_value = true;
+    header->value = at;
+  }
+  header->value_len = at + length - header->value;
+  return 0;
+}
+
+static int httpd_on_headers_complete(http_parser *parser)
+{
+  httpd_parse_state_t *state = parser->data;
+  httpd_request_t *req = state->req;
+  
+  switch (parser->method) {
+  case HTTP_GET:
+    req->type = HTTPD_REQ_TYPE_GET;
+    break;
+  case HTTP_POST:
+    req->type = HTTPD_REQ_TYPE_POST;
+    break;
+  case HTTP_PUT:
+    req->type = HTTPD_REQ_TYPE_PUT;
+    break;
+  case HTTP_DELETE:
+    req->type = HTTPD_REQ_TYPE_DELETE;
+    break;
+  case HTTP_HEAD:
+    req->type = HTTPD_REQ_TYPE_HEAD;
+    break;
+  default:
+    httpd_d("Unknown request type %d", parser->method);
+    req->type = HTTPD_REQ_TYPE_UNKNOWN;
+    state->err = -kInProgressErr;
+    return 1;
+  }
+  
+  if (parser->http_major == 1 && parser->http_minor == 0) {
+    httpd_set_error("HTTP/1.0 clients are not supported");
+    state->err = -WM_E_HTTPD_NOTSUPP;
+    return 1;
+  }
+  
+  if (parser->flags & F_CHUNKED)
+    req->chunked = 1;
+  else if ((parser->flags & F_CONTENTLENGTH) && parser->content_length > 0) {
+    req->body_nbytes = (int)parser->content_length;
+    req->remaining_bytes = req->body_nbytes;
+  }
+  return 0;
+}
+
+static bool httpd_header_is(const httpd_header_t *header, const char *name, int name_len)
+{
+  return header->name_len == name_len &&
+    strncasecmp(header->name, name, name_len) == 0;
+}
+
+/* Copy a header value, cut to fit in the buffer */
+static void httpd_header_cpy(const httpd_header_t *header, char *dest, int dest_len)
+{
+  int len = header->value_len < dest_len - 1 ? header->value_len : dest_len - 1;
+  
+  memcpy(dest, header->value, len);
+  dest[len] = 0;
+}
+
+/* Fill in the fields of the request taken from its headers */
+static int httpd_parse_known_headers(httpd_request_t *req)
+{
+  const httpd_header_t *header;
+  char value[HTTPD_MAX_VAL_LENGTH * 2];
+  int i;
+  
+  for (i = 0; i < req->header_count; i++) {
+    header = &req->headers[i];
+    if (httpd_header_is(header, http_content_type, sizeof(http_content_type) - 3)) {
+      httpd_header_cpy(header, req->content_type, sizeof(req->content_type));
+    } else if (httpd_header_is(header, http_user_agent, sizeof(http_user_agent) - 1)) {
+      httpd_header_cpy(header, value, sizeof(value));
+      httpd_parse_useragent(value, &req->agent);
+    } else if (httpd_header_is(header, "If-None-Match", sizeof("If-None-Match") - 1)) {
+      /*
+      * We use the FTFS CRC to generate ETag. Hence, the ETag we
+      * receive is not expected to be more that 32 bits in value.
+      */
+      httpd_header_cpy(header, value, sizeof(value));
+      const char *first_double_quote = strchr(value, '"');
+      if (!first_double_quote) {
+        httpd_d("If_None_Match has no double quote");
+        return -kInProgressErr;
+      }
+      req->etag_val = strtol(first_double_quote + 1, NULL, 16);
+      req->if_none_match = true;
+    }
+  }
+  return kNoErr;
+}
+
+/* Receive the head of the next request into the receive buffer and parse it
+* with the incremental parser of the HTTP client in one go. */
+int httpd_parse_request(httpd_request_t *req)
+{
+  static const http_parser_settings settings = {
+    .on_url = httpd_on_url,
+    .on_header_field = httpd_on_header_field,
+    .on_header_value = httpd_on_header_value,
+    .on_headers_complete = httpd_on_headers_complete,
+  };
+  http_parser parser;
+  httpd_parse_state_t state;
+  const char *head;
+  int head_len;
+  
+  head_len = htsys_recv_head(req->sock, &head);
+  if (head_len == 0)
+    return HTTPD_DONE;
+  if (head_len == kNoSpaceErr) {
+    httpd_set_error("Request headers longer than %d bytes", HTTPD_RECV_BUFFER_SIZE);
+    return -WM_E_HTTPD_TOOLONG;
+  }
+  if (head_len < 0)
+    return -WM_E_HTTPD_DATA_RD;
+  
+  memset(&state, 0, sizeof(state));
+  state.req = req;
+  http_parser_init(&parser, HTTP_REQUEST);
+  parser.data = &state;
+  
+  http_parser_execute(&parser, &settings, head, head_len);
+  if (state.err != kNoErr)
+    return state.err;
+  if (HTTP_PARSER_ERRNO(&parser) != HPE_OK) {
+    httpd_set_error("Malformed request: %s",
+                    http_errno_description(HTTP_PARSER_ERRNO(&parser)));
+    return -kInProgressErr;
+  }
+  
+  req->hdr_parsed = 1;
+  return httpd_parse_known_headers(req);
+}
+
+/* Look up a header of the request */
+const char *httpd_get_header(httpd_request_t *req, const char *name, int *value_len)
+{
+  int name_len = strlen(name);
+  int i;
+  
+  for (i = 0; i < req->header_count; i++) {
+    if (httpd_header_is(&req->headers[i], name, name_len)) {
+      if (value_len)
+        *value_len = req->headers[i].value_len;
+      return req->headers[i].value;
+    }
+  }
+  return NULL;
+}
+
 /* Get a pointer to the next token in a request. A token is
 * delimited by whitespace (tab space or newline cr or '\0'. We assume that
 * all databuffers are null terminated
@@ -88,6 +88,34 @@ int httpd_get_tag_from_url(httpd_request_t *req_p,
 			const char *tag, char *val, unsigned val_len);
 
 
+/** @brief Receive and parse the head of the next request on req->sock
+ *
+ *  @note  The request line and all the headers are received into the receive
+ *  buffer of the connection with as few recv() calls as the client allows, and
+ *  parsed into req, including req->headers. The body is left to the handler,
+ *  see \ref httpd_get_data and \ref httpd_read_body.
+ *
+ *  @param[in] req     The request, with req->sock set and the rest zeroed
+ *
+ *  @return WM_SUCCESS     :if successful
+ *  @return HTTPD_DONE     :if the client closed the connection
+ *  @return -WM_E_HTTPD_DATA_RD  :if receiving failed
+ *  @return -WM_E_HTTPD_TOOLONG  :if the head does not fit in HTTPD_RECV_BUFFER_SIZE
+ *  @return -WM_FAIL       :otherwise
+ */
+int httpd_parse_request(httpd_request_t *req);
+
+/** @brief Look up a header of the request by its name, ignoring the case
+ *
+ *  @param[in]  req        The request parsed by \ref httpd_parse_request
+ *  @param[in]  name       The name of the header
+ *  @param[out] value_len  The length of the value, may be NULL
+ *
+ *  @return The value, not NULL terminated and valid while the request is
+ *  handled, or NULL if the header is not present
+ */
+const char *httpd_get_header(httpd_request_t *req, const char *name, int *value_len);
+
 void httpd_parse_useragent(char *hdrline, httpd_useragent_t *agent);
 int httpd_parse_hdr_main(const char *data_p, httpd_request_t *req_p);
 #endif /* __HTTP_PARSE_H__ */
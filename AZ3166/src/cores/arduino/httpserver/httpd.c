@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include "httpd.h"
+#include "httpd_sys.h"
 #include "httpd_wsgi.h"
 #include "http-strings.h"
 #include "mico.h"
@@ -320,6 +321,7 @@ static void httpd_handle_client_connection( const fd_set *active_readfds )
         return;
 
     httpd_d("Client socket accepted: %d", client_sockfd);
+    htsys_recv_reset( client_sockfd );
     FD_ZERO( &readfds );
     FD_SET( client_sockfd, &readfds );
 
@@ -333,7 +335,11 @@ static void httpd_handle_client_connection( const fd_set *active_readfds )
         }
 
         httpd_d("Waiting on client socket");
-        activefds_cnt = httpd_select( client_sockfd, &readfds, NULL, HTTPD_CLIENT_SOCK_TIMEOUT );
+        /* A pipelined request may be in the receive buffer already */
+        if ( htsys_recv_pending( client_sockfd ) )
+            activefds_cnt = 1;
+        else
+            activefds_cnt = httpd_select( client_sockfd, &readfds, NULL, HTTPD_CLIENT_SOCK_TIMEOUT );
 
         if ( httpd_stop_req )
         {
@@ -0,0 +1,387 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. 
+
+#include <string.h>
+
+#include "httpd_form.h"
+#include "httpd_wsgi.h"
+#include "mico.h"
+
+/* Size of the pieces httpd_form_read() reads the body in */
+#define HTTPD_FORM_READ_LENGTH 256
+
+enum {
+	/* multipart/form-data */
+	FORM_PREAMBLE,
+	FORM_DELIMITER,
+	FORM_DELIMITER_LF,
+	FORM_CLOSE_DELIMITER,
+	FORM_PART_HEADERS,
+	FORM_PART_DATA,
+	FORM_EPILOGUE,
+	/* application/x-www-form-urlencoded */
+	FORM_NAME,
+	FORM_VALUE,
+};
+
+static int form_event(httpd_form_t *form, httpd_form_event_t event,
+		      const char *data, int len)
+{
+	if (event == HTTPD_FORM_FIELD_DATA && len == 0)
+		return kNoErr;
+	return form->cb(form->arg, event, form->name, data, len);
+}
+
+int httpd_form_init(httpd_form_t *form, const char *content_type,
+		    httpd_form_cb_t cb, void *arg)
+{
+	const char *boundary;
+	int len;
+
+	memset(form, 0, sizeof(*form));
+	form->cb = cb;
+	form->arg = arg;
+
+	if (content_type == NULL ||
+	    strstr(content_type, "multipart/form-data") == NULL) {
+		form->state = FORM_NAME;
+		return kNoErr;
+	}
+
+	boundary = strstr(content_type, "boundary=");
+	if (boundary == NULL) {
+		httpd_d("No boundary in %s", content_type);
+		return -kInProgressErr;
+	}
+	boundary += 9;
+	if (*boundary == '"') {
+		boundary++;
+		len = strcspn(boundary, "\"");
+	} else {
+		len = strcspn(boundary, "; \t\r\n");
+	}
+	if (len == 0 || len > HTTPD_FORM_MAX_BOUNDARY_LENGTH) {
+		httpd_d("Invalid boundary in %s", content_type);
+		return -kInProgressErr;
+	}
+
+	form->multipart = 1;
+	memcpy(form->delimiter, "\r\n--", 4);
+	memcpy(&form->delimiter[4], boundary, len);
+	form->delimiter_len = 4 + len;
+	/* The body starts right with the first delimiter, without its CR LF */
+	form->state = FORM_PREAMBLE;
+	form->match = 2;
+	return kNoErr;
+}
+
+/* Take the field name from a Content-Disposition header line */
+static void form_parse_disposition(httpd_form_t *form, const char *line)
+{
+	const char *p = line;
+	char quote = 0;
+
+	/* "name=", but not the end of "filename=" */
+	while ((p = strstr(p, "name=")) != NULL) {
+		if (p[-1] == ';' || p[-1] == ' ' || p[-1] == '\t')
+			break;
+		p += 5;
+	}
+	if (p == NULL)
+		return;
+
+	p += 5;
+	if (*p == '"')
+		quote = *p++;
+	form->name_len = 0;
+	while (*p && form->name_len < HTTPD_FORM_MAX_NAME_LENGTH) {
+		if (quote ? *p == quote : (*p == ';' || *p == ' '))
+			break;
+		form->name[form->name_len++] = *p++;
+	}
+	form->name[form->name_len] = 0;
+}
+
+static int form_feed_multipart(httpd_form_t *form, const char *p, const char *end)
+{
+	const char *run;
+	const char *cr;
+	int err;
+	char c;
+
+	while (p < end) {
+		switch (form->state) {
+		case FORM_PREAMBLE:
+		case FORM_PART_DATA:
+			/* Everything up to the next delimiter is data. The
+			 * bytes matching the start of the delimiter are held
+			 * back, they are handed out of form->delimiter if the
+			 * delimiter turns out to be data. */
+			run = p;
+			while (p < end) {
+				if (form->match == 0) {
+					cr = memchr(p, ISO_cr, end - p);
+					if (cr == NULL) {
+						p = end;
+						break;
+					}
+					p = cr;
+				}
+				if (*p == form->delimiter[form->match]) {
+					if (form->state == FORM_PART_DATA && form->match == 0) {
+						err = form_event(form, HTTPD_FORM_FIELD_DATA, run, p - run);
+						if (err != kNoErr)
+							return err;
+					}
+					p++;
+					run = p;
+					if (++form->match == form->delimiter_len)
+						break;
+				} else {
+					if (form->state == FORM_PART_DATA) {
+						err = form_event(form, HTTPD_FORM_FIELD_DATA,
+								 form->delimiter, form->match);
+						if (err != kNoErr)
+							return err;
+					}
+					form->match = 0;
+					run = p;
+					/* A CR may start the delimiter again */
+					if (*p != ISO_cr)
+						p++;
+				}
+			}
+
+			if (form->match == form->delimiter_len) {
+				if (form->state == FORM_PART_DATA) {
+					err = form_event(form, HTTPD_FORM_FIELD_END, NULL, 0);
+					if (err != kNoErr)
+						return err;
+				}
+				form->match = 0;
+				form->state = FORM_DELIMITER;
+			} else if (form->state == FORM_PART_DATA) {
+				err = form_event(form, HTTPD_FORM_FIELD_DATA, run, p - run);
+				if (err != kNoErr)
+					return err;
+			}
+			break;
+
+		case FORM_DELIMITER:
+			c = *p++;
+			if (c == '-')
+				form->state = FORM_CLOSE_DELIMITER;
+			else if (c == ISO_cr)
+				form->state = FORM_DELIMITER_LF;
+			else if (c != ISO_space && c != ISO_tab) {
+				httpd_d("Malformed delimiter");
+				return -kInProgressErr;
+			}
+			break;
+
+		case FORM_CLOSE_DELIMITER:
+			if (*p++ != '-') {
+				httpd_d("Malformed close delimiter");
+				return -kInProgressErr;
+			}
+			form->state = FORM_EPILOGUE;
+			break;
+
+		case FORM_DELIMITER_LF:
+			if (*p++ != ISO_nl) {
+				httpd_d("Malformed delimiter");
+				return -kInProgressErr;
+			}
+			form->name[0] = 0;
+			form->name_len = 0;
+			form->line_len = 0;
+			form->state = FORM_PART_HEADERS;
+			break;
+
+		case FORM_PART_HEADERS:
+			c = *p++;
+			if (c != ISO_nl) {
+				/* The rest of a long line is cut */
+				if (form->line_len < HTTPD_FORM_MAX_LINE_LENGTH)
+					form->line[form->line_len++] = c;
+				break;
+			}
+			if (form->line_len > 0 && form->line[form->line_len - 1] == ISO_cr)
+				form->line_len--;
+			form->line[form->line_len] = 0;
+			if (form->line_len == 0) {
+				/* The empty line ends the headers of the part */
+				form->state = FORM_PART_DATA;
+				err = form_event(form, HTTPD_FORM_FIELD_START, NULL, 0);
+				if (err != kNoErr)
+					return err;
+			} else if (strncasecmp(form->line, "Content-Disposition:", 20) == 0) {
+				form_parse_disposition(form, &form->line[20]);
+			}
+			form->line_len = 0;
+			break;
+
+		case FORM_EPILOGUE:
+		default:
+			p = end;
+			break;
+		}
+	}
+	return kNoErr;
+}
+
+static int form_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+static int form_flush(httpd_form_t *form)
+{
+	int len = form->data_len;
+
+	form->data_len = 0;
+	return form_event(form, HTTPD_FORM_FIELD_DATA, form->data, len);
+}
+
+static int form_put(httpd_form_t *form, char c)
+{
+	if (form->state == FORM_NAME) {
+		/* Long names are cut */
+		if (form->name_len < HTTPD_FORM_MAX_NAME_LENGTH) {
+			form->name[form->name_len++] = c;
+			form->name[form->name_len] = 0;
+		}
+		return kNoErr;
+	}
+
+	form->data[form->data_len++] = c;
+	if (form->data_len == HTTPD_FORM_DATA_LENGTH)
+		return form_flush(form);
+	return kNoErr;
+}
+
+static int form_end_field(httpd_form_t *form)
+{
+	int err = kNoErr;
+
+	if (form->state == FORM_VALUE) {
+		err = form_flush(form);
+		if (err == kNoErr)
+			err = form_event(form, HTTPD_FORM_FIELD_END, NULL, 0);
+	} else if (form->name_len > 0) {
+		/* A field without '=' has an empty value */
+		err = form_event(form, HTTPD_FORM_FIELD_START, NULL, 0);
+		if (err == kNoErr)
+			err = form_event(form, HTTPD_FORM_FIELD_END, NULL, 0);
+	}
+
+	form->state = FORM_NAME;
+	form->name[0] = 0;
+	form->name_len = 0;
+	return err;
+}
+
+static int form_feed_urlencoded(httpd_form_t *form, const char *p, const char *end)
+{
+	int err = kNoErr;
+	int hex;
+	char c;
+
+	for (; p < end && err == kNoErr; p++) {
+		c = *p;
+		if (form->state == FORM_VALUE && form->escape == 0) {
+			/* Copy plain characters in runs */
+			const char *run = p;
+			int n;
+
+			while (p < end && *p != ISO_percent && *p != '&' && *p != '+')
+				p++;
+			while (run < p && err == kNoErr) {
+				n = HTTPD_FORM_DATA_LENGTH - form->data_len;
+				if (n > p - run)
+					n = p - run;
+				memcpy(&form->data[form->data_len], run, n);
+				form->data_len += n;
+				run += n;
+				if (form->data_len == HTTPD_FORM_DATA_LENGTH)
+					err = form_flush(form);
+			}
+			if (p == end || err != kNoErr)
+				break;
+			c = *p;
+		}
+		if (form->escape > 0) {
+			hex = form_hex(c);
+			if (hex < 0) {
+				httpd_d("Invalid URL-encoded string");
+				return -kInProgressErr;
+			}
+			form->escape_value = (form->escape_value << 4) | hex;
+			if (--form->escape == 0)
+				err = form_put(form, (char)form->escape_value);
+		} else if (c == ISO_percent) {
+			form->escape = 2;
+			form->escape_value = 0;
+		} else if (c == '&') {
+			err = form_end_field(form);
+		} else if (c == '=' && form->state == FORM_NAME) {
+			form->state = FORM_VALUE;
+			err = form_event(form, HTTPD_FORM_FIELD_START, NULL, 0);
+		} else if (c == '+') {
+			err = form_put(form, ' ');
+		} else {
+			err = form_put(form, c);
+		}
+	}
+	return err;
+}
+
+int httpd_form_feed(httpd_form_t *form, const char *data, int len)
+{
+	if (form->multipart)
+		return form_feed_multipart(form, data, data + len);
+	return form_feed_urlencoded(form, data, data + len);
+}
+
+int httpd_form_finish(httpd_form_t *form)
+{
+	if (form->multipart) {
+		if (form->state != FORM_EPILOGUE) {
+			httpd_d("Incomplete multipart body");
+			return -kInProgressErr;
+		}
+		return kNoErr;
+	}
+
+	if (form->escape > 0) {
+		httpd_d("Incomplete URL-encoded string");
+		return -kInProgressErr;
+	}
+	return form_end_field(form);
+}
+
+int httpd_form_read(httpd_request_t *req, httpd_form_cb_t cb, void *arg)
+{
+	httpd_form_t form;
+	char buf[HTTPD_FORM_READ_LENGTH];
+	int err, len;
+
+	err = httpd_form_init(&form, req->content_type, cb, arg);
+	if (err != kNoErr)
+		return err;
+
+	while ((len = httpd_read_body(req, buf, sizeof(buf))) > 0) {
+		err = httpd_form_feed(&form, buf, len);
+		if (err != kNoErr)
+			return err;
+	}
+	if (len < 0)
+		return len;
+	return httpd_form_finish(&form);
+}
@@ -0,0 +1,117 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. 
+
+#ifndef _HTTPD_FORM_H_
+#define _HTTPD_FORM_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "httpd_utility.h"
+
+/** Longest field name kept, longer names are cut */
+#define HTTPD_FORM_MAX_NAME_LENGTH 32
+
+/** Longest boundary of multipart/form-data, as allowed by RFC 2046 */
+#define HTTPD_FORM_MAX_BOUNDARY_LENGTH 70
+
+/** Longest header line of a multipart/form-data part, longer lines are cut */
+#define HTTPD_FORM_MAX_LINE_LENGTH 128
+
+/** Size of the buffer the decoded bytes of a urlencoded value are collected in */
+#define HTTPD_FORM_DATA_LENGTH 128
+
+typedef enum {
+	/** A field starts, data is NULL */
+	HTTPD_FORM_FIELD_START,
+	/** The next piece of the value of the field */
+	HTTPD_FORM_FIELD_DATA,
+	/** The field is complete, data is NULL */
+	HTTPD_FORM_FIELD_END,
+} httpd_form_event_t;
+
+/** Receives the fields of a form as they are decoded
+ *
+ *  @param[in] arg    The argument given to \ref httpd_form_init
+ *  @param[in] event  What happened
+ *  @param[in] name   The name of the field, NULL terminated
+ *  @param[in] data   The piece of the value for HTTPD_FORM_FIELD_DATA, only
+ *  valid during the call
+ *  @param[in] len    The length of data
+ *
+ *  @return WM_SUCCESS to go on, any other value stops the decoding and is
+ *  returned by \ref httpd_form_feed
+ */
+typedef int (*httpd_form_cb_t)(void *arg, httpd_form_event_t event,
+			       const char *name, const char *data, int len);
+
+/** State of the decoder, the memory it needs is all in here */
+typedef struct {
+	int multipart;
+	int state;
+	httpd_form_cb_t cb;
+	void *arg;
+	char name[HTTPD_FORM_MAX_NAME_LENGTH + 1];
+	int name_len;
+	/* multipart/form-data: "\r\n--" boundary, and how much of it matched */
+	char delimiter[4 + HTTPD_FORM_MAX_BOUNDARY_LENGTH + 1];
+	int delimiter_len;
+	int match;
+	char line[HTTPD_FORM_MAX_LINE_LENGTH + 1];
+	int line_len;
+	/* application/x-www-form-urlencoded: the %XX being decoded */
+	int escape;
+	int escape_value;
+	char data[HTTPD_FORM_DATA_LENGTH];
+	int data_len;
+} httpd_form_t;
+
+/** @brief Start decoding a form body
+ *
+ *  @param[out] form          The decoder
+ *  @param[in] content_type   The Content-Type of the request, multipart/form-data
+ *  with its boundary, otherwise application/x-www-form-urlencoded is assumed
+ *  @param[in] cb             Receives the fields
+ *  @param[in] arg            Passed to cb
+ *
+ *  @return WM_SUCCESS     :if successful
+ *  @return -WM_FAIL       :if the boundary of multipart/form-data is missing
+ */
+int httpd_form_init(httpd_form_t *form, const char *content_type,
+		    httpd_form_cb_t cb, void *arg);
+
+/** @brief Decode the next piece of the body, split anywhere
+ *
+ *  @return WM_SUCCESS     :if successful
+ *  @return -WM_FAIL       :if the body is malformed
+ *  @return The value returned by the callback if it stopped the decoding
+ */
+int httpd_form_feed(httpd_form_t *form, const char *data, int len);
+
+/** @brief End decoding after the last piece of the body
+ *
+ *  @return WM_SUCCESS     :if successful
+ *  @return -WM_FAIL       :if the body is incomplete
+ *  @return The value returned by the callback if it failed
+ */
+int httpd_form_finish(httpd_form_t *form);
+
+/** @brief Read the body of a POST request and decode it as a form
+ *
+ *  @note  The body is read piece by piece with \ref httpd_read_body and each
+ *  field is handed to cb as it arrives, so the body is never held in memory
+ *  as a whole.
+ *
+ *  @return WM_SUCCESS     :if successful
+ *  @return -WM_FAIL       :otherwise
+ *  @return The value returned by the callback if it stopped the decoding
+ */
+int httpd_form_read(httpd_request_t *req, httpd_form_cb_t cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
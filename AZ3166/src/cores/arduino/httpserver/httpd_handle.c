@@ -279,9 +279,8 @@ int httpd_send_error(int conn, int http_error)
 
 
 /*
- * @pre Only first line of HTTP header (which has the resource name) has
- * been read from the socket. We need to read the remaining header and the
- * data after that.
+ * @pre The head of the request has been read from the socket. We need to
+ * read the data after that.
  */
 void httpd_purge_socket_data(httpd_request_t *req, char *msg_in,
 			     int msg_in_len, int conn)
@@ -293,19 +292,20 @@ void httpd_purge_socket_data(httpd_request_t *req, char *msg_in,
 		return;
 	}
 
-	int data_remaining = req->body_nbytes;
+	int data_remaining = req->remaining_bytes;
 
 	while (data_remaining) {
 		int to_read = msg_in_len >= data_remaining ?
 			data_remaining : msg_in_len;
-		int actually_read = httpd_recv(conn, msg_in, to_read, 0);
-		if (actually_read < 0) {
+		int actually_read = htsys_recv(conn, msg_in, to_read);
+		if (actually_read <= 0) {
 			httpd_d("Unable to read content."
 				"Was purging socket data");
 			return;
 		}
 		data_remaining -= actually_read;
 	}
+	req->remaining_bytes = 0;
 }
 
 /* Handle an incoming message (request) from the client. This is the
@@ -314,7 +314,6 @@ void httpd_purge_socket_data(httpd_request_t *req, char *msg_in,
 int httpd_handle_message(int conn)
 {
 	int err;
-	int req_line_len;
 	char msg_in[128];
 
 	/* clear out the httpd_req structure */
@@ -322,33 +321,32 @@ int httpd_handle_message(int conn)
 
 	httpd_req.sock = conn;
 
-	/* Read the first line of the HTTP header */
-	req_line_len = htsys_getln_soc(conn, msg_in, sizeof(msg_in));
-	if (req_line_len == 0)
+	/* Read and parse the request line and the headers */
+	err = httpd_parse_request(&httpd_req);
+	if (err == HTTPD_DONE)
 		return HTTPD_DONE;
-
-	if (req_line_len < 0) {
+	else if (err == -WM_E_HTTPD_DATA_RD) {
 		httpd_d("Could not read from socket");
 		return -kInProgressErr;
-	}
-
-	/* Parse the first line of the header */
-	err = httpd_parse_hdr_main(msg_in, &httpd_req);
-	if (err == -WM_E_HTTPD_NOTSUPP)
-		/* Send 505 HTTP Version not supported */
-		return httpd_send_error(conn, HTTP_505);
-	else if (err != kNoErr) {
-		/* Send 500 Internal Server Error */
-		return httpd_send_error(conn, HTTP_500);
+	} else if (err != kNoErr) {
+		if (err == -WM_E_HTTPD_NOTSUPP)
+			/* Send 505 HTTP Version not supported */
+			err = httpd_send_error(conn, HTTP_505);
+		else
+			/* Send 500 Internal Server Error */
+			err = httpd_send_error(conn, HTTP_500);
+		/* Where the next request starts is unknown, close the
+		 * connection */
+		return err == kNoErr ? HTTPD_DONE : err;
 	}
 
 	/* set a generic error that can be overridden by the wsgi handling. */
 	httpd_d("Presetting");
 
 	/* Web Services Gateway Interface branch point:
-	 * At this point we have the request type (httpd_req.type) and the path
-	 * (httpd_req.filename) and all the headers waiting to be read from
-	 * the socket.
+	 * At this point we have the request type (httpd_req.type), the path
+	 * (httpd_req.filename) and all the headers, the body is waiting to be
+	 * read from the socket.
 	 *
 	 * The call bellow will iterate through all the url patterns and
 	 * invoke the handlers that match the request type and pattern.  If
@@ -358,6 +356,10 @@ int httpd_handle_message(int conn)
 
 	if (err == HTTPD_DONE) {
 		httpd_d("Done processing request.");
+		/* Skip the body the handler left, the next request follows it */
+		if (httpd_req.remaining_bytes > 0)
+			httpd_purge_socket_data(&httpd_req, msg_in,
+					sizeof(msg_in), conn);
 		return kNoErr;
 	} else if (err == -WM_E_HTTPD_NO_HANDLER) {
 		httpd_d("No handler for the given URL %s was found",
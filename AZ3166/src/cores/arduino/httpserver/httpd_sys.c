@@ -30,48 +30,207 @@
  ******************************************************************************
  */
 
+#include <string.h>
+
 #include "httpd.h"
 #include "http-strings.h"
 #include "mico.h"
 
-int htsys_getln_soc(int sd, char *data_p, int buflen)
+/* The server handles one client connection at a time */
+static struct {
+	int sock;
+	/* Length of the head of the current request, 0 until it is received */
+	int head_len;
+	/* The unread bytes are data[start, end) */
+	int start;
+	int end;
+	char data[HTTPD_RECV_BUFFER_SIZE];
+} htsys_conn = { -1, 0, 0, 0 };
+
+static htsys_recv_fn_t htsys_recv_fn = httpd_recv;
+
+void htsys_set_recv(htsys_recv_fn_t recv_fn)
+{
+	htsys_recv_fn = recv_fn ? recv_fn : httpd_recv;
+}
+
+void htsys_recv_reset(int sd)
+{
+	htsys_conn.sock = sd;
+	htsys_conn.head_len = 0;
+	htsys_conn.start = 0;
+	htsys_conn.end = 0;
+}
+
+static int htsys_fill(int sd)
 {
-	int len = 0;
-	char *c_p;
 	int result;
 
-//	ASSERT(data_p != NULL);
-	c_p = data_p;
+	if (htsys_conn.sock != sd)
+		htsys_recv_reset(sd);
+
+	if (htsys_conn.end == sizeof(htsys_conn.data))
+		return kNoSpaceErr;
+
+	result = htsys_recv_fn(sd, &htsys_conn.data[htsys_conn.end],
+			    sizeof(htsys_conn.data) - htsys_conn.end, 0);
+	if (result > 0)
+		htsys_conn.end += result;
+	return result;
+}
+
+/* Reuse the space of the bytes already read after the head */
+static void htsys_compact(void)
+{
+	if (htsys_conn.start == htsys_conn.end)
+		htsys_conn.start = htsys_conn.end = htsys_conn.head_len;
+}
+
+/* Find the empty line ending the head in data[0, end), searching from *from.
+ * Lines may end with LF only. */
+static int htsys_find_head_end(int *from)
+{
+	int i;
+
+	for (i = *from; i < htsys_conn.end; i++) {
+		if (htsys_conn.data[i] != ISO_nl)
+			continue;
+		if (i + 1 < htsys_conn.end && htsys_conn.data[i + 1] == ISO_nl)
+			return i + 2;
+		if (i + 2 < htsys_conn.end && htsys_conn.data[i + 1] == ISO_cr &&
+		    htsys_conn.data[i + 2] == ISO_nl)
+			return i + 3;
+		if (i + 2 >= htsys_conn.end) {
+			/* The rest of this line ending is not received yet */
+			*from = i;
+			return 0;
+		}
+	}
+	*from = i;
+	return 0;
+}
+
+int htsys_recv_head(int sd, const char **head)
+{
+	int result, head_end, from = 0;
+
+	if (htsys_conn.sock != sd)
+		htsys_recv_reset(sd);
+
+	/* Drop the head of the previous request, keep what follows it */
+	if (htsys_conn.start > 0) {
+		memmove(htsys_conn.data, &htsys_conn.data[htsys_conn.start],
+			htsys_conn.end - htsys_conn.start);
+		htsys_conn.end -= htsys_conn.start;
+		htsys_conn.start = 0;
+	}
+	htsys_conn.head_len = 0;
+
+	while (1) {
+		/* Empty lines before the request line are ignored */
+		while (htsys_conn.end > 0 && (htsys_conn.data[0] == ISO_cr ||
+					      htsys_conn.data[0] == ISO_nl)) {
+			memmove(htsys_conn.data, &htsys_conn.data[1], --htsys_conn.end);
+			from = 0;
+		}
 
-	/* Read one byte at a time */
-	while ((result = httpd_recv(sd, c_p, 1, 0)) != 0) {
-		/* error on recv */
-		if (result == -1) {
-			*c_p = 0;
-			httpd_d("recv failed len: %d", len);
+		head_end = htsys_find_head_end(&from);
+		if (head_end > 0)
+			break;
+
+		result = htsys_fill(sd);
+		if (result == kNoSpaceErr) {
+			httpd_d("Request head longer than %d bytes", HTTPD_RECV_BUFFER_SIZE);
+			return kNoSpaceErr;
+		}
+		if (result == 0 && htsys_conn.end == 0)
+			return 0;
+		if (result <= 0) {
+			httpd_d("recv failed: %d", result);
 			return -kInProgressErr;
 		}
+	}
+
+	htsys_conn.head_len = head_end;
+	htsys_conn.start = head_end;
+	*head = htsys_conn.data;
+	return head_end;
+}
+
+int htsys_head_received(int sd)
+{
+	return htsys_conn.sock == sd && htsys_conn.head_len > 0;
+}
+
+int htsys_recv_pending(int sd)
+{
+	return htsys_conn.sock == sd && htsys_conn.end > htsys_conn.start;
+}
+
+int htsys_recv(int sd, void *buf, int n)
+{
+	int buffered;
+
+	if (htsys_conn.sock != sd)
+		htsys_recv_reset(sd);
 
-		/* If new line... */
-		if ((*c_p == ISO_nl) || (*c_p == ISO_cr)) {
-			result = httpd_recv(sd, c_p, 1, 0);
-			if ((*c_p != ISO_nl) && (*c_p != ISO_cr)) {
-				httpd_d("should get double CR LF: %d, %d",
-				      (int)*c_p, result);
+	buffered = htsys_conn.end - htsys_conn.start;
+	if (buffered == 0) {
+		htsys_compact();
+		/* Large reads go straight to the caller */
+		if (n >= (int)sizeof(htsys_conn.data) / 2)
+			return htsys_recv_fn(sd, buf, n, 0);
+		buffered = htsys_fill(sd);
+		if (buffered == kNoSpaceErr)
+			return htsys_recv_fn(sd, buf, n, 0);
+		if (buffered <= 0)
+			return buffered;
+	}
+
+	if (n > buffered)
+		n = buffered;
+	memcpy(buf, &htsys_conn.data[htsys_conn.start], n);
+	htsys_conn.start += n;
+	return n;
+}
+
+int htsys_getln_soc(int sd, char *data_p, int buflen)
+{
+	int len = 0;
+	int result;
+	char c;
+
+	if (htsys_conn.sock != sd)
+		htsys_recv_reset(sd);
+
+	while (1) {
+		if (htsys_conn.start == htsys_conn.end) {
+			htsys_compact();
+			result = htsys_fill(sd);
+			if (result == kNoSpaceErr) {
+				httpd_d("buf full: recv didn't read complete line.");
+				break;
+			}
+			if (result == 0)
+				break;
+			if (result < 0) {
+				*data_p = 0;
+				httpd_d("recv failed len: %d", len);
+				return -kInProgressErr;
 			}
-			break;
 		}
-		len++;
-		c_p++;
 
-		/* give up here since we'll at least need 3 more chars to
-		 * finish off the line */
-		if (len >= buflen - 1) {
-			httpd_d("buf full: recv didn't read complete line.");
+		c = htsys_conn.data[htsys_conn.start++];
+		if (c == ISO_cr)
+			continue;
+		if (c == ISO_nl)
 			break;
-		}
+
+		/* The rest of a line longer than the buffer is dropped */
+		if (len < buflen - 1)
+			data_p[len++] = c;
 	}
 
-	*c_p = 0;
+	data_p[len] = 0;
 	return len;
 }
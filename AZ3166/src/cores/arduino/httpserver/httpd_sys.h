@@ -40,6 +40,48 @@ extern "C"
 
 #include "httpd_utility.h"
 
+/*
+ * The client connection is read through a receive buffer filled by bulk
+ * recv() calls. The head of a request (request line and headers) stays in the
+ * buffer while the request is handled, so that the header values can point
+ * into it. The bytes after the head are handed out by htsys_recv().
+ */
+
+typedef int (*htsys_recv_fn_t)(int sd, void *buf, size_t n, int flags);
+
+/** Set the function filling the receive buffer, NULL restores httpd_recv().
+ *  The unit tests feed scripted recv() results through it. */
+void htsys_set_recv(htsys_recv_fn_t recv_fn);
+
+/** Drop the buffered data, called for every new client connection */
+void htsys_recv_reset(int sd);
+
+/** Receive until the head of the next request is complete
+ *
+ *  @param[in]  sd    The client socket
+ *  @param[out] head  The head in the receive buffer, valid until the next call
+ *
+ *  @return The length of the head, 0 if the client closed the connection
+ *  before sending anything, -kInProgressErr on a receive error and
+ *  kNoSpaceErr if the head does not fit in HTTPD_RECV_BUFFER_SIZE
+ */
+int htsys_recv_head(int sd, const char **head);
+
+/** Check whether the head of the current request has been received */
+int htsys_head_received(int sd);
+
+/** Check whether received data is waiting in the buffer, e.g. a pipelined
+ *  request, so that select() would not report it */
+int htsys_recv_pending(int sd);
+
+/** Receive up to n bytes after the head, the buffered ones first
+ *
+ *  @return The number of bytes received, 0 if the connection was closed and
+ *  -1 on error, like recv()
+ */
+int htsys_recv(int sd, void *buf, int n);
+
+/** Receive a line terminated by CR LF, without the terminator */
 int htsys_getln_soc(int sd, char *data_p, int buflen);
 
 #ifdef __cplusplus
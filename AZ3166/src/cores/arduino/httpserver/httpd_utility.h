@@ -124,6 +124,21 @@ enum wm_httpd_errno {
  */
 #define HTTPD_MAX_MESSAGE 512
 
+/** Size of the receive buffer of the client connection
+ *
+ * The request line and all the headers of a request must fit in it, otherwise
+ * a 500 Internal Server Error response is generated. The headers are kept in
+ * it while the request is handled, see \ref httpd_get_header. The body is read
+ * through it.
+ */
+#define HTTPD_RECV_BUFFER_SIZE 1536
+
+/** Maximum number of headers of a request kept for \ref httpd_get_header
+ *
+ * Further headers are still parsed, but can not be looked up.
+ */
+#define HTTPD_MAX_HEADERS 24
+
 /** Maximum URI length
  *
  * This is the maximum supported URI length.  For example, if a client sends a
@@ -233,6 +248,16 @@ typedef struct  {
 	char version[HTTPD_MAX_VAL_LENGTH + 1];	/* +1 for null termination */
 } httpd_useragent_t;
 
+/** A header of the incoming HTTP request. The name and the value point into
+ * the receive buffer and are not NULL terminated.
+ */
+typedef struct {
+	const char *name;
+	int name_len;
+	const char *value;
+	int value_len;
+} httpd_header_t;
+
 struct httpd_wsgi_call;
 
 /** Request structure representing various properties of an HTTP request
@@ -264,6 +289,10 @@ typedef struct {
 	bool if_none_match;
 	/** Used for storing the etag of an URI */
 	unsigned etag_val;
+	/** The headers of the incoming HTTP Request */
+	httpd_header_t headers[HTTPD_MAX_HEADERS];
+	/** The number of the headers */
+	int header_count;
 } httpd_request_t;
 
 
@@ -38,6 +38,7 @@
 #include "httpd_handle.h"
 #include "http_parse.h"
 #include "http-strings.h"
+#include "httpd_sys.h"
 #include "mico.h"
 
 static struct httpd_wsgi_call *all_wsgi_calls[MAX_WSGI_HANDLERS];
@@ -144,7 +145,12 @@ int httpd_purge_headers(int sock)
 {
 	unsigned char ch;
 	httpd_purge_state_t purge_state = ANY_OTHER_CHAR;
-	while (httpd_recv(sock, &ch, 1, 0) != 0) {
+
+	/* httpd_parse_request() has read them already */
+	if (htsys_head_received(sock))
+		return kNoErr;
+
+	while (htsys_recv(sock, &ch, 1) > 0) {
 		switch (ch) {
 		case '\r':
 			if (purge_state == ANY_OTHER_CHAR)
@@ -494,49 +500,54 @@ int httpd_send_response(httpd_request_t *req, const char *first_line,
 	}
 	return ret;
 }
-int httpd_get_data(httpd_request_t *req, char *content, int length)
+int httpd_read_body(httpd_request_t *req, char *content, int length)
 {
 	int ret;
-	char *buf;
 
-	/* Is this condition required? */
-	if (req->body_nbytes >= HTTPD_MAX_MESSAGE - 2)
+	if (length > req->remaining_bytes)
+		length = req->remaining_bytes;
+	if (length <= 0)
+		return 0;
+
+	ret = htsys_recv(req->sock, content, length);
+	if (ret <= 0) {
+		httpd_d("Failed to read POST data");
 		return -kInProgressErr;
+	}
+	req->remaining_bytes -= ret;
+	return ret;
+}
 
+int httpd_get_data(httpd_request_t *req, char *content, int length)
+{
+	int ret;
+	int received = 0;
 
-	buf = malloc(HTTPD_MAX_MESSAGE);
-	if (!buf) {
-		httpd_d("Failed to allocate memory for buffer");
+	/* Is this condition required? */
+	if (req->body_nbytes >= HTTPD_MAX_MESSAGE - 2)
 		return -kInProgressErr;
-	}
 
 	if (!req->hdr_parsed) {
-		ret = httpd_parse_hdr_tags(req, req->sock, buf,
-			HTTPD_MAX_MESSAGE);
-
+		ret = httpd_parse_hdr_tags(req, req->sock, content, length);
 		if (ret != kNoErr) {
 			httpd_d("Unable to parse header tags");
-			goto out;
-		} else {
-			httpd_d("Headers parsed successfully\r\n");
-			req->hdr_parsed = 1;
+			return -kInProgressErr;
 		}
+		httpd_d("Headers parsed successfully\r\n");
+		req->hdr_parsed = 1;
 	}
 
-	/* handle here */
-	ret = httpd_recv(req->sock, content,
-			length, 0);
-	if (ret == -1) {
-		httpd_d("Failed to read POST data");
-		goto out;
+	/* The body may come in several segments */
+	while (received < length && req->remaining_bytes > 0) {
+		ret = httpd_read_body(req, content + received, length - received);
+		if (ret < 0)
+			return ret;
+		received += ret;
 	}
 	/* scratch will now have the JSON data */
-	content[ret] = '\0';
-	req->remaining_bytes -= ret;
+	content[received] = '\0';
 	httpd_d("Read %d bytes and remaining %d bytes",
-		ret, req->remaining_bytes);
-out:
-	free(buf);
+		received, req->remaining_bytes);
 	return req->remaining_bytes;
 }
 
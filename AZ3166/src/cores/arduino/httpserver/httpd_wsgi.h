@@ -150,6 +150,22 @@ int httpd_purge_headers(int sock);
  */
 int httpd_get_data(httpd_request_t *req, char *content, int length);
 
+/** @brief Read the next piece of the body of an HTTP POST or PUT request
+ *
+ *  @note  The body is handed out as it arrives, so that a handler can process
+ *  a body larger than any of its buffers piece by piece. The headers have been
+ *  parsed before the handler is called, req->body_nbytes and
+ *  req->remaining_bytes tell the size of the body. Bodies sent with
+ *  Transfer-Encoding: chunked are not supported.
+ *
+ *  @param[in] req      The incoming HTTP request \ref httpd_request_t
+ *  @param[out] content The buffer in which the data is to be received
+ *  @param[in] length   The length of the content buffer
+ *  @return  The number of bytes received, 0 at the end of the body
+ *  @return  -WM_FAIL   :otherwise
+ */
+int httpd_read_body(httpd_request_t *req, char *content, int length);
+
 /* Initialise the WSGI handler data structures */
 int httpd_wsgi_init(void);
 
@@ -0,0 +1,165 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#include "Arduino.h"
+#include "SystemBoot.h"
+#include "SystemTickCounter.h"
+
+#define BOOT_STACK_SIZE     0x1000
+#define BOOT_TASK_MAX       8
+#define BOOT_FLAG_COUNT     5
+#define BOOT_POLL_MS        10
+
+typedef struct
+{
+    void (*task)(void);
+    int depends;
+    int provides;
+} BOOT_TASK;
+
+static BOOT_TASK bootTasks[BOOT_TASK_MAX];
+static int bootTaskCount = 0;
+
+static volatile int readyFlags = 0;
+static int readyElapsed[BOOT_FLAG_COUNT] = { -1, -1, -1, -1, -1 };
+
+static Mutex bootMutex;
+static Semaphore bootSignal(0);
+static Thread *bootThread = NULL;
+
+static void boot_worker(void)
+{
+    while (true)
+    {
+        BOOT_TASK task = { NULL, 0, 0 };
+
+        // Pick the first task which has all its dependencies ready, keep the order of the others
+        bootMutex.lock();
+        for (int i = 0; i < bootTaskCount; i++)
+        {
+            if ((bootTasks[i].depends & readyFlags) == bootTasks[i].depends)
+            {
+                task = bootTasks[i];
+                memmove(&bootTasks[i], &bootTasks[i + 1], (bootTaskCount - i - 1) * sizeof(BOOT_TASK));
+                bootTaskCount--;
+                break;
+            }
+        }
+        bootMutex.unlock();
+
+        if (task.task != NULL)
+        {
+            task.task();
+            SystemSetReady(task.provides);
+        }
+        else
+        {
+            // Nothing can run yet, wait for a new task or a readiness change
+            bootSignal.wait();
+        }
+    }
+}
+
+int SystemBootSchedule(void (*task)(void), int depends, int provides)
+{
+    if (task == NULL)
+    {
+        return -1;
+    }
+
+    bootMutex.lock();
+    if (bootTaskCount >= BOOT_TASK_MAX)
+    {
+        bootMutex.unlock();
+        return -1;
+    }
+    if (bootThread == NULL)
+    {
+        bootThread = new Thread(osPriorityNormal, BOOT_STACK_SIZE, NULL);
+        if (bootThread == NULL)
+        {
+            bootMutex.unlock();
+            return -1;
+        }
+        bootThread->start(boot_worker);
+    }
+    bootTasks[bootTaskCount].task = task;
+    bootTasks[bootTaskCount].depends = depends;
+    bootTasks[bootTaskCount].provides = provides;
+    bootTaskCount++;
+    bootMutex.unlock();
+
+    bootSignal.release();
+    return 0;
+}
+
+void SystemSetReady(int flags)
+{
+    if (flags == 0)
+    {
+        return;
+    }
+
+    int elapsed = (int)SystemTickCounterRead();
+
+    bootMutex.lock();
+    for (int i = 0; i < BOOT_FLAG_COUNT; i++)
+    {
+        if ((flags & (1 << i)) && readyElapsed[i] < 0)
+        {
+            readyElapsed[i] = elapsed;
+        }
+    }
+    readyFlags |= flags;
+    bootMutex.unlock();
+
+    bootSignal.release();
+}
+
+void SystemClearReady(int flags)
+{
+    bootMutex.lock();
+    readyFlags &= ~flags;
+    bootMutex.unlock();
+}
+
+int SystemIsReady(int flags)
+{
+    return ((readyFlags & flags) == flags ? 1 : 0);
+}
+
+int SystemWaitReady(int flags, int timeout)
+{
+    uint64_t start_ms = SystemTickCounterRead();
+    while (!SystemIsReady(flags))
+    {
+        if (timeout >= 0 && (int)(SystemTickCounterRead() - start_ms) >= timeout)
+        {
+            return -1;
+        }
+        wait_ms(BOOT_POLL_MS);
+    }
+    return 0;
+}
+
+int SystemBootElapsed(int flag)
+{
+    for (int i = 0; i < BOOT_FLAG_COUNT; i++)
+    {
+        if (flag == (1 << i))
+        {
+            return readyElapsed[i];
+        }
+    }
+    return -1;
+}
+
+void SystemBootReport(void)
+{
+    Serial.printf("Boot timings (ms): setup %d, sensors %d, Wi-Fi %d, time %d, telemetry %d\r\n",
+        SystemBootElapsed(BOOT_READY_SETUP),
+        SystemBootElapsed(BOOT_READY_SENSORS),
+        SystemBootElapsed(BOOT_READY_WIFI),
+        SystemBootElapsed(BOOT_READY_TIME),
+        SystemBootElapsed(BOOT_READY_TELEMETRY));
+}
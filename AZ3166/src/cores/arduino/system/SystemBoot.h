@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __SYSTEM_BOOT_H__
+#define __SYSTEM_BOOT_H__
+
+#include "mbed.h"
+
+// Readiness flags of the boot sequence
+#define BOOT_READY_SETUP        0x01    // setup() of the sketch is entered
+#define BOOT_READY_SENSORS      0x02    // Onboard sensors are initialized
+#define BOOT_READY_WIFI         0x04    // Wi-Fi station is connected
+#define BOOT_READY_TIME         0x08    // NTP sync is done, check IsTimeSynced() for the result
+#define BOOT_READY_TELEMETRY    0x10    // The first telemetry data is delivered
+
+#ifdef __cplusplus
+extern "C"{
+#endif  // __cplusplus
+
+/**
+ * @brief    Schedule a boot task on the boot worker thread.
+ *
+ * @param    task - The task to run.
+ *           depends - Readiness flags that must be set before the task runs.
+ *           provides - Readiness flags set once the task returns.
+ *
+ * @return   0 upon success or other value upon failure.
+**/
+int SystemBootSchedule(void (*task)(void), int depends, int provides);
+
+/**
+ * @brief    Mark one or more readiness flags as set, and record when they became ready.
+**/
+void SystemSetReady(int flags);
+
+/**
+ * @brief    Clear one or more readiness flags, e.g. when the Wi-Fi connection is lost.
+**/
+void SystemClearReady(int flags);
+
+/**
+ * @brief    Check whether all the specified readiness flags are set.
+ *
+ * @return   1 if all are set, or 0.
+**/
+int SystemIsReady(int flags);
+
+/**
+ * @brief    Wait until all the specified readiness flags are set.
+ *
+ * @param    flags - Readiness flags to wait for.
+ *           timeout - Timeout in ms, -1 means infinity.
+ *
+ * @return   0 upon ready or other value upon timeout.
+**/
+int SystemWaitReady(int flags, int timeout);
+
+/**
+ * @brief    Get the time from boot to the moment the readiness flag was first set.
+ *
+ * @param    flag - One readiness flag.
+ *
+ * @return   Elapsed time in ms, or -1 if the flag has never been set.
+**/
+int SystemBootElapsed(int flag);
+
+/**
+ * @brief    Print the boot timings to the serial port.
+**/
+void SystemBootReport(void);
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif  // __SYSTEM_BOOT_H__
@@ -0,0 +1,355 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#include "Arduino.h"
+#include "emw10xx_lwip_stack.h"
+#include "nsapi_dns.h"
+#include "SystemBoot.h"
+#include "SystemDNS.h"
+#include "SystemTickCounter.h"
+
+#define DNS_PREFETCH_MAX    4
+
+typedef struct
+{
+    char host[DNS_CACHE_HOST_MAX_LEN + 1];
+    nsapi_addr_t addr;
+    nsapi_error_t result;       // 0 for a positive entry, the lookup error for a negative one
+    uint64_t expire_ms;
+    uint64_t used_ms;
+} DNS_CACHE_ENTRY;
+
+static DNS_CACHE_ENTRY dnsCache[DNS_CACHE_SIZE];
+static Mutex dnsMutex;
+static volatile int dnsHits = 0;
+static volatile int dnsMisses = 0;
+
+static char dnsPrefetch[DNS_PREFETCH_MAX][DNS_CACHE_HOST_MAX_LEN + 1];
+static int dnsPrefetchCount = 0;
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Cache
+static DNS_CACHE_ENTRY *FindEntry(const char *host, uint64_t now)
+{
+    for (int i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+        if (dnsCache[i].host[0] != 0 && dnsCache[i].expire_ms > now && strcmp(dnsCache[i].host, host) == 0)
+        {
+            return &dnsCache[i];
+        }
+    }
+    return NULL;
+}
+
+static bool LookupCache(const char *host, nsapi_addr_t *addr, nsapi_error_t *result)
+{
+    uint64_t now = SystemTickCounterRead();
+
+    dnsMutex.lock();
+    DNS_CACHE_ENTRY *entry = FindEntry(host, now);
+    if (entry != NULL)
+    {
+        entry->used_ms = now;
+        *addr = entry->addr;
+        *result = entry->result;
+        dnsHits++;
+    }
+    else
+    {
+        dnsMisses++;
+    }
+    dnsMutex.unlock();
+
+    return (entry != NULL);
+}
+
+static void UpdateCache(const char *host, const nsapi_addr_t *addr, nsapi_error_t result)
+{
+    // Only cache the answers and the name errors, transient failures are retried
+    if (result != NSAPI_ERROR_OK && result != NSAPI_ERROR_DNS_FAILURE)
+    {
+        return;
+    }
+
+    uint64_t now = SystemTickCounterRead();
+
+    dnsMutex.lock();
+    DNS_CACHE_ENTRY *entry = FindEntry(host, now);
+    if (entry == NULL)
+    {
+        // Reuse an expired slot, or evict the least recently used one
+        entry = &dnsCache[0];
+        for (int i = 0; i < DNS_CACHE_SIZE; i++)
+        {
+            if (dnsCache[i].host[0] == 0 || dnsCache[i].expire_ms <= now)
+            {
+                entry = &dnsCache[i];
+                break;
+            }
+            if (dnsCache[i].used_ms < entry->used_ms)
+            {
+                entry = &dnsCache[i];
+            }
+        }
+        strcpy(entry->host, host);
+    }
+    entry->addr = *addr;
+    entry->result = result;
+    entry->expire_ms = now + (result == NSAPI_ERROR_OK ? DNS_CACHE_TTL_MS : DNS_CACHE_NEGATIVE_TTL_MS);
+    entry->used_ms = now;
+    dnsMutex.unlock();
+}
+
+static nsapi_error_t Resolve(const char *host, nsapi_addr_t *addr, nsapi_version_t version)
+{
+    nsapi_error_t result;
+
+    // Literal addresses and long names bypass the cache
+    SocketAddress literal;
+    if (literal.set_ip_address(host))
+    {
+        *addr = literal.get_addr();
+        return NSAPI_ERROR_OK;
+    }
+    if (strlen(host) > DNS_CACHE_HOST_MAX_LEN)
+    {
+        return nsapi_dns_query(&lwip_stack, host, addr, version);
+    }
+
+    if (LookupCache(host, addr, &result))
+    {
+        return result;
+    }
+
+    if (lwip_stack.stack_api->gethostbyname != NULL)
+    {
+        result = lwip_stack.stack_api->gethostbyname(&lwip_stack, host, addr, version);
+    }
+    else
+    {
+        result = nsapi_dns_query(&lwip_stack, host, addr, version);
+    }
+    UpdateCache(host, addr, result);
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Network stack, everything but the name resolution goes to the lwIP stack
+#define INNER_API   (lwip_stack.stack_api)
+
+static nsapi_addr_t cached_get_ip_address(nsapi_stack_t *stack)
+{
+    return INNER_API->get_ip_address(&lwip_stack);
+}
+
+static nsapi_error_t cached_gethostbyname(nsapi_stack_t *stack, const char *host, nsapi_addr_t *addr, nsapi_version_t version)
+{
+    return Resolve(host, addr, version);
+}
+
+static nsapi_error_t cached_add_dns_server(nsapi_stack_t *stack, nsapi_addr_t addr)
+{
+    if (INNER_API->add_dns_server == NULL)
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    SystemDNSFlush();
+    return INNER_API->add_dns_server(&lwip_stack, addr);
+}
+
+static nsapi_error_t cached_setstackopt(nsapi_stack_t *stack, int level, int optname, const void *optval, unsigned optlen)
+{
+    if (INNER_API->setstackopt == NULL)
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    return INNER_API->setstackopt(&lwip_stack, level, optname, optval, optlen);
+}
+
+static nsapi_error_t cached_getstackopt(nsapi_stack_t *stack, int level, int optname, void *optval, unsigned *optlen)
+{
+    if (INNER_API->getstackopt == NULL)
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    return INNER_API->getstackopt(&lwip_stack, level, optname, optval, optlen);
+}
+
+static nsapi_error_t cached_socket_open(nsapi_stack_t *stack, nsapi_socket_t *socket, nsapi_protocol_t proto)
+{
+    return INNER_API->socket_open(&lwip_stack, socket, proto);
+}
+
+static nsapi_error_t cached_socket_close(nsapi_stack_t *stack, nsapi_socket_t socket)
+{
+    return INNER_API->socket_close(&lwip_stack, socket);
+}
+
+static nsapi_error_t cached_socket_bind(nsapi_stack_t *stack, nsapi_socket_t socket, nsapi_addr_t addr, uint16_t port)
+{
+    return INNER_API->socket_bind(&lwip_stack, socket, addr, port);
+}
+
+static nsapi_error_t cached_socket_listen(nsapi_stack_t *stack, nsapi_socket_t socket, int backlog)
+{
+    return INNER_API->socket_listen(&lwip_stack, socket, backlog);
+}
+
+static nsapi_error_t cached_socket_connect(nsapi_stack_t *stack, nsapi_socket_t socket, nsapi_addr_t addr, uint16_t port)
+{
+    return INNER_API->socket_connect(&lwip_stack, socket, addr, port);
+}
+
+static nsapi_error_t cached_socket_accept(nsapi_stack_t *stack, nsapi_socket_t server, nsapi_socket_t *socket, nsapi_addr_t *addr, uint16_t *port)
+{
+    return INNER_API->socket_accept(&lwip_stack, server, socket, addr, port);
+}
+
+static nsapi_size_or_error_t cached_socket_send(nsapi_stack_t *stack, nsapi_socket_t socket, const void *data, nsapi_size_t size)
+{
+    return INNER_API->socket_send(&lwip_stack, socket, data, size);
+}
+
+static nsapi_size_or_error_t cached_socket_recv(nsapi_stack_t *stack, nsapi_socket_t socket, void *data, nsapi_size_t size)
+{
+    return INNER_API->socket_recv(&lwip_stack, socket, data, size);
+}
+
+static nsapi_size_or_error_t cached_socket_sendto(nsapi_stack_t *stack, nsapi_socket_t socket, nsapi_addr_t addr, uint16_t port, const void *data, nsapi_size_t size)
+{
+    return INNER_API->socket_sendto(&lwip_stack, socket, addr, port, data, size);
+}
+
+static nsapi_size_or_error_t cached_socket_recvfrom(nsapi_stack_t *stack, nsapi_socket_t socket, nsapi_addr_t *addr, uint16_t *port, void *buffer, nsapi_size_t size)
+{
+    return INNER_API->socket_recvfrom(&lwip_stack, socket, addr, port, buffer, size);
+}
+
+static void cached_socket_attach(nsapi_stack_t *stack, nsapi_socket_t socket, void (*callback)(void *), void *data)
+{
+    INNER_API->socket_attach(&lwip_stack, socket, callback, data);
+}
+
+static nsapi_error_t cached_setsockopt(nsapi_stack_t *stack, nsapi_socket_t socket, int level, int optname, const void *optval, unsigned optlen)
+{
+    if (INNER_API->setsockopt == NULL)
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    return INNER_API->setsockopt(&lwip_stack, socket, level, optname, optval, optlen);
+}
+
+static nsapi_error_t cached_getsockopt(nsapi_stack_t *stack, nsapi_socket_t socket, int level, int optname, void *optval, unsigned *optlen)
+{
+    if (INNER_API->getsockopt == NULL)
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    return INNER_API->getsockopt(&lwip_stack, socket, level, optname, optval, optlen);
+}
+
+static const nsapi_stack_api_t cached_stack_api =
+{
+    cached_get_ip_address,
+    cached_gethostbyname,
+    cached_add_dns_server,
+    cached_setstackopt,
+    cached_getstackopt,
+    cached_socket_open,
+    cached_socket_close,
+    cached_socket_bind,
+    cached_socket_listen,
+    cached_socket_connect,
+    cached_socket_accept,
+    cached_socket_send,
+    cached_socket_recv,
+    cached_socket_sendto,
+    cached_socket_recvfrom,
+    cached_socket_attach,
+    cached_setsockopt,
+    cached_getsockopt,
+};
+
+static nsapi_stack_t cached_stack = { &cached_stack_api, NULL };
+
+NetworkStack *CachedDNSInterface::get_stack()
+{
+    // Bring up the EMW10xx stack first
+    EMW10xxInterface::get_stack();
+    return nsapi_create_stack(&cached_stack);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// APIs
+static void DNSPrefetchTask(void)
+{
+    while (true)
+    {
+        char host[DNS_CACHE_HOST_MAX_LEN + 1];
+
+        dnsMutex.lock();
+        if (dnsPrefetchCount == 0)
+        {
+            dnsMutex.unlock();
+            break;
+        }
+        dnsPrefetchCount--;
+        strcpy(host, dnsPrefetch[dnsPrefetchCount]);
+        dnsMutex.unlock();
+
+        nsapi_addr_t addr;
+        Resolve(host, &addr, NSAPI_IPv4);
+    }
+}
+
+void SystemDNSFlush(void)
+{
+    dnsMutex.lock();
+    memset(dnsCache, 0, sizeof(dnsCache));
+    dnsMutex.unlock();
+}
+
+int SystemDNSPrefetch(const char *host)
+{
+    if (host == NULL || host[0] == 0 || strlen(host) > DNS_CACHE_HOST_MAX_LEN)
+    {
+        return -1;
+    }
+
+    dnsMutex.lock();
+    if (FindEntry(host, SystemTickCounterRead()) != NULL)
+    {
+        dnsMutex.unlock();
+        return 0;
+    }
+    if (dnsPrefetchCount >= DNS_PREFETCH_MAX)
+    {
+        dnsMutex.unlock();
+        return -1;
+    }
+    bool idle = (dnsPrefetchCount == 0);
+    strcpy(dnsPrefetch[dnsPrefetchCount++], host);
+    dnsMutex.unlock();
+
+    // One task drains all the queued names on the system worker once Wi-Fi is up
+    if (idle && SystemBootSchedule(DNSPrefetchTask, BOOT_READY_WIFI, 0) != 0)
+    {
+        dnsMutex.lock();
+        dnsPrefetchCount = 0;
+        dnsMutex.unlock();
+        return -1;
+    }
+    return 0;
+}
+
+void SystemDNSStats(int *hits, int *misses)
+{
+    if (hits != NULL)
+    {
+        *hits = dnsHits;
+    }
+    if (misses != NULL)
+    {
+        *misses = dnsMisses;
+    }
+}
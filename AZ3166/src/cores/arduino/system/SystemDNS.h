@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __SYSTEM_DNS_H__
+#define __SYSTEM_DNS_H__
+
+#include "mbed.h"
+#include "EMW10xxInterface.h"
+
+#define DNS_CACHE_SIZE              8
+#define DNS_CACHE_HOST_MAX_LEN      64
+// lwIP does not surface the record TTL, so a conservative TTL is applied to every answer
+#define DNS_CACHE_TTL_MS            300000
+#define DNS_CACHE_NEGATIVE_TTL_MS   30000
+
+#ifdef __cplusplus
+/** EMW10xx Wi-Fi interface whose network stack resolves host names through the DNS cache.
+ *  Every socket opened on it, and every gethostbyname on it, shares the cache.
+ */
+class CachedDNSInterface : public EMW10xxInterface
+{
+protected:
+    virtual NetworkStack *get_stack();
+};
+#endif  // __cplusplus
+
+#ifdef __cplusplus
+extern "C"{
+#endif  // __cplusplus
+
+/**
+ * @brief    Drop all the cached DNS entries, called when the network changed.
+**/
+void SystemDNSFlush(void);
+
+/**
+ * @brief    Resolve a host name in background and keep the result in the cache.
+ *
+ * @param    host - The host name.
+ *
+ * @return   0 upon the request is queued or the host is already cached, or other value upon failure.
+**/
+int SystemDNSPrefetch(const char *host);
+
+/**
+ * @brief    Get the hit and miss counters of the DNS cache.
+**/
+void SystemDNSStats(int *hits, int *misses);
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif  // __SYSTEM_DNS_H__
@@ -2,16 +2,110 @@
 // Licensed under the MIT license. 
 
 #include "Arduino.h"
+#include "mbed_rtc_time.h"
+#include "rtc_api.h"
 #include "SystemTime.h"
+#include "SystemTickCounter.h"
 #include "SystemWiFi.h"
 #include "NTPClient.h"
 
+#define NTP_TIMEOUT_MS          2000
+#define NTP_RESYNC_INTERVAL_MS  3600000
+// Retry interval until the first sync succeeds
+#define NTP_RETRY_INTERVAL_MS   60000
+#define NTP_STACK_SIZE          0x1000
+// Offset errors below the threshold are slewed, otherwise the clock is stepped
+#define CLOCK_STEP_THRESHOLD_MS 128
+// Max slew rate in ppm, the same as adjtime()
+#define CLOCK_SLEW_PPM          500
+
 static const char *defaultNTPs = "pool.ntp.org;cn.pool.ntp.org;europe.pool.ntp.org;asia.pool.ntp.org;oceania.pool.ntp.org";
 
 static char **ntpHosts = NULL;
 static int ntpHostCount = 0;
 
 static bool timeSynced = false;
+static Thread *ntpThread = NULL;
+static Mutex ntpMutex;
+
+// The system clock is the monotonic tick counter plus an offset, adjusted by NTP
+static bool clockInited = false;
+static int64_t clockOffset = 0;
+static int64_t clockSlew = 0;
+static uint64_t clockSlewStart = 0;
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Disciplined clock
+static int64_t ClockOffset(uint64_t now)
+{
+    // The part of the pending slew applied since the last adjustment
+    int64_t limit = (int64_t)(now - clockSlewStart) * CLOCK_SLEW_PPM / 1000000;
+    int64_t applied = clockSlew > 0 ? min(clockSlew, limit) : max(clockSlew, -limit);
+    return clockOffset + applied;
+}
+
+static void ClockAdjust(int64_t offset, bool step)
+{
+    core_util_critical_section_enter();
+    uint64_t now = SystemTickCounterRead();
+    if (step)
+    {
+        clockOffset = offset;
+        clockSlew = 0;
+    }
+    else
+    {
+        int64_t current = ClockOffset(now);
+        clockOffset = current;
+        clockSlew = offset - current;
+    }
+    clockSlewStart = now;
+    core_util_critical_section_exit();
+}
+
+static time_t ClockRead(void)
+{
+    return (time_t)(SystemTimeMs() / 1000);
+}
+
+static void ClockWrite(time_t t)
+{
+    ClockAdjust((int64_t)t * 1000 - (int64_t)SystemTickCounterRead(), true);
+    // Keep the RTC close, so the time is right after a reset
+    rtc_write(t);
+}
+
+static void ClockInit(void)
+{
+}
+
+static int ClockIsEnabled(void)
+{
+    return 1;
+}
+
+void SystemTimeInit(void)
+{
+    if (clockInited)
+    {
+        return;
+    }
+
+    // Start from the RTC, which keeps running over a reset
+    rtc_init();
+    ClockAdjust((int64_t)rtc_read() * 1000 - (int64_t)SystemTickCounterRead(), true);
+    attach_rtc(ClockRead, ClockWrite, ClockInit, ClockIsEnabled);
+    clockInited = true;
+}
+
+uint64_t SystemTimeMs(void)
+{
+    core_util_critical_section_enter();
+    uint64_t now = SystemTickCounterRead();
+    int64_t ms = (int64_t)now + ClockOffset(now);
+    core_util_critical_section_exit();
+    return (uint64_t)ms;
+}
 
 char **splitString(const char * tsList)
 {
@@ -65,10 +159,13 @@ int SetTimeServer(const char * tsList)
     return 0;
 }
 
-static NTPResult NTPSyncUP(char* host)
+static void NTPResyncWorker(void)
 {
-    NTPClient ntp(WiFiInterface());
-    return ntp.setTime(host);
+    while (true)
+    {
+        Thread::wait(timeSynced ? NTP_RESYNC_INTERVAL_MS : NTP_RETRY_INTERVAL_MS);
+        SyncTime();
+    }
 }
 
 void SyncTime(void)
@@ -77,16 +174,39 @@ void SyncTime(void)
     {
         splitString(defaultNTPs);
     }
-    
-    timeSynced = false;
-    for (int i = 0; i < ntpHostCount; i++)
+    SystemTimeInit();
+
+    // Query all the servers at once and take the best sample
+    int64_t offset;
+    uint32_t distance;
+    NTPClient ntp(WiFiInterface());
+    ntpMutex.lock();
+    if (ntpThread == NULL)
     {
-        if (NTPSyncUP(ntpHosts[i]) == NTP_OK)
+        // Retry until the first sync, then re-sync periodically to discipline the drift of the tick counter
+        ntpThread = new Thread(osPriorityLow, NTP_STACK_SIZE, NULL);
+        if (ntpThread != NULL)
         {
-            timeSynced = true;
-            break;
+            ntpThread->start(NTPResyncWorker);
         }
     }
+    if (ntp.query(ntpHosts, ntpHostCount, &offset, &distance, NTP_TIMEOUT_MS) != NTP_OK)
+    {
+        // Keep the last sync if any, the clock free-runs until the next attempt
+        ntpMutex.unlock();
+        return;
+    }
+
+    // Step on the first sync or a large error, otherwise slew to keep time() monotonic
+    int64_t error = offset - ClockOffset(SystemTickCounterRead());
+    bool step = (!timeSynced || error > CLOCK_STEP_THRESHOLD_MS || error < -CLOCK_STEP_THRESHOLD_MS);
+    ClockAdjust(offset, step);
+    if (step)
+    {
+        rtc_write((time_t)(SystemTimeMs() / 1000));
+    }
+    timeSynced = true;
+    ntpMutex.unlock();
 }
 
 int IsTimeSynced(void)
@@ -21,9 +21,26 @@ int SetTimeServer(const char * tsList);
 
 /**
  * @brief    Sync up the time from Time Server.
+ *
+ * @remarks  All the Time Servers are queried at once and the best sample is taken. The first sync
+ *           or a large error steps the clock, smaller errors are slewed. A background thread retries
+ *           every minute until the first sync succeeds, and re-syncs every hour after that.
 **/
 void SyncTime(void);
 
+/**
+ * @brief    Attach the system clock (the monotonic tick counter plus the NTP offset) to time().
+ *           It starts from the RTC and is called once at the system startup.
+**/
+void SystemTimeInit(void);
+
+/**
+ * @brief    Get the current UTC time in ms since Epoch.
+ *
+ * @return   The current UTC time in ms.
+**/
+uint64_t SystemTimeMs(void);
+
 /**
  * @brief    Check whether the local time is synced up with Time Server.
  * 
@@ -6,25 +6,183 @@
 #include "EMW10xxInterface.h"
 #include "EEPROMInterface.h"
 #include "NTPClient.h"
+#include "SystemBoot.h"
+#include "SystemDNS.h"
 #include "SystemWiFi.h"
 #include "SystemTime.h"
 #include "Telemetry.h"
 
+#define WIFI_CACHE_MAGIC                0x57464333  // "WFC3"
+#define WIFI_FAST_CONNECT_TIMEOUT_MS    5000
+#define WIFI_KEY_MAX_LEN                64
+#define WIFI_IP_MAX_LEN                 16
+
+// The last successful connection, persisted in EEPROM for the fast re-connect
+typedef struct
+{
+    uint32_t magic;
+    char ssid[WIFI_SSID_MAX_LEN];
+    uint32_t pwd_hash;              // The PMK is only valid for the password it was derived from
+    char bssid[6];
+    uint8_t channel;
+    uint8_t security;
+    uint8_t key_len;
+    char key[WIFI_KEY_MAX_LEN];     // PMK reported by the Wi-Fi module
+    char ip[WIFI_IP_MAX_LEN];       // Address of the last lease, only a hint for the DHCP client
+} WIFI_CACHE_RECORD;
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 // WiFi related functions
 NetworkInterface *_defaultSystemNetwork = NULL;
 static char ssid[WIFI_SSID_MAX_LEN + 1] = { 0 };
+static uint32_t pwdHash = 0;
+
+static WIFI_CACHE_RECORD wifiRecord;
+static Semaphore stationUpSem(0);
+static Semaphore dhcpDoneSem(0);
+static WIFI_CONNECT_STATS wifiStats = { 0, -1, -1, -1 };
+static uint64_t connectStartMs = 0;
+static bool bootTasksScheduled = false;
+
+static void WiFiStatusChanged(WiFiEvent status, void *arg)
+{
+    if (status == NOTIFY_STATION_UP)
+    {
+        stationUpSem.release();
+    }
+}
+
+static void WiFiParaChanged(apinfo_adv_t *ap_info, char *key, int key_len, void *arg)
+{
+    // Keep the BSSID, channel and PMK of the AP just associated
+    memcpy(wifiRecord.bssid, ap_info->bssid, sizeof(wifiRecord.bssid));
+    wifiRecord.channel = ap_info->channel;
+    wifiRecord.security = ap_info->security;
+    wifiRecord.key_len = (uint8_t)min(key_len, WIFI_KEY_MAX_LEN);
+    memcpy(wifiRecord.key, key, wifiRecord.key_len);
+
+    wifiStats.assoc_ms = (int)(SystemTickCounterRead() - connectStartMs);
+}
+
+static void WiFiDHCPCompleted(IPStatusTypedef *pnet, void *arg)
+{
+    wifiStats.dhcp_ms = (int)(SystemTickCounterRead() - connectStartMs);
+    dhcpDoneSem.release();
+}
 
 bool InitSystemWiFi(void)
 {
     if (_defaultSystemNetwork == NULL)
     {
-        _defaultSystemNetwork = (NetworkInterface*)new EMW10xxInterface();
+        _defaultSystemNetwork = (NetworkInterface*)new CachedDNSInterface();
+        if (_defaultSystemNetwork != NULL)
+        {
+            mico_system_notify_register(mico_notify_WIFI_STATUS_CHANGED, (void *)WiFiStatusChanged, NULL);
+            mico_system_notify_register(mico_notify_WiFI_PARA_CHANGED, (void *)WiFiParaChanged, NULL);
+            mico_system_notify_register(mico_notify_DHCP_COMPLETED, (void *)WiFiDHCPCompleted, NULL);
+        }
     }
     
     return (_defaultSystemNetwork != NULL);
 }
 
+static bool LoadWiFiCache(WIFI_CACHE_RECORD *record)
+{
+    EEPROMInterface eeprom;
+    if (eeprom.read((uint8_t*)record, sizeof(WIFI_CACHE_RECORD), 0x00, WIFI_CACHE_ZONE_IDX) != sizeof(WIFI_CACHE_RECORD))
+    {
+        return false;
+    }
+    return (record->magic == WIFI_CACHE_MAGIC
+        && strncmp(record->ssid, ssid, WIFI_SSID_MAX_LEN) == 0
+        && record->pwd_hash == pwdHash
+        && record->key_len > 0
+        && record->ip[0] != 0);
+}
+
+static void SaveWiFiCache(void)
+{
+    IPStatusTypedef ipStatus;
+    if (micoWlanGetIPStatus(&ipStatus, Station) != kNoErr || wifiRecord.key_len == 0)
+    {
+        return;
+    }
+
+    wifiRecord.magic = WIFI_CACHE_MAGIC;
+    strncpy(wifiRecord.ssid, ssid, WIFI_SSID_MAX_LEN);
+    wifiRecord.pwd_hash = pwdHash;
+    strncpy(wifiRecord.ip, ipStatus.ip, WIFI_IP_MAX_LEN);
+
+    // Only write when something changed, the EEPROM has limited write cycles
+    WIFI_CACHE_RECORD cached;
+    if (LoadWiFiCache(&cached) && memcmp(&cached, &wifiRecord, sizeof(WIFI_CACHE_RECORD)) == 0)
+    {
+        return;
+    }
+    EEPROMInterface eeprom;
+    if (eeprom.write((uint8_t*)&wifiRecord, sizeof(WIFI_CACHE_RECORD), WIFI_CACHE_ZONE_IDX) != 0)
+    {
+        Serial.print("ERROR: Failed to save the Wi-Fi cache to EEPROM.\r\n");
+    }
+}
+
+static void DropWiFiCache(void)
+{
+    EEPROMInterface eeprom;
+    memset(&wifiRecord, 0, sizeof(wifiRecord));
+    eeprom.write((uint8_t*)&wifiRecord, sizeof(WIFI_CACHE_RECORD), WIFI_CACHE_ZONE_IDX);
+}
+
+static bool FastConnect(void)
+{
+    WIFI_CACHE_RECORD cached;
+    if (!LoadWiFiCache(&cached))
+    {
+        return false;
+    }
+
+    // Targeted connect to the cached BSSID and channel with the PMK. The lease is not reused as a
+    // static address, it may have expired or been handed to another host meanwhile, so DHCP stays
+    // on and is offered the last address
+    network_InitTypeDef_adv_st para;
+    memset(&para, 0, sizeof(para));
+    memcpy(para.ap_info.ssid, cached.ssid, sizeof(para.ap_info.ssid));
+    memcpy(para.ap_info.bssid, cached.bssid, sizeof(para.ap_info.bssid));
+    para.ap_info.channel = cached.channel;
+    para.ap_info.security = cached.security;
+    memcpy(para.key, cached.key, cached.key_len);
+    para.key_len = cached.key_len;
+    strncpy(para.local_ip_addr, cached.ip, sizeof(para.local_ip_addr));
+    para.dhcpMode = DHCP_Client;
+    para.wifi_retry_interval = 100;
+
+    while (stationUpSem.wait(0) > 0 || dhcpDoneSem.wait(0) > 0)
+    {
+        // Drop the stale notifications
+    }
+
+    // EMW10xxInterface follows the link state through the same MiCO notification
+    micoWlanStartAdv(&para);
+    if (stationUpSem.wait(WIFI_FAST_CONNECT_TIMEOUT_MS) <= 0)
+    {
+        micoWlanSuspendStation();
+        return false;
+    }
+    int elapsed = (int)(SystemTickCounterRead() - connectStartMs);
+    if (dhcpDoneSem.wait(max(WIFI_FAST_CONNECT_TIMEOUT_MS - elapsed, 0)) <= 0)
+    {
+        micoWlanSuspendStation();
+        return false;
+    }
+
+    wifiRecord = cached;
+    if (wifiStats.assoc_ms < 0)
+    {
+        wifiStats.assoc_ms = (int)(SystemTickCounterRead() - connectStartMs);
+    }
+    return true;
+}
+
 bool SystemWiFiConnect(void)
 {
     EEPROMInterface eeprom;
@@ -49,7 +207,34 @@ bool SystemWiFiConnect(void)
         return false;
     }
 
+    // A changed password makes the cached setting stale even if the SSID is the same
+    pwdHash = 2166136261u;              // FNV-1a
+    for (const uint8_t *p = pwd; *p; p++)
+    {
+        pwdHash = (pwdHash ^ *p) * 16777619u;
+    }
+
     ((EMW10xxInterface*)_defaultSystemNetwork)->set_interface(Station);
+
+    wifiStats.fast_connect = 0;
+    wifiStats.assoc_ms = -1;
+    wifiStats.dhcp_ms = -1;
+    wifiStats.first_packet_ms = -1;
+    connectStartMs = SystemTickCounterRead();
+
+    if (FastConnect())
+    {
+        wifiStats.fast_connect = 1;
+        Serial.printf("Wi-Fi %s connected with the cached setting.\r\n", ssid);
+        SystemWiFiConnected();
+        // The lease may have brought another address
+        SystemBootSchedule(SaveWiFiCache, BOOT_READY_WIFI, 0);
+        return true;
+    }
+
+    // Fall back to the full scan and DHCP
+    memset(&wifiRecord, 0, sizeof(wifiRecord));
+    connectStartMs = SystemTickCounterRead();
     ret = ((EMW10xxInterface*)_defaultSystemNetwork)->connect( (char*)ssid, (char*)pwd, NSAPI_SECURITY_WPA_WPA2, 0 );
     if(ret != 0)
     {
@@ -59,28 +244,66 @@ bool SystemWiFiConnect(void)
     else
     {
         Serial.printf("Wi-Fi %s connected.\r\n", ssid);
-        
-        // Sync system from NTP time server
-        SyncTime();
-        if (IsTimeSynced() == 0)
-        {
-            time_t t = time(NULL);
-            Serial.printf("Now is (UTC): %s\r\n", ctime(&t));
-        }
-        else
+        SystemWiFiConnected();
+        SystemBootSchedule(SaveWiFiCache, BOOT_READY_WIFI, 0);
+        return true;
+    }
+}
+
+static void SyncTimeTask(void)
+{
+    // Sync system from NTP time server
+    SyncTime();
+    if (IsTimeSynced() == 0)
+    {
+        // The NTP response is the first packet received on the new link
+        wifiStats.first_packet_ms = (int)(SystemTickCounterRead() - connectStartMs);
+        Serial.printf("Wi-Fi timings (ms): fast %d, association %d, DHCP %d, first packet %d\r\n",
+            wifiStats.fast_connect, wifiStats.assoc_ms, wifiStats.dhcp_ms, wifiStats.first_packet_ms);
+
+        time_t t = time(NULL);
+        Serial.printf("Now is (UTC): %s\r\n", ctime(&t));
+    }
+    else
+    {
+        Serial.println("Time sync failed");
+        if (wifiStats.fast_connect)
         {
-            Serial.println("Time sync failed");
+            // Nothing came back over the cached AP, do a full connect on next boot
+            DropWiFiCache();
         }
+    }
+}
 
-        // Initialize the telemetry only after Wi-Fi established
-        telemetry_init();
+static void TelemetryTask(void)
+{
+    // Initialize the telemetry only after Wi-Fi established
+    telemetry_init();
 
-        // Microsoft collects data to operate effectively and provide you the best experiences with our products. 
-        // We collect data about the features you use, how often you use them, and how you use them.
-        send_telemetry_data_sync("", "wifi", "Wi-Fi connected");
+    // Microsoft collects data to operate effectively and provide you the best experiences with our products. 
+    // We collect data about the features you use, how often you use them, and how you use them.
+    send_telemetry_data_async("", "wifi", "Wi-Fi connected");
+}
 
-        return true;
+void SystemWiFiConnected(void)
+{
+    // The answers from the previous network may not be valid any more
+    SystemDNSFlush();
+
+    // NTP and telemetry run on the boot worker once, the time stamp of the telemetry depends on the time sync.
+    // NTP keeps the time synced by itself after that, and a reconnect is no new boot
+    if (!bootTasksScheduled)
+    {
+        bootTasksScheduled = true;
+        SystemBootSchedule(SyncTimeTask, BOOT_READY_WIFI, BOOT_READY_TIME);
+        SystemBootSchedule(TelemetryTask, BOOT_READY_TIME, 0);
     }
+    SystemSetReady(BOOT_READY_WIFI);
+}
+
+const WIFI_CONNECT_STATS* SystemWiFiConnectStats(void)
+{
+    return &wifiStats;
 }
 
 const char* SystemWiFiSSID(void)
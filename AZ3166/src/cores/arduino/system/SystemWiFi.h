@@ -10,10 +10,20 @@
 extern "C"{
 #endif  // __cplusplus
 
+typedef struct
+{
+    int fast_connect;       // 1 if connected with the cached BSSID, channel, PMK and lease
+    int assoc_ms;           // Time to associate with the AP, -1 if unknown
+    int dhcp_ms;            // Time to get the IP address from DHCP
+    int first_packet_ms;    // Time to receive the first packet (the NTP response)
+} WIFI_CONNECT_STATS;
+
 bool InitSystemWiFi(void);
 bool SystemWiFiConnect(void);
+void SystemWiFiConnected(void);
 int SystemWiFiRSSI(void);
 const char* SystemWiFiSSID(void);
+const WIFI_CONNECT_STATS* SystemWiFiConnectStats(void);
 NetworkInterface* WiFiInterface(void);
 
 bool SystemWiFiAPStart(const char *ssid, const char *passphrase);
@@ -19,10 +19,14 @@
 
 #define ARDUINO_MAIN
 #include "Arduino.h"
+#include "SystemBoot.h"
 #include "Thread.h"
 
 static void arduino_main( void )
 {
+    SystemSetReady(BOOT_READY_SETUP);
+    Serial.printf("Time to setup: %d ms\r\n", SystemBootElapsed(BOOT_READY_SETUP));
+
     setup();
 
     for(;;)
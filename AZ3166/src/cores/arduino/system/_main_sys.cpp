@@ -9,6 +9,7 @@
 #include "mico_system.h"
 #include "SystemLock.h"
 #include "SystemTickCounter.h"
+#include "SystemTime.h"
 #include "SystemWiFi.h"
 
 static bool Initialization(void)
@@ -29,6 +30,9 @@ static bool Initialization(void)
     // Initialize the system tickcounter
     SystemTickCounterInit();
 
+    // Drive time() from the tickcounter, so NTP can slew it
+    SystemTimeInit();
+
     // Initialize the OLED screen
     Screen.init();
 
@@ -44,16 +48,10 @@ static bool Initialization(void)
     DigitalOut LedUser(LED_USER);
     LedUser = 0;
 
-    // Turn off RGB led
-    PwmOut _red(PB_4);
-    PwmOut _green(PB_3);
-    PwmOut _blue(PC_7);
-    _red.period(0.001);
-    _green.period(0.001);
-    _blue.period(0.001);
-    _red.write(0.0f);
-    _green.write(0.0f);
-    _blue.write(0.0f);
+    // Turn off RGB led, the channels stay configured for RGB_LED and analogWrite
+    pwmChannelAttach(PB_4, 1000);
+    pwmChannelAttach(PB_3, 1000);
+    pwmChannelAttach(PC_7, 1000);
 
     return true;
 }
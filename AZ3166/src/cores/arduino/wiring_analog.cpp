@@ -114,33 +114,15 @@ static inline uint32_t mapResolution(uint32_t value, uint32_t from, uint32_t to)
 }
 
 //perform the read operation on the selected analog pin.
-//the initialization of the analog PIN is done through this function
+//the ADC channel of the pin is resolved and configured on first use, see AnalogCapture.cpp
 uint32_t analogRead(uint32_t ulPin)
 {
-  uint32_t ulValue = 0;
-  uint32_t attr = 0;
-  int i;
-
-  //find the pin.
-  i = get_pin_description(ulPin);
-  if(i < 0)
-  {
-      return 0;
-  }
-  attr = pinsDescription[i].mode;
-  if((attr & GPIO_PIN_ADC) == GPIO_PIN_ADC)
-  {
-    PinName pinName = PinName(ulPin);
-    AnalogIn ain(pinName);
-    float fValue = ain.read();
-    ulValue =  fValue * 1024;
-    ulValue = mapResolution(ulValue, ADC_RESOLUTION, _readResolution);
-    return ulValue;
-  }
-  else
+  int value = analogReadRaw(ulPin);
+  if (value < 0)
   {
     return 0;
   }
+  return mapResolution(value, ADC_RESOLUTION, _readResolution);
 }
 
 void analogOutputInit(void)
@@ -168,11 +150,12 @@ void analogWrite(uint32_t ulPin, uint32_t ulValue)
 
     if((attr & GPIO_PIN_PWM) == GPIO_PIN_PWM)
     {
+      // The timer is set up once, later writes only update the compare register
       ulValue = mapResolution(ulValue, _writeResolution, PWM_RESOLUTION);
-      PinName pinName = PinName(ulPin);
-      PwmOut pout(pinName);
-      float fValue = (float)ulValue / PWM_MAX_DUTY_CYCLE;
-      pout.write(fValue);
+      if (pwmChannelAttach(ulPin, 1000000 / PWM_FREQUENCY) == 0)
+      {
+        pwmChannelWrite(ulPin, ulValue, PWM_MAX_DUTY_CYCLE);
+      }
     }
     else
     { //DIGITAL PIN ONLY
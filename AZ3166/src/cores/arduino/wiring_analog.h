@@ -20,7 +20,7 @@
 #define _WIRING_ANALOG_
 
 //ADC resolution
-#define ADC_RESOLUTION                10
+#define ADC_RESOLUTION                12
 
 //PWR resolution
 #define PWM_RESOLUTION                8
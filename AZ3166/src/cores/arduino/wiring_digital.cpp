@@ -16,37 +16,120 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+// The inline digitalWrite() and digitalRead() would clash with their external definitions here
+#define WIRING_DIGITAL_OUT_OF_LINE
 #include "mbed.h"
+#include "wiring_digital.h"
 
 #ifdef __cplusplus
  extern "C" {
 #endif
 
+uint8_t digitalPinModes[DIGITAL_PIN_COUNT] = { 0 };
+
+// The only place where a pin is configured as GPIO
+static void configPin( uint32_t ulPin, uint32_t ulMode )
+{
+  gpio_t gpio;
+  gpio_init(&gpio, PinName(ulPin));
+
+  switch (ulMode)
+  {
+    case OUTPUT:
+      gpio_dir(&gpio, PIN_OUTPUT);
+      break;
+    case INPUT_PULLUP:
+      gpio_dir(&gpio, PIN_INPUT);
+      gpio_mode(&gpio, PullUp);
+      break;
+    case INPUT_PULLDOWN:
+      gpio_dir(&gpio, PIN_INPUT);
+      gpio_mode(&gpio, PullDown);
+      break;
+    default:
+      gpio_dir(&gpio, PIN_INPUT);
+      gpio_mode(&gpio, PullNone);
+      break;
+  }
+  digitalPinModes[ulPin] = ulMode;
+}
+
 void pinMode( uint32_t ulPin, uint32_t ulMode )
 {
-  if (ulMode > 5)
+  if (ulPin >= DIGITAL_PIN_COUNT)
+  {
+    return;
+  }
+  if (ulMode != INPUT && ulMode != OUTPUT && ulMode != INPUT_PULLUP && ulMode != INPUT_PULLDOWN)
+  {
+    return;
+  }
+
+  if (digitalPinModes[ulPin] != ulMode)
+  {
+    configPin(ulPin, ulMode);
+  }
+}
+
+void pinModeReset( uint32_t ulPin )
+{
+  if (ulPin < DIGITAL_PIN_COUNT)
+  {
+    digitalPinModes[ulPin] = 0;
+  }
+}
+
+void digitalWritePin( uint32_t ulPin, uint32_t ulVal )
+{
+  if (ulPin >= DIGITAL_PIN_COUNT)
   {
     return;
   }
 
-  PinName pinName = PinName(ulPin);
-  DigitalIn pin(pinName);
-  PinMode pinMode = PinMode(ulMode);
-  pin.mode(pinMode);
+  switch (digitalPinModes[ulPin])
+  {
+    case OUTPUT:
+      digitalWriteFast(ulPin, ulVal);
+      break;
+    case 0:
+    {
+      // Not configured by pinMode(), drive the pin as before. gpio_init() turns on the clock of the
+      // port, which the level needs, and the level is set before the direction so it does not glitch
+      gpio_t gpio;
+      gpio_init(&gpio, PinName(ulPin));
+      digitalWriteFast(ulPin, ulVal);
+      configPin(ulPin, OUTPUT);
+      break;
+    }
+    default:
+      // An input, HIGH enables the pull-up and LOW disables it
+      pinMode(ulPin, ulVal ? INPUT_PULLUP : INPUT);
+      break;
+  }
+}
+
+int digitalReadPin( uint32_t ulPin )
+{
+  if (ulPin >= DIGITAL_PIN_COUNT)
+  {
+    return LOW;
+  }
+
+  if (digitalPinModes[ulPin] == 0)
+  {
+    configPin(ulPin, INPUT);
+  }
+  return digitalReadFast(ulPin);
 }
 
 void digitalWrite( uint32_t ulPin, uint32_t ulVal )
 {
-  PinName pinName = PinName(ulPin);
-  DigitalOut pin(pinName);
-  pin.write(ulVal ? 1 : 0);
+  digitalWritePin(ulPin, ulVal);
 }
 
 int digitalRead( uint32_t ulPin )
 {
-  PinName pinName = PinName(ulPin);
-  DigitalIn pin(pinName);
-  return pin.read();
+  return digitalReadPin(ulPin);
 }
 
 #ifdef __cplusplus
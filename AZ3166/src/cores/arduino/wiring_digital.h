@@ -19,10 +19,22 @@
 #ifndef _WIRING_DIGITAL_
 #define _WIRING_DIGITAL_
 
+#include "cmsis.h"
+#include "PinNames.h"
+#include "wiring_constants.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
 
+// Pins PA_0 to PH_15, a pin resolves to its GPIO port and bit mask, see PinNames.h
+#define DIGITAL_PIN_COUNT           0x80
+#define DIGITAL_PIN_PORT(pin)       ((GPIO_TypeDef *)(GPIOA_BASE + STM_PORT(pin) * (GPIOB_BASE - GPIOA_BASE)))
+#define DIGITAL_PIN_MASK(pin)       (1UL << STM_PIN(pin))
+
+// Mode of every pin as set by pinMode(), 0 if the pin has not been configured yet
+extern uint8_t digitalPinModes[DIGITAL_PIN_COUNT];
+
 /**
  * \brief Configures the specified pin to behave either as an input or an output. See the description of digital pins for details.
  *
@@ -62,6 +74,76 @@ void digitalWrite( uint32_t dwPin, uint32_t dwVal ) ;
  */
 int digitalRead( uint32_t ulPin ) ;
 
+/**
+ * \brief The bodies of digitalWrite() and digitalRead(), the inline versions below call them for
+ * pins that are not compile-time constants.
+ */
+void digitalWritePin( uint32_t ulPin, uint32_t ulVal ) ;
+int digitalReadPin( uint32_t ulPin ) ;
+
+/**
+ * \brief Forget the cached mode of a pin, so that the next digital access configures it again.
+ *
+ * Called when the pin is taken by a peripheral such as the ADC or a PWM timer.
+ *
+ * \param ulPin the pin number
+ */
+void pinModeReset( uint32_t ulPin ) ;
+
+/**
+ * \brief Write a digital pin through its BSRR register, without any check.
+ *
+ * The pin must have been set to OUTPUT with pinMode().
+ *
+ * \param ulPin the pin number
+ * \param ulVal HIGH or LOW
+ */
+static inline __attribute__((always_inline)) void digitalWriteFast( uint32_t ulPin, uint32_t ulVal )
+{
+  DIGITAL_PIN_PORT(ulPin)->BSRR = (ulVal ? DIGITAL_PIN_MASK(ulPin) : DIGITAL_PIN_MASK(ulPin) << 16);
+}
+
+/**
+ * \brief Read a digital pin through its IDR register, without any check.
+ *
+ * The pin must have been configured with pinMode().
+ *
+ * \param ulPin the pin number
+ *
+ * \return HIGH or LOW
+ */
+static inline __attribute__((always_inline)) int digitalReadFast( uint32_t ulPin )
+{
+  return ((DIGITAL_PIN_PORT(ulPin)->IDR & DIGITAL_PIN_MASK(ulPin)) ? HIGH : LOW);
+}
+
+// With a constant pin the port and the mask are resolved at compile time, and a configured pin
+// is accessed inline. Other pins go through the functions, which use the same registers.
+// The definitions are only used for inlining (gnu_inline), the external digitalWrite() and
+// digitalRead() are still defined in wiring_digital.cpp for prebuilt code and function pointers.
+#if !defined(WIRING_DIGITAL_OUT_OF_LINE)
+extern inline __attribute__((gnu_inline, always_inline)) void digitalWrite( uint32_t ulPin, uint32_t ulVal )
+{
+  if (__builtin_constant_p(ulPin) && ulPin < DIGITAL_PIN_COUNT && digitalPinModes[ulPin & (DIGITAL_PIN_COUNT - 1)] == OUTPUT)
+  {
+    digitalWriteFast(ulPin, ulVal);
+  }
+  else
+  {
+    digitalWritePin(ulPin, ulVal);
+  }
+}
+
+extern inline __attribute__((gnu_inline, always_inline)) int digitalRead( uint32_t ulPin )
+{
+  if (__builtin_constant_p(ulPin) && ulPin < DIGITAL_PIN_COUNT && digitalPinModes[ulPin & (DIGITAL_PIN_COUNT - 1)] != 0)
+  {
+    return digitalReadFast(ulPin);
+  }
+  return digitalReadPin(ulPin);
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
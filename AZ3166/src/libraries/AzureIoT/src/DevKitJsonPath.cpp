@@ -0,0 +1,812 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DevKitJsonPath.h"
+
+typedef struct
+{
+    char close;             // '}' or ']'
+    uint32_t mask;          // Paths going on inside this container
+    uint32_t own;           // Paths whose value is this container
+    const char* start;
+    int index;              // Current member
+} JSON_LEVEL;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scanning
+static const char *SkipSpace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    {
+        p++;
+    }
+    return p;
+}
+
+// p is after the opening quote, returns the position after the closing quote or NULL
+static const char *ScanString(const char *p, const char *end)
+{
+    while (p < end)
+    {
+        if (*p == '"')
+        {
+            return p + 1;
+        }
+        if (*p == '\\')
+        {
+            p += 2;
+            continue;
+        }
+        if ((unsigned char)*p < 0x20)
+        {
+            return NULL;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+// Numbers, true, false and null
+static const char *ScanLiteral(const char *p, const char *end, JSON_PATH_TYPE *type)
+{
+    const char *start = p;
+    while (p < end && ((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'z') || *p == '-' || *p == '+' || *p == '.' || *p == 'E'))
+    {
+        p++;
+    }
+
+    size_t length = p - start;
+    if (length == 4 && strncmp(start, "true", 4) == 0)
+    {
+        *type = JSON_PATH_BOOLEAN;
+    }
+    else if (length == 5 && strncmp(start, "false", 5) == 0)
+    {
+        *type = JSON_PATH_BOOLEAN;
+    }
+    else if (length == 4 && strncmp(start, "null", 4) == 0)
+    {
+        *type = JSON_PATH_NULL;
+    }
+    else if (length > 0 && (*start == '-' || (*start >= '0' && *start <= '9')))
+    {
+        *type = JSON_PATH_NUMBER;
+    }
+    else
+    {
+        return NULL;
+    }
+    return p;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Paths
+static int SegmentCount(const char *path)
+{
+    if (*path == '\0')
+    {
+        return 0;
+    }
+    int count = 1;
+    for (; *path; path++)
+    {
+        if (*path == '.')
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool SegmentEquals(const char *path, int segment, const char *key, size_t length)
+{
+    while (segment-- > 0)
+    {
+        path = strchr(path, '.');
+        if (path == NULL)
+        {
+            return false;
+        }
+        path++;
+    }
+    return strncmp(path, key, length) == 0 && (path[length] == '.' || path[length] == '\0');
+}
+
+// The paths of mask that go on with the member key of the container at depth
+static uint32_t MatchMember(const JSON_PATH *paths, uint32_t mask, int depth, const char *key, size_t length)
+{
+    uint32_t result = 0;
+    for (int i = 0; mask != 0; i++, mask >>= 1)
+    {
+        if ((mask & 1) && SegmentEquals(paths[i].path, depth, key, length))
+        {
+            result |= (1u << i);
+        }
+    }
+    return result;
+}
+
+// Reads the key of an object member, or takes the index of an array element, and returns the paths
+// leading to its value
+static const char *BeginMember(JSON_LEVEL *level, int depth, const char *p, const char *end, const JSON_PATH *paths, uint32_t *valueMask)
+{
+    *valueMask = 0;
+    if (level->close == ']')
+    {
+        if (level->mask != 0)
+        {
+            char index[12];
+            size_t length = (size_t)snprintf(index, sizeof(index), "%d", level->index);
+            *valueMask = MatchMember(paths, level->mask, depth - 1, index, length);
+        }
+        return p;
+    }
+
+    p = SkipSpace(p, end);
+    if (p >= end || *p != '"')
+    {
+        return NULL;
+    }
+    const char *key = p + 1;
+    p = ScanString(key, end);
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    if (level->mask != 0)
+    {
+        *valueMask = MatchMember(paths, level->mask, depth - 1, key, p - 1 - key);
+    }
+
+    p = SkipSpace(p, end);
+    if (p >= end || *p != ':')
+    {
+        return NULL;
+    }
+    return p + 1;
+}
+
+static void Record(JSON_PATH *paths, uint32_t mask, JSON_PATH_TYPE type, const char *value, size_t length)
+{
+    for (int i = 0; mask != 0; i++, mask >>= 1)
+    {
+        if (mask & 1)
+        {
+            paths[i].type = type;
+            paths[i].value = value;
+            paths[i].length = length;
+        }
+    }
+}
+
+static int FoundCount(uint32_t all, uint32_t pending)
+{
+    int count = 0;
+    for (uint32_t found = all & ~pending; found != 0; found &= found - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+int DevKitJsonPath_Extract(const char *json, size_t size, JSON_PATH *paths, int count)
+{
+    if (json == NULL || paths == NULL || count < 0 || count > JSON_PATH_MAX_COUNT)
+    {
+        return -1;
+    }
+
+    uint32_t all = (count == 32 ? 0xFFFFFFFFu : (1u << count) - 1);
+    uint32_t pending = all;
+    // Segments of every path, so that the paths ending at a value are found at once
+    uint8_t segments[JSON_PATH_MAX_COUNT];
+    for (int i = 0; i < count; i++)
+    {
+        paths[i].type = JSON_PATH_NOT_FOUND;
+        paths[i].value = NULL;
+        paths[i].length = 0;
+        segments[i] = (uint8_t)SegmentCount(paths[i].path);
+    }
+
+    JSON_LEVEL stack[JSON_PATH_MAX_DEPTH];
+    int depth = 0;
+    const char *p = json;
+    const char *end = json + size;
+    uint32_t valueMask = all;
+    bool expectValue = true;
+
+    while (true)
+    {
+        if (expectValue)
+        {
+            p = SkipSpace(p, end);
+            if (p >= end)
+            {
+                return -1;
+            }
+
+            uint32_t here = 0;
+            for (int i = 0; i < count; i++)
+            {
+                if ((valueMask & (1u << i)) && segments[i] == depth)
+                {
+                    here |= (1u << i);
+                }
+            }
+            here &= pending;
+
+            if (*p == '{' || *p == '[')
+            {
+                if (depth == JSON_PATH_MAX_DEPTH)
+                {
+                    return -1;
+                }
+                JSON_LEVEL *level = &stack[depth++];
+                level->close = (*p == '{' ? '}' : ']');
+                level->mask = valueMask & pending & ~here;
+                level->own = here;
+                level->start = p;
+                level->index = 0;
+
+                p = SkipSpace(p + 1, end);
+                if (p < end && *p == level->close)
+                {
+                    // Empty, closed below
+                    expectValue = false;
+                    continue;
+                }
+                p = BeginMember(level, depth, p, end, paths, &valueMask);
+                if (p == NULL)
+                {
+                    return -1;
+                }
+                continue;
+            }
+
+            const char *start = p;
+            JSON_PATH_TYPE type;
+            if (*p == '"')
+            {
+                type = JSON_PATH_STRING;
+                p = ScanString(p + 1, end);
+            }
+            else
+            {
+                p = ScanLiteral(p, end, &type);
+            }
+            if (p == NULL)
+            {
+                return -1;
+            }
+            if (here != 0)
+            {
+                if (type == JSON_PATH_STRING)
+                {
+                    Record(paths, here, type, start + 1, p - start - 2);
+                }
+                else
+                {
+                    Record(paths, here, type, start, p - start);
+                }
+                pending &= ~here;
+            }
+            expectValue = false;
+        }
+
+        if (depth == 0 || pending == 0)
+        {
+            return FoundCount(all, pending);
+        }
+
+        // After a value, ',' goes on with the container and the closing bracket ends it
+        JSON_LEVEL *level = &stack[depth - 1];
+        p = SkipSpace(p, end);
+        if (p >= end)
+        {
+            return -1;
+        }
+        if (*p == ',')
+        {
+            level->index++;
+            p = BeginMember(level, depth, p + 1, end, paths, &valueMask);
+            if (p == NULL)
+            {
+                return -1;
+            }
+            expectValue = true;
+        }
+        else if (*p == level->close)
+        {
+            p++;
+            if (level->own != 0)
+            {
+                Record(paths, level->own, (level->close == '}' ? JSON_PATH_OBJECT : JSON_PATH_ARRAY), level->start, p - level->start);
+                pending &= ~level->own;
+            }
+            depth--;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Validation
+static int HexValue(char c);
+
+// Like ScanString(), and the escapes must be valid too
+static const char *CheckString(const char *p, const char *end)
+{
+    while (p < end)
+    {
+        if (*p == '"')
+        {
+            return p + 1;
+        }
+        if ((unsigned char)*p < 0x20)
+        {
+            return NULL;
+        }
+        if (*p++ != '\\')
+        {
+            continue;
+        }
+        if (p >= end)
+        {
+            return NULL;
+        }
+        if (*p == 'u')
+        {
+            for (int i = 1; i <= 4; i++)
+            {
+                if (p + i >= end || HexValue(p[i]) < 0)
+                {
+                    return NULL;
+                }
+            }
+            p += 5;
+        }
+        else if (strchr("\"\\/bfnrt", *p) != NULL && *p != '\0')
+        {
+            p++;
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static const char *CheckDigits(const char *p, const char *end)
+{
+    const char *start = p;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        p++;
+    }
+    return (p > start ? p : NULL);
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+static const char *CheckNumber(const char *p, const char *end)
+{
+    if (p < end && *p == '-')
+    {
+        p++;
+    }
+    if (p < end && *p == '0')
+    {
+        p++;
+    }
+    else if ((p = CheckDigits(p, end)) == NULL)
+    {
+        return NULL;
+    }
+    if (p < end && *p == '.' && (p = CheckDigits(p + 1, end)) == NULL)
+    {
+        return NULL;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if (p < end && (*p == '+' || *p == '-'))
+        {
+            p++;
+        }
+        p = CheckDigits(p, end);
+    }
+    return p;
+}
+
+int DevKitJsonPath_Validate(const char *json, size_t size)
+{
+    if (json == NULL)
+    {
+        return -1;
+    }
+
+    char close[JSON_PATH_MAX_DEPTH];
+    int depth = 0;
+    const char *p = json;
+    const char *end = json + size;
+    while (true)
+    {
+        // A value
+        p = SkipSpace(p, end);
+        if (p >= end)
+        {
+            return -1;
+        }
+        if (*p == '{' || *p == '[')
+        {
+            if (depth == JSON_PATH_MAX_DEPTH)
+            {
+                return -1;
+            }
+            close[depth++] = (*p == '{' ? '}' : ']');
+            p = SkipSpace(p + 1, end);
+            if (p < end && *p == close[depth - 1])
+            {
+                p++;
+                depth--;
+            }
+            else if (close[depth - 1] == '}')
+            {
+                if (p >= end || *p != '"' || (p = CheckString(p + 1, end)) == NULL)
+                {
+                    return -1;
+                }
+                p = SkipSpace(p, end);
+                if (p >= end || *p++ != ':')
+                {
+                    return -1;
+                }
+                continue;
+            }
+            else
+            {
+                continue;
+            }
+        }
+        else if (*p == '"')
+        {
+            p = CheckString(p + 1, end);
+        }
+        else if (*p == '-' || (*p >= '0' && *p <= '9'))
+        {
+            p = CheckNumber(p, end);
+        }
+        else if (end - p >= 4 && (strncmp(p, "true", 4) == 0 || strncmp(p, "null", 4) == 0))
+        {
+            p += 4;
+        }
+        else if (end - p >= 5 && strncmp(p, "false", 5) == 0)
+        {
+            p += 5;
+        }
+        else
+        {
+            p = NULL;
+        }
+        if (p == NULL)
+        {
+            return -1;
+        }
+
+        // After a value, ',' goes on with the container and the closing brackets end them
+        while (true)
+        {
+            p = SkipSpace(p, end);
+            if (depth == 0)
+            {
+                return (p == end ? 0 : -1);
+            }
+            if (p >= end)
+            {
+                return -1;
+            }
+            if (*p == close[depth - 1])
+            {
+                p++;
+                depth--;
+                continue;
+            }
+            if (*p++ != ',')
+            {
+                return -1;
+            }
+            if (close[depth - 1] == '}')
+            {
+                p = SkipSpace(p, end);
+                if (p >= end || *p != '"' || (p = CheckString(p + 1, end)) == NULL)
+                {
+                    return -1;
+                }
+                p = SkipSpace(p, end);
+                if (p >= end || *p++ != ':')
+                {
+                    return -1;
+                }
+            }
+            break;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Writing
+// Room a member takes: the closing braces of the open objects, the names, quotes, colons and braces
+// of the new ones, the value and the closing braces of the object
+static size_t MemberSpace(int depth, const char *path, size_t valueLength)
+{
+    int objects = SegmentCount(path) - 1;
+    return depth + 1 + strlen(path) + 4 * (objects + 1) + valueLength + objects + 2;
+}
+
+// The objects of path a, up to depth, that path b goes through too
+static int CommonObjects(const char *a, int depth, const char *b)
+{
+    int common = 0;
+    while (common < depth)
+    {
+        const char *ea = strchr(a, '.');
+        const char *eb = strchr(b, '.');
+        if (ea == NULL || eb == NULL || ea - a != eb - b || strncmp(a, b, ea - a) != 0)
+        {
+            break;
+        }
+        a = ea + 1;
+        b = eb + 1;
+        common++;
+    }
+    return common;
+}
+
+size_t DevKitJsonPath_MemberSize(const char *path, size_t valueLength)
+{
+    // The opening brace
+    return 1 + MemberSpace(0, path, valueLength);
+}
+
+int DevKitJsonPath_WriteObject(const char **paths, const char **values, int count, char *buffer, size_t size, bool *written)
+{
+    if (paths == NULL || values == NULL || count < 0 || count > JSON_PATH_MAX_COUNT || buffer == NULL || size < 3 || written == NULL)
+    {
+        return -1;
+    }
+
+    // Sorted by path, so that the members of an object are next to each other
+    uint8_t sorted[JSON_PATH_MAX_COUNT];
+    for (int i = 0; i < count; i++)
+    {
+        int j = i;
+        while (j > 0 && strcmp(paths[sorted[j - 1]], paths[i]) > 0)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = (uint8_t)i;
+        written[i] = false;
+    }
+
+    char *p = buffer;
+    char *end = buffer + size;
+    const char *openPath = "";
+    int depth = 0;          // Objects of openPath still open
+    bool first = true;      // No member yet in the innermost object
+    *p++ = '{';
+    for (int i = 0; i < count; i++)
+    {
+        const char *path = paths[sorted[i]];
+        const char *value = values[sorted[i]];
+        size_t valueLength = strlen(value);
+        if (p + MemberSpace(depth, path, valueLength) > end)
+        {
+            continue;
+        }
+
+        int common = CommonObjects(openPath, depth, path);
+        for (; depth > common; depth--)
+        {
+            *p++ = '}';
+            first = false;
+        }
+
+        const char *name = path;
+        for (int n = 0; n < common; n++)
+        {
+            name = strchr(name, '.') + 1;
+        }
+        while (true)
+        {
+            const char *nameEnd = strchr(name, '.');
+            size_t length = (nameEnd ? nameEnd - name : strlen(name));
+            if (!first)
+            {
+                *p++ = ',';
+            }
+            *p++ = '"';
+            memcpy(p, name, length);
+            p += length;
+            *p++ = '"';
+            *p++ = ':';
+            if (nameEnd == NULL)
+            {
+                break;
+            }
+            *p++ = '{';
+            depth++;
+            first = true;
+            name = nameEnd + 1;
+        }
+        memcpy(p, value, valueLength);
+        p += valueLength;
+        first = false;
+        openPath = path;
+        written[sorted[i]] = true;
+    }
+    if (p == buffer + 1)
+    {
+        return 0;
+    }
+    for (; depth > 0; depth--)
+    {
+        *p++ = '}';
+    }
+    *p++ = '}';
+    *p = '\0';
+    return (int)(p - buffer);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Values
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int ParseHex4(const char *p, const char *end)
+{
+    if (end - p < 4)
+    {
+        return -1;
+    }
+    int value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int digit = HexValue(p[i]);
+        if (digit < 0)
+        {
+            return -1;
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+int DevKitJsonPath_GetString(const JSON_PATH *path, char *buffer, size_t bufferSize)
+{
+    if (path == NULL || path->type != JSON_PATH_STRING || buffer == NULL || bufferSize == 0)
+    {
+        return -1;
+    }
+
+    const char *p = path->value;
+    const char *end = p + path->length;
+    size_t n = 0;
+    while (p < end)
+    {
+        char utf8[4];
+        size_t length = 1;
+        if (*p != '\\')
+        {
+            utf8[0] = *p++;
+        }
+        else
+        {
+            p++;
+            if (p >= end)
+            {
+                return -1;
+            }
+            char c = *p++;
+            switch (c)
+            {
+            case 'b': utf8[0] = '\b'; break;
+            case 'f': utf8[0] = '\f'; break;
+            case 'n': utf8[0] = '\n'; break;
+            case 'r': utf8[0] = '\r'; break;
+            case 't': utf8[0] = '\t'; break;
+            case 'u':
+            {
+                long code = ParseHex4(p, end);
+                if (code < 0)
+                {
+                    return -1;
+                }
+                p += 4;
+                // Surrogate pair
+                if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                {
+                    long low = ParseHex4(p + 2, end);
+                    if (low >= 0xDC00 && low <= 0xDFFF)
+                    {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                if (code < 0x80)
+                {
+                    utf8[0] = (char)code;
+                }
+                else if (code < 0x800)
+                {
+                    utf8[0] = (char)(0xC0 | (code >> 6));
+                    utf8[1] = (char)(0x80 | (code & 0x3F));
+                    length = 2;
+                }
+                else if (code < 0x10000)
+                {
+                    utf8[0] = (char)(0xE0 | (code >> 12));
+                    utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[2] = (char)(0x80 | (code & 0x3F));
+                    length = 3;
+                }
+                else
+                {
+                    utf8[0] = (char)(0xF0 | (code >> 18));
+                    utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+                    utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[3] = (char)(0x80 | (code & 0x3F));
+                    length = 4;
+                }
+                break;
+            }
+            default:
+                // '"', '\\' and '/'
+                utf8[0] = c;
+                break;
+            }
+        }
+
+        if (n + length >= bufferSize)
+        {
+            return -1;
+        }
+        memcpy(buffer + n, utf8, length);
+        n += length;
+    }
+    buffer[n] = '\0';
+    return (int)n;
+}
+
+double DevKitJsonPath_GetNumber(const JSON_PATH *path, double defaultValue)
+{
+    char number[40];
+    if (path == NULL || path->type != JSON_PATH_NUMBER || path->length >= sizeof(number))
+    {
+        return defaultValue;
+    }
+    memcpy(number, path->value, path->length);
+    number[path->length] = '\0';
+    return strtod(number, NULL);
+}
+
+int DevKitJsonPath_GetBool(const JSON_PATH *path, int defaultValue)
+{
+    if (path == NULL || path->type != JSON_PATH_BOOLEAN)
+    {
+        return defaultValue;
+    }
+    return (path->value[0] == 't' ? 1 : 0);
+}
@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef __DEVKIT_JSON_PATH_H__
+#define __DEVKIT_JSON_PATH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Nesting of objects and arrays the extractor follows
+#define JSON_PATH_MAX_DEPTH 16
+// Paths one DevKitJsonPath_Extract() call looks for
+#define JSON_PATH_MAX_COUNT 32
+
+typedef enum
+{
+    JSON_PATH_NOT_FOUND,
+    JSON_PATH_STRING,
+    JSON_PATH_NUMBER,
+    JSON_PATH_BOOLEAN,
+    JSON_PATH_NULL,
+    JSON_PATH_OBJECT,
+    JSON_PATH_ARRAY
+} JSON_PATH_TYPE;
+
+typedef struct
+{
+    // Dot separated keys, e.g. "desired.firmware.fwVersion", array elements by index, e.g. "items.0.id"
+    const char* path;
+
+    // Filled in by DevKitJsonPath_Extract()
+    JSON_PATH_TYPE type;
+    const char* value;      // Points into the JSON text, strings without the quotes and still escaped
+    size_t length;
+} JSON_PATH;
+
+/**
+* @brief    Find the values of the given paths in a JSON text in one pass, without building a
+*           document and without copying or allocating anything.
+*
+* @param    json                The JSON text, not necessarily NULL terminated.
+* @param    size                The length of the JSON text.
+* @param    paths               The paths to look for, the results are stored in them.
+* @param    count               Number of the paths, up to JSON_PATH_MAX_COUNT.
+*
+* @return   The number of the paths found, or -1 if the JSON text is malformed.
+*
+* @remarks  The first occurrence of a path wins. Keys are compared as they are written, so a key
+*           with escapes only matches a path with the same escapes. The text after the last path
+*           found is not checked.
+*/
+int DevKitJsonPath_Extract(const char *json, size_t size, JSON_PATH *paths, int count);
+
+/**
+* @brief    Check that a text is one well-formed JSON value, with white space around it only.
+*
+* @param    json                The JSON text, not necessarily NULL terminated.
+* @param    size                The length of the JSON text.
+*
+* @return   0 if the text is well-formed, or -1 if not or if it nests deeper than JSON_PATH_MAX_DEPTH.
+*/
+int DevKitJsonPath_Validate(const char *json, size_t size);
+
+/**
+* @brief    Write JSON values at dot separated paths as one object, nested by the paths, e.g.
+*           {"a":{"b":1,"c":2},"d":3} for "a.b", "a.c" and "d".
+*
+* @param    paths               The paths, none of them the object of another one.
+* @param    values              The JSON values, written as they are.
+* @param    count               Number of the paths, up to JSON_PATH_MAX_COUNT.
+* @param    buffer              Buffer to receive the NULL terminated object.
+* @param    size                Size of the buffer.
+* @param    written             Set for every value in the object, the values that don't fit are left out.
+*
+* @return   The length of the object, 0 if no value fits, or -1 on bad arguments.
+*/
+int DevKitJsonPath_WriteObject(const char **paths, const char **values, int count, char *buffer, size_t size, bool *written);
+
+/**
+* @brief    The buffer size DevKitJsonPath_WriteObject() needs for an object with only the given value.
+*/
+size_t DevKitJsonPath_MemberSize(const char *path, size_t valueLength);
+
+/**
+* @brief    Copy a string value with the escapes resolved.
+*
+* @param    path                A path found by DevKitJsonPath_Extract().
+* @param    buffer              Buffer to receive the NULL terminated string.
+* @param    bufferSize          Size of the buffer.
+*
+* @return   The length of the string, or -1 if the value is no string or does not fit.
+*/
+int DevKitJsonPath_GetString(const JSON_PATH *path, char *buffer, size_t bufferSize);
+
+/**
+* @brief    Get a number value.
+*
+* @return   The number, or defaultValue if the value is no number.
+*/
+double DevKitJsonPath_GetNumber(const JSON_PATH *path, double defaultValue);
+
+/**
+* @brief    Get a boolean value.
+*
+* @return   1 for true, 0 for false, or defaultValue if the value is no boolean.
+*/
+int DevKitJsonPath_GetBool(const JSON_PATH *path, int defaultValue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __DEVKIT_JSON_PATH_H__
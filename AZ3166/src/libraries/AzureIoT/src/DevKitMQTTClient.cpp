@@ -5,11 +5,13 @@
 #include "DevkitDPSClient.h"
 #include "EEPROMInterface.h"
 #include "SerialLog.h"
+#include "SystemBoot.h"
 #include "SystemTickCounter.h"
 #include "SystemTime.h"
 #include "SystemVersion.h"
 #include "SystemWiFi.h"
 #include "Telemetry.h"
+#include "floatIO.h"
 
 #include "iothub_client_version.h"
 #include "iothub_client_ll.h"
@@ -18,12 +20,69 @@
 #include "azure_c_shared_utility/shared_util_options.h"
 
 #define CONNECT_TIMEOUT_MS 30000
+#define TIME_SYNC_TIMEOUT_MS 30000
 #define CHECK_INTERVAL_MS 5000
 #define MQTT_KEEPALIVE_INTERVAL_S 120
 #define SEND_EVENT_RETRY_COUNT 2
 #define EVENT_TIMEOUT_MS 10000
 #define EVENT_CONFIRMED -2
 #define EVENT_FAILED -3
+// The worker runs the IoT hub client at this period, and at once when there is something to send
+#define IOTHUB_WORKER_POLL_MS 10
+#define IOTHUB_WORKER_STACK_SIZE 0x2000
+// Status callbacks and method calls waiting for DevKitMQTTClient_Check(), the messages and twin updates are not counted
+#define CALLBACK_QUEUE_SIZE 16
+// Messages waiting, beyond them IoT hub is asked to send them again later
+#define MESSAGE_MAX_WAITING 8
+// Partial twin updates waiting, beyond them they are all dropped and the full twin is asked for instead
+#define TWIN_UPDATE_MAX_WAITING 8
+#define SEND_WAIT_MS 100
+// The registered device methods, in a hash table at most half full
+#define METHOD_TABLE_SIZE (2 * DEVICE_METHOD_MAX_COUNT)
+// Response buffers of the method handlers, more than one only when methods are answered on several threads
+#define METHOD_RESPONSE_BUFFERS 2
+// The JSON of one reported properties patch, the properties that don't fit go with the next one
+#define REPORTED_PATCH_SIZE 1024
+
+typedef enum
+{
+    CALLBACK_CONNECTION_STATUS,
+    CALLBACK_SEND_CONFIRMATION,
+    CALLBACK_MESSAGE,
+    CALLBACK_DEVICE_TWIN,
+    CALLBACK_DEVICE_METHOD,
+    CALLBACK_REPORT_CONFIRMATION
+} CALLBACK_TYPE;
+
+// A callback of the IoT hub client, passed from the worker to the thread calling DevKitMQTTClient_Check()
+typedef struct CALLBACK_EVENT_TAG
+{
+    struct CALLBACK_EVENT_TAG *next;
+    CALLBACK_TYPE type;
+    int result;                 // Status, confirmation result, twin update state or status code
+    int reason;
+    METHOD_HANDLE methodId;
+    int generation;             // Of the client the method call came from
+    const char *methodName;     // Follows the payload in data
+    size_t size;
+    unsigned char data[1];      // Payload, NULL terminated
+} CALLBACK_EVENT;
+
+typedef struct
+{
+    const char *name;           // NULL for a free entry
+    uint32_t hash;
+    DEVICE_METHOD_HANDLER handler;
+} DEVICE_METHOD_ENTRY;
+
+typedef struct
+{
+    char path[REPORTED_PATH_MAX_LEN + 1];   // Empty for a free entry
+    char *value;                            // JSON text
+    size_t capacity;
+    bool dirty;                             // Changed since it went out last
+    bool sending;                           // In the patch on the way
+} REPORTED_PROPERTY;
 
 static int callbackCounter;
 static IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = NULL;
@@ -44,6 +103,51 @@ static const char* trustedCerts = certificates;
 
 static uint64_t iothub_check_ms;
 
+// The client runs on the worker thread, the other threads get iothubMutex to call it
+static Mutex iothubMutex;
+static Semaphore iothubWake(0);
+static Thread *iothubThread = NULL;
+static int clientGeneration = 0;
+// The callbacks in the order they came, under callbackMutex, callbackReady has a token for each
+static Mutex callbackMutex;
+static Semaphore callbackReady(0);
+static CALLBACK_EVENT *callbackHead = NULL;
+static CALLBACK_EVENT *callbackTail = NULL;
+static int callbackCount = 0;
+static int twinWaiting = 0;
+static int messageWaiting = 0;
+// A twin update was lost, the full twin is asked for by the worker, under iothubMutex
+static bool twinStale = false;
+static bool twinRequested = false;
+// Synchronous sends wait for their confirmation one at a time
+static Mutex sendMutex;
+static Semaphore sendDone(0);
+
+// The registered methods, their response buffers and the counts, under methodMutex
+static Mutex methodMutex;
+static DEVICE_METHOD_ENTRY methods[DEVICE_METHOD_MAX_COUNT];
+static unsigned char methodTable[METHOD_TABLE_SIZE];      // Entry + 1, 0 for an empty slot
+static unsigned char methodResponses[METHOD_RESPONSE_BUFFERS][DEVICE_METHOD_RESPONSE_SIZE];
+static unsigned int methodResponsesInUse = 0;
+static DEVICE_METHOD_STATS methodStats = { 0 };
+
+// The reported properties and the counts, under reportedMutex. One patch is on the way at a time, the
+// properties changed meanwhile go with the next one.
+static Mutex reportedMutex;
+static REPORTED_PROPERTY reportedProperties[REPORTED_PROPERTY_MAX_COUNT];
+static char reportedPatch[REPORTED_PATCH_SIZE];
+static EVENT_INSTANCE *reportedEvent = NULL;
+static volatile int reportedDirty = 0;
+static volatile bool reportedForce = false;
+static int reportInterval = REPORTED_INTERVAL_MS;
+static uint64_t reported_ms = 0;
+static REPORTED_STATS reportedStats = { 0 };
+
+// On the worker, next to the client
+static void RefreshTwin();
+static void FlushReported();
+static bool ReportedPatchDone(EVENT_INSTANCE *event, int statusCode);
+
 static char *iothub_hostname = NULL;
 static char *miniSolutionName = NULL;
 
@@ -55,6 +159,13 @@ extern void ota_callback(const unsigned char *payLoad, size_t size);
 // Utilities
 static void CheckConnection()
 {
+    if (!resetClient)
+    {
+        return;
+    }
+
+    // One thread re-connects, the others wait for it
+    sendMutex.lock();
     if (resetClient)
     {
         if (SystemWiFiRSSI() == 0)
@@ -70,6 +181,7 @@ static void CheckConnection()
             DevKitMQTTClient_Init(enableDeviceTwin);
         }
     }
+    sendMutex.unlock();
 }
 
 static void AZIoTLog(LOG_CATEGORY log_category, const char *file, const char *func, const int line, unsigned int options, const char *format, ...)
@@ -180,8 +292,237 @@ static void FreeEventInstance(EVENT_INSTANCE *event)
     }
 }
 
+static CALLBACK_EVENT *NewCallbackEvent(CALLBACK_TYPE type, const unsigned char *payload, size_t size, const char *methodName)
+{
+    size_t nameLength = (methodName ? strlen(methodName) + 1 : 0);
+    CALLBACK_EVENT *event = (CALLBACK_EVENT *)malloc(sizeof(CALLBACK_EVENT) + size + nameLength);
+    if (event == NULL)
+    {
+        LogError("Failed to malloc for the callback");
+        return NULL;
+    }
+
+    event->type = type;
+    event->result = 0;
+    event->reason = 0;
+    event->methodId = NULL;
+    event->generation = clientGeneration;
+    event->size = size;
+    if (size > 0)
+    {
+        memcpy(event->data, payload, size);
+    }
+    event->data[size] = '\0';
+    event->methodName = NULL;
+    if (methodName)
+    {
+        event->methodName = (const char *)event->data + size + 1;
+        memcpy((char *)event->methodName, methodName, nameLength);
+    }
+    return event;
+}
+
+// Messages are limited by MESSAGE_MAX_WAITING, twin updates by DeviceTwinCallback(), the others by CALLBACK_QUEUE_SIZE
+static bool PostCallbackEvent(CALLBACK_EVENT *event)
+{
+    if (event == NULL)
+    {
+        return false;
+    }
+    bool counted = (event->type != CALLBACK_MESSAGE && event->type != CALLBACK_DEVICE_TWIN);
+
+    callbackMutex.lock();
+    if ((counted && callbackCount >= CALLBACK_QUEUE_SIZE) || (event->type == CALLBACK_MESSAGE && messageWaiting >= MESSAGE_MAX_WAITING))
+    {
+        callbackMutex.unlock();
+        LogError("Callback queue is full");
+        free(event);
+        return false;
+    }
+    if (counted)
+    {
+        callbackCount++;
+    }
+    else if (event->type == CALLBACK_DEVICE_TWIN)
+    {
+        twinWaiting++;
+    }
+    else
+    {
+        messageWaiting++;
+    }
+    event->next = NULL;
+    if (callbackTail)
+    {
+        callbackTail->next = event;
+    }
+    else
+    {
+        callbackHead = event;
+    }
+    callbackTail = event;
+    callbackMutex.unlock();
+
+    callbackReady.release();
+    return true;
+}
+
+static CALLBACK_EVENT *TakeCallbackEvent()
+{
+    callbackMutex.lock();
+    CALLBACK_EVENT *event = callbackHead;
+    if (event)
+    {
+        callbackHead = event->next;
+        if (callbackHead == NULL)
+        {
+            callbackTail = NULL;
+        }
+        if (event->type == CALLBACK_DEVICE_TWIN)
+        {
+            twinWaiting--;
+        }
+        else if (event->type == CALLBACK_MESSAGE)
+        {
+            messageWaiting--;
+        }
+        else
+        {
+            callbackCount--;
+        }
+    }
+    callbackMutex.unlock();
+    return event;
+}
+
+// With callbackMutex held, their tokens of callbackReady are left and taken without an event
+static void DropTwinEvents()
+{
+    CALLBACK_EVENT **link = &callbackHead;
+    callbackTail = NULL;
+    while (*link)
+    {
+        CALLBACK_EVENT *event = *link;
+        if (event->type == CALLBACK_DEVICE_TWIN)
+        {
+            *link = event->next;
+            free(event);
+            continue;
+        }
+        callbackTail = event;
+        link = &event->next;
+    }
+    twinWaiting = 0;
+}
+
+static uint32_t HashMethodName(const char *methodName)
+{
+    uint32_t hash = 2166136261u;        // FNV-1a
+    for (const char *p = methodName; *p; p++)
+    {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
+
+// With methodMutex held
+static DEVICE_METHOD_ENTRY *FindMethod(const char *methodName, uint32_t hash)
+{
+    for (int i = hash % METHOD_TABLE_SIZE; methodTable[i] != 0; i = (i + 1) % METHOD_TABLE_SIZE)
+    {
+        DEVICE_METHOD_ENTRY *entry = &methods[methodTable[i] - 1];
+        if (entry->hash == hash && strcmp(entry->name, methodName) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void InsertMethod(int index)
+{
+    int i = methods[index].hash % METHOD_TABLE_SIZE;
+    while (methodTable[i] != 0)
+    {
+        i = (i + 1) % METHOD_TABLE_SIZE;
+    }
+    methodTable[i] = (unsigned char)(index + 1);
+}
+
+static unsigned char *TakeResponseBuffer()
+{
+    methodMutex.lock();
+    for (int i = 0; i < METHOD_RESPONSE_BUFFERS; i++)
+    {
+        if ((methodResponsesInUse & (1u << i)) == 0)
+        {
+            methodResponsesInUse |= (1u << i);
+            methodMutex.unlock();
+            return methodResponses[i];
+        }
+    }
+    methodStats.allocations++;
+    methodMutex.unlock();
+    return (unsigned char *)malloc(DEVICE_METHOD_RESPONSE_SIZE);
+}
+
+static void ReleaseResponseBuffer(unsigned char *buffer)
+{
+    for (int i = 0; i < METHOD_RESPONSE_BUFFERS; i++)
+    {
+        if (buffer == methodResponses[i])
+        {
+            methodMutex.lock();
+            methodResponsesInUse &= ~(1u << i);
+            methodMutex.unlock();
+            return;
+        }
+    }
+    free(buffer);
+}
+
+static void WakeWorker()
+{
+    iothubWake.release();
+}
+
+static void IoTHubWorker()
+{
+    while (true)
+    {
+        iothubWake.wait(IOTHUB_WORKER_POLL_MS);
+
+        iothubMutex.lock();
+        if (iotHubClientHandle != NULL && !resetClient)
+        {
+            IoTHubClient_LL_DoWork(iotHubClientHandle);
+            RefreshTwin();
+        }
+        iothubMutex.unlock();
+
+        FlushReported();
+    }
+}
+
+static bool StartWorker()
+{
+    if (iothubThread == NULL)
+    {
+        iothubThread = new Thread(osPriorityNormal, IOTHUB_WORKER_STACK_SIZE, NULL);
+        if (iothubThread == NULL)
+        {
+            LogError("Failed to create the IoT hub worker");
+            return false;
+        }
+        iothubThread->start(IoTHubWorker);
+    }
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Event handlers
+// They run on the worker, in IoTHubClient_LL_DoWork(), and pass the callbacks of the app on to
+// DevKitMQTTClient_Check().
 static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void *userContextCallback)
 {
     clientConnected = false;
@@ -199,8 +540,14 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
         }
         break;
     case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
-        break;
     case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
+        if (result == IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED && is_iothub_from_dps && DevkitDPSHubConnected(false))
+        {
+            // The IoT hub cached from an earlier DPS registration turned the device down, register
+            // again on the re-connect
+            resetClient = true;
+            LogInfo(">>>Connection status: rejected");
+        }
         break;
     case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
         break;
@@ -224,6 +571,10 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
             LedAzure = 1;
             clientConnected = true;
             LogInfo(">>>Connection status: connected");
+            if (is_iothub_from_dps)
+            {
+                DevkitDPSHubConnected(true);
+            }
 
             LogTrace("Create", "IoT hub established");
         }
@@ -232,7 +583,13 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
 
     if (_connection_status_callback)
     {
-        _connection_status_callback(result, reason);
+        CALLBACK_EVENT *event = NewCallbackEvent(CALLBACK_CONNECTION_STATUS, NULL, 0, NULL);
+        if (event)
+        {
+            event->result = result;
+            event->reason = reason;
+            PostCallbackEvent(event);
+        }
     }
 }
 
@@ -251,6 +608,7 @@ static void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, v
         {
             currentTrackingId = EVENT_FAILED;
         }
+        sendDone.release();
     }
 
     // Free the message
@@ -258,13 +616,17 @@ static void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, v
 
     if (_send_confirmation_callback)
     {
-        _send_confirmation_callback(result);
+        CALLBACK_EVENT *callback = NewCallbackEvent(CALLBACK_SEND_CONFIRMATION, NULL, 0, NULL);
+        if (callback)
+        {
+            callback->result = result;
+            PostCallbackEvent(callback);
+        }
     }
 }
 
 static IOTHUBMESSAGE_DISPOSITION_RESULT ReceiveMessageCallback(IOTHUB_MESSAGE_HANDLE message, void *userContextCallback)
 {
-    int *counter = (int *)userContextCallback;
     const char *buffer;
     size_t size;
 
@@ -274,157 +636,617 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT ReceiveMessageCallback(IOTHUB_MESSAGE_HA
         LogError("unable to retrieve the message data");
         return IOTHUBMESSAGE_REJECTED;
     }
+
+    if (!PostCallbackEvent(NewCallbackEvent(CALLBACK_MESSAGE, (const unsigned char *)buffer, size, NULL)))
+    {
+        // Too many waiting for the app or no memory for it, IoT hub sends it again later
+        return IOTHUBMESSAGE_ABANDONED;
+    }
+    return IOTHUBMESSAGE_ACCEPTED;
+}
+
+static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payLoad, size_t size, void *userContextCallback)
+{
+    if (payLoad == NULL)
+    {
+        return;
+    }
+
+    // The firmware of the twin is picked up here, whether the app calls DevKitMQTTClient_Check() or not
+    ota_callback(payLoad, size);
+    if (_device_twin_callback == NULL)
+    {
+        return;
+    }
+
+    // No update is lost: the full twin makes the updates still waiting obsolete, and when the updates
+    // pile up or one can't be kept, they are dropped for the full twin
+    CALLBACK_EVENT *event = NewCallbackEvent(CALLBACK_DEVICE_TWIN, payLoad, size, NULL);
+    callbackMutex.lock();
+    bool lost = (event == NULL || (updateState != DEVICE_TWIN_UPDATE_COMPLETE && twinWaiting >= TWIN_UPDATE_MAX_WAITING));
+    if (lost || updateState == DEVICE_TWIN_UPDATE_COMPLETE)
+    {
+        DropTwinEvents();
+    }
+    callbackMutex.unlock();
+    if (lost)
+    {
+        free(event);
+        twinStale = true;
+        return;
+    }
+    event->result = updateState;
+    PostCallbackEvent(event);
+}
+
+static void TwinRefreshCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payLoad, size_t size, void *userContextCallback)
+{
+    twinRequested = false;
+    if (payLoad == NULL || size == 0)
+    {
+        // Ask again
+        twinStale = true;
+        return;
+    }
+    DeviceTwinCallback(DEVICE_TWIN_UPDATE_COMPLETE, payLoad, size, userContextCallback);
+}
+
+// On the worker, with iothubMutex held
+static void RefreshTwin()
+{
+    if (twinStale && !twinRequested && clientConnected)
+    {
+        if (IoTHubDeviceClient_LL_GetTwinAsync(iotHubClientHandle, TwinRefreshCallback, NULL) == IOTHUB_CLIENT_OK)
+        {
+            twinStale = false;
+            twinRequested = true;
+        }
+    }
+}
+
+static int DeviceMethodCallback(const char *methodName, const unsigned char *payload, size_t size, METHOD_HANDLE methodId, void *userContextCallback)
+{
+    CALLBACK_EVENT *event = NewCallbackEvent(CALLBACK_DEVICE_METHOD, payload, size, methodName);
+    if (event)
+    {
+        event->methodId = methodId;
+        if (PostCallbackEvent(event))
+        {
+            // Answered by DispatchCallbacks()
+            return 0;
+        }
+    }
+
+    methodMutex.lock();
+    methodStats.calls++;
+    methodStats.busy++;
+    methodMutex.unlock();
+
+    const char *responseMessage = "\"Device is busy\"";
+    IoTHubClient_LL_DeviceMethodResponse(iotHubClientHandle, methodId, (const unsigned char *)responseMessage, strlen(responseMessage), 503);
+    return 0;
+}
+
+static void ReportConfirmationCallback(int statusCode, void *userContextCallback)
+{
+    EVENT_INSTANCE *event = (EVENT_INSTANCE *)userContextCallback;
+    LogInfo(">>>Confirmation[%d] received for state tracking id = %d with state code = %d", callbackCounter++, event->trackingId, statusCode);
+    ReportedPatchDone(event, statusCode);
+
+    if (currentTrackingId == event->trackingId)
+    {
+        currentTrackingId = (statusCode == 204 ? EVENT_CONFIRMED : EVENT_FAILED);
+        sendDone.release();
+    }
+    if (statusCode != 204)
+    {
+        LogError("Report confirmation failed with state code %d", statusCode);
+    }
+
+    // Free the state
+    FreeEventInstance(event);
+
+    if (_report_confirmation_callback)
+    {
+        CALLBACK_EVENT *callback = NewCallbackEvent(CALLBACK_REPORT_CONFIRMATION, NULL, 0, NULL);
+        if (callback)
+        {
+            callback->result = statusCode;
+            PostCallbackEvent(callback);
+        }
+    }
+}
+
+static void RespondDeviceMethod(CALLBACK_EVENT *event)
+{
+    const unsigned char *response = NULL;
+    unsigned char *buffer = NULL;       // A response buffer, or the response of the callback
+    int responseSize = 0;
+    int status;
+
+    methodMutex.lock();
+    methodStats.calls++;
+    DEVICE_METHOD_ENTRY *entry = FindMethod(event->methodName, HashMethodName(event->methodName));
+    DEVICE_METHOD_HANDLER handler = (entry ? entry->handler : NULL);
+    methodMutex.unlock();
+    DEVICE_METHOD_CALLBACK callback = (handler ? NULL : _device_method_callback);
+
+    if (handler)
+    {
+        buffer = TakeResponseBuffer();
+        status = 500;
+        if (buffer != NULL)
+        {
+            status = handler(event->data, (int)event->size, buffer, DEVICE_METHOD_RESPONSE_SIZE, &responseSize);
+            response = buffer;
+        }
+        if (buffer == NULL || responseSize < 0 || responseSize > DEVICE_METHOD_RESPONSE_SIZE)
+        {
+            LogError("No room for the response of method %s", event->methodName);
+            response = (const unsigned char *)"\"Response too large\"";
+            responseSize = strlen((const char *)response);
+            status = 500;
+        }
+    }
+    else if (callback)
+    {
+        status = callback(event->methodName, event->data, (int)event->size, &buffer, &responseSize);
+        response = buffer;
+    }
+    else
+    {
+        response = (const unsigned char *)"\"No method found\"";
+        responseSize = strlen((const char *)response);
+        status = 404;
+    }
+
+    methodMutex.lock();
+    if (handler)
+    {
+        methodStats.handled++;
+    }
+    else if (callback)
+    {
+        methodStats.fallback++;
+        if (buffer != NULL)
+        {
+            methodStats.allocations++;
+        }
+    }
+    else
+    {
+        methodStats.not_found++;
+    }
+    methodMutex.unlock();
+
+    iothubMutex.lock();
+    // The method handles of a client are gone with it
+    if (iotHubClientHandle != NULL && event->generation == clientGeneration)
+    {
+        if (IoTHubClient_LL_DeviceMethodResponse(iotHubClientHandle, event->methodId, response, responseSize, status) != IOTHUB_CLIENT_OK)
+        {
+            LogError("IoTHubClient_LL_DeviceMethodResponse..........FAILED!");
+        }
+    }
+    iothubMutex.unlock();
+    WakeWorker();
+    if (handler)
+    {
+        ReleaseResponseBuffer(buffer);
+    }
     else
     {
-        char *temp = (char *)malloc(size + 1);
-        if (temp == NULL)
+        free(buffer);
+    }
+}
+
+// Runs the callbacks passed on by the worker, waiting up to millisec for the first one, returns the messages delivered
+static int DispatchCallbacks(uint32_t millisec)
+{
+    int messages = 0;
+    while (true)
+    {
+        if (callbackReady.wait(millisec) <= 0)
         {
-            LogError("Failed to malloc for command");
-            return IOTHUBMESSAGE_REJECTED;
+            return messages;
         }
-        memcpy(temp, buffer, size);
-        temp[size] = '\0';
-        LogInfo(">>>Received Message [%d], Size=%d Message %s", *counter, (int)size, temp);
-        if (_message_callback)
+        millisec = 0;
+
+        CALLBACK_EVENT *event = TakeCallbackEvent();
+        if (event == NULL)
+        {
+            // The token of a dropped twin update
+            continue;
+        }
+        switch (event->type)
+        {
+        case CALLBACK_CONNECTION_STATUS:
+            if (_connection_status_callback)
+            {
+                _connection_status_callback((IOTHUB_CLIENT_CONNECTION_STATUS)event->result, (IOTHUB_CLIENT_CONNECTION_STATUS_REASON)event->reason);
+            }
+            break;
+        case CALLBACK_SEND_CONFIRMATION:
+            if (_send_confirmation_callback)
+            {
+                _send_confirmation_callback((IOTHUB_CLIENT_CONFIRMATION_RESULT)event->result);
+            }
+            break;
+        case CALLBACK_MESSAGE:
+            LogInfo(">>>Received Message [%d], Size=%d Message %s", receiveContext, (int)event->size, (const char *)event->data);
+            if (_message_callback)
+            {
+                _message_callback((const char *)event->data, event->size);
+            }
+            receiveContext++;
+            messages++;
+            break;
+        case CALLBACK_DEVICE_TWIN:
+            if (_device_twin_callback)
+            {
+                _device_twin_callback((DEVICE_TWIN_UPDATE_STATE)event->result, event->data, event->size);
+            }
+            break;
+        case CALLBACK_DEVICE_METHOD:
+            RespondDeviceMethod(event);
+            break;
+        case CALLBACK_REPORT_CONFIRMATION:
+            if (_report_confirmation_callback)
+            {
+                _report_confirmation_callback(event->result);
+            }
+            break;
+        }
+        free(event);
+    }
+}
+
+// Hands the event to the client, which frees it once confirmed
+static bool QueueEvent(EVENT_INSTANCE *event, bool waitConfirmation)
+{
+    bool result = true;
+    iothubMutex.lock();
+    event->trackingId = trackingId++;
+    if (event->type == MESSAGE)
+    {
+        if (IoTHubDeviceClient_LL_SendEventAsync(iotHubClientHandle, event->messageHandle, SendConfirmationCallback, event) != IOTHUB_CLIENT_OK)
+        {
+            LogError("IoTHubClient_LL_SendEventAsync..........FAILED!");
+            result = false;
+        }
+        else
+        {
+            LogInfo(">>>IoTHubClient_LL_SendEventAsync accepted message for transmission to IoT Hub.");
+        }
+    }
+    else if (event->type == STATE)
+    {
+        if (IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)event->stateString, strlen(event->stateString), ReportConfirmationCallback, event) != IOTHUB_CLIENT_OK)
+        {
+            LogError("IoTHubClient_LL_SendReportedState..........FAILED!");
+            result = false;
+        }
+        else
+        {
+            LogInfo(">>>IoTHubClient_LL_SendReportedState accepted state for transmission to IoT Hub.");
+        }
+    }
+    if (result && waitConfirmation)
+    {
+        currentTrackingId = event->trackingId;
+    }
+    iothubMutex.unlock();
+
+    if (!result)
+    {
+        FreeEventInstance(event);
+    }
+    WakeWorker();
+    return result;
+}
+
+static bool SendEventOnce(EVENT_INSTANCE *event)
+{
+    if (event == NULL)
+    {
+        return false;
+    }
+
+    if (iotHubClientHandle == NULL || SystemWiFiRSSI() == 0)
+    {
+        FreeEventInstance(event);
+        return false;
+    }
+
+    CheckConnection();
+    if (resetClient)
+    {
+        // Disconnected
+        FreeEventInstance(event);
+        return false;
+    }
+
+    sendMutex.lock();
+    // Tokens left by confirmations that came after their sender gave up
+    while (sendDone.wait(0) > 0)
+    {
+    }
+
+    bool result = false;
+    uint64_t start_ms = SystemTickCounterRead();
+    if (QueueEvent(event, true))
+    {
+        while (true)
+        {
+            sendDone.wait(SEND_WAIT_MS);
+
+            if (currentTrackingId == EVENT_CONFIRMED)
+            {
+                // IoT Hub got this event
+                result = true;
+                break;
+            }
+            if (currentTrackingId == EVENT_FAILED)
+            {
+                break;
+            }
+
+            // Check timeout
+            int diff = (int)(SystemTickCounterRead() - start_ms);
+            if (diff >= EVENT_TIMEOUT_MS)
+            {
+                // Time out, reset the client
+                LogError("Waiting for send confirmation, time is up %d", diff);
+                resetClient = true;
+            }
+
+            if (resetClient)
+            {
+                // resetClient also can be set as true by the worker
+                // Disconnected, re-send the message
+                break;
+            }
+        }
+    }
+    sendMutex.unlock();
+    return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reported properties
+static bool IsValidPath(const char *path)
+{
+    size_t length = strlen(path);
+    if (length == 0 || length > REPORTED_PATH_MAX_LEN || path[0] == '.' || path[length - 1] == '.')
+    {
+        return false;
+    }
+    for (const char *p = path; *p; p++)
+    {
+        // The names are written to the patch as they are
+        if (*p == '"' || *p == '\\' || (unsigned char)*p < 0x20 || (p[0] == '.' && p[1] == '.'))
         {
-            _message_callback(temp, size);
+            return false;
         }
-        free(temp);
     }
-
-    /* Some device specific action code goes here... */
-    (*counter)++;
-    return IOTHUBMESSAGE_ACCEPTED;
+    return true;
 }
 
-static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payLoad, size_t size, void *userContextCallback)
+// A property can't be an object with other properties in it
+static bool PathsOverlap(const char *a, const char *b)
 {
-    ota_callback(payLoad, size);
-    if (_device_twin_callback)
+    size_t la = strlen(a);
+    size_t lb = strlen(b);
+    if (la > lb)
     {
-        _device_twin_callback(updateState, payLoad, size);
+        return PathsOverlap(b, a);
     }
+    return strncmp(a, b, la) == 0 && (b[la] == '\0' || b[la] == '.');
 }
 
-static int DeviceMethodCallback(const char *methodName, const unsigned char *payload, size_t size, unsigned char **response, size_t *response_size, void *userContextCallback)
+// Writes the dirty properties into reportedPatch, nested by their paths, and marks them as sending.
+// With reportedMutex held, returns the length of the patch or 0 if there is nothing to send.
+static int BuildReportedPatch()
 {
-    if (_device_method_callback)
+    const char *paths[REPORTED_PROPERTY_MAX_COUNT];
+    const char *values[REPORTED_PROPERTY_MAX_COUNT];
+    REPORTED_PROPERTY *dirty[REPORTED_PROPERTY_MAX_COUNT];
+    bool written[REPORTED_PROPERTY_MAX_COUNT];
+    int count = 0;
+    for (int i = 0; i < REPORTED_PROPERTY_MAX_COUNT; i++)
     {
-        return _device_method_callback(methodName, payload, size, response, (int *)response_size);
+        REPORTED_PROPERTY *property = &reportedProperties[i];
+        if (property->path[0] != '\0' && property->dirty)
+        {
+            paths[count] = property->path;
+            values[count] = property->value;
+            dirty[count++] = property;
+        }
     }
 
-    const char *responseMessage = "\"No method found\"";
-    *response_size = strlen(responseMessage);
-    *response = (unsigned char *)strdup("\"No method found\"");
-
-    return 404;
+    // The properties that don't fit go with the next patch, SetReported() takes only the ones that
+    // fit in a patch of their own
+    int length = DevKitJsonPath_WriteObject(paths, values, count, reportedPatch, REPORTED_PATCH_SIZE, written);
+    for (int i = 0; i < count && length > 0; i++)
+    {
+        if (written[i])
+        {
+            dirty[i]->dirty = false;
+            dirty[i]->sending = true;
+            reportedDirty--;
+        }
+    }
+    return (length > 0 ? length : 0);
 }
 
-static void ReportConfirmationCallback(int statusCode, void *userContextCallback)
+// The patch on the way is confirmed, lost or refused. The properties of a patch lost on the way, with status
+// 0 or 408, or refused for now, 429 or 5xx, are sent again unless they changed meanwhile. A patch IoT hub
+// rejects, 4xx, would be rejected again and is dropped. Returns true if the event is the patch.
+static bool ReportedPatchDone(EVENT_INSTANCE *event, int statusCode)
 {
-    EVENT_INSTANCE *event = (EVENT_INSTANCE *)userContextCallback;
-    LogInfo(">>>Confirmation[%d] received for state tracking id = %d with state code = %d", callbackCounter++, event->trackingId, statusCode);
-
-    if (statusCode == 204)
+    reportedMutex.lock();
+    bool found = (event != NULL && event == reportedEvent);
+    if (found)
     {
-        if (currentTrackingId == event->trackingId)
+        bool confirmed = (statusCode >= 200 && statusCode < 300);
+        bool retry = (statusCode == 0 || statusCode == 408 || statusCode == 429 || statusCode >= 500);
+        reportedEvent = NULL;
+        for (int i = 0; i < REPORTED_PROPERTY_MAX_COUNT; i++)
         {
-            currentTrackingId = EVENT_CONFIRMED;
+            REPORTED_PROPERTY *property = &reportedProperties[i];
+            if (property->sending)
+            {
+                property->sending = false;
+                if (retry && !property->dirty)
+                {
+                    property->dirty = true;
+                    reportedDirty++;
+                }
+                else if (!confirmed && !retry && !property->dirty)
+                {
+                    // Not reported, setting the same value again sends it
+                    property->value[0] = '\0';
+                }
+            }
+        }
+        if (!confirmed)
+        {
+            reportedStats.failed++;
         }
     }
-    else
+    reportedMutex.unlock();
+    return found;
+}
+
+static void FlushReported()
+{
+    if (reportedDirty == 0)
     {
-        LogError("Report confirmation failed with state code %d", statusCode);
+        // Nothing to flush, the next changes wait for the interval again
+        reportedForce = false;
+        return;
+    }
+    if (reportedEvent != NULL || iotHubClientHandle == NULL || !clientConnected || resetClient)
+    {
+        return;
+    }
+    if (!reportedForce && (int)(SystemTickCounterRead() - reported_ms) < reportInterval)
+    {
+        return;
     }
 
-    // Free the state
-    FreeEventInstance(event);
+    EVENT_INSTANCE *event = NULL;
+    reportedMutex.lock();
+    reportedForce = false;
+    reported_ms = SystemTickCounterRead();
+    int length = BuildReportedPatch();
+    if (length > 0)
+    {
+        event = DevKitMQTTClient_Event_Generate(reportedPatch, STATE);
+        reportedEvent = event;
+        reportedStats.patches++;
+        reportedStats.bytes += length;
+    }
+    reportedMutex.unlock();
 
-    if (_report_confirmation_callback)
+    if (event != NULL && !QueueEvent(event, false))
     {
-        _report_confirmation_callback(statusCode);
+        ReportedPatchDone(event, 0);
     }
 }
 
-static bool SendEventOnce(EVENT_INSTANCE *event)
+// Last writer wins, with reportedMutex held
+static bool StoreReported(REPORTED_PROPERTY *property, const char *path, const char *json, size_t length)
 {
-    if (event == NULL)
+    if (property != NULL && property->capacity < length + 1)
     {
-        return false;
+        char *value = (char *)realloc(property->value, length + 1);
+        if (value == NULL)
+        {
+            property = NULL;
+        }
+        else
+        {
+            property->value = value;
+            property->capacity = length + 1;
+        }
     }
-
-    if (iotHubClientHandle == NULL || SystemWiFiRSSI() == 0)
+    if (property == NULL)
     {
-        FreeEventInstance(event);
+        LogError("No room for the reported property %s", path);
         return false;
     }
 
-    event->trackingId = trackingId++;
-    currentTrackingId = event->trackingId;
-
-    CheckConnection();
-    if (resetClient)
+    if (property->path[0] == '\0')
     {
-        // Disconnected
-        return false;
+        strcpy(property->path, path);
     }
-
-    uint64_t start_ms = SystemTickCounterRead();
-    if (event->type == MESSAGE)
+    memcpy(property->value, json, length);
+    property->value[length] = '\0';
+    if (property->dirty)
     {
-        if (IoTHubDeviceClient_LL_SendEventAsync(iotHubClientHandle, event->messageHandle, SendConfirmationCallback, event) != IOTHUB_CLIENT_OK)
-        {
-            LogError("IoTHubClient_LL_SendEventAsync..........FAILED!");
-            FreeEventInstance(event);
-            return false;
-        }
-        LogInfo(">>>IoTHubClient_LL_SendEventAsync accepted message for transmission to IoT Hub.");
+        reportedStats.coalesced++;
     }
-    else if (event->type == STATE)
+    else
     {
-        if (IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)event->stateString, strlen(event->stateString), ReportConfirmationCallback, event) != IOTHUB_CLIENT_OK)
-        {
-            LogError("IoTHubClient_LL_SendReportedState..........FAILED!");
-            FreeEventInstance(event);
-            return false;
-        }
-        LogInfo(">>>IoTHubClient_LL_SendReportedState accepted state for transmission to IoT Hub.");
+        property->dirty = true;
+        reportedDirty++;
     }
+    return true;
+}
 
-    while (true)
+static bool SetReported(const char *path, const char *json, size_t length)
+{
+    if (path == NULL || json == NULL || length == 0 || !IsValidPath(path))
     {
-        IoTHubClient_LL_DoWork(iotHubClientHandle);
-
-        if (currentTrackingId == EVENT_CONFIRMED)
-        {
-            // IoT Hub got this event
-            return true;
-        }
+        return false;
+    }
+    if (DevKitJsonPath_MemberSize(path, length) > REPORTED_PATCH_SIZE)
+    {
+        LogError("The reported property %s does not fit in a patch", path);
+        return false;
+    }
 
-        // Check timeout
-        int diff = (int)(SystemTickCounterRead() - start_ms);
-        if (diff >= EVENT_TIMEOUT_MS)
+    bool result = true;
+    reportedMutex.lock();
+    reportedStats.updates++;
+    REPORTED_PROPERTY *property = NULL;
+    REPORTED_PROPERTY *unused = NULL;
+    for (int i = 0; i < REPORTED_PROPERTY_MAX_COUNT; i++)
+    {
+        REPORTED_PROPERTY *entry = &reportedProperties[i];
+        if (entry->path[0] == '\0')
         {
-            // Time out, reset the client
-            LogError("Waiting for send confirmation, time is up %d", diff);
-            resetClient = true;
+            if (unused == NULL)
+            {
+                unused = entry;
+            }
         }
-
-        if (resetClient)
+        else if (strcmp(entry->path, path) == 0)
         {
-            // resetClient also can be set as true in the IoTHubClient_LL_DoWork
-            // Disconnected, re-send the message
+            property = entry;
             break;
         }
-        else
+        else if (PathsOverlap(entry->path, path))
         {
-            // Sleep a while
-            ThreadAPI_Sleep(100);
+            LogError("The reported property %s overlaps %s", path, entry->path);
+            result = false;
+            break;
         }
     }
 
-    return false;
+    if (result && property != NULL && strlen(property->value) == length && memcmp(property->value, json, length) == 0)
+    {
+        reportedStats.unchanged++;
+    }
+    else if (result)
+    {
+        result = StoreReported((property != NULL ? property : unused), path, json, length);
+    }
+    reportedMutex.unlock();
+    return result;
 }
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // MQTT APIs
 EVENT_INSTANCE *DevKitMQTTClient_Event_Generate(const char *eventString, EVENT_TYPE type)
@@ -463,17 +1285,9 @@ void DevKitMQTTClient_Event_AddProp(EVENT_INSTANCE *message, const char *key, co
     Map_AddOrUpdate(propMap, key, value);
 }
 
-bool DevKitMQTTClient_Init(bool hasDeviceTwin, bool traceOn)
+// Creates and sets up the client, with iothubMutex held
+static bool CreateClient(bool traceOn)
 {
-    if (iotHubClientHandle != NULL)
-    {
-        return true;
-    }
-    enableDeviceTwin = hasDeviceTwin;
-    callbackCounter = 0;
-
-    xlogging_set_log_function(AZIoTLog);
-
     srand((unsigned int)time(NULL));
     trackingId = 0;
 
@@ -578,21 +1392,62 @@ bool DevKitMQTTClient_Init(bool hasDeviceTwin, bool traceOn)
             return false;
         }
 
-        if (IoTHubClient_LL_SetDeviceMethodCallback(iotHubClientHandle, DeviceMethodCallback, NULL) != IOTHUB_CLIENT_OK)
+        // Answered later, on the thread that calls DevKitMQTTClient_Check()
+        if (IoTHubClient_LL_SetDeviceMethodCallback_Ex(iotHubClientHandle, DeviceMethodCallback, NULL) != IOTHUB_CLIENT_OK)
         {
-            LogError("Failed on IoTHubClient_LL_SetDeviceMethodCallback");
+            LogError("Failed on IoTHubClient_LL_SetDeviceMethodCallback_Ex");
             return false;
         }
     }
 
+    return true;
+}
+
+bool DevKitMQTTClient_Init(bool hasDeviceTwin, bool traceOn)
+{
+    if (iotHubClientHandle != NULL)
+    {
+        return true;
+    }
+    enableDeviceTwin = hasDeviceTwin;
+    callbackCounter = 0;
+
+    xlogging_set_log_function(AZIoTLog);
+
+    // The SAS token relies on the system time, which is synced in background once Wi-Fi is connected
+    if (SystemWaitReady(BOOT_READY_TIME, TIME_SYNC_TIMEOUT_MS) != 0)
+    {
+        LogInfo("Time sync is not finished, continue anyway.");
+    }
+
+    if (!StartWorker())
+    {
+        return false;
+    }
+
+    // A cached DPS assignment the IoT hub rejected is registered again first
+    if (is_iothub_from_dps && !DevkitDPSRefresh())
+    {
+        return false;
+    }
+
+    // The worker picks up the client once it is complete
+    iothubMutex.lock();
+    resetClient = false;
+    bool result = CreateClient(traceOn);
+    iothubMutex.unlock();
+    if (!result)
+    {
+        return false;
+    }
+
     iothub_check_ms = SystemTickCounterRead();
 
     // Waiting for the confirmation
-    resetClient = false;
     uint64_t start_ms = SystemTickCounterRead();
+    WakeWorker();
     while (true)
     {
-        IoTHubClient_LL_DoWork(iotHubClientHandle);
         if (clientConnected)
         {
             break;
@@ -608,7 +1463,7 @@ bool DevKitMQTTClient_Init(bool hasDeviceTwin, bool traceOn)
             resetClient = true;
             return false;
         }
-        ThreadAPI_Sleep(500);
+        ThreadAPI_Sleep(SEND_WAIT_MS);
     }
 
     return true;
@@ -636,18 +1491,21 @@ bool DevKitMQTTClient_SetOption(const char* optionName, const void* value)
         return true;
     }
 
+    bool result = false;
+    iothubMutex.lock();
     if (iotHubClientHandle != NULL)
     {
         if (IoTHubClient_LL_SetOption(iotHubClientHandle, optionName, value) == IOTHUB_CLIENT_OK)
         {
-            return true;
+            result = true;
         }
         else
         {
             LogError("Failed to set option \"%s\"", optionName);
         }
     }
-    return false;
+    iothubMutex.unlock();
+    return result;
 }
 
 bool DevKitMQTTClient_SendEvent(const char *text)
@@ -666,6 +1524,21 @@ bool DevKitMQTTClient_SendEvent(const char *text)
     return false;
 }
 
+bool DevKitMQTTClient_SendEventAsync(const char *text)
+{
+    if (text == NULL || iotHubClientHandle == NULL || resetClient)
+    {
+        return false;
+    }
+
+    EVENT_INSTANCE *event = DevKitMQTTClient_Event_Generate(text, MESSAGE);
+    if (event == NULL)
+    {
+        return false;
+    }
+    return QueueEvent(event, false);
+}
+
 bool DevKitMQTTClient_ReceiveEvent()
 {
     CheckConnection();
@@ -675,12 +1548,11 @@ bool DevKitMQTTClient_ReceiveEvent()
         return false;
     }
 
-    int count = receiveContext;
     uint64_t tm = SystemTickCounterRead();
-    while ((int)(SystemTickCounterRead() - tm) < CHECK_INTERVAL_MS)
+    int diff;
+    while ((diff = (int)(SystemTickCounterRead() - tm)) < CHECK_INTERVAL_MS)
     {
-        IoTHubClient_LL_DoWork(iotHubClientHandle);
-        if (count < receiveContext)
+        if (DispatchCallbacks(CHECK_INTERVAL_MS - diff) > 0)
         {
             return true;
         }
@@ -690,8 +1562,6 @@ bool DevKitMQTTClient_ReceiveEvent()
             // Disconnected
             return false;
         }
-
-        ThreadAPI_Sleep(500);
     }
     // Timeout
     resetClient = true;
@@ -714,6 +1584,99 @@ bool DevKitMQTTClient_ReportState(const char *stateString)
     return false;
 }
 
+bool DevKitMQTTClient_SetReportedProperty(const char *path, const char *json)
+{
+    // A malformed value would get the whole patch rejected
+    return json != NULL && DevKitJsonPath_Validate(json, strlen(json)) == 0 && SetReported(path, json, strlen(json));
+}
+
+bool DevKitMQTTClient_SetReportedString(const char *path, const char *value)
+{
+    if (value == NULL)
+    {
+        return false;
+    }
+
+    size_t length = 2;
+    for (const char *p = value; *p; p++)
+    {
+        length += ((unsigned char)*p < 0x20 ? 6 : (*p == '"' || *p == '\\') ? 2 : 1);
+    }
+    char *json = (char *)malloc(length + 1);
+    if (json == NULL)
+    {
+        return false;
+    }
+
+    char *q = json;
+    *q++ = '"';
+    for (const char *p = value; *p; p++)
+    {
+        if ((unsigned char)*p < 0x20)
+        {
+            q += sprintf(q, "\\u%04x", (unsigned char)*p);
+        }
+        else
+        {
+            if (*p == '"' || *p == '\\')
+            {
+                *q++ = '\\';
+            }
+            *q++ = *p;
+        }
+    }
+    *q++ = '"';
+    *q = '\0';
+    bool result = SetReported(path, json, length);
+    free(json);
+    return result;
+}
+
+bool DevKitMQTTClient_SetReportedNumber(const char *path, double value)
+{
+    // No JSON for nan and inf
+    if (value != value || value - value != 0)
+    {
+        return false;
+    }
+    char json[FLOAT_IO_SHORTEST_SIZE];
+    int length = formatShortest(json, value);
+    return SetReported(path, json, length);
+}
+
+bool DevKitMQTTClient_SetReportedBool(const char *path, bool value)
+{
+    return SetReported(path, (value ? "true" : "false"), (value ? 4 : 5));
+}
+
+void DevKitMQTTClient_SetReportInterval(int millisec)
+{
+    reportInterval = (millisec > 0 ? millisec : 0);
+}
+
+void DevKitMQTTClient_FlushReported(void)
+{
+    if (reportedDirty > 0)
+    {
+        reportedForce = true;
+        WakeWorker();
+    }
+}
+
+void DevKitMQTTClient_GetReportedStats(REPORTED_STATS *stats, bool reset)
+{
+    reportedMutex.lock();
+    if (stats != NULL)
+    {
+        *stats = reportedStats;
+    }
+    if (reset)
+    {
+        memset(&reportedStats, 0, sizeof(reportedStats));
+    }
+    reportedMutex.unlock();
+}
+
 bool DevKitMQTTClient_SendEventInstance(EVENT_INSTANCE *event)
 {
     if (event == NULL)
@@ -726,40 +1689,40 @@ bool DevKitMQTTClient_SendEventInstance(EVENT_INSTANCE *event)
 
 void DevKitMQTTClient_Check(bool hasDelay)
 {
-    if (iotHubClientHandle == NULL || SystemWiFiRSSI() == 0)
+    if (iotHubClientHandle == NULL)
     {
         return;
     }
 
-    int diff = hasDelay ? ((int)(SystemTickCounterRead() - iothub_check_ms)) : CHECK_INTERVAL_MS;
-    if (diff >= CHECK_INTERVAL_MS)
+    if (resetClient)
     {
-        CheckConnection();
-        if (resetClient)
+        // Re-connect at most every CHECK_INTERVAL_MS
+        int diff = hasDelay ? ((int)(SystemTickCounterRead() - iothub_check_ms)) : CHECK_INTERVAL_MS;
+        if (diff < CHECK_INTERVAL_MS || SystemWiFiRSSI() == 0)
         {
-            // Disconnected
             return;
         }
-        
-        for (int i = 0; i < 5; i++)
-        {
-            IoTHubClient_LL_DoWork(iotHubClientHandle);
-            if (resetClient || SystemWiFiRSSI() == 0)
-            {
-                // Disconnected
-                break;
-            }
-        }
+        CheckConnection();
         iothub_check_ms = SystemTickCounterRead();
     }
+
+    DispatchCallbacks(0);
 }
 
 void DevKitMQTTClient_Close(void)
 {
     if (iotHubClientHandle != NULL)
     {
+        iothubMutex.lock();
         IoTHubClient_LL_Destroy(iotHubClientHandle);
         iotHubClientHandle = NULL;
+        clientGeneration++;
+        // The next client gets the full twin when it connects
+        twinStale = false;
+        twinRequested = false;
+        // The properties of a patch not confirmed go again with the next client
+        ReportedPatchDone(reportedEvent, 0);
+        iothubMutex.unlock();
 
         if (!is_iothub_from_dps && iothub_hostname)
         {
@@ -794,6 +1757,75 @@ void DevKitMQTTClient_SetDeviceMethodCallback(DEVICE_METHOD_CALLBACK device_meth
     _device_method_callback = device_method_callback;
 }
 
+bool DevKitMQTTClient_RegisterDeviceMethod(const char *methodName, DEVICE_METHOD_HANDLER handler)
+{
+    if (methodName == NULL)
+    {
+        return false;
+    }
+
+    bool result = true;
+    uint32_t hash = HashMethodName(methodName);
+    methodMutex.lock();
+    DEVICE_METHOD_ENTRY *entry = FindMethod(methodName, hash);
+    if (entry != NULL)
+    {
+        if (handler != NULL)
+        {
+            entry->handler = handler;
+        }
+        else
+        {
+            // Removed, the table is rebuilt so that the probe sequences of the others stay whole
+            entry->name = NULL;
+            memset(methodTable, 0, sizeof(methodTable));
+            for (int i = 0; i < DEVICE_METHOD_MAX_COUNT; i++)
+            {
+                if (methods[i].name != NULL)
+                {
+                    InsertMethod(i);
+                }
+            }
+        }
+    }
+    else if (handler != NULL)
+    {
+        int i = 0;
+        while (i < DEVICE_METHOD_MAX_COUNT && methods[i].name != NULL)
+        {
+            i++;
+        }
+        if (i == DEVICE_METHOD_MAX_COUNT)
+        {
+            LogError("No room for method %s", methodName);
+            result = false;
+        }
+        else
+        {
+            methods[i].name = methodName;
+            methods[i].hash = hash;
+            methods[i].handler = handler;
+            InsertMethod(i);
+        }
+    }
+    methodMutex.unlock();
+    return result;
+}
+
+void DevKitMQTTClient_GetMethodStats(DEVICE_METHOD_STATS *stats, bool reset)
+{
+    methodMutex.lock();
+    if (stats != NULL)
+    {
+        *stats = methodStats;
+    }
+    if (reset)
+    {
+        memset(&methodStats, 0, sizeof(methodStats));
+    }
+    methodMutex.unlock();
+}
+
 void DevKitMQTTClient_SetReportConfirmationCallback(REPORT_CONFIRMATION_CALLBACK report_confirmation_callback)
 {
     _report_confirmation_callback = report_confirmation_callback;
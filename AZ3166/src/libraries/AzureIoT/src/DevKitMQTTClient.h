@@ -5,6 +5,8 @@
 #define __IOTHUB_MQTT_CLIENT_H__
 
 #include "AzureIotHub.h"
+// For the message, device twin and device method callbacks to read their JSON payloads
+#include "DevKitJsonPath.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -13,6 +15,17 @@ extern "C"
 
 #define OPTION_MINI_SOLUTION_NAME "MiniSolution"
 
+// Methods DevKitMQTTClient_RegisterDeviceMethod() takes
+#define DEVICE_METHOD_MAX_COUNT 16
+// Capacity of the response buffer passed to the method handlers
+#define DEVICE_METHOD_RESPONSE_SIZE 512
+
+// Properties DevKitMQTTClient_SetReportedProperty() keeps, and the length of their paths
+#define REPORTED_PROPERTY_MAX_COUNT 16
+#define REPORTED_PATH_MAX_LEN 48
+// The changed reported properties go out at most this often, unless DevKitMQTTClient_SetReportInterval() says otherwise
+#define REPORTED_INTERVAL_MS 1000
+
 enum EVENT_TYPE
 {
     MESSAGE, STATE
@@ -26,6 +39,26 @@ typedef struct EVENT_INSTANCE_TAG
     int trackingId; // For tracking the events within the user callback.
 } EVENT_INSTANCE;
 
+typedef struct
+{
+    unsigned int calls;         // Method calls from IoT hub
+    unsigned int handled;       // Answered by a registered handler
+    unsigned int fallback;      // Passed to the callback of DevKitMQTTClient_SetDeviceMethodCallback()
+    unsigned int not_found;     // Answered with 404
+    unsigned int busy;          // Answered with 503, the callback queue was full
+    unsigned int allocations;   // Responses on the heap, from the callback or with the pooled buffers all taken
+} DEVICE_METHOD_STATS;
+
+typedef struct
+{
+    unsigned int updates;       // Properties set
+    unsigned int coalesced;     // Set again before the last value went out, the last value wins
+    unsigned int unchanged;     // Set to the value that went out last
+    unsigned int patches;       // Patches sent
+    unsigned int bytes;         // JSON bytes of the patches
+    unsigned int failed;        // Patches not confirmed, lost or refused for now (0, 408, 429, 5xx) go again, rejected (4xx) are dropped
+} REPORTED_STATS;
+
 /**
 * @brief    Generate an event with the event string specified by @p eventString.
 *
@@ -44,6 +77,19 @@ EVENT_INSTANCE* DevKitMQTTClient_Event_Generate(const char *eventString, EVENT_T
 */
 void DevKitMQTTClient_Event_AddProp(EVENT_INSTANCE *message, const char * key, const char * value);
 
+/**
+* The IoT hub client runs on a worker thread of its own, which sends and receives as soon as there
+* is something to do. The callbacks set below are called by DevKitMQTTClient_Check() and
+* DevKitMQTTClient_ReceiveEvent() only, on the thread calling them, so call one of them from loop():
+* DevKitMQTTClient_SendEvent(), DevKitMQTTClient_ReportState() and DevKitMQTTClient_Init() don't
+* call the callbacks any more. The send and report functions can be called from any thread.
+*
+* Messages wait in memory until they are passed on, up to a few, the ones beyond are abandoned for
+* IoT hub to send them again later. Twin updates wait too, but a full twin replaces the
+* updates still waiting, and when more than a few pile up they make way for the full twin. The
+* firmware update of the twin is read by the worker, see IoTHubClient_GetLatestFwInfo().
+*/
+
 /**
 * @brief    Initialize a IoT Hub MQTT client for communication with an existing IoT hub.
 *           The connection string is load from the EEPROM.
@@ -76,6 +122,16 @@ bool DevKitMQTTClient_SetOption(const char* optionName, const void* value);
 */
 bool DevKitMQTTClient_SendEvent(const char *text);
 
+/**
+* @brief    Queue the message specified by @p text and return without waiting for IoT hub, the
+*           result is passed to the send confirmation callback.
+*
+* @param    text                The text message.
+*
+* @return   Return true if the message is queued, or false if fails.
+*/
+bool DevKitMQTTClient_SendEventAsync(const char *text);
+
 /**
 * @brief    Synchronous call to report the state specified by @p stateString.
 *
@@ -85,6 +141,51 @@ bool DevKitMQTTClient_SendEvent(const char *text);
 */
 bool DevKitMQTTClient_ReportState(const char *stateString);
 
+/**
+* @brief    Set a reported property of the device twin to a JSON value. The properties changed are
+*           sent together in one patch, at most every REPORTED_INTERVAL_MS, by the worker thread.
+*           A property set again before it is sent only sends its last value.
+*
+* @param    path                Dot separated names, e.g. "sensors.temperature" for
+*                               {"sensors":{"temperature":...}}, up to REPORTED_PATH_MAX_LEN characters.
+* @param    json                The JSON value, e.g. "23.5", "\"on\"" or "null" to delete the property.
+*
+* @return   Return true on success, or false if the path or the JSON is malformed, the path overlaps
+*           another property, the property doesn't fit in a patch or REPORTED_PROPERTY_MAX_COUNT
+*           properties are set already.
+*/
+bool DevKitMQTTClient_SetReportedProperty(const char *path, const char *json);
+
+/**
+* @brief    Set a reported property to a string, which is escaped for JSON.
+*/
+bool DevKitMQTTClient_SetReportedString(const char *path, const char *value);
+
+/**
+* @brief    Set a reported property to a number, written with the digits needed to read it back.
+*/
+bool DevKitMQTTClient_SetReportedNumber(const char *path, double value);
+
+/**
+* @brief    Set a reported property to true or false.
+*/
+bool DevKitMQTTClient_SetReportedBool(const char *path, bool value);
+
+/**
+* @brief    Set the least time between two patches of reported properties, 0 sends them as they change.
+*/
+void DevKitMQTTClient_SetReportInterval(int millisec);
+
+/**
+* @brief    Send the changed reported properties now, without waiting for the report interval.
+*/
+void DevKitMQTTClient_FlushReported(void);
+
+/**
+* @brief    Get the counts of the reported properties set and sent since the last reset.
+*/
+void DevKitMQTTClient_GetReportedStats(REPORTED_STATS *stats, bool reset = false);
+
 /**
 * @brief    Synchronous call to report the event specified by @p event.
 *
@@ -95,16 +196,17 @@ bool DevKitMQTTClient_ReportState(const char *stateString);
 bool DevKitMQTTClient_SendEventInstance(EVENT_INSTANCE *event);
 
 /**
-* @brief    Retrieve a message from IoT hub
+* @brief    Wait up to 5 seconds for a message from IoT hub, calling the callbacks that come before it.
 *
 * @return   Return true if get a message successfully, or false if there is no message returns.
 */
 bool DevKitMQTTClient_ReceiveEvent();
 
 /**
-* @brief    The function is called to try receiving message from IoT hub.
+* @brief    Call the callbacks of what came from IoT hub since the last call, and re-connect if the
+*           connection is lost. Call it from loop().
 *
-* @param    hasDelay        Indicate whether check with IoT hub immediately or has delay, default is delay check (true).
+* @param    hasDelay        Re-connect at most every 5 seconds (true), or right away (false).
 */
 void DevKitMQTTClient_Check(bool hasDelay = true);
 
@@ -138,6 +240,24 @@ void DevKitMQTTClient_SetDeviceTwinCallback(DEVICE_TWIN_CALLBACK device_twin_cal
 */
 void DevKitMQTTClient_SetDeviceMethodCallback(DEVICE_METHOD_CALLBACK device_method_callback);
 
+/**
+* @brief    Register the handler of a device method. The handler writes the response into the buffer
+*           it is given, of DEVICE_METHOD_RESPONSE_SIZE bytes, and returns the status. The methods
+*           registered go before the callback of DevKitMQTTClient_SetDeviceMethodCallback().
+*
+* @param    methodName          The method name, which must stay valid while it is registered.
+* @param    handler             The handler, or NULL to remove the method.
+*
+* @return   Return true on success, or false if DEVICE_METHOD_MAX_COUNT methods are registered already.
+*/
+bool DevKitMQTTClient_RegisterDeviceMethod(const char *methodName, DEVICE_METHOD_HANDLER handler);
+
+/**
+* @brief    Get the counts of the device method calls, how they were answered and the responses
+*           allocated on the heap since the last reset.
+*/
+void DevKitMQTTClient_GetMethodStats(DEVICE_METHOD_STATS *stats, bool reset = false);
+
 /**
 * @brief    Sets up the report confirmation callback to be invoked when report of the device's properties.
 */
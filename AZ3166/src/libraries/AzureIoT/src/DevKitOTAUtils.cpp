@@ -1,32 +1,57 @@
+#include "mbed.h"
 #include "DevKitOTAUtils.h"
-#include "parson.h"
+#include "DevKitJsonPath.h"
 #include "DevKitMQTTClient.h"
 #include "ctype.h"
 #include "CheckSumUtils.h"
 #include "mico.h"
 
 static FW_INFO *latestFwInfo = NULL;
+// ota_callback() runs on the IoT hub worker, the info it found waits here for IoTHubClient_GetLatestFwInfo()
+static Mutex fwInfoMutex;
+static FW_INFO *receivedFwInfo = NULL;
+static bool fwInfoReceived = false;
+
+// The firmware properties, in the desired part of a full twin or at the root of a twin update
+enum
+{
+    FW_PATH_OBJECT,
+    FW_PATH_VERSION,
+    FW_PATH_PACKAGE_URI,
+    FW_PATH_PACKAGE_CHECK_VALUE,
+    FW_PATH_SIZE,
+    FW_PATH_COUNT
+};
+
+static const char *fwPaths[2][FW_PATH_COUNT] =
+{
+    { "desired.firmware", "desired.firmware.fwVersion", "desired.firmware.fwPackageURI", "desired.firmware.fwPackageCheckValue", "desired.firmware.fwSize" },
+    { "firmware", "firmware.fwVersion", "firmware.fwPackageURI", "firmware.fwPackageCheckValue", "firmware.fwSize" }
+};
 
 static void fw_info_free(FW_INFO *fwInfo)
 {
+    // The strings are in the same block
     if (fwInfo)
     {
-        if (fwInfo->fwVersion != NULL)
-        {
-            free(fwInfo->fwVersion);
-        }
-        if (fwInfo->fwPackageURI != NULL)
-        {
-            free(fwInfo->fwPackageURI);
-        }
-        if (fwInfo->fwPackageCheckValue != NULL)
-        {
-            free(fwInfo->fwPackageCheckValue);
-        }
         free(fwInfo);
     }
 }
 
+// Copies a string value behind the FW_INFO, returns NULL if it is missing
+static char *fw_info_copy(const JSON_PATH *path, char **buffer, size_t *bufferSize)
+{
+    int length = DevKitJsonPath_GetString(path, *buffer, *bufferSize);
+    if (length < 0)
+    {
+        return NULL;
+    }
+    char *result = *buffer;
+    *buffer += length + 1;
+    *bufferSize -= length + 1;
+    return result;
+}
+
 int IoTHubClient_FwVersionCompare(const char* fwVersion1, const char* fwVersion2)
 {
     if (fwVersion1 == NULL || fwVersion2 == NULL)
@@ -61,6 +86,15 @@ int IoTHubClient_FwVersionCompare(const char* fwVersion1, const char* fwVersion2
 
 const FW_INFO* IoTHubClient_GetLatestFwInfo(void)
 {
+    fwInfoMutex.lock();
+    if (fwInfoReceived)
+    {
+        fw_info_free(latestFwInfo);
+        latestFwInfo = receivedFwInfo;
+        receivedFwInfo = NULL;
+        fwInfoReceived = false;
+    }
+    fwInfoMutex.unlock();
     return latestFwInfo;
 }
 
@@ -76,59 +110,48 @@ bool IoTHubClient_ReportOTAStatus(MAP_HANDLE OTAStatusMap)
 
 void ota_callback(const unsigned char *payLoad, size_t size)
 {
-    char *deviceTwinPayLoad = (char *)malloc(size + 1);
-    if (deviceTwinPayLoad != NULL)
+    // Pick the values straight out of the payload, no copy and no document
+    JSON_PATH paths[2][FW_PATH_COUNT];
+    for (int i = 0; i < 2; i++)
     {
-        memcpy(deviceTwinPayLoad, payLoad, size);
-        deviceTwinPayLoad[size] = '\0';
+        for (int j = 0; j < FW_PATH_COUNT; j++)
+        {
+            paths[i][j].path = fwPaths[i][j];
+        }
     }
-    else
+    if (DevKitJsonPath_Extract((const char *)payLoad, size, &paths[0][0], 2 * FW_PATH_COUNT) < 0)
     {
+        LogError("Parse device twin failed");
         return;
     }
-    
-    JSON_Value *root_value;
-    root_value = json_parse_string(deviceTwinPayLoad);
-    if (json_value_get_type(root_value) != JSONObject)
+
+    // A full twin has a desired part, an update is the desired part
+    JSON_PATH *firmware = (paths[0][FW_PATH_OBJECT].type == JSON_PATH_OBJECT ? paths[0] : paths[1]);
+    if (firmware[FW_PATH_OBJECT].type != JSON_PATH_OBJECT)
     {
-        if (root_value != NULL)
-        {
-            json_value_free(root_value);
-        }
-        LogError("Parse %s failed", deviceTwinPayLoad);
-        free(deviceTwinPayLoad);
         return;
     }
-    
-    JSON_Object *root_object = json_value_get_object(root_value);
-    JSON_Object *desired_object = json_object_get_object(root_object, "desired");
-    desired_object = desired_object == NULL ? root_object : desired_object;
-    if (desired_object != NULL)
+
+    // One block for the FW_INFO and its strings, the escaped lengths are enough for them
+    size_t bufferSize = firmware[FW_PATH_VERSION].length + firmware[FW_PATH_PACKAGE_URI].length + firmware[FW_PATH_PACKAGE_CHECK_VALUE].length + 3;
+    FW_INFO *fwInfo = (FW_INFO*)malloc(sizeof(FW_INFO) + bufferSize);
+    if (fwInfo)
     {
-        JSON_Object* firmwareVal = json_object_get_object(desired_object, "firmware");
-        if (firmwareVal != NULL)
+        char *buffer = (char *)(fwInfo + 1);
+        fwInfo->fwVersion = fw_info_copy(&firmware[FW_PATH_VERSION], &buffer, &bufferSize);
+        fwInfo->fwPackageURI = fw_info_copy(&firmware[FW_PATH_PACKAGE_URI], &buffer, &bufferSize);
+        fwInfo->fwPackageCheckValue = fw_info_copy(&firmware[FW_PATH_PACKAGE_CHECK_VALUE], &buffer, &bufferSize);
+        fwInfo->fwSize = (int)DevKitJsonPath_GetNumber(&firmware[FW_PATH_SIZE], 0);
+        if (fwInfo->fwVersion == NULL || fwInfo->fwPackageURI == NULL)
         {
-            if (latestFwInfo)
-            {
-                fw_info_free(latestFwInfo);
-                latestFwInfo = NULL;
-            }
-            latestFwInfo = (FW_INFO*)malloc(sizeof(FW_INFO));
-            if (latestFwInfo)
-            {
-                latestFwInfo->fwVersion = strdup(json_object_get_string(firmwareVal, "fwVersion"));
-                latestFwInfo->fwPackageURI = strdup(json_object_get_string(firmwareVal, "fwPackageURI"));
-                latestFwInfo->fwPackageCheckValue = strdup(json_object_get_string(firmwareVal, "fwPackageCheckValue"));
-                latestFwInfo->fwSize = json_object_get_number(firmwareVal, "fwSize");
-                if (latestFwInfo->fwVersion == NULL || latestFwInfo->fwPackageURI == NULL)
-                {
-                    fw_info_free(latestFwInfo);
-                    latestFwInfo = NULL;
-                }
-            }
+            fw_info_free(fwInfo);
+            fwInfo = NULL;
         }
     }
-    
-    json_value_free(root_value);
-    free(deviceTwinPayLoad);
+
+    fwInfoMutex.lock();
+    fw_info_free(receivedFwInfo);
+    receivedFwInfo = fwInfo;
+    fwInfoReceived = true;
+    fwInfoMutex.unlock();
 }
\ No newline at end of file
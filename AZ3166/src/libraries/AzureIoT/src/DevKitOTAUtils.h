@@ -32,6 +32,9 @@ typedef struct {
 * @brief    Retrieve the latest firmware information from Azure.
 *
 * @return   FW_INFO upon success or NULL upon failure.
+*
+* @remarks  The twin is read as it arrives, without DevKitMQTTClient_Check(). The info returned stays
+*           valid until the next call.
 */
 const FW_INFO* IoTHubClient_GetLatestFwInfo(void);
 
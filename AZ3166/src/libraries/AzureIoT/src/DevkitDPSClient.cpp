@@ -5,6 +5,8 @@
 #include "DiceCore.h"
 #include "EEPROMInterface.h"
 #include "RiotCore.h"
+#include "SystemTickCounter.h"
+#include "mbedtls/sha256.h"
 
 #include "iothub_client.h"
 #include "hsm_client_key.h"
@@ -18,6 +20,11 @@
 DEFINE_ENUM_STRINGS(PROV_DEVICE_RESULT, PROV_DEVICE_RESULT_VALUE);
 DEFINE_ENUM_STRINGS(PROV_DEVICE_REG_STATUS, PROV_DEVICE_REG_STATUS_VALUES);
 
+#define DPS_CACHE_MAGIC             0x44505331  // "DPS1"
+#define DPS_INPUTS_HASH_LEN         32
+#define DPS_IOTHUB_URI_MAX_LEN      128
+#define DPS_DEVICE_ID_MAX_LEN       128
+
 typedef struct CLIENT_SAMPLE_INFO_TAG
 {
     unsigned int sleep_time;
@@ -34,10 +41,28 @@ typedef struct IOTHUB_CLIENT_SAMPLE_INFO_TAG
     int stop_running;
 } IOTHUB_CLIENT_SAMPLE_INFO;
 
+// The last assignment of DPS, persisted in EEPROM after the UDS string
+typedef struct
+{
+    uint32_t magic;
+    uint8_t inputs[DPS_INPUTS_HASH_LEN];        // SHA-256 of the registration inputs
+    char iothub_uri[DPS_IOTHUB_URI_MAX_LEN + 1];
+    char device_id[DPS_DEVICE_ID_MAX_LEN + 1];
+} DPS_CACHE_RECORD;
+
 static CLIENT_SAMPLE_INFO user_ctx = { 0 };
 static DPS_AUTH_TYPE g_auth_type = DPS_AUTH_X509_INDIVIDUAL;
 bool is_iothub_from_dps = false;
 static bool g_trace_on = true;
+static DPS_BOOT_STATS g_boot_stats = { 0, -1, -1 };
+static uint8_t g_inputs[DPS_INPUTS_HASH_LEN];
+static volatile bool g_cache_dropped = false;
+
+// Parameters of the last DevkitDPSClientStart(), for DevkitDPSRefresh()
+static char* g_prov_uri = NULL;
+static char* g_id_scope = NULL;
+static char* g_proxy_address = NULL;
+static int g_proxy_port = 0;
 extern void* __start_riot_core;
 extern void* __stop_riot_core;
 
@@ -195,11 +220,164 @@ char* DiceInit(char* udsString)
     return udsString;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cached assignment
+static void HashInputs(const char* global_prov_uri, const char* id_scope, const char* registration_id,
+    const uint8_t* secret, size_t secretLength)
+{
+    const char* strings[3] = { global_prov_uri, id_scope, (registration_id != NULL ? registration_id : "") };
+    uint8_t authType = (uint8_t)g_auth_type;
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    mbedtls_sha256_update_ret(&ctx, &authType, 1);
+    for (int i = 0; i < 3; i++)
+    {
+        // With the NULL terminator, so that the strings can't run into each other
+        mbedtls_sha256_update_ret(&ctx, (const unsigned char*)strings[i], strlen(strings[i]) + 1);
+    }
+    if (secret != NULL)
+    {
+        mbedtls_sha256_update_ret(&ctx, secret, secretLength);
+    }
+    mbedtls_sha256_finish_ret(&ctx, g_inputs);
+    mbedtls_sha256_free(&ctx);
+}
+
+static bool LoadDPSCache(DPS_CACHE_RECORD* record)
+{
+    EEPROMInterface eeprom;
+    if (eeprom.read((uint8_t*)record, sizeof(DPS_CACHE_RECORD), DPS_CACHE_OFFSET, DPS_CACHE_ZONE_IDX) != sizeof(DPS_CACHE_RECORD))
+    {
+        return false;
+    }
+    record->iothub_uri[DPS_IOTHUB_URI_MAX_LEN] = 0;
+    record->device_id[DPS_DEVICE_ID_MAX_LEN] = 0;
+    return (record->magic == DPS_CACHE_MAGIC
+        && memcmp(record->inputs, g_inputs, DPS_INPUTS_HASH_LEN) == 0
+        && record->iothub_uri[0] != 0
+        && record->device_id[0] != 0);
+}
+
+static void SaveDPSCache(void)
+{
+    if (strlen(user_ctx.iothub_uri) > DPS_IOTHUB_URI_MAX_LEN || strlen(user_ctx.device_id) > DPS_DEVICE_ID_MAX_LEN)
+    {
+        return;
+    }
+
+    DPS_CACHE_RECORD record;
+    memset(&record, 0, sizeof(record));
+    record.magic = DPS_CACHE_MAGIC;
+    memcpy(record.inputs, g_inputs, DPS_INPUTS_HASH_LEN);
+    strcpy(record.iothub_uri, user_ctx.iothub_uri);
+    strcpy(record.device_id, user_ctx.device_id);
+
+    // Only write when something changed, the EEPROM has limited write cycles
+    DPS_CACHE_RECORD cached;
+    if (LoadDPSCache(&cached) && memcmp(&cached, &record, sizeof(DPS_CACHE_RECORD)) == 0)
+    {
+        return;
+    }
+    EEPROMInterface eeprom;
+    if (eeprom.write((uint8_t*)&record, sizeof(DPS_CACHE_RECORD), DPS_CACHE_OFFSET, DPS_CACHE_ZONE_IDX) != 0)
+    {
+        LogError("Failed to save the DPS assignment to EEPROM.");
+    }
+}
+
+static void DropDPSCache(void)
+{
+    EEPROMInterface eeprom;
+    uint32_t magic = 0;
+    eeprom.write((uint8_t*)&magic, sizeof(magic), DPS_CACHE_OFFSET, DPS_CACHE_ZONE_IDX);
+}
+
+static char* KeepString(char* kept, const char* value)
+{
+    free(kept);
+    return (value != NULL ? strdup(value) : NULL);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Registration
+static bool RegisterDevice(void)
+{
+    bool result = true;
+
+    free(user_ctx.iothub_uri);
+    free(user_ctx.device_id);
+    memset(&user_ctx, 0, sizeof(CLIENT_SAMPLE_INFO));
+
+    // Set ini
+    user_ctx.registration_complete = 0;
+    user_ctx.sleep_time = 10;
+
+    PROV_DEVICE_LL_HANDLE handle = NULL;
+
+    if ((handle = Prov_Device_LL_Create(g_prov_uri, g_id_scope, Prov_Device_HTTP_Protocol)) == NULL)
+    {
+        LogError("failed calling Prov_Device_LL_Create");
+        result = false;
+    }
+    else
+    {
+        if (g_proxy_address != NULL)
+        {
+            HTTP_PROXY_OPTIONS http_proxy;
+            http_proxy.host_address = g_proxy_address;
+            http_proxy.port = g_proxy_port;
+            if (Prov_Device_LL_SetOption(handle, OPTION_HTTP_PROXY, &http_proxy) != PROV_DEVICE_RESULT_OK)
+            {
+                LogError("Failed to set option \"HTTP Proxy\"");
+                result = false;
+            }
+        }
+
+        (void)Prov_Device_LL_SetOption(handle, "logtrace", &g_trace_on);
+        if (Prov_Device_LL_SetOption(handle, "TrustedCerts", certificates) != PROV_DEVICE_RESULT_OK)
+        {
+            LogError("Failed to set option \"TrustedCerts\"");
+            result = false;
+        }
+        else if (Prov_Device_LL_Register_Device(handle, register_device_callback, &user_ctx, registation_status_callback, &user_ctx) != PROV_DEVICE_RESULT_OK)
+        {
+            LogError("failed calling Prov_Device_LL_Register_Device");
+            result = false;
+        }
+        else
+        {
+            // Waiting the register to be completed
+            do
+            {
+                Prov_Device_LL_DoWork(handle);
+                ThreadAPI_Sleep(user_ctx.sleep_time);
+            } while (user_ctx.registration_complete == 0);
+        }
+        // Free DPS client
+        Prov_Device_LL_Destroy(handle);
+    }
+
+    if (user_ctx.registration_complete != 1)
+    {
+        LogError("registration failed!\r\n");
+        result = false;
+    }
+    else
+    {
+        is_iothub_from_dps = true;
+        SaveDPSCache();
+    }
+    return result;
+}
+
 bool __attribute__((section(".riot_fw"))) DevkitDPSClientStart(const char* global_prov_uri,
     const char* id_scope, const char* registration_id, char* udsString,
     const char* proxy_address, int proxy_port)
 {
     bool result = true;
+    uint64_t start_ms = SystemTickCounterRead();
     
     if (global_prov_uri == NULL || id_scope == NULL)
     {
@@ -231,6 +409,9 @@ bool __attribute__((section(".riot_fw"))) DevkitDPSClientStart(const char* globa
             return false;
         }
 
+        // The CDI goes with the UDS and the measured RIoT Core, so the cache follows both
+        HashInputs(global_prov_uri, id_scope, registration_id, DiceCDI.bytes, DICE_DIGEST_LENGTH);
+
         // If DiceCore detects an error condition, it will not enable access to
         // the volatile storage segment. This attempt to transfer control to RIoT
         // will trigger a system reset. We will not be able to proceed.
@@ -240,6 +421,14 @@ bool __attribute__((section(".riot_fw"))) DevkitDPSClientStart(const char* globa
             return false;
         }
     }
+    else if (g_auth_type == DPS_AUTH_SYMMETRIC_KEY && udsString != NULL)
+    {
+        HashInputs(global_prov_uri, id_scope, registration_id, (const uint8_t*)udsString, strlen(udsString));
+    }
+    else
+    {
+        HashInputs(global_prov_uri, id_scope, registration_id, NULL, 0);
+    }
     
     if (platform_init() != 0)
     {
@@ -263,66 +452,34 @@ bool __attribute__((section(".riot_fw"))) DevkitDPSClientStart(const char* globa
     }
     else
     {
-        memset(&user_ctx, 0, sizeof(CLIENT_SAMPLE_INFO));
-
-        // Set ini
-        user_ctx.registration_complete = 0;
-        user_ctx.sleep_time = 10;
-        
-        PROV_DEVICE_LL_HANDLE handle = NULL;
+        g_prov_uri = KeepString(g_prov_uri, global_prov_uri);
+        g_id_scope = KeepString(g_id_scope, id_scope);
+        g_proxy_address = KeepString(g_proxy_address, proxy_address);
+        g_proxy_port = proxy_port;
 
-        if ((handle = Prov_Device_LL_Create(global_prov_uri, id_scope, Prov_Device_HTTP_Protocol)) == NULL)
+        DPS_CACHE_RECORD record;
+        if (LoadDPSCache(&record))
         {
-            LogError("failed calling Prov_Device_LL_Create");
-            result = false;
+            // Same inputs as the last registration, go straight to its IoT hub
+            free(user_ctx.iothub_uri);
+            free(user_ctx.device_id);
+            user_ctx.iothub_uri = strdup(record.iothub_uri);
+            user_ctx.device_id = strdup(record.device_id);
+            user_ctx.registration_complete = 1;
+            g_boot_stats.cached = 1;
+            is_iothub_from_dps = true;
+            LogInfo("Use the IoT hub %s of the last DPS registration", record.iothub_uri);
         }
         else
         {
-            if (proxy_address != NULL)
-            {
-                HTTP_PROXY_OPTIONS http_proxy;
-                http_proxy.host_address = proxy_address;
-                http_proxy.port = proxy_port;
-                if (Prov_Device_LL_SetOption(handle, OPTION_HTTP_PROXY, &http_proxy) != PROV_DEVICE_RESULT_OK)
-                {
-                    LogError("Failed to set option \"HTTP Proxy\"");
-                    result = false;
-                }
-            }
-
-            (void)Prov_Device_LL_SetOption(handle, "logtrace", &g_trace_on);
-            if (Prov_Device_LL_SetOption(handle, "TrustedCerts", certificates) != PROV_DEVICE_RESULT_OK)
-            {
-                LogError("Failed to set option \"TrustedCerts\"");
-                result = false;
-            }
-            else if (Prov_Device_LL_Register_Device(handle, register_device_callback, &user_ctx, registation_status_callback, &user_ctx) != PROV_DEVICE_RESULT_OK)
-            {
-                LogError("failed calling Prov_Device_LL_Register_Device");
-                result = false;
-            }
-            else
-            {
-                // Waiting the register to be completed
-                do
-                {
-                    Prov_Device_LL_DoWork(handle);
-                    ThreadAPI_Sleep(user_ctx.sleep_time);
-                } while (user_ctx.registration_complete == 0);
-            }
-            // Free DPS client
-            Prov_Device_LL_Destroy(handle);
+            g_boot_stats.cached = 0;
+            result = RegisterDevice();
         }
+    }
 
-        if (user_ctx.registration_complete != 1)
-        {
-            LogError("registration failed!\r\n");
-            result = false;
-        }
-        else
-        {
-            is_iothub_from_dps = true;
-        }
+    if (result)
+    {
+        g_boot_stats.provision_ms = (int)(SystemTickCounterRead() - start_ms);
     }
     return result;
 }
@@ -342,3 +499,47 @@ char* DevkitDPSGetDeviceID(void)
     return (is_iothub_from_dps ? user_ctx.device_id : NULL);
 }
 
+const DPS_BOOT_STATS* DevkitDPSBootStats(void)
+{
+    return &g_boot_stats;
+}
+
+bool DevkitDPSHubConnected(bool accepted)
+{
+    if (accepted)
+    {
+        if (g_boot_stats.hub_connected_ms < 0)
+        {
+            g_boot_stats.hub_connected_ms = (int)SystemTickCounterRead();
+            LogInfo("IoT hub connected %d ms after boot, %s", g_boot_stats.hub_connected_ms,
+                (g_boot_stats.cached ? "with the cached DPS assignment" : "after DPS registration"));
+        }
+        return false;
+    }
+
+    // The device may have been moved to another IoT hub or re-created since the registration was cached
+    if (!g_boot_stats.cached || g_cache_dropped)
+    {
+        return false;
+    }
+    g_cache_dropped = true;
+    return true;
+}
+
+bool DevkitDPSRefresh(void)
+{
+    if (!g_cache_dropped)
+    {
+        return true;
+    }
+
+    LogInfo("The IoT hub rejected the cached DPS assignment, register the device again");
+    DropDPSCache();
+    g_boot_stats.cached = 0;
+    if (!RegisterDevice())
+    {
+        return false;
+    }
+    g_cache_dropped = false;
+    return true;
+}
@@ -26,12 +26,31 @@ void DevkitDPSSetLogTrace(bool ison);
 // you must set auth type before calling DevkitDPSClientStart
 void DevkitDPSSetAuthType(DPS_AUTH_TYPE auth_type);
 
+// The assigned IoT hub and device ID are kept in the EEPROM with a hash of the registration inputs,
+// a later start with the same inputs goes to that IoT hub without registering again
 bool DevkitDPSClientStart(const char* dps_uri, const char* dps_scope_id, const char* registration_id = NULL,
     char* udsString = NULL, const char* proxy_address = NULL, int proxy_port = 0);
 
 char* DevkitDPSGetIoTHubURI(void);
 char* DevkitDPSGetDeviceID(void);
 
+typedef struct
+{
+    int cached;             // 1 if the IoT hub and device ID came from the cache, without registration
+    int provision_ms;       // Time spent in DevkitDPSClientStart(), -1 before it succeeds
+    int hub_connected_ms;   // Time from boot to the first connection to the IoT hub, -1 before it
+} DPS_BOOT_STATS;
+
+const DPS_BOOT_STATS* DevkitDPSBootStats(void);
+
+// The IoT hub client tells how the assigned IoT hub took the device, returns true if the assignment
+// came from the cache and was dropped, so the client should call DevkitDPSRefresh() and start over
+bool DevkitDPSHubConnected(bool accepted);
+
+// Register the device again with the parameters of the last DevkitDPSClientStart() if the cached
+// assignment was dropped, returns false if the registration fails
+bool DevkitDPSRefresh(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,7 @@
 
 #include "FP/FP.h"
 #include "MQTTPacket/MQTTPacket.h"
+#include "MQTTTopicIndex.h"
 #include "stdio.h"
 #include "Arduino.h"
 #include "MQTTNetwork.h"
@@ -29,6 +30,22 @@
 #if !defined(MQTTCLIENT_QOS2)
     #define MQTTCLIENT_QOS2 0
 #endif
+#if !defined(MQTTCLIENT_READ_BUFFER_SIZE)
+    // Bytes read from the network at once, packet headers are parsed from here
+    #define MQTTCLIENT_READ_BUFFER_SIZE 64
+#endif
+#if !defined(MQTTCLIENT_MAX_QUEUED)
+    // QoS1 publishes kept until their PUBACK, whether sent already or waiting for the window or a connection
+    #define MQTTCLIENT_MAX_QUEUED 8
+#endif
+#if !defined(MQTTCLIENT_QUEUE_SIZE)
+    // Bytes for the packets of the queued QoS1 publishes, the default of the QUEUE_SIZE of Client
+    #define MQTTCLIENT_QUEUE_SIZE 1024
+#endif
+#if !defined(MQTTCLIENT_INFLIGHT_WINDOW)
+    // QoS1 publishes sent without waiting for the PUBACKs of the ones before, by default
+    #define MQTTCLIENT_INFLIGHT_WINDOW 4
+#endif
 
 namespace MQTT
 {
@@ -45,6 +62,12 @@ namespace MQTT
         unsigned short id;
         void *payload;
         size_t payloadlen;
+
+        // Received messages that do not fit in the packet buffer are handed to the message handler
+        // in several calls, each with the next chunk of the payload: where the chunk starts and the
+        // length of the whole payload.
+        size_t payloadoffset;
+        size_t payloadtotal;
     };
 
 
@@ -83,15 +106,28 @@ namespace MQTT
     *
     * This version of the API blocks on all method calls, until they are complete.  This means that only one
     * MQTT request can be in process at any one time.
+    *
+    * MAX_MQTT_PACKET_SIZE is the size of the packet buffers, not a limit of the messages: larger payloads
+    * are sent straight from the memory of the caller after the packet header, and received payloads are
+    * passed to the message handler in chunks as they are read from the network.
+    *
+    * MAX_MESSAGE_HANDLERS is the pool of subscriptions: subscribe() takes a slot and unsubscribe() gives it
+    * back.  Every handler whose topic filter matches a message is called, the filters are looked up in a
+    * trie of their levels, see TopicIndex.
+    *
+    * QUEUE_SIZE is the buffer of the queued QoS1 publishes, kept until their PUBACK and sent again after a
+    * reconnect.  0 leaves the queue out: a QoS1 publish then waits for its PUBACK before the next one and
+    * publishAsync() only takes QoS0.
     * @param Network a network class which supports send, receive
     * @param Timer a timer class with the methods:
     */
-    template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE = 100, int MAX_MESSAGE_HANDLERS = 5>
+    template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE = 100, int MAX_MESSAGE_HANDLERS = 5, int QUEUE_SIZE = MQTTCLIENT_QUEUE_SIZE>
     class Client
     {
     public:
 
         typedef void (*messageHandler)(MessageData&);
+        typedef void (*publishHandler)(unsigned short id);
 
         /** Construct the client
         *  @param network - pointer to an instance of the Network class - must be connected to the endpoint
@@ -150,17 +186,39 @@ namespace MQTT
         */
         int publish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos = QOS1, bool retained = false);
 
+        /** MQTT Publish without waiting for the acks
+        *  A QoS0 message is sent at once.  A QoS1 message is copied into the queue and sent as soon as the
+        *  in-flight window and the connection allow, even when the client is not connected yet.  It stays in
+        *  the queue until its PUBACK, and after a reconnect it is sent again with the DUP flag.  The PUBACKs
+        *  are processed by yield().
+        *  @param topic - the topic to publish to
+        *  @param message - the message to send, its id is set to the packet id used
+        *  @param handler - called with the packet id when the PUBACK arrives
+        *  @return success code - BUFFER_OVERFLOW if the queue is full
+        */
+        int publishAsync(const char* topicName, Message& message, publishHandler handler = 0);
+
+        /** Set how many QoS1 publishes may wait for their PUBACKs at the same time
+        *  @param window - 1 to MQTTCLIENT_MAX_QUEUED
+        */
+        void setInflightWindow(int window);
+
+        /** The number of QoS1 publishes in the queue, sent or not, that have no PUBACK yet
+        */
+        int queuedPublishes();
+
         /** MQTT Subscribe - send an MQTT subscribe packet and wait for the suback
         *  @param topicFilter - a topic pattern which can include wildcards
         *  @param qos - the MQTT QoS to subscribe at
         *  @param mh - the callback function to be invoked when a message is received for this subscription
-        *  @return success code -
+        *  @return success code - FAILURE without sending anything when all MAX_MESSAGE_HANDLERS slots are taken
+        *      or the filter is malformed.  The topicFilter string must stay valid until unsubscribe.
         */
         int subscribe(const char* topicFilter, enum QoS qos, messageHandler mh);
 
         /** MQTT Unsubscribe - send an MQTT unsubscribe packet and wait for the unsuback
         *  @param topicFilter - a topic pattern which can include wildcards
-        *  @return success code -
+        *  @return success code - the slots of all the handlers subscribed with this filter are freed
         */
         int unsubscribe(const char* topicFilter);
 
@@ -189,14 +247,25 @@ namespace MQTT
 
         int cycle(Timer& timer);
         int waitfor(int packet_type, Timer& timer);
+        int waitPuback(unsigned short id, Timer& timer);
         int keepalive();
-        int publish(int len, Timer& timer, enum QoS qos);
+        int publish(int len, const unsigned char* payload, int payloadlen, unsigned short id, Timer& timer, enum QoS qos);
+    #if MQTTCLIENT_QOS1
+        int queuePublish(MQTTString& topicName, Message& message, publishHandler handler);
+        int sendQueue();
+        void ackQueued(unsigned short id);
+    #endif
 
-        int decodePacket(int* value, int timeout);
+        int readBytes(unsigned char* buffer, int len, Timer& timer);
+        int skipBytes(int len, Timer& timer);
+        int decodePacket(int* value, Timer& timer);
         int readPacket(Timer& timer);
+        int writeBytes(const unsigned char* buffer, int len, Timer& timer);
         int sendPacket(int length, Timer& timer);
+        int sendPacket(int length, const unsigned char* payload, int payloadlen, Timer& timer);
         int deliverMessage(MQTTString& topicName, Message& message);
-        bool isTopicMatched(char* topicFilter, MQTTString& topicName);
+        static void deliverToHandler(void* context, int slot);
+        int deliverPublish(MQTTString& topicName, Message& message, bool deliver);
 
         Network& ipstack;
         unsigned long command_timeout_ms;
@@ -204,6 +273,12 @@ namespace MQTT
         unsigned char sendbuf[MAX_MQTT_PACKET_SIZE];
         unsigned char readbuf[MAX_MQTT_PACKET_SIZE];
 
+        // Bytes read from the network ahead of the packet being parsed
+        unsigned char rxbuf[MQTTCLIENT_READ_BUFFER_SIZE];
+        int rxstart, rxend;
+        // Payload of the PUBLISH in readbuf still to be read, when it does not fit in readbuf
+        int payloadRemaining;
+
         Timer last_sent, last_received;
         unsigned int keepAliveInterval;
         bool ping_outstanding;
@@ -211,17 +286,39 @@ namespace MQTT
 
         PacketId packetid;
 
-        struct MessageHandlers
+        TopicIndex<MAX_MESSAGE_HANDLERS> topicIndex;
+        FP<void, MessageData&> messageHandlers[MAX_MESSAGE_HANDLERS];      // Indexed by the slots of topicIndex
+        struct Delivery
         {
-            const char* topicFilter;
-            FP<void, MessageData&> fp;
-        } messageHandlers[MAX_MESSAGE_HANDLERS];      // Message handlers are indexed by subscription topic
+            Client* client;
+            MessageData* md;
+            int handled;
+        };
 
         FP<void, MessageData&> defaultMessageHandler;
 
         bool isconnected;
 
-    #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+        unsigned short lastPuback;
+
+    #if MQTTCLIENT_QOS1
+        // QoS1 publishes until their PUBACK, oldest first; their packets follow one another in queuebuf,
+        // wrapping around at its end
+        struct QueuedPublish
+        {
+            unsigned short id;
+            bool sent;
+            bool acked;
+            int offset;
+            int len;
+            publishHandler handler;
+        } queue[MQTTCLIENT_MAX_QUEUED];
+        int queueHead, queueCount;
+        int inflightWindow;
+        unsigned char queuebuf[QUEUE_SIZE > 0 ? QUEUE_SIZE : 1];
+    #endif
+
+    #if MQTTCLIENT_QOS2
         unsigned char pubbuf[MAX_MQTT_PACKET_SIZE];  // store the last publish for sending on reconnect
         int inflightLen;
         unsigned short inflightMsgid;
@@ -242,18 +339,24 @@ namespace MQTT
 }
 
 
-template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
-MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::Client(Network& network, unsigned int command_timeout_ms)  : ipstack(network), packetid()
+template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS, int QUEUE_SIZE>
+MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS, QUEUE_SIZE>::Client(Network& network, unsigned int command_timeout_ms)  : ipstack(network), packetid()
 {
     last_sent = Timer();
     last_received = Timer();
     ping_outstanding = false;
-    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-        messageHandlers[i].topicFilter = 0;
     this->command_timeout_ms = command_timeout_ms;
     isconnected = false;
+    rxstart = rxend = 0;
+    payloadRemaining = 0;
+    lastPuback = 0;
     
-#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+#if MQTTCLIENT_QOS1
+    queueHead = queueCount = 0;
+    inflightWindow = MQTTCLIENT_INFLIGHT_WINDOW;
+#endif
+
+#if MQTTCLIENT_QOS2
     inflightMsgid = 0;
     inflightQoS = QOS0;
 #endif
@@ -266,8 +369,8 @@ MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::Client(Network& network,
 }
 
 #if MQTTCLIENT_QOS2
-template<class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::isQoS2msgidFree(unsigned short id)
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+bool MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::isQoS2msgidFree(unsigned short id)
 {
     for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
     {
@@ -277,8 +380,8 @@ bool MQTT::Client<Network, Timer, a, b>::isQoS2msgidFree(unsigned short id)
     return true;
 }
 
-template<class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::useQoS2msgid(unsigned short id)
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+bool MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::useQoS2msgid(unsigned short id)
 {
     for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
     {
@@ -292,38 +395,122 @@ bool MQTT::Client<Network, Timer, a, b>::useQoS2msgid(unsigned short id)
 }
 #endif
 
-template<class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::sendPacket(int length, Timer& timer)
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::writeBytes(const unsigned char* buffer, int len, Timer& timer)
 {
     int rc = FAILURE,
         sent = 0;
 
-    while (sent < length && !timer.expired())
+    while (sent < len && !timer.expired())
     {
-        rc = ipstack.write(&sendbuf[sent], length, timer.left_ms());
+        rc = ipstack.write((unsigned char*)&buffer[sent], len - sent, timer.left_ms());
         if (rc < 0)  // there was an error writing the data
             break;
         sent += rc;
     }
-    if (sent == length)
+    return sent;
+}
+
+
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::sendPacket(int length, Timer& timer)
+{
+    return sendPacket(length, NULL, 0, timer);
+}
+
+
+/**
+ * Send the packet in sendbuf, followed by a payload that is not in sendbuf
+ * @param length the length of the packet in sendbuf
+ * @param payload the rest of the packet, sent from where it is without copying it
+ * @return success code
+ */
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::sendPacket(int length, const unsigned char* payload, int payloadlen, Timer& timer)
+{
+    int rc = FAILURE;
+
+    if (writeBytes(sendbuf, length, timer) == length &&
+        (payloadlen == 0 || writeBytes(payload, payloadlen, timer) == payloadlen))
     {
         if (this->keepAliveInterval > 0)
             last_sent.countdown(this->keepAliveInterval); // record the fact that we have successfully sent the packet
         rc = SUCCESS;
     }
-    else
-        rc = FAILURE;
         
 #if defined(MQTT_DEBUG)
     char printbuf[50];
-    DEBUG("Rc %d from sending packet %s\n", rc, MQTTPacket_toString(printbuf, sizeof(printbuf), sendbuf, length));
+    if (payloadlen == 0)
+        DEBUG("Rc %d from sending packet %s\n", rc, MQTTPacket_toString(printbuf, sizeof(printbuf), sendbuf, length));
+    else
+        DEBUG("Rc %d from sending packet of %d bytes\n", rc, length + payloadlen);
 #endif
     return rc;
 }
 
 
-template<class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::decodePacket(int* value, int timeout)
+/**
+ * Read exactly len bytes, the bytes read ahead into rxbuf first.  Small reads fill rxbuf with as much as
+ * the network has, so that the header of a packet does not take a network read per byte; reads of at least
+ * the size of rxbuf go straight into buffer.
+ * @return the number of bytes read, less than len if the timer expired or the network failed
+ */
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::readBytes(unsigned char* buffer, int len, Timer& timer)
+{
+    int got = 0;
+
+    while (got < len)
+    {
+        int n = rxend - rxstart;
+        if (n > 0)
+        {
+            if (n > len - got)
+                n = len - got;
+            memcpy(buffer + got, rxbuf + rxstart, n);
+            rxstart += n;
+            got += n;
+            continue;
+        }
+
+        if (timer.expired())
+            break;
+        if (len - got >= MQTTCLIENT_READ_BUFFER_SIZE)
+        {
+            n = ipstack.read(buffer + got, len - got, timer.left_ms());
+            if (n <= 0)
+                break;
+            got += n;
+        }
+        else
+        {
+            n = ipstack.read(rxbuf, MQTTCLIENT_READ_BUFFER_SIZE, timer.left_ms());
+            if (n <= 0)
+                break;
+            rxstart = 0;
+            rxend = n;
+        }
+    }
+    return got;
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::skipBytes(int len, Timer& timer)
+{
+    while (len > 0)
+    {
+        int n = (len < MAX_MQTT_PACKET_SIZE) ? len : MAX_MQTT_PACKET_SIZE;
+        if (readBytes(readbuf, n, timer) != n)
+            return FAILURE;
+        len -= n;
+    }
+    return SUCCESS;
+}
+
+
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::decodePacket(int* value, Timer& timer)
 {
     unsigned char c;
     int multiplier = 1;
@@ -333,20 +520,13 @@ int MQTT::Client<Network, Timer, a, b>::decodePacket(int* value, int timeout)
     *value = 0;
     do
     {
-        int rc = MQTTPACKET_READ_ERROR;
-
         if (++len > MAX_NO_OF_REMAINING_LENGTH_BYTES)
-        {
-            rc = MQTTPACKET_READ_ERROR; /* bad data */
-            goto exit;
-        }
-        rc = ipstack.read(&c, 1, timeout);
-        if (rc != 1)
-            goto exit;
+            return FAILURE; /* bad data */
+        if (readBytes(&c, 1, timer) != 1)
+            return FAILURE;
         *value += (c & 127) * multiplier;
         multiplier *= 128;
     } while ((c & 128) != 0);
-exit:
     return len;
 }
 
@@ -354,31 +534,64 @@ exit:
 /**
  * If any read fails in this method, then we should disconnect from the network, as on reconnect
  * the packets can be retried.
+ * A PUBLISH larger than readbuf is read up to its payload, which is left on the network for cycle()
+ * to hand to the message handler in chunks.  Other packets larger than readbuf are dropped.
  * @param timeout the max time to wait for the packet read to complete, in milliseconds
  * @return the MQTT packet type, or -1 if none
  */
-template<class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::readPacket(Timer& timer)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::readPacket(Timer& timer)
 {
     int rc = FAILURE;
     MQTTHeader header = {0};
     int len = 0;
     int rem_len = 0;
+    int var_len = 0;
+    unsigned char topiclen[2];
 
     /* 1. read the header byte.  This has the packet type in it */
-    if (ipstack.read(readbuf, 1, timer.left_ms()) != 1)
+    if (readBytes(readbuf, 1, timer) != 1)
         goto exit;
 
     len = 1;
     /* 2. read the remaining length.  This is variable in itself */
-    decodePacket(&rem_len, timer.left_ms());
-    len += MQTTPacket_encode(readbuf + 1, rem_len); /* put the original remaining length into the buffer */
+    if (decodePacket(&rem_len, timer) == FAILURE)
+        goto exit;
+    header.byte = readbuf[0];
+
+    if (MQTTPacket_len(rem_len) <= MAX_MQTT_PACKET_SIZE)
+    {
+        len += MQTTPacket_encode(readbuf + 1, rem_len); /* put the original remaining length into the buffer */
 
-    /* 3. read the rest of the buffer using a callback to supply the rest of the data */
-    if (rem_len > 0 && (ipstack.read(readbuf + len, rem_len, timer.left_ms()) != rem_len))
+        /* 3. read the rest of the packet into the buffer */
+        if (rem_len > 0 && readBytes(readbuf + len, rem_len, timer) != rem_len)
+            goto exit;
+    }
+    else if (header.bits.type == PUBLISH)
+    {
+        /* 3. read the topic and the packet id only, the buffer holds a PUBLISH that ends before the payload */
+        if (rem_len < 2 || readBytes(topiclen, 2, timer) != 2)
+            goto exit;
+        var_len = 2 + 256 * topiclen[0] + topiclen[1] + (header.bits.qos > 0 ? 2 : 0);
+        if (var_len > rem_len || MQTTPacket_len(var_len) >= MAX_MQTT_PACKET_SIZE)
+        {
+            skipBytes(rem_len - 2, timer); /* no room for the topic */
+            goto exit;
+        }
+        len += MQTTPacket_encode(readbuf + 1, var_len);
+        readbuf[len++] = topiclen[0];
+        readbuf[len++] = topiclen[1];
+        if (readBytes(readbuf + len, var_len - 2, timer) != var_len - 2)
+            goto exit;
+        len += var_len - 2;
+        payloadRemaining = rem_len - var_len;
+    }
+    else
+    {
+        skipBytes(rem_len, timer);
         goto exit;
+    }
 
-    header.byte = readbuf[0];
     rc = header.bits.type;
     if (this->keepAliveInterval > 0)
         last_received.countdown(this->keepAliveInterval); // record the fact that we have successfully received a packet
@@ -392,62 +605,38 @@ exit:
 }
 
 
-// assume topic filter and name is in correct format
-// # can only be at end
-// + and # can only be next to separator
-template<class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::isTopicMatched(char* topicFilter, MQTTString& topicName)
+template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS, int QUEUE_SIZE>
+void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS, QUEUE_SIZE>::deliverToHandler(void* context, int slot)
 {
-    char* curf = topicFilter;
-    char* curn = topicName.lenstring.data;
-    char* curn_end = curn + topicName.lenstring.len;
-
-    while (*curf && curn < curn_end)
+    Delivery* delivery = (Delivery*)context;
+    if (delivery->client->messageHandlers[slot].attached())
     {
-        if (*curn == '/' && *curf != '/')
-            break;
-        if (*curf != '+' && *curf != '#' && *curf != *curn)
-            break;
-        if (*curf == '+')
-        {   // skip until we meet the next separator, or end of string
-            char* nextpos = curn + 1;
-            while (nextpos < curn_end && *nextpos != '/')
-                nextpos = ++curn + 1;
-        }
-        else if (*curf == '#')
-            curn = curn_end - 1;    // skip until end of string
-        curf++;
-        curn++;
-    };
-
-    return (curn == curn_end) && (*curf == '\0');
+        delivery->client->messageHandlers[slot](*delivery->md);
+        delivery->handled++;
+    }
 }
 
 
-
-template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
-int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::deliverMessage(MQTTString& topicName, Message& message)
+template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS, QUEUE_SIZE>::deliverMessage(MQTTString& topicName, Message& message)
 {
     int rc = FAILURE;
+    MessageData md(topicName, message);
+    Delivery delivery = {this, &md, 0};
+    const char* topic = topicName.lenstring.data;
+    int len = topicName.lenstring.len;
 
-    // we have to find the right message handler - indexed by topic
-    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    if (topicName.cstring)
     {
-        if (messageHandlers[i].topicFilter != 0 && (MQTTPacket_equals(&topicName, (char*)messageHandlers[i].topicFilter) ||
-                isTopicMatched((char*)messageHandlers[i].topicFilter, topicName)))
-        {
-            if (messageHandlers[i].fp.attached())
-            {
-                MessageData md(topicName, message);
-                messageHandlers[i].fp(md);
-                rc = SUCCESS;
-            }
-        }
+        topic = topicName.cstring;
+        len = strlen(topic);
     }
+    topicIndex.match(topic, len, deliverToHandler, &delivery);
+    if (delivery.handled > 0)
+        rc = SUCCESS;
 
     if (rc == FAILURE && defaultMessageHandler.attached())
     {
-        MessageData md(topicName, message);
         defaultMessageHandler(md);
         rc = SUCCESS;
     }
@@ -456,9 +645,52 @@ int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::deliverMessage(MQTTSt
 }
 
 
+/**
+ * Hand the PUBLISH in readbuf to the message handlers.  If its payload did not fit in readbuf, the payload
+ * is read in chunks into the space after the topic, and each chunk is handed over as soon as it is read.
+ * @param deliver false to read the payload without handing it over
+ * @return success code - on failure, the rest of the payload could not be read
+ */
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::deliverPublish(MQTTString& topicName, Message& message, bool deliver)
+{
+    int rc = SUCCESS;
+    unsigned char* chunk = (unsigned char*)message.payload;
+    int chunksize = &readbuf[MAX_MQTT_PACKET_SIZE] - chunk;
+    Timer timer = Timer(command_timeout_ms);   // the payload has started, don't cut it at the timeout of yield
+
+    message.payloadoffset = 0;
+    message.payloadtotal = message.payloadlen + payloadRemaining;
+    if (payloadRemaining == 0)
+    {
+        if (deliver)
+            deliverMessage(topicName, message);
+        return rc;
+    }
+
+    while (payloadRemaining > 0)
+    {
+        int len = (payloadRemaining < chunksize) ? payloadRemaining : chunksize;
+        if (readBytes(chunk, len, timer) != len)
+        {
+            rc = FAILURE;
+            break;
+        }
+        payloadRemaining -= len;
+        message.payload = chunk;
+        message.payloadlen = len;
+        if (deliver)
+            deliverMessage(topicName, message);
+        message.payloadoffset += len;
+    }
+    payloadRemaining = 0;
+    return rc;
+}
+
+
 
-template<class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::yield(unsigned long timeout_ms)
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::yield(unsigned long timeout_ms)
 {
     int rc = SUCCESS;
     Timer timer = Timer();
@@ -477,8 +709,8 @@ int MQTT::Client<Network, Timer, a, b>::yield(unsigned long timeout_ms)
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::cycle(Timer& timer)
 {
     /* get one piece of work off the wire and one pass through */
 
@@ -491,28 +723,49 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer)
     switch (packet_type)
     {
         case CONNACK:
-        case PUBACK:
         case SUBACK:
             break;
+        case PUBACK:
+        {
+            unsigned short mypacketid;
+            unsigned char dup, type;
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
+            {
+                lastPuback = mypacketid;
+#if MQTTCLIENT_QOS1
+                ackQueued(mypacketid);
+                if (isconnected)
+                    sendQueue(); // the window has room again
+#endif
+            }
+            break;
+        }
         case PUBLISH:
+        {
             MQTTString topicName;
             Message msg;
+            bool deliver = true;
             if (MQTTDeserialize_publish((unsigned char*)&msg.dup, (int*)&msg.qos, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
                                  (unsigned char**)&msg.payload, (int*)&msg.payloadlen, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
                 goto exit;
 #if MQTTCLIENT_QOS2
-            if (msg.qos != QOS2)
-#endif
-                deliverMessage(topicName, msg);
-#if MQTTCLIENT_QOS2
-            else if (isQoS2msgidFree(msg.id))
+            if (msg.qos == QOS2)
             {
-                if (useQoS2msgid(msg.id))
-                    deliverMessage(topicName, msg);
-                else
+                if (!isQoS2msgidFree(msg.id))
+                    deliver = false;
+                else if (!useQoS2msgid(msg.id))
+                {
                     WARN("Maximum number of incoming QoS2 messages exceeded");
-            }   
+                    deliver = false;
+                }
+            }
 #endif
+            if (deliverPublish(topicName, msg, deliver) != SUCCESS)
+            {
+                rc = FAILURE;
+                isconnected = false; // the rest of the packet is lost, the connection can't go on
+                goto exit;
+            }
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
             if (msg.qos != QOS0)
             {
@@ -527,8 +780,9 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer)
                 if (rc == FAILURE)
                     goto exit; // there was a problem
             }
-            break;
 #endif
+            break;
+        }
 #if MQTTCLIENT_QOS2
         case PUBREC:
             unsigned short mypacketid;
@@ -557,8 +811,8 @@ exit:
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::keepalive()
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::keepalive()
 {
     int rc = FAILURE;
 
@@ -585,8 +839,8 @@ exit:
 
 
 // only used in single-threaded mode where one command at a time is in process
-template<class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::waitfor(int packet_type, Timer& timer)
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::waitfor(int packet_type, Timer& timer)
 {
     int rc = FAILURE;
 
@@ -601,8 +855,158 @@ int MQTT::Client<Network, Timer, a, b>::waitfor(int packet_type, Timer& timer)
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_connectData& options)
+// wait for the PUBACK of one publish, the PUBACKs of the others in flight may come first
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::waitPuback(unsigned short id, Timer& timer)
+{
+    while (!timer.expired())
+    {
+        int rc = cycle(timer);
+        if (rc == FAILURE)
+            break;
+        if (rc == PUBACK && lastPuback == id)
+            return SUCCESS;
+    }
+    return FAILURE;
+}
+
+
+#if MQTTCLIENT_QOS1
+/**
+ * Serialize a QoS1 publish into the queue, after the newest one
+ * @return success code - BUFFER_OVERFLOW if there is no free entry or no room in queuebuf
+ */
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::queuePublish(MQTTString& topicName, Message& message, publishHandler handler)
+{
+    int len = MQTTPacket_len(MQTTSerialize_publishLength(QOS1, topicName, message.payloadlen));
+    int offset = 0;
+
+    if (queueCount == MQTTCLIENT_MAX_QUEUED)
+        return BUFFER_OVERFLOW;
+    if (queueCount > 0)
+    {
+        struct QueuedPublish& oldest = queue[queueHead];
+        struct QueuedPublish& newest = queue[(queueHead + queueCount - 1) % MQTTCLIENT_MAX_QUEUED];
+        int end = newest.offset + newest.len;
+
+        if (newest.offset >= oldest.offset && end + len <= QUEUE_SIZE)
+            offset = end;          // after the newest
+        else if (newest.offset >= oldest.offset && len <= oldest.offset)
+            offset = 0;            // wrap around
+        else if (newest.offset < oldest.offset && end + len <= oldest.offset)
+            offset = end;          // wrapped already, up to the oldest
+        else
+            return BUFFER_OVERFLOW;
+    }
+    else if (len > QUEUE_SIZE)
+        return BUFFER_OVERFLOW;
+
+    message.id = packetid.getNext();
+    if (MQTTSerialize_publish(&queuebuf[offset], len, 0, QOS1, message.retained, message.id,
+            topicName, (unsigned char*)message.payload, message.payloadlen) != len)
+        return FAILURE;
+
+    struct QueuedPublish& entry = queue[(queueHead + queueCount) % MQTTCLIENT_MAX_QUEUED];
+    entry.id = message.id;
+    entry.sent = false;
+    entry.acked = false;
+    entry.offset = offset;
+    entry.len = len;
+    entry.handler = handler;
+    queueCount++;
+    return SUCCESS;
+}
+
+
+// Send the queued publishes not sent yet, oldest first, as far as the in-flight window allows
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::sendQueue()
+{
+    Timer timer = Timer(command_timeout_ms);
+    int inflight = 0;
+
+    for (int i = 0; i < queueCount; ++i)
+    {
+        struct QueuedPublish& entry = queue[(queueHead + i) % MQTTCLIENT_MAX_QUEUED];
+        if (entry.acked)
+            continue;
+        if (!entry.sent)
+        {
+            if (inflight >= inflightWindow)
+                break;
+            if (sendPacket(0, &queuebuf[entry.offset], entry.len, timer) != SUCCESS)
+            {
+                isconnected = false;
+                return FAILURE;
+            }
+            queuebuf[entry.offset] |= 0x08; // any later send of the packet is a duplicate
+            entry.sent = true;
+        }
+        inflight++;
+    }
+    return SUCCESS;
+}
+
+
+// Take a publish out of the queue once its PUBACK arrives, the PUBACKs may come in any order
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+void MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::ackQueued(unsigned short id)
+{
+    publishHandler handler = 0;
+
+    for (int i = 0; i < queueCount; ++i)
+    {
+        struct QueuedPublish& entry = queue[(queueHead + i) % MQTTCLIENT_MAX_QUEUED];
+        if (entry.sent && !entry.acked && entry.id == id)
+        {
+            entry.acked = true;
+            handler = entry.handler;
+            break;
+        }
+    }
+    while (queueCount > 0 && queue[queueHead].acked)
+    {
+        queueHead = (queueHead + 1) % MQTTCLIENT_MAX_QUEUED;
+        queueCount--;
+    }
+
+    if (handler)
+        handler(id);
+}
+#endif
+
+
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+void MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::setInflightWindow(int window)
+{
+#if MQTTCLIENT_QOS1
+    if (window < 1)
+        window = 1;
+    if (window > MQTTCLIENT_MAX_QUEUED)
+        window = MQTTCLIENT_MAX_QUEUED;
+    inflightWindow = window;
+#endif
+}
+
+
+template<class Network, class Timer, int a, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, a, b, QUEUE_SIZE>::queuedPublishes()
+{
+    int count = 0;
+#if MQTTCLIENT_QOS1
+    for (int i = 0; i < queueCount; ++i)
+    {
+        if (!queue[(queueHead + i) % MQTTCLIENT_MAX_QUEUED].acked)
+            count++;
+    }
+#endif
+    return count;
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::connect(MQTTPacket_connectData& options)
 {
     Timer connect_timer = Timer(command_timeout_ms);
     int rc = FAILURE;
@@ -613,6 +1017,8 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_co
 
     this->keepAliveInterval = options.keepAliveInterval;
     this->cleansession = options.cleansession;
+    rxstart = rxend = 0;    // nothing left over from an earlier connection
+    payloadRemaining = 0;
     if ((len = MQTTSerialize_connect(sendbuf, MAX_MQTT_PACKET_SIZE, &options)) <= 0)
         goto exit;
     if ((rc = sendPacket(len, connect_timer)) != SUCCESS)  // send the connect packet
@@ -640,15 +1046,24 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_co
         if ((len = MQTTSerialize_ack(sendbuf, MAX_MQTT_PACKET_SIZE, PUBREL, 0, inflightMsgid)) <= 0)
             rc = FAILURE;
         else
-            rc = publish(len, connect_timer, inflightQoS);
+            rc = publish(len, NULL, 0, inflightMsgid, connect_timer, inflightQoS);
     }
     else
 #endif
-#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+#if MQTTCLIENT_QOS2
     if (inflightMsgid > 0)
     {
         memcpy(sendbuf, pubbuf, MAX_MQTT_PACKET_SIZE);
-        rc = publish(inflightLen, connect_timer, inflightQoS);
+        rc = publish(inflightLen, NULL, 0, inflightMsgid, connect_timer, inflightQoS);
+    }
+#endif
+#if MQTTCLIENT_QOS1
+    // send the queue again from the start, the publishes sent before carry the DUP flag now
+    if (rc == SUCCESS)
+    {
+        for (int i = 0; i < queueCount; ++i)
+            queue[(queueHead + i) % MQTTCLIENT_MAX_QUEUED].sent = false;
+        rc = sendQueue();
     }
 #endif
 
@@ -659,25 +1074,31 @@ exit:
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect()
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::connect()
 {
     MQTTPacket_connectData default_options = MQTTPacket_connectData_initializer;
     return connect(default_options);
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::subscribe(const char* topicFilter, enum QoS qos, messageHandler messageHandler)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS, QUEUE_SIZE>::subscribe(const char* topicFilter, enum QoS qos, messageHandler messageHandler)
 {
     int rc = FAILURE;
     Timer timer = Timer(command_timeout_ms);
     int len = 0;
     MQTTString topic = {(char*)topicFilter, 0, 0};
+    int slot = -1;
 
     if (!isconnected)
         goto exit;
 
+    // take the slot first, so that a full pool or a malformed filter does not cost the connection
+    if ((slot = topicIndex.add(topicFilter)) < 0)
+        return FAILURE;
+    messageHandlers[slot].attach(messageHandler);
+
     len = MQTTSerialize_subscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), 1, &topic, (int*)&qos);
     if (len <= 0)
         goto exit;
@@ -691,31 +1112,23 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::su
         if (MQTTDeserialize_suback(&mypacketid, 1, &count, &grantedQoS, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
             rc = grantedQoS; // 0, 1, 2 or 0x80
         if (rc != 0x80)
-        {
-            for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-            {
-                if (messageHandlers[i].topicFilter == 0)
-                {
-                    messageHandlers[i].topicFilter = topicFilter;
-                    messageHandlers[i].fp.attach(messageHandler);
-                    rc = 0;
-                    break;
-                }
-            }
-        }
+            rc = 0;
     }
     else
         rc = FAILURE;
 
 exit:
     if (rc != SUCCESS)
+    {
+        topicIndex.remove(slot);
         isconnected = false;
+    }
     return rc;
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::unsubscribe(const char* topicFilter)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS, QUEUE_SIZE>::unsubscribe(const char* topicFilter)
 {
     int rc = FAILURE;
     Timer timer = Timer(command_timeout_ms);
@@ -734,7 +1147,12 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::un
     {
         unsigned short mypacketid;  // should be the same as the packetid above
         if (MQTTDeserialize_unsuback(&mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
+        {
+            // give back the slots of all the handlers of this filter
+            for (int slot = topicIndex.find(topicFilter); slot >= 0; slot = topicIndex.find(topicFilter, slot + 1))
+                topicIndex.remove(slot);
             rc = 0;
+        }
     }
     else
         rc = FAILURE;
@@ -746,29 +1164,17 @@ exit:
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(int len, Timer& timer, enum QoS qos)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::publish(int len, const unsigned char* payload, int payloadlen, unsigned short id, Timer& timer, enum QoS qos)
 {
     int rc;
     
-    if ((rc = sendPacket(len, timer)) != SUCCESS) // send the publish packet
+    if ((rc = sendPacket(len, payload, payloadlen, timer)) != SUCCESS) // send the publish packet
         goto exit; // there was a problem
 
 #if MQTTCLIENT_QOS1 
     if (qos == QOS1)
-    {
-        if (waitfor(PUBACK, timer) == PUBACK)
-        {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
-                rc = FAILURE;
-            else if (inflightMsgid == mypacketid)
-                inflightMsgid = 0;
-        }
-        else
-            rc = FAILURE;
-    }
+        rc = waitPuback(id, timer);
 #elif MQTTCLIENT_QOS2
     else if (qos == QOS2)
     {
@@ -794,8 +1200,8 @@ exit:
 
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos, bool retained)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::publish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos, bool retained)
 {
     int rc = FAILURE;
     Timer timer = Timer(command_timeout_ms);
@@ -807,18 +1213,57 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* t
         
     topicString.cstring = (char*)topicName;
 
+#if MQTTCLIENT_QOS1
+    // through the queue, so that it is sent again after a reconnect and keeps its place behind the
+    // publishes in flight; a payload too large for the queue is sent from the memory of the caller
+    if (qos == QOS1 && MQTTPacket_len(MQTTSerialize_publishLength(qos, topicString, payloadlen)) <= QUEUE_SIZE)
+    {
+        Message message;
+        message.qos = QOS1;
+        message.retained = retained;
+        message.dup = false;
+        message.id = 0;
+        message.payload = payload;
+        message.payloadlen = payloadlen;
+        message.payloadoffset = 0;
+        message.payloadtotal = payloadlen;
+        while ((rc = queuePublish(topicString, message, 0)) == BUFFER_OVERFLOW && !timer.expired())
+        {
+            if (cycle(timer) == FAILURE) // wait for PUBACKs to make room
+                break;
+        }
+        if (rc == SUCCESS)
+        {
+            id = message.id;
+            if ((rc = sendQueue()) == SUCCESS)
+                rc = waitPuback(id, timer);
+            if (rc != SUCCESS)
+                isconnected = false;
+        }
+        goto exit;
+    }
+#endif
+
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
     if (qos == QOS1 || qos == QOS2)
         id = packetid.getNext();
 #endif
 
-    len = MQTTSerialize_publish(sendbuf, MAX_MQTT_PACKET_SIZE, 0, qos, retained, id,
-              topicString, (unsigned char*)payload, payloadlen);
+    len = MQTTSerialize_publishHeader(sendbuf, MAX_MQTT_PACKET_SIZE, 0, qos, retained, id,
+              topicString, payloadlen);
     if (len <= 0)
         goto exit;
+    if (len + (int)payloadlen <= MAX_MQTT_PACKET_SIZE)
+    {
+        // small enough to go out in one write
+        memcpy(&sendbuf[len], payload, payloadlen);
+        len += payloadlen;
+        payloadlen = 0;
+    }
         
-#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
-    if (!cleansession)
+#if MQTTCLIENT_QOS2
+    // only a publish that fits in the buffer is kept for sending on reconnect
+    if (qos == QOS2 && !cleansession && payloadlen == 0)
     {
         memcpy(pubbuf, sendbuf, len);
         inflightMsgid = id;
@@ -830,29 +1275,53 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* t
     }
 #endif
         
-    rc = publish(len, timer, qos);
+    rc = publish(len, (const unsigned char*)payload, payloadlen, id, timer, qos);
 exit:
     return rc;
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, void* payload, size_t payloadlen, enum QoS qos, bool retained)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::publishAsync(const char* topicName, Message& message, publishHandler handler)
+{
+    int rc = FAILURE;
+    MQTTString topicString = MQTTString_initializer;
+
+    topicString.cstring = (char*)topicName;
+    if (message.qos == QOS0)
+    {
+        if (isconnected)
+            rc = publish(topicName, message.payload, message.payloadlen, message.id, QOS0, message.retained);
+    }
+#if MQTTCLIENT_QOS1
+    else if (message.qos == QOS1)
+    {
+        rc = queuePublish(topicString, message, handler);
+        if (rc == SUCCESS && isconnected)
+            sendQueue();    // on failure it stays queued for the reconnect
+    }
+#endif
+    return rc;
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::publish(const char* topicName, void* payload, size_t payloadlen, enum QoS qos, bool retained)
 {
     unsigned short id = 0;  // dummy - not used for anything
     return publish(topicName, payload, payloadlen, id, qos, retained);
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, Message& message)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::publish(const char* topicName, Message& message)
 {
     return publish(topicName, message.payload, message.payloadlen, message.qos, message.retained);
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::disconnect()
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b, int QUEUE_SIZE>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b, QUEUE_SIZE>::disconnect()
 {
     int rc = FAILURE;
     Timer timer = Timer(command_timeout_ms);     // we might wait for incomplete incoming publishes to complete
@@ -0,0 +1,169 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _MQTTTLSNETWORK_H_
+#define _MQTTTLSNETWORK_H_
+
+#include "NetworkInterface.h"
+#include "MQTTmbed.h"
+#include "SystemWiFi.h"
+#include "TLSSocket.h"
+#include "Telemetry.h"
+
+// Decrypted bytes read ahead of the client, so that the small reads of a packet header don't go
+// through mbedtls_ssl_read() one by one
+#define MQTT_TLS_READ_BUFFER_SIZE 256
+// Socket timeout of the TLS handshake, read() and write() leave the timeout of their last call
+#define MQTT_TLS_CONNECT_TIMEOUT_MS 5000
+
+/**
+* The transport of MQTT::Client for TLS brokers, e.g. on port 8883:
+*
+*     MQTTTLSNetwork network(caCertificates);
+*     MQTT::Client<MQTTTLSNetwork, Countdown> client(network);
+*     network.connect("broker.example.com", 8883);
+*     client.connect(data);
+*
+* The TLS socket lives as long as the network, so the CA certificates are parsed once and a
+* connect() after disconnect() resumes the TLS session of the last one when the broker allows it.
+*/
+class MQTTTLSNetwork
+{
+  public:
+    MQTTTLSNetwork(const char *caCertificates)
+    {
+        _caCertificates = caCertificates;
+        _tlsSocket = NULL;
+        _connected = false;
+        _rxStart = _rxEnd = 0;
+    }
+
+    ~MQTTTLSNetwork()
+    {
+        if (_tlsSocket != NULL)
+        {
+            _tlsSocket->close();
+            delete _tlsSocket;
+            _tlsSocket = NULL;
+        }
+    }
+
+    int read(unsigned char *buffer, int len, int timeout)
+    {
+        if (!_connected)
+        {
+            return NSAPI_ERROR_NO_SOCKET;
+        }
+
+        int n = _rxEnd - _rxStart;
+        if (n == 0)
+        {
+            _tlsSocket->set_timeout(timeout);
+            if (len >= MQTT_TLS_READ_BUFFER_SIZE)
+            {
+                // Large reads go straight to the caller
+                return _tlsSocket->recv(buffer, len);
+            }
+
+            n = _tlsSocket->recv(_rxBuffer, MQTT_TLS_READ_BUFFER_SIZE);
+            if (n <= 0)
+            {
+                return n;
+            }
+            _rxStart = 0;
+            _rxEnd = n;
+        }
+
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(buffer, _rxBuffer + _rxStart, n);
+        _rxStart += n;
+        return n;
+    }
+
+    int write(unsigned char *buffer, int len, int timeout)
+    {
+        if (!_connected)
+        {
+            return NSAPI_ERROR_NO_SOCKET;
+        }
+
+        _tlsSocket->set_timeout(timeout);
+        return _tlsSocket->send(buffer, len);
+    }
+
+    int connect(const char *hostname, int port)
+    {
+        if (_connected)
+        {
+            return NSAPI_ERROR_OK;
+        }
+
+        if (_tlsSocket == NULL)
+        {
+            _tlsSocket = new TLSSocket(_caCertificates, WiFiInterface());
+            if (_tlsSocket == NULL)
+            {
+                return NSAPI_ERROR_NO_SOCKET;
+            }
+        }
+
+        _rxStart = _rxEnd = 0;
+        _tlsSocket->set_timeout(MQTT_TLS_CONNECT_TIMEOUT_MS);
+        int ret = _tlsSocket->connect(hostname, port);
+        if (ret == 0)
+        {
+            _connected = true;
+            // Microsoft collects data to operate effectively and provide you the best experiences with our products.
+            // We collect data about the features you use, how often you use them, and how you use them.
+            send_telemetry_data_async("", "mqtt connection", "Connect MQTT server over TLS successfully");
+        }
+        else
+        {
+            // connect host or TLS handshake failed
+            send_telemetry_data_async("", "mqtt connection", "Connect MQTT server over TLS failed.");
+            _tlsSocket->close();
+        }
+        return ret;
+    }
+
+    int disconnect()
+    {
+        if (!_connected)
+        {
+            return NSAPI_ERROR_OK;
+        }
+
+        // The socket is kept for the session of the next connect
+        _connected = false;
+        return _tlsSocket->close();
+    }
+
+    /**
+    * @brief get the handshakes, the resumed ones, the time and the bytes of the last connect and
+    *        the bytes on the wire since the last reset
+    */
+    void getStats(TLS_STATS *stats, bool reset = false)
+    {
+        if (_tlsSocket != NULL)
+        {
+            _tlsSocket->get_stats(stats, reset);
+        }
+        else if (stats != NULL)
+        {
+            memset(stats, 0, sizeof(TLS_STATS));
+        }
+    }
+
+  private:
+    const char *_caCertificates;
+    TLSSocket *_tlsSocket;
+    bool _connected;
+    unsigned char _rxBuffer[MQTT_TLS_READ_BUFFER_SIZE];
+    int _rxStart;
+    int _rxEnd;
+};
+
+#endif // _MQTTTLSNETWORK_H_
@@ -0,0 +1,391 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#if !defined(MQTTTOPICINDEX_H)
+#define MQTTTOPICINDEX_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(MQTTCLIENT_FILTER_LEVELS)
+    // Trie nodes per subscription slot, a filter takes one node per level before a final '#'
+    #define MQTTCLIENT_FILTER_LEVELS 4
+#endif
+
+namespace MQTT
+{
+    /**
+    * @class TopicIndex
+    * @brief the topic filters of the subscriptions, in a trie of their levels
+    *
+    * Every filter takes one of MAX_FILTERS slots, which index the handlers of the client.  A topic is
+    * matched by following its levels down the trie, along the exact and the '+' children of the nodes
+    * reached, so the cost goes with the levels of the topic and the filters that match, not with the
+    * number of filters.  The exact children are found in a hash table keyed by the parent and a hash of
+    * the level, and the filter of every candidate is compared with the topic before it is reported.
+    *
+    * All memory is in the object: MAX_NODES nodes shared by the filters, which must stay valid while
+    * they are in the index.
+    */
+    template<int MAX_FILTERS, int MAX_NODES = MAX_FILTERS * MQTTCLIENT_FILTER_LEVELS>
+    class TopicIndex
+    {
+    public:
+        typedef void (*matchHandler)(void* context, int slot);
+
+        TopicIndex()
+        {
+            clear();
+        }
+
+        void clear()
+        {
+            for (int i = 0; i < MAX_FILTERS; ++i)
+                filters[i].topicFilter = 0;
+            for (int i = 0; i < TABLE_SIZE; ++i)
+                table[i] = -1;
+            // node 0 is the root, the others are free
+            initNode(ROOT, -1, 0, 0);
+            nodes[ROOT].refs = 1;
+            freeNodes = (MAX_NODES > 1) ? 1 : -1;
+            for (int i = 1; i < MAX_NODES; ++i)
+                nodes[i].plus = (i + 1 < MAX_NODES) ? i + 1 : -1;
+        }
+
+        /** Add a topic filter
+        *  @return the slot of the filter, or -1 if the filter is malformed or the slots or nodes ran out
+        */
+        int add(const char* topicFilter)
+        {
+            if (topicFilter == 0 || !isValidFilter(topicFilter))
+                return -1;
+
+            int slot = 0;
+            while (slot < MAX_FILTERS && filters[slot].topicFilter != 0)
+                ++slot;
+            if (slot == MAX_FILTERS)
+                return -1;
+
+            short node = ROOT;
+            bool multiLevel = false;
+            const char* level = topicFilter;
+            while (true)
+            {
+                const char* end = level;
+                while (*end != '/' && *end != '\0')
+                    ++end;
+                int len = end - level;
+
+                if (len == 1 && *level == '#')
+                {
+                    multiLevel = true;
+                    break;
+                }
+
+                short child;
+                if (len == 1 && *level == '+')
+                {
+                    child = nodes[node].plus;
+                    if (child < 0 && (child = newNode(node, 0, 0)) >= 0)
+                        nodes[node].plus = child;
+                }
+                else
+                {
+                    uint32_t hash = hashLevel(level, len);
+                    child = findChild(node, hash, len);
+                    if (child < 0 && (child = newNode(node, hash, len)) >= 0)
+                        insertChild(child);
+                }
+                if (child < 0)
+                {
+                    release(node);
+                    return -1;
+                }
+                nodes[child].refs++;
+                node = child;
+
+                if (*end == '\0')
+                    break;
+                level = end + 1;
+            }
+
+            Filter& f = filters[slot];
+            f.topicFilter = topicFilter;
+            f.node = node;
+            f.multiLevel = multiLevel;
+            short& head = multiLevel ? nodes[node].multiLevel : nodes[node].filters;
+            f.next = head;
+            head = slot;
+            return slot;
+        }
+
+        /** Remove the filter of a slot
+        *  @return the slot, or -1 if it was free
+        */
+        int remove(int slot)
+        {
+            if (slot < 0 || slot >= MAX_FILTERS || filters[slot].topicFilter == 0)
+                return -1;
+
+            Filter& f = filters[slot];
+            short* link = f.multiLevel ? &nodes[f.node].multiLevel : &nodes[f.node].filters;
+            while (*link != slot)
+                link = &filters[*link].next;
+            *link = f.next;
+            f.topicFilter = 0;
+            release(f.node);
+            return slot;
+        }
+
+        /** Find a slot with the given filter, starting at slot from
+        *  @return the slot, or -1 if the filter is not in the index
+        */
+        int find(const char* topicFilter, int from = 0)
+        {
+            for (int slot = from; slot < MAX_FILTERS; ++slot)
+            {
+                if (filters[slot].topicFilter != 0 && strcmp(filters[slot].topicFilter, topicFilter) == 0)
+                    return slot;
+            }
+            return -1;
+        }
+
+        const char* getFilter(int slot)
+        {
+            return (slot >= 0 && slot < MAX_FILTERS) ? filters[slot].topicFilter : 0;
+        }
+
+        /** Report every filter matching a topic, in no particular order
+        *  @param topic - the topic name, not necessarily NULL terminated
+        *  @return the number of the filters reported
+        */
+        int match(const char* topic, int len, matchHandler handler, void* context)
+        {
+            if (len <= 0)
+                return 0;
+            Match m = {topic, topic + len, handler, context, 0};
+            matchLevel(m, ROOT, topic);
+            return m.count;
+        }
+
+        /** Match a topic against one filter
+        *  Wildcards in the first level of a filter don't match topics starting with '$', e.g. $SYS/...
+        */
+        static bool isMatched(const char* topicFilter, const char* topic, int len)
+        {
+            const char* t = topic;
+            const char* tend = topic + len;
+            const char* f = topicFilter;
+
+            if (len > 0 && *t == '$' && (*f == '+' || *f == '#'))
+                return false;
+            while (true)
+            {
+                if (f[0] == '#' && f[1] == '\0')
+                    return true;                    // the rest of the topic, the parent level included
+
+                const char* fe = f;
+                while (*fe != '/' && *fe != '\0')
+                    ++fe;
+                const char* te = t;
+                while (te < tend && *te != '/')
+                    ++te;
+
+                if (!(fe - f == 1 && *f == '+') && (fe - f != te - t || memcmp(f, t, fe - f) != 0))
+                    return false;
+
+                bool moreFilter = (*fe == '/');
+                bool moreTopic = (te < tend);
+                if (!moreTopic)
+                    return !moreFilter || (fe[1] == '#' && fe[2] == '\0');
+                if (!moreFilter)
+                    return false;
+                f = fe + 1;
+                t = te + 1;
+            }
+        }
+
+    private:
+        static const short ROOT = 0;
+        static const int TABLE_SIZE = 2 * MAX_NODES;   // at most half full, for short probe sequences
+
+        struct Node
+        {
+            uint32_t hash;          // of the level, 0 for '+'
+            short parent;
+            unsigned short len;
+            short plus;             // the '+' child, the next free node for a free node
+            short filters;          // the filters ending here, chained through Filter::next
+            short multiLevel;       // the filters ending here with "/#"
+            short refs;             // filters through this node
+        } nodes[MAX_NODES];
+
+        struct Filter
+        {
+            const char* topicFilter;    // 0 for a free slot
+            short node;
+            short next;
+            bool multiLevel;
+        } filters[MAX_FILTERS];
+
+        // The exact children of all nodes, open addressing with linear probing
+        short table[TABLE_SIZE];
+        short freeNodes;
+
+        struct Match
+        {
+            const char* topic;
+            const char* end;
+            matchHandler handler;
+            void* context;
+            int count;
+        };
+
+        static bool isValidFilter(const char* topicFilter)
+        {
+            if (*topicFilter == '\0')
+                return false;
+            for (const char* p = topicFilter; *p; ++p)
+            {
+                if (*p != '+' && *p != '#')
+                    continue;
+                // wildcards take a whole level, and '#' is the last one
+                if (p != topicFilter && p[-1] != '/')
+                    return false;
+                if (*p == '+' && p[1] != '/' && p[1] != '\0')
+                    return false;
+                if (*p == '#' && p[1] != '\0')
+                    return false;
+            }
+            return true;
+        }
+
+        static uint32_t hashLevel(const char* level, int len)
+        {
+            uint32_t hash = 2166136261u;        // FNV-1a
+            for (int i = 0; i < len; ++i)
+                hash = (hash ^ (unsigned char)level[i]) * 16777619u;
+            return hash;
+        }
+
+        static int home(short parent, uint32_t hash)
+        {
+            return (hash + (uint32_t)parent * 2654435761u) % TABLE_SIZE;
+        }
+
+        void initNode(short n, short parent, uint32_t hash, int len)
+        {
+            nodes[n].hash = hash;
+            nodes[n].parent = parent;
+            nodes[n].len = len;
+            nodes[n].plus = -1;
+            nodes[n].filters = -1;
+            nodes[n].multiLevel = -1;
+            nodes[n].refs = 0;
+        }
+
+        short newNode(short parent, uint32_t hash, int len)
+        {
+            short n = freeNodes;
+            if (n < 0)
+                return -1;
+            freeNodes = nodes[n].plus;
+            initNode(n, parent, hash, len);
+            return n;
+        }
+
+        short findChild(short parent, uint32_t hash, int len)
+        {
+            for (int i = home(parent, hash); table[i] >= 0; i = (i + 1) % TABLE_SIZE)
+            {
+                Node& n = nodes[table[i]];
+                if (n.hash == hash && n.parent == parent && n.len == len)
+                    return table[i];
+            }
+            return -1;
+        }
+
+        void insertChild(short child)
+        {
+            int i = home(nodes[child].parent, nodes[child].hash);
+            while (table[i] >= 0)
+                i = (i + 1) % TABLE_SIZE;
+            table[i] = child;
+        }
+
+        void removeChild(short child)
+        {
+            int i = home(nodes[child].parent, nodes[child].hash);
+            while (table[i] != child)
+                i = (i + 1) % TABLE_SIZE;
+
+            // Move back the entries after the hole that can't be found past it any more
+            for (int j = (i + 1) % TABLE_SIZE; table[j] >= 0; j = (j + 1) % TABLE_SIZE)
+            {
+                int k = home(nodes[table[j]].parent, nodes[table[j]].hash);
+                if ((j > i) ? (k <= i || k > j) : (k <= i && k > j))
+                {
+                    table[i] = table[j];
+                    i = j;
+                }
+            }
+            table[i] = -1;
+        }
+
+        // Drop one reference from a node and its parents, the nodes no filter goes through are freed
+        void release(short n)
+        {
+            while (n != ROOT)
+            {
+                short parent = nodes[n].parent;
+                if (--nodes[n].refs == 0)
+                {
+                    if (nodes[parent].plus == n)
+                        nodes[parent].plus = -1;
+                    else
+                        removeChild(n);
+                    nodes[n].plus = freeNodes;
+                    freeNodes = n;
+                }
+                n = parent;
+            }
+        }
+
+        void report(Match& m, short slot)
+        {
+            for (; slot >= 0; slot = filters[slot].next)
+            {
+                // Different levels with the same hash share a node, the filter tells them apart
+                if (isMatched(filters[slot].topicFilter, m.topic, m.end - m.topic))
+                {
+                    m.count++;
+                    m.handler(m.context, slot);
+                }
+            }
+        }
+
+        // level is the start of the next level of the topic, or 0 when the node stands for the whole topic
+        void matchLevel(Match& m, short n, const char* level)
+        {
+            report(m, nodes[n].multiLevel);
+            if (level == 0)
+            {
+                report(m, nodes[n].filters);
+                return;
+            }
+
+            const char* end = level;
+            while (end < m.end && *end != '/')
+                ++end;
+            const char* next = (end < m.end) ? end + 1 : 0;
+
+            short child = findChild(n, hashLevel(level, end - level), end - level);
+            if (child >= 0)
+                matchLevel(m, child, next);
+            if (nodes[n].plus >= 0)
+                matchLevel(m, nodes[n].plus, next);
+        }
+    };
+}
+
+#endif
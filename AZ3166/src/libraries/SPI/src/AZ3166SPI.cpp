@@ -11,18 +11,51 @@
 
 #include "AZ3166SPI.h"
 
+// mbed SPI with access to the HAL handle, for the register and DMA transfers
+class SPIDevice : public MbedSPI
+{
+public:
+  SPIDevice(PinName mosi, PinName miso, PinName sclk, PinName ssel) : MbedSPI(mosi, miso, sclk, ssel) {}
+
+  SPI_HandleTypeDef *handle(void)
+  {
+    return &_spi.handle;
+  }
+
+  // Apply the format and frequency of this object if another one used the peripheral meanwhile
+  void select(void)
+  {
+    aquire();
+  }
+};
+
+// SPI2 requests, RX on DMA1 stream 3 and TX on DMA1 stream 4 channel 0, shared with the audio codec
+static DMA_HandleTypeDef dmaRx;
+static DMA_HandleTypeDef dmaTx;
+static Semaphore dmaDone(0);
+static volatile bool dmaBusy = false;
+static bool dmaPending = false;
+// The bus stays locked while the DMA runs, until the thread which started it sees the end
+static bool dmaLocked = false;
+static osThreadId dmaOwner = NULL;
+static SPI_TRANSFER_CALLBACK dmaCallback = NULL;
+static void *dmaContext = NULL;
+static uint16_t dummyTx = 0xFFFF;
+static uint16_t dummyRx;
+
 SPIClass SPI;
 
 SPIClass::SPIClass()
 {
   deviceSPI = NULL;
+  spiBits = SPI_DEFAULT_BITS_PER_FRAME;
 }
 
 void SPIClass::begin()
 {
   end();
-  
-  deviceSPI = new MbedSPI(SPI_MOSI, SPI_MISO, SPI_CLK, SPI_SS);
+
+  deviceSPI = new SPIDevice(SPI_MOSI, SPI_MISO, SPI_CLK, SPI_SS);
   spi_setup();
 }
 
@@ -30,6 +63,7 @@ void SPIClass::end(void)
 {
   if (deviceSPI)
   {
+    waitTransfer();
     delete deviceSPI;
     deviceSPI = NULL;
   }
@@ -45,6 +79,7 @@ void SPIClass::beginTransaction(SPISettings settings)
   pinMode(PB_12, OUTPUT);
   digitalWrite(PB_12, HIGH);
 
+  // Both only reconfigure the peripheral when the setting changed
   setFrequency(settings._clock);
   setDataMode(settings._dataMode);
 }
@@ -64,11 +99,12 @@ void SPIClass::setDataMode(uint8_t dataMode)
   {
     begin();
   }
-  
-  if (dataMode < 4)
+
+  if (dataMode < 4 && dataMode != spiSetting._dataMode)
   {
+    waitTransfer();
     spiSetting._dataMode = dataMode;
-    deviceSPI->format(SPI_DEFAULT_BITS_PER_FRAME, spiSetting._dataMode);
+    deviceSPI->format(spiBits, spiSetting._dataMode);
   }
 }
 
@@ -79,21 +115,83 @@ void SPIClass::setFrequency(uint32_t freq)
     begin();
   }
 
-  if (freq <= SPI_CLOCK_DIV2 && freq >= SPI_CLOCK_DIV128)
+  if (freq <= SPI_CLOCK_MAX && freq >= SPI_CLOCK_DIV128 && freq != spiSetting._clock)
   {
+    waitTransfer();
     spiSetting._clock = freq;
     deviceSPI->frequency(spiSetting._clock);
   }
 }
 
 uint8_t SPIClass::transfer(uint8_t data)
+{
+  uint8_t rx;
+  transferBuffer(&data, &rx, 1, 8);
+  return rx;
+}
+
+uint16_t SPIClass::transfer16(uint16_t data)
+{
+  uint16_t rx;
+  transferBuffer(&data, &rx, 1, 16);
+  return rx;
+}
+
+void SPIClass::transfer(void *buf, size_t count)
+{
+  transferBuffer(buf, buf, count, 8);
+}
+
+void SPIClass::transfer(const void *txBuf, void *rxBuf, size_t count)
+{
+  transferBuffer(txBuf, rxBuf, count, 8);
+}
+
+void SPIClass::transfer16(const uint16_t *txBuf, uint16_t *rxBuf, size_t count)
+{
+  transferBuffer(txBuf, rxBuf, count, 16);
+}
+
+int SPIClass::transferAsync(const void *txBuf, void *rxBuf, size_t count, SPI_TRANSFER_CALLBACK callback, void *context)
 {
   if (deviceSPI == NULL)
   {
     begin();
   }
-  
-  return (uint8_t)deviceSPI->write(data);
+  if (count == 0 || count > 0xFFFF)
+  {
+    return -1;
+  }
+
+  waitTransfer();
+  setBits(8);
+  return startDMA(txBuf, rxBuf, count, 8, callback, context);
+}
+
+bool SPIClass::isTransferDone(void)
+{
+  if (dmaBusy)
+  {
+    return false;
+  }
+  // Done, release the bus
+  waitTransfer();
+  return true;
+}
+
+void SPIClass::waitTransfer(void)
+{
+  if (dmaPending)
+  {
+    dmaDone.wait();
+    dmaPending = false;
+  }
+  // The mutex can only be released by its owner, not from the DMA interrupt
+  if (dmaLocked && Thread::gettid() == dmaOwner)
+  {
+    dmaLocked = false;
+    deviceSPI->unlock();
+  }
 }
 
 void SPIClass::spi_setup(void)
@@ -104,6 +202,190 @@ void SPIClass::spi_setup(void)
     deviceSPI->frequency(spiSetting._clock);
 
     spiSetting._dataMode = SPI_MODE0;
-    deviceSPI->format(SPI_DEFAULT_BITS_PER_FRAME, spiSetting._dataMode);
+    spiBits = SPI_DEFAULT_BITS_PER_FRAME;
+    deviceSPI->format(spiBits, spiSetting._dataMode);
+  }
+}
+
+void SPIClass::setBits(int bits)
+{
+  if (bits != spiBits)
+  {
+    spiBits = bits;
+    deviceSPI->format(spiBits, spiSetting._dataMode);
+  }
+}
+
+void SPIClass::transferBuffer(const void *txBuf, void *rxBuf, size_t count, int bits)
+{
+  if (deviceSPI == NULL)
+  {
+    begin();
+  }
+  if (count == 0)
+  {
+    return;
+  }
+
+  waitTransfer();
+  setBits(bits);
+
+  // Large buffers go by DMA in chunks of the 16-bit DMA counter
+  const size_t chunk = 0xFFFF;
+  const size_t frameSize = bits / 8;
+  while (count >= SPI_DMA_MIN_LENGTH)
+  {
+    size_t n = (count > chunk ? chunk : count);
+    if (startDMA(txBuf, rxBuf, n, bits, NULL, NULL) != 0)
+    {
+      break;
+    }
+    waitTransfer();
+
+    count -= n;
+    if (txBuf != NULL)
+    {
+      txBuf = (const uint8_t *)txBuf + n * frameSize;
+    }
+    if (rxBuf != NULL)
+    {
+      rxBuf = (uint8_t *)rxBuf + n * frameSize;
+    }
+  }
+
+  if (count > 0)
+  {
+    transferPolled(txBuf, rxBuf, count, bits);
+  }
+}
+
+void SPIClass::transferPolled(const void *txBuf, void *rxBuf, size_t count, int bits)
+{
+  deviceSPI->lock();
+  deviceSPI->select();
+
+  SPI_HandleTypeDef *handle = deviceSPI->handle();
+  SPI_TypeDef *spi = handle->Instance;
+  __HAL_SPI_ENABLE(handle);
+
+  // Drop a stale frame and clear the overrun flag
+  while (spi->SR & SPI_SR_RXNE)
+  {
+    (void)spi->DR;
   }
+  (void)spi->SR;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    uint16_t tx = 0xFFFF;
+    if (txBuf != NULL)
+    {
+      tx = (bits == 16 ? ((const uint16_t *)txBuf)[i] : ((const uint8_t *)txBuf)[i]);
+    }
+
+    while ((spi->SR & SPI_SR_TXE) == 0)
+    {
+    }
+    spi->DR = tx;
+    while ((spi->SR & SPI_SR_RXNE) == 0)
+    {
+    }
+    uint16_t rx = spi->DR;
+
+    if (rxBuf != NULL)
+    {
+      if (bits == 16)
+      {
+        ((uint16_t *)rxBuf)[i] = rx;
+      }
+      else
+      {
+        ((uint8_t *)rxBuf)[i] = (uint8_t)rx;
+      }
+    }
+  }
+
+  deviceSPI->unlock();
+}
+
+static void OnDMAComplete(DMA_HandleTypeDef *hdma)
+{
+  SPI_TypeDef *spi = (SPI_TypeDef *)hdma->Parent;
+
+  // RX completes last, the frames are all shifted out by now
+  spi->CR2 &= ~(SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+  HAL_DMA_Abort_IT(&dmaTx);
+  dmaBusy = false;
+
+  if (dmaCallback != NULL)
+  {
+    dmaCallback(dmaContext);
+  }
+  dmaDone.release();
+}
+
+static void DMARxIRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&dmaRx);
+}
+
+static void InitDMA(DMA_HandleTypeDef *hdma, DMA_Stream_TypeDef *stream, uint32_t direction, bool increment, int bits)
+{
+  hdma->Instance = stream;
+  hdma->Init.Channel = DMA_CHANNEL_0;
+  hdma->Init.Direction = direction;
+  hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma->Init.MemInc = (increment ? DMA_MINC_ENABLE : DMA_MINC_DISABLE);
+  hdma->Init.PeriphDataAlignment = (bits == 16 ? DMA_PDATAALIGN_HALFWORD : DMA_PDATAALIGN_BYTE);
+  hdma->Init.MemDataAlignment = (bits == 16 ? DMA_MDATAALIGN_HALFWORD : DMA_MDATAALIGN_BYTE);
+  hdma->Init.Mode = DMA_NORMAL;
+  hdma->Init.Priority = DMA_PRIORITY_HIGH;
+  hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(hdma);
+}
+
+int SPIClass::startDMA(const void *txBuf, void *rxBuf, size_t count, int bits, SPI_TRANSFER_CALLBACK callback, void *context)
+{
+  deviceSPI->lock();
+  deviceSPI->select();
+
+  SPI_HandleTypeDef *handle = deviceSPI->handle();
+  SPI_TypeDef *spi = handle->Instance;
+  if (spi != SPI2)
+  {
+    deviceSPI->unlock();
+    return -1;
+  }
+
+  // The streams are shared with the audio codec, so they are set up for every transfer
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  InitDMA(&dmaRx, DMA1_Stream3, DMA_PERIPH_TO_MEMORY, rxBuf != NULL, bits);
+  InitDMA(&dmaTx, DMA1_Stream4, DMA_MEMORY_TO_PERIPH, txBuf != NULL, bits);
+  dmaRx.Parent = spi;
+  dmaRx.XferCpltCallback = OnDMAComplete;
+  NVIC_SetVector(DMA1_Stream3_IRQn, (uint32_t)DMARxIRQHandler);
+  NVIC_EnableIRQ(DMA1_Stream3_IRQn);
+
+  dmaCallback = callback;
+  dmaContext = context;
+  dmaBusy = true;
+  dmaPending = true;
+
+  __HAL_SPI_ENABLE(handle);
+  while (spi->SR & SPI_SR_RXNE)
+  {
+    (void)spi->DR;
+  }
+  (void)spi->SR;
+
+  HAL_DMA_Start_IT(&dmaRx, (uint32_t)&spi->DR, (uint32_t)(rxBuf != NULL ? rxBuf : &dummyRx), count);
+  HAL_DMA_Start(&dmaTx, (uint32_t)(txBuf != NULL ? txBuf : &dummyTx), (uint32_t)&spi->DR, count);
+  // RX first, so that no frame is missed
+  spi->CR2 |= SPI_CR2_RXDMAEN;
+  spi->CR2 |= SPI_CR2_TXDMAEN;
+
+  // Other threads can't reprogram the bus under the DMA, waitTransfer() unlocks it
+  dmaLocked = true;
+  dmaOwner = Thread::gettid();
+  return 0;
 }
@@ -24,9 +24,15 @@
 #define SPI_CLOCK_DIV64   250000    //250 KHz
 #define SPI_CLOCK_DIV128  125000    //125 KHz
 
+// SPI2 sits on APB1, so the fastest clock is half of the 50MHz bus clock
+#define SPI_CLOCK_MAX     25000000
+
 #define SPI_SPEED_CLOCK_DEFAULT_HZ SPI_CLOCK_DIV16
 #define SPI_DEFAULT_BITS_PER_FRAME 8
 
+// Shorter buffers are transferred by polling, the DMA setup costs more than it saves
+#define SPI_DMA_MIN_LENGTH 32
+
 const uint8_t SPI_MODE0 = 0x00; ///<  CPOL: 0  CPHA: 0
 const uint8_t SPI_MODE1 = 0x01; ///<  CPOL: 0  CPHA: 1
 const uint8_t SPI_MODE2 = 0x10; ///<  CPOL: 1  CPHA: 0
@@ -42,6 +48,10 @@ public:
   uint8_t _dataMode;
 };
 
+typedef void (*SPI_TRANSFER_CALLBACK)(void *context);
+
+class SPIDevice;
+
 class SPIClass
 {
 public:
@@ -58,13 +68,31 @@ public:
   void setFrequency(uint32_t freq);
 
   uint8_t transfer(uint8_t data);
+  uint16_t transfer16(uint16_t data);
+
+  // Full duplex buffer transfers, txBuf NULL sends 0xFF and rxBuf NULL discards the received data
+  void transfer(void *buf, size_t count);
+  void transfer(const void *txBuf, void *rxBuf, size_t count);
+  void transfer16(const uint16_t *txBuf, uint16_t *rxBuf, size_t count);
+
+  // Start a DMA transfer of 8-bit frames and return at once, the callback runs in interrupt context.
+  // The buffers must stay valid until the transfer is done. The bus stays locked for the other threads
+  // until the calling thread sees the end with waitTransfer(), isTransferDone() or the next transfer
+  int transferAsync(const void *txBuf, void *rxBuf, size_t count, SPI_TRANSFER_CALLBACK callback = NULL, void *context = NULL);
+  bool isTransferDone(void);
+  void waitTransfer(void);
 
 private:
   void spi_setup(void);
+  void setBits(int bits);
+  void transferBuffer(const void *txBuf, void *rxBuf, size_t count, int bits);
+  void transferPolled(const void *txBuf, void *rxBuf, size_t count, int bits);
+  int startDMA(const void *txBuf, void *rxBuf, size_t count, int bits, SPI_TRANSFER_CALLBACK callback, void *context);
 
   SPISettings spiSetting;
+  int spiBits;
 
-  MbedSPI *deviceSPI;
+  SPIDevice *deviceSPI;
 };
 
 #if SPI_INTERFACES_COUNT > 0
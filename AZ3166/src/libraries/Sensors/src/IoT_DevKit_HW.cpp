@@ -2,6 +2,7 @@
 #include "AzureIotHub.h"
 #include "AZ3166WiFi.h"
 #include "Sensor.h"
+#include "SystemBoot.h"
 #include "SystemVersion.h"
 #include "SystemTickCounter.h"
 #include "EEPROMInterface.h"
@@ -20,29 +21,24 @@ static LPS22HBSensor *pressureSensor;
 static char *connString = NULL;
 static const char *boardName = NULL;
 
-// Blink the RGB LED
-static volatile uint64_t blinkRGBLEDTimeStart = 0;
-static volatile int64_t blinkRGBLEDTime = -1;
-static volatile int colorRGBLED = 0;
+// Blink the RGB LED, the colors are cycled by the PWM waveform engine
+static volatile bool blinkRGBLED = false;
 
 // Blink the User LED
 static volatile uint64_t blinkUserLEDTimeStart = 0;
 static volatile int64_t blinkUserLEDTime = -1;
 static volatile int userLEDStat = 0;
 
-static struct _tagRGB
-{
-    int red;
-    int green;
-    int blue;
-} _rgb[] =
+static const int _rgb[][3] =
     {
         {255, 0, 0},
         {0, 255, 0},
         {0, 0, 255},
 };
 
-static bool initWiFi(void)
+static int sensorInitResult = 0;
+
+static int initWiFi(void)
 {
     if (WiFi.begin() == WL_CONNECTED)
     {
@@ -55,45 +51,9 @@ static bool initWiFi(void)
     }
 }
 
-int initIoTDevKit(int isShowInfo)
+static int initSensors(void)
 {
-    if (isShowInfo)
-    {
-        // Init the screen
-        Screen.init();
-        Screen.print(0, "IoT DevKit");
-        Screen.print(2, "Initializing...");
-    }
-
-    // Serial
-    Serial.begin(115200);
-
-    // Init pins
-    pinMode(LED_WIFI, OUTPUT);
-    pinMode(LED_AZURE, OUTPUT);
-    pinMode(LED_USER, OUTPUT);
-    pinMode(USER_BUTTON_A, INPUT);
-    pinMode(USER_BUTTON_B, INPUT);
-
-    // Turn off the RGB Led
-    rgbLed.turnOff();
-
-    // Init I2C bus
-    if (isShowInfo)
-    {
-        Screen.print(3, "  I2C");
-    }
-    if ((ext_i2c = new DevI2C(D14, D15)) == NULL)
-    {
-        LogError("Failed to initialize I2C.");
-        return -101;
-    }
-    
     // Init the gyroscope and accelerator sensor
-    if (isShowInfo)
-    {
-        Screen.print(3, "  LSM6DSL");
-    }
     if ((acc_gyro = new LSM6DSLSensor(*ext_i2c, D4, D5)) == NULL)
     {
         LogError("Failed to initialize gyroscope and accelerator sensor.");
@@ -104,10 +64,6 @@ int initIoTDevKit(int isShowInfo)
     acc_gyro->enableGyroscope();
 
     // Init the humidity and temperature sensor
-    if (isShowInfo)
-    {
-        Screen.print(3, "  HTS221");
-    }
     if ((ht_sensor = new HTS221Sensor(*ext_i2c)) == NULL)
     {
         LogError("Failed to initialize humidity and temperature sensor.");
@@ -117,10 +73,6 @@ int initIoTDevKit(int isShowInfo)
     ht_sensor->reset();
 
     // Init the magnetometer sensor
-    if (isShowInfo)
-    {
-        Screen.print(3, "  LIS2MDL");
-    }
     if ((magnetometer = new LIS2MDLSensor(*ext_i2c)) == NULL)
     {
         LogError("Failed to initialize magnetometer sensor.");
@@ -129,10 +81,6 @@ int initIoTDevKit(int isShowInfo)
     magnetometer->init(NULL);
 
     // Init IrDA
-    if (isShowInfo)
-    {
-        Screen.print(3, "  IrDA");
-    }
     if ((IrdaSensor = new IRDASensor()) == NULL)
     {
         LogError("Failed to initialize IrDa sensor.");
@@ -141,10 +89,6 @@ int initIoTDevKit(int isShowInfo)
     IrdaSensor->init();
 
     // Init pressure sensor
-    if (isShowInfo)
-    {
-        Screen.print(3, "  LPS22HB");
-    }
     if ((pressureSensor = new LPS22HBSensor(*ext_i2c)) == NULL)
     {
         LogError("Failed to initialize pressure sensor.");
@@ -152,12 +96,69 @@ int initIoTDevKit(int isShowInfo)
     }
     pressureSensor->init(NULL);
 
-    // Init WiFi
+    return 0;
+}
+
+static void initSensorsTask(void)
+{
+    sensorInitResult = initSensors();
+}
+
+int initIoTDevKit(int isShowInfo)
+{
     if (isShowInfo)
     {
-        Screen.print(3, "  Wi-Fi");
+        // Init the screen
+        Screen.init();
+        Screen.print(0, "IoT DevKit");
+        Screen.print(2, "Initializing...");
     }
-    return initWiFi();
+
+    // Serial
+    Serial.begin(115200);
+
+    // Init pins
+    pinMode(LED_WIFI, OUTPUT);
+    pinMode(LED_AZURE, OUTPUT);
+    pinMode(LED_USER, OUTPUT);
+    pinMode(USER_BUTTON_A, INPUT);
+    pinMode(USER_BUTTON_B, INPUT);
+
+    // Turn off the RGB Led
+    rgbLed.turnOff();
+
+    // Init I2C bus
+    if (isShowInfo)
+    {
+        Screen.print(3, "  I2C");
+    }
+    if ((ext_i2c = new DevI2C(D14, D15)) == NULL)
+    {
+        LogError("Failed to initialize I2C.");
+        return -101;
+    }
+
+    if (isShowInfo)
+    {
+        Screen.print(3, "  Sensors & Wi-Fi");
+    }
+
+    // The sensors are initialized on the boot worker while the Wi-Fi is associating,
+    // fall back to initialize them here if the worker is not available
+    if (SystemBootSchedule(initSensorsTask, 0, BOOT_READY_SENSORS) != 0)
+    {
+        initSensorsTask();
+        SystemSetReady(BOOT_READY_SENSORS);
+    }
+
+    int result = initWiFi();
+
+    SystemWaitReady(BOOT_READY_SENSORS, -1);
+    if (sensorInitResult != 0)
+    {
+        return sensorInitResult;
+    }
+    return result;
 }
 
 const char *getIoTHubConnectionString(void)
@@ -203,8 +204,415 @@ const char *getDevKitSerialNumber(void)
     return GetBoardID();
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Background sampling
+#define SAMPLER_RING_SIZE           32
+#define SAMPLER_STACK_SIZE          0x800
+#define SAMPLER_MIN_INTERVAL_MS     10
+#define SAMPLER_RETRY_MS            2
+
+// Data-ready bits in the status registers
+#define HTS221_STATUS_T_DA          0x01
+#define HTS221_STATUS_H_DA          0x02
+#define LPS22HB_STATUS_P_DA         0x01
+#define LSM6DSL_STATUS_XLDA         0x01
+#define LSM6DSL_STATUS_GDA          0x02
+#define LIS2MDL_STATUS_ZYXDA        0x08
+
+enum
+{
+    SAMPLER_DEV_HTS221 = 0,
+    SAMPLER_DEV_LPS22HB,
+    SAMPLER_DEV_LSM6DSL,
+    SAMPLER_DEV_LIS2MDL,
+    SAMPLER_DEV_COUNT
+};
+
+enum
+{
+    SAMPLE_READ = 0,
+    SAMPLE_NOT_READY,
+    SAMPLE_ERROR
+};
+
+// The device and the data-ready bit of every DEVKIT_SENSOR
+static const struct
+{
+    int device;
+    uint8_t ready;
+} samplerSources[DEVKIT_SENSOR_COUNT] =
+    {
+        {SAMPLER_DEV_HTS221, HTS221_STATUS_T_DA},
+        {SAMPLER_DEV_HTS221, HTS221_STATUS_H_DA},
+        {SAMPLER_DEV_LPS22HB, LPS22HB_STATUS_P_DA},
+        {SAMPLER_DEV_LIS2MDL, LIS2MDL_STATUS_ZYXDA},
+        {SAMPLER_DEV_LSM6DSL, LSM6DSL_STATUS_GDA},
+        {SAMPLER_DEV_LSM6DSL, LSM6DSL_STATUS_XLDA},
+};
+
+typedef struct
+{
+    int interval;                   // 0 means not sampled
+    uint64_t slot;                  // When the next sample is scheduled
+    uint64_t due;                   // When the sensor is polled next, later than slot if it was not ready
+    DEVKIT_SENSOR_SAMPLE *ring;
+    int head;
+    int count;
+    DEVKIT_SENSOR_SAMPLE latest;
+    bool hasLatest;
+    int64_t jitterTotal;
+    DEVKIT_SENSOR_STATS stats;
+} SAMPLER_CHANNEL;
+
+static SAMPLER_CHANNEL samplerChannels[DEVKIT_SENSOR_COUNT];
+static Mutex samplerMutex;
+static Semaphore samplerSignal(0);
+static Thread *samplerThread = NULL;
+static int samplerBatches = 0;
+static uint64_t samplerBusyUs = 0;
+static uint64_t samplerStatsStart = 0;
+
+static int readSamplerStatus(int device, uint8_t *status)
+{
+    switch (device)
+    {
+    case SAMPLER_DEV_HTS221:
+        return ht_sensor->readIO(status, HTS221_STATUS_REG, 1);
+    case SAMPLER_DEV_LPS22HB:
+        return pressureSensor->readIO(status, LPS22HB_STATUS_REG_ADDR, 1);
+    case SAMPLER_DEV_LSM6DSL:
+        return acc_gyro->readIO(status, LSM6DSL_ACC_GYRO_STATUS_REG, 1);
+    case SAMPLER_DEV_LIS2MDL:
+        return ext_i2c->i2c_read(status, LIS2MDL_M_MEMS_ADDRESS, STATUS_REG, 1);
+    }
+    return -1;
+}
+
+static int readSamplerSensor(int sensor, DEVKIT_SENSOR_SAMPLE *sample)
+{
+    switch (sensor)
+    {
+    case DEVKIT_SENSOR_TEMPERATURE:
+        return ht_sensor->getTemperature(&sample->value);
+    case DEVKIT_SENSOR_HUMIDITY:
+        return ht_sensor->getHumidity(&sample->value);
+    case DEVKIT_SENSOR_PRESSURE:
+        return pressureSensor->getPressure(&sample->value);
+    case DEVKIT_SENSOR_MAGNETOMETER:
+        return magnetometer->getMAxes(sample->axes);
+    case DEVKIT_SENSOR_GYROSCOPE:
+        return acc_gyro->getGAxes(sample->axes);
+    case DEVKIT_SENSOR_ACCELERATOR:
+        return acc_gyro->getXAxes(sample->axes);
+    }
+    return -1;
+}
+
+static void configSamplerRate(int sensor)
+{
+    // HTS221 runs at 1Hz and LPS22HB in one-shot mode by default, run them continuously
+    // at the lowest rate that covers the interval, so that no read has to wait for a conversion
+    if (sensor == DEVKIT_SENSOR_TEMPERATURE || sensor == DEVKIT_SENSOR_HUMIDITY)
+    {
+        int interval = samplerChannels[DEVKIT_SENSOR_TEMPERATURE].interval;
+        int other = samplerChannels[DEVKIT_SENSOR_HUMIDITY].interval;
+        if (interval == 0 || (other != 0 && other < interval))
+        {
+            interval = other;
+        }
+        ht_sensor->setOdr(interval == 0 ? 1.0f : 1000.0f / interval);
+    }
+    else if (sensor == DEVKIT_SENSOR_PRESSURE)
+    {
+        int interval = samplerChannels[DEVKIT_SENSOR_PRESSURE].interval;
+        uint8_t odr = (interval == 0 ? LPS22HB_ODR_ONE_SHOT
+                    : interval >= 1000 ? LPS22HB_ODR_1Hz
+                    : interval >= 143 ? LPS22HB_ODR_7Hz
+                    : interval >= 80 ? LPS22HB_ODR_12_5Hz
+                    : LPS22HB_ODR_25Hz);
+        uint8_t reg;
+        if (pressureSensor->readIO(&reg, LPS22HB_CTRL_REG1_ADDR, 1) == 0)
+        {
+            reg = (reg & ~LPS22HB_ODR_MASK) | odr;
+            pressureSensor->writeIO(&reg, LPS22HB_CTRL_REG1_ADDR, 1);
+        }
+    }
+}
+
+static void pushSample(SAMPLER_CHANNEL *channel, const DEVKIT_SENSOR_SAMPLE *sample)
+{
+    if (channel->count == SAMPLER_RING_SIZE)
+    {
+        // Drop the oldest one
+        channel->head = (channel->head + 1) % SAMPLER_RING_SIZE;
+        channel->count--;
+        channel->stats.overruns++;
+    }
+    channel->ring[(channel->head + channel->count) % SAMPLER_RING_SIZE] = *sample;
+    channel->count++;
+    channel->latest = *sample;
+    channel->hasLatest = true;
+
+    int jitter = (int)(sample->timestamp - channel->slot);
+    if (jitter > channel->stats.maxJitter)
+    {
+        channel->stats.maxJitter = jitter;
+    }
+    channel->jitterTotal += jitter;
+    channel->stats.samples++;
+}
+
+static void sampler_worker(void)
+{
+    while (true)
+    {
+        int due[DEVKIT_SENSOR_COUNT];
+        int dueCount = 0;
+        uint32_t waitMs = osWaitForever;
+        uint64_t now = SystemTickCounterRead();
+
+        samplerMutex.lock();
+        for (int i = 0; i < DEVKIT_SENSOR_COUNT; i++)
+        {
+            if (samplerChannels[i].interval == 0)
+            {
+                continue;
+            }
+            if (samplerChannels[i].due <= now)
+            {
+                due[dueCount++] = i;
+            }
+            else if ((uint32_t)(samplerChannels[i].due - now) < waitMs)
+            {
+                waitMs = (uint32_t)(samplerChannels[i].due - now);
+            }
+        }
+        samplerMutex.unlock();
+
+        if (dueCount == 0)
+        {
+            // Sleep until the next sample, or a sensor is started or stopped
+            samplerSignal.wait(waitMs);
+            continue;
+        }
+
+        // Run all the due reads in one batch, the status register of every device is read once
+        DEVKIT_SENSOR_SAMPLE samples[DEVKIT_SENSOR_COUNT];
+        int results[DEVKIT_SENSOR_COUNT];
+        uint8_t status[SAMPLER_DEV_COUNT];
+        int statusResult[SAMPLER_DEV_COUNT] = {-1, -1, -1, -1};
+
+        ext_i2c->lock();
+        uint32_t startUs = micros();
+        for (int i = 0; i < dueCount; i++)
+        {
+            int device = samplerSources[due[i]].device;
+            if (statusResult[device] < 0)
+            {
+                statusResult[device] = (readSamplerStatus(device, &status[device]) == 0 ? SAMPLE_READ : SAMPLE_ERROR);
+            }
+
+            if (statusResult[device] == SAMPLE_ERROR)
+            {
+                results[i] = SAMPLE_ERROR;
+            }
+            else if ((status[device] & samplerSources[due[i]].ready) == 0)
+            {
+                results[i] = SAMPLE_NOT_READY;
+            }
+            else
+            {
+                results[i] = (readSamplerSensor(due[i], &samples[i]) == 0 ? SAMPLE_READ : SAMPLE_ERROR);
+                samples[i].timestamp = SystemTickCounterRead();
+            }
+        }
+        uint32_t busyUs = micros() - startUs;
+        ext_i2c->unlock();
+
+        now = SystemTickCounterRead();
+        samplerMutex.lock();
+        samplerBatches++;
+        samplerBusyUs += busyUs;
+        for (int i = 0; i < dueCount; i++)
+        {
+            SAMPLER_CHANNEL *channel = &samplerChannels[due[i]];
+            if (channel->interval == 0)
+            {
+                // Stopped during the batch
+                continue;
+            }
+
+            if (results[i] == SAMPLE_NOT_READY)
+            {
+                // Poll again soon, the slot is kept so the delay shows up as jitter
+                channel->stats.notReady++;
+                channel->due = now + max(SAMPLER_RETRY_MS, channel->interval / 8);
+                continue;
+            }
+
+            if (results[i] == SAMPLE_READ)
+            {
+                pushSample(channel, &samples[i]);
+            }
+            else
+            {
+                channel->stats.errors++;
+            }
+
+            // Skip the slots already missed rather than bursting to catch up
+            channel->slot += channel->interval;
+            if (channel->slot <= now)
+            {
+                channel->slot = now + channel->interval;
+            }
+            channel->due = channel->slot;
+        }
+        samplerMutex.unlock();
+    }
+}
+
+static bool getLatestSample(int sensor, DEVKIT_SENSOR_SAMPLE *sample)
+{
+    samplerMutex.lock();
+    bool ret = (samplerChannels[sensor].interval != 0 && samplerChannels[sensor].hasLatest);
+    if (ret)
+    {
+        *sample = samplerChannels[sensor].latest;
+    }
+    samplerMutex.unlock();
+    return ret;
+}
+
+int startDevKitSensorSampling(int sensor, int intervalMs)
+{
+    if (sensor < 0 || sensor >= DEVKIT_SENSOR_COUNT || intervalMs < SAMPLER_MIN_INTERVAL_MS)
+    {
+        return -1;
+    }
+    if (!SystemIsReady(BOOT_READY_SENSORS) || sensorInitResult != 0)
+    {
+        LogError("The sensors are not initialized.");
+        return -1;
+    }
+
+    samplerMutex.lock();
+    SAMPLER_CHANNEL *channel = &samplerChannels[sensor];
+    if (channel->ring == NULL)
+    {
+        channel->ring = (DEVKIT_SENSOR_SAMPLE *)malloc(SAMPLER_RING_SIZE * sizeof(DEVKIT_SENSOR_SAMPLE));
+        if (channel->ring == NULL)
+        {
+            samplerMutex.unlock();
+            LogError("No memory");
+            return -1;
+        }
+    }
+    if (samplerThread == NULL)
+    {
+        samplerThread = new Thread(osPriorityAboveNormal, SAMPLER_STACK_SIZE, NULL);
+        if (samplerThread == NULL)
+        {
+            samplerMutex.unlock();
+            LogError("No memory");
+            return -1;
+        }
+        samplerStatsStart = SystemTickCounterRead();
+        samplerThread->start(sampler_worker);
+    }
+    channel->interval = intervalMs;
+    channel->slot = channel->due = SystemTickCounterRead();
+    configSamplerRate(sensor);
+    samplerMutex.unlock();
+
+    samplerSignal.release();
+    return 0;
+}
+
+void stopDevKitSensorSampling(int sensor)
+{
+    if (sensor < 0 || sensor >= DEVKIT_SENSOR_COUNT)
+    {
+        return;
+    }
+
+    samplerMutex.lock();
+    SAMPLER_CHANNEL *channel = &samplerChannels[sensor];
+    if (channel->interval != 0)
+    {
+        channel->interval = 0;
+        channel->head = 0;
+        channel->count = 0;
+        channel->hasLatest = false;
+        configSamplerRate(sensor);
+    }
+    samplerMutex.unlock();
+
+    samplerSignal.release();
+}
+
+int readDevKitSensorSamples(int sensor, DEVKIT_SENSOR_SAMPLE *samples, int count)
+{
+    if (sensor < 0 || sensor >= DEVKIT_SENSOR_COUNT || samples == NULL)
+    {
+        return 0;
+    }
+
+    samplerMutex.lock();
+    SAMPLER_CHANNEL *channel = &samplerChannels[sensor];
+    int n = 0;
+    while (n < count && channel->count > 0)
+    {
+        samples[n++] = channel->ring[channel->head];
+        channel->head = (channel->head + 1) % SAMPLER_RING_SIZE;
+        channel->count--;
+    }
+    samplerMutex.unlock();
+    return n;
+}
+
+void getDevKitSamplerStats(DEVKIT_SAMPLER_STATS *stats, int reset)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    uint64_t now = SystemTickCounterRead();
+
+    samplerMutex.lock();
+    stats->batches = samplerBatches;
+    stats->busBusyUs = samplerBusyUs;
+    stats->busUtilization = (now > samplerStatsStart ? (float)samplerBusyUs / ((now - samplerStatsStart) * 1000) : 0);
+    for (int i = 0; i < DEVKIT_SENSOR_COUNT; i++)
+    {
+        stats->sensor[i] = samplerChannels[i].stats;
+        if (samplerChannels[i].stats.samples > 0)
+        {
+            stats->sensor[i].avgJitter = (int)(samplerChannels[i].jitterTotal / samplerChannels[i].stats.samples);
+        }
+        if (reset)
+        {
+            memset(&samplerChannels[i].stats, 0, sizeof(DEVKIT_SENSOR_STATS));
+            samplerChannels[i].jitterTotal = 0;
+        }
+    }
+    if (reset)
+    {
+        samplerBatches = 0;
+        samplerBusyUs = 0;
+        samplerStatsStart = now;
+    }
+    samplerMutex.unlock();
+}
+
 float getDevKitHumidityValue(void)
 {
+    DEVKIT_SENSOR_SAMPLE sample;
+    if (getLatestSample(DEVKIT_SENSOR_HUMIDITY, &sample))
+    {
+        return sample.value;
+    }
+
     float humidity = 0;
     ht_sensor->getHumidity(&humidity);
     return humidity;
@@ -212,8 +620,16 @@ float getDevKitHumidityValue(void)
 
 float getDevKitTemperatureValue(int isFahrenheit)
 {
+    DEVKIT_SENSOR_SAMPLE sample;
     float temperature = 0;
-    ht_sensor->getTemperature(&temperature);
+    if (getLatestSample(DEVKIT_SENSOR_TEMPERATURE, &sample))
+    {
+        temperature = sample.value;
+    }
+    else
+    {
+        ht_sensor->getTemperature(&temperature);
+    }
     if (isFahrenheit)
     {
         //convert from C to F
@@ -224,6 +640,12 @@ float getDevKitTemperatureValue(int isFahrenheit)
 
 float getDevKitPressureValue(void)
 {
+    DEVKIT_SENSOR_SAMPLE sample;
+    if (getLatestSample(DEVKIT_SENSOR_PRESSURE, &sample))
+    {
+        return sample.value;
+    }
+
     float pressure = 0;
     pressureSensor->getPressure(&pressure);
     return pressure;
@@ -231,8 +653,12 @@ float getDevKitPressureValue(void)
 
 void getDevKitMagnetometerValue(int *x, int *y, int *z)
 {
-    int axes[3];
-    magnetometer->getMAxes(axes);
+    DEVKIT_SENSOR_SAMPLE sample;
+    int *axes = sample.axes;
+    if (!getLatestSample(DEVKIT_SENSOR_MAGNETOMETER, &sample))
+    {
+        magnetometer->getMAxes(axes);
+    }
     *x = axes[0];
     *y = axes[1];
     *z = axes[2];
@@ -240,8 +666,12 @@ void getDevKitMagnetometerValue(int *x, int *y, int *z)
 
 void getDevKitGyroscopeValue(int *x, int *y, int *z)
 {
-    int axes[3];
-    acc_gyro->getGAxes(axes);
+    DEVKIT_SENSOR_SAMPLE sample;
+    int *axes = sample.axes;
+    if (!getLatestSample(DEVKIT_SENSOR_GYROSCOPE, &sample))
+    {
+        acc_gyro->getGAxes(axes);
+    }
     *x = axes[0];
     *y = axes[1];
     *z = axes[2];
@@ -249,8 +679,12 @@ void getDevKitGyroscopeValue(int *x, int *y, int *z)
 
 void getDevKitAcceleratorValue(int *x, int *y, int *z)
 {
-    int axes[3];
-    acc_gyro->getXAxes(axes);
+    DEVKIT_SENSOR_SAMPLE sample;
+    int *axes = sample.axes;
+    if (!getLatestSample(DEVKIT_SENSOR_ACCELERATOR, &sample))
+    {
+        acc_gyro->getXAxes(axes);
+    }
     *x = axes[0];
     *y = axes[1];
     *z = axes[2];
@@ -268,11 +702,13 @@ void turnOffUserLED(void)
 
 void turnOnRGBLED(int red, int green, int blue)
 {
+    blinkRGBLED = false;
     rgbLed.setColor(red, green, blue);
 }
 
 void turnOffRGBLED(void)
 {
+    blinkRGBLED = false;
     rgbLed.turnOff();
 }
 
@@ -286,10 +722,14 @@ void startBlinkDevKitUserLED(int msDuration)
 
 void startBlinkDevKitRGBLED(int msDuration)
 {
-    blinkRGBLEDTimeStart = SystemTickCounterRead();
-    blinkRGBLEDTime = (msDuration == -1 ? 0x7fffffffffffffff : msDuration);
-    colorRGBLED = 0;
-    rgbLed.setColor(_rgb[colorRGBLED].red, _rgb[colorRGBLED].green, _rgb[colorRGBLED].blue);
+    // 500ms per color, whole cycles until the duration is covered
+    int count = sizeof(_rgb) / sizeof(_rgb[0]);
+    int repeat = 0;
+    if (msDuration != -1)
+    {
+        repeat = max(1, (msDuration + count * 500 - 1) / (count * 500));
+    }
+    blinkRGBLED = (rgbLed.play(_rgb, count, 500, repeat) == 0);
 }
 
 int textOutDevKitScreen(unsigned int line, const char *s, int wrap)
@@ -324,28 +764,11 @@ int transmitIrDA(unsigned char *data, int size, int timeout)
 
 static void _blinkRGBLED(uint64_t msNow)
 {
-    if (blinkRGBLEDTime <= 0)
+    if (blinkRGBLED && !rgbLed.isPlaying())
     {
-        return;
-    }
-
-    uint64_t ms = msNow - blinkRGBLEDTimeStart;
-    if (ms >= 500)
-    {
-        // Change the color
-        colorRGBLED = (colorRGBLED + 1) % (sizeof(_rgb) / sizeof(struct _tagRGB));
-        rgbLed.setColor(_rgb[colorRGBLED].red, _rgb[colorRGBLED].green, _rgb[colorRGBLED].blue);
-        
-        blinkRGBLEDTime -= ms;
-        if (blinkRGBLEDTime <= 0)
-        {
-            // End
-            rgbLed.turnOff();
-        }
-        else
-        {
-            blinkRGBLEDTimeStart = msNow;
-        }
+        // End
+        blinkRGBLED = false;
+        rgbLed.turnOff();
     }
 }
 
@@ -364,7 +787,7 @@ static void _blinkUserLED(uint64_t msNow)
         digitalWrite(LED_USER, userLEDStat);
 
         blinkUserLEDTime -= ms;
-        if (blinkRGBLEDTime <= 0)
+        if (blinkUserLEDTime <= 0)
         {
             // End
             digitalWrite(LED_USER, 0);
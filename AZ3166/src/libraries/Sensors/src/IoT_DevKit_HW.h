@@ -1,11 +1,50 @@
 #ifndef _IOT_DEVKIT_HW_H_
 #define _IOT_DEVKIT_HW_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    // Onboard sensors which can be sampled in background
+    typedef enum
+    {
+        DEVKIT_SENSOR_TEMPERATURE = 0,
+        DEVKIT_SENSOR_HUMIDITY,
+        DEVKIT_SENSOR_PRESSURE,
+        DEVKIT_SENSOR_MAGNETOMETER,
+        DEVKIT_SENSOR_GYROSCOPE,
+        DEVKIT_SENSOR_ACCELERATOR,
+        DEVKIT_SENSOR_COUNT
+    } DEVKIT_SENSOR;
+
+    typedef struct
+    {
+        uint64_t timestamp;     // SystemTickCounterRead() in ms when the sample was read
+        float value;            // Temperature (Celsius), humidity or pressure
+        int axes[3];            // Magnetometer, gyroscope or accelerator
+    } DEVKIT_SENSOR_SAMPLE;
+
+    typedef struct
+    {
+        int samples;            // Samples written into the ring buffer
+        int overruns;           // Oldest samples overwritten before being read
+        int notReady;           // Polls skipped as the sensor had no new data
+        int errors;             // Failed I2C transactions
+        int maxJitter;          // Worst lateness against the schedule in ms
+        int avgJitter;          // Average lateness against the schedule in ms
+    } DEVKIT_SENSOR_STATS;
+
+    typedef struct
+    {
+        int batches;            // I2C batches run by the sampling worker
+        uint64_t busBusyUs;     // Time spent on the I2C bus by the sampling worker
+        float busUtilization;   // busBusyUs over the time since the statistics were reset, 0 to 1
+        DEVKIT_SENSOR_STATS sensor[DEVKIT_SENSOR_COUNT];
+    } DEVKIT_SAMPLER_STATS;
+
     /**
      * @brief    Initialize the board, include all sensors and Wi-Fi.
      * 
@@ -86,6 +125,47 @@ extern "C"
      * @return   Accelerator value.
     **/
     void getDevKitAcceleratorValue(int *x, int *y, int *z);
+
+    /**
+     * @brief    Start to sample one onboard sensor in background.
+     *
+     * @param    sensor - One of DEVKIT_SENSOR.
+     *           intervalMs - The sampling interval in ms, must not be less than 10.
+     *
+     * @return   0 upon success or other values upon failure.
+     *
+     * @remarks  All the sensors are sampled by one worker thread, the I2C transactions which are due at the
+     *           same time are batched, and a sensor is only read once its data-ready bit is set.
+     *           While a sensor is sampled, the getDevKit*Value functions return its latest sample instead of
+     *           reading the sensor.
+    **/
+    int startDevKitSensorSampling(int sensor, int intervalMs);
+
+    /**
+     * @brief    Stop to sample one onboard sensor in background, the samples not read are dropped.
+     *
+     * @param    sensor - One of DEVKIT_SENSOR.
+    **/
+    void stopDevKitSensorSampling(int sensor);
+
+    /**
+     * @brief    Read the oldest samples of one onboard sensor from its ring buffer.
+     *
+     * @param    sensor - One of DEVKIT_SENSOR.
+     *           samples - Buffer to receive the samples.
+     *           count - Max number of the samples to read.
+     *
+     * @return   Number of the samples read.
+    **/
+    int readDevKitSensorSamples(int sensor, DEVKIT_SENSOR_SAMPLE *samples, int count);
+
+    /**
+     * @brief    Retrieve the statistics of the background sampling.
+     *
+     * @param    stats - Buffer to receive the statistics.
+     *           reset - Indicate whether to reset the statistics after read.
+    **/
+    void getDevKitSamplerStats(DEVKIT_SAMPLER_STATS *stats, int reset);
     
     /**
      * @brief    Turn on the onboard User LED.
@@ -1,19 +1,108 @@
+#include "Arduino.h"
 #include "RGB_LED.h"
 
-RGB_LED::RGB_LED(PinName red, PinName green, PinName blue) : _red(red), _green(green), _blue(blue)
+RGB_LED::RGB_LED(PinName red, PinName green, PinName blue)
 {
-    _red.period(0.001);
-    _green.period(0.001);
-    _blue.period(0.001);
+    _pins[0] = red;
+    _pins[1] = green;
+    _pins[2] = blue;
+    for (int i = 0; i < 3; i++)
+    {
+        // Configured once, the later writes only update the compare registers
+        pwmChannelAttach(_pins[i], 1000);
+    }
     turnOff();
 }
 
+RGB_LED::~RGB_LED()
+{
+    stop();
+}
+
 void RGB_LED::setColor(int red, int green, int blue) {
-    _red.write(red / 255.0f);
-    _green.write(green / 255.0f);
-    _blue.write(blue / 255.0f);
+    int color[3] = { red, green, blue };
+    for (int i = 0; i < 3; i++)
+    {
+        _color[i] = constrain(color[i], 0, 255);
+        pwmChannelWrite(_pins[i], _color[i], 255);
+    }
 }
 
 void RGB_LED::turnOff() {
     setColor(0, 0, 0);
-}
\ No newline at end of file
+}
+
+int RGB_LED::fadeTo(int red, int green, int blue, int msDuration)
+{
+    if (msDuration <= 0)
+    {
+        setColor(red, green, blue);
+        return 0;
+    }
+
+    stop();
+    int color[3] = { red, green, blue };
+    uint32_t stepUs = (uint32_t)msDuration * 1000 / RGB_LED_WAVEFORM_STEPS;
+    for (int i = 0; i < 3; i++)
+    {
+        color[i] = constrain(color[i], 0, 255);
+        pwmWaveformFade(_pins[i], _waveform[i], RGB_LED_WAVEFORM_STEPS, _color[i], color[i]);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (pwmWaveformStart(i, _pins[i], _waveform[i], RGB_LED_WAVEFORM_STEPS, stepUs, 1) != 0)
+        {
+            stop();
+            return -1;
+        }
+        _color[i] = color[i];
+    }
+    return 0;
+}
+
+int RGB_LED::play(const int (*colors)[3], int count, int msStep, int repeat)
+{
+    if (colors == NULL || count <= 0 || count > RGB_LED_WAVEFORM_STEPS || msStep <= 0)
+    {
+        return -1;
+    }
+
+    stop();
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < count; j++)
+        {
+            _waveform[i][j] = pwmChannelTicks(_pins[i], constrain(colors[j][i], 0, 255), 255);
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (pwmWaveformStart(i, _pins[i], _waveform[i], count, (uint32_t)msStep * 1000, repeat) != 0)
+        {
+            stop();
+            return -1;
+        }
+        _color[i] = constrain(colors[count - 1][i], 0, 255);
+    }
+    return 0;
+}
+
+bool RGB_LED::isPlaying()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (pwmWaveformBusy(i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RGB_LED::stop()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        pwmWaveformStop(i);
+    }
+}
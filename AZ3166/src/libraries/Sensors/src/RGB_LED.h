@@ -2,19 +2,33 @@
 #define __RGB_LED_H__
 
 #include "mbed.h"
+#include "PwmChannel.h"
+
+// Steps of the color sequences and fades, each color channel plays on its own waveform track
+#define RGB_LED_WAVEFORM_STEPS  32
 
 class RGB_LED
 {
     public:
         RGB_LED(PinName red = PB_4, PinName green = PB_3, PinName blue = PC_7);
+        // Stops the tracks, they read the waveforms from this object
+        ~RGB_LED();
 
         void setColor(int red = 255, int green = 255, int blue = 255);
         void turnOff();
 
+        // Fade from the current color, runs in background on the waveform tracks 0 to 2
+        int fadeTo(int red, int green, int blue, int msDuration);
+        // Show the colors one after another, each for msStep, repeat 0 means forever
+        int play(const int (*colors)[3], int count, int msStep, int repeat);
+        bool isPlaying();
+
     private: 
-        PwmOut _red;
-        PwmOut _green;
-        PwmOut _blue;
+        PinName _pins[3];
+        int _color[3];
+        uint32_t _waveform[3][RGB_LED_WAVEFORM_STEPS];
+
+        void stop();
 };
 
-#endif
\ No newline at end of file
+#endif
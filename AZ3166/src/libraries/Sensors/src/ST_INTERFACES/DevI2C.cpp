@@ -0,0 +1,422 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license.
+
+#include "mbed.h"
+#include "us_ticker_api.h"
+#include "DevI2C.h"
+
+#define I2C_ENGINE_STACK_SIZE       0x800
+#define I2C_TRANSFER_TIMEOUT_MS     100
+// Thread signal set on the submitter when one of its transactions is completed
+#define I2C_DONE_SIGNAL             0x8000
+
+void DevI2C::init_engine(void)
+{
+    _engine = NULL;
+    _engine_tid = NULL;
+    _bus_owner = NULL;
+    _bus_depth = 0;
+    _transfer_event = 0;
+    memset(_head, 0, sizeof(_head));
+    memset(_tail, 0, sizeof(_tail));
+    memset(_counters, 0, sizeof(_counters));
+}
+
+void DevI2C::lock(void)
+{
+    _bus_mutex.lock();
+    _bus_owner = Thread::gettid();
+    _bus_depth++;
+    I2C::lock();
+}
+
+void DevI2C::unlock(void)
+{
+    I2C::unlock();
+    if (--_bus_depth == 0)
+    {
+        _bus_owner = NULL;
+    }
+    _bus_mutex.unlock();
+}
+
+int DevI2C::i2c_write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+{
+    I2CTransaction transaction = I2CTransaction();
+    transaction.device = DeviceAddr;
+    transaction.reg = RegisterAddr;
+    transaction.read = false;
+    transaction.data = pBuffer;
+    transaction.length = NumByteToWrite;
+    transaction.priority = I2C_PRIORITY_NORMAL;
+    return run(&transaction);
+}
+
+int DevI2C::i2c_read(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToRead)
+{
+    I2CTransaction transaction = I2CTransaction();
+    transaction.device = DeviceAddr;
+    transaction.reg = RegisterAddr;
+    transaction.read = true;
+    transaction.data = pBuffer;
+    transaction.length = NumByteToRead;
+    transaction.priority = I2C_PRIORITY_NORMAL;
+    return run(&transaction);
+}
+
+int DevI2C::submit(I2CTransaction *transaction)
+{
+    if (transaction == NULL)
+    {
+        return -1;
+    }
+
+    _queue_mutex.lock();
+    if (_engine == NULL)
+    {
+        _engine = new Thread(osPriorityHigh, I2C_ENGINE_STACK_SIZE, NULL);
+        if (_engine == NULL)
+        {
+            _queue_mutex.unlock();
+            return -1;
+        }
+        _engine->start(callback(this, &DevI2C::engine));
+    }
+
+    uint32_t now = us_ticker_read();
+    for (I2CTransaction *t = transaction; t != NULL; t = t->chain)
+    {
+        t->result = I2C_PENDING;
+        t->submitted = now;
+        t->owner = Thread::gettid();
+    }
+
+    int priority = (transaction->priority >= 0 && transaction->priority < I2C_PRIORITY_COUNT) ? transaction->priority : I2C_PRIORITY_NORMAL;
+    transaction->next = NULL;
+    if (_tail[priority] != NULL)
+    {
+        _tail[priority]->next = transaction;
+    }
+    else
+    {
+        _head[priority] = transaction;
+    }
+    _tail[priority] = transaction;
+    _queue_mutex.unlock();
+
+    _queue_signal.release();
+    return 0;
+}
+
+int DevI2C::wait(I2CTransaction *transaction, uint32_t timeout)
+{
+    // The signal is shared by all the transactions of the thread, so check the result after every wake up
+    while (transaction->result == I2C_PENDING)
+    {
+        osEvent evt = Thread::signal_wait(I2C_DONE_SIGNAL, timeout);
+        if (evt.status != osEventSignal && transaction->result == I2C_PENDING)
+        {
+            if (cancel(transaction))
+            {
+                break;
+            }
+            // The worker has taken it, the descriptor must outlive the transfer
+            timeout = osWaitForever;
+        }
+    }
+    return transaction->result;
+}
+
+bool DevI2C::cancel(I2CTransaction *transaction)
+{
+    bool canceled = false;
+
+    _queue_mutex.lock();
+    for (int i = 0; i < I2C_PRIORITY_COUNT && !canceled; i++)
+    {
+        I2CTransaction *previous = NULL;
+        for (I2CTransaction *t = _head[i]; t != NULL; previous = t, t = t->next)
+        {
+            if (t != transaction)
+            {
+                continue;
+            }
+            if (previous != NULL)
+            {
+                previous->next = t->next;
+            }
+            else
+            {
+                _head[i] = t->next;
+            }
+            if (_tail[i] == t)
+            {
+                _tail[i] = previous;
+            }
+            canceled = true;
+            break;
+        }
+    }
+    _queue_mutex.unlock();
+
+    if (canceled)
+    {
+        for (I2CTransaction *t = transaction; t != NULL; t = t->chain)
+        {
+            t->result = I2C_CANCELED;
+        }
+    }
+    return canceled;
+}
+
+int DevI2C::get_stats(uint8_t DeviceAddr, I2CDeviceStats *stats)
+{
+    int ret = -1;
+
+    _queue_mutex.lock();
+    for (int i = 0; i < I2C_DEVICE_STATS_MAX; i++)
+    {
+        if (_counters[i].transactions > 0 && _counters[i].device == DeviceAddr)
+        {
+            stats->device = DeviceAddr;
+            stats->transactions = _counters[i].transactions;
+            stats->errors = _counters[i].errors;
+            stats->avg_latency_us = (uint32_t)(_counters[i].total_latency_us / _counters[i].transactions);
+            stats->max_latency_us = _counters[i].max_latency_us;
+            ret = 0;
+            break;
+        }
+    }
+    _queue_mutex.unlock();
+    return ret;
+}
+
+int DevI2C::run(I2CTransaction *transaction)
+{
+    osThreadId self = Thread::gettid();
+
+    // The worker itself (from a callback) and the thread owning the bus would wait for themselves
+    if (self != _engine_tid && self != _bus_owner && submit(transaction) == 0)
+    {
+        return wait(transaction);
+    }
+
+    transaction->submitted = us_ticker_read();
+    lock();
+    int result = transfer_blocking(transaction, false);
+    unlock();
+    record(transaction, result);
+    transaction->result = result;
+    return result;
+}
+
+int DevI2C::transfer_blocking(I2CTransaction *transaction, bool repeated)
+{
+    int ret;
+
+    if (transaction->read)
+    {
+        /* Send device address, with no STOP condition */
+        ret = write(transaction->device, (const char*)&transaction->reg, 1, true);
+        if (!ret)
+        {
+            /* Read data, with STOP condition unless chained */
+            ret = read(transaction->device, (char*)transaction->data, transaction->length, repeated);
+        }
+        return (ret ? -1 : 0);
+    }
+
+    /* The register address and the data go in one write, only large writes need the heap */
+    uint8_t tmp[TEMP_BUF_SIZE];
+    uint8_t *buf = tmp;
+    if (transaction->length >= TEMP_BUF_SIZE)
+    {
+        buf = (uint8_t*)malloc(transaction->length + 1);
+        if (buf == NULL)
+        {
+            return -2;
+        }
+    }
+    buf[0] = transaction->reg;
+    memcpy(buf + 1, transaction->data, transaction->length);
+
+    ret = write(transaction->device, (const char*)buf, transaction->length + 1, repeated);
+
+    if (buf != tmp)
+    {
+        free(buf);
+    }
+    return (ret ? -1 : 0);
+}
+
+#if DEVICE_I2C_ASYNCH
+void DevI2C::on_event(int event)
+{
+    // Called in the interrupt context
+    _transfer_event = event;
+    _transfer_done.release();
+}
+
+int DevI2C::transfer_async(I2CTransaction *transaction, bool repeated)
+{
+    const char *tx;
+    int tx_length;
+    char *rx = NULL;
+    int rx_length = 0;
+    uint8_t tmp[TEMP_BUF_SIZE];
+    uint8_t *buf = tmp;
+
+    if (transaction->read)
+    {
+        // Register address then data, with a repeated start in between
+        tx = (const char*)&transaction->reg;
+        tx_length = 1;
+        rx = (char*)transaction->data;
+        rx_length = transaction->length;
+    }
+    else
+    {
+        if (transaction->length >= TEMP_BUF_SIZE)
+        {
+            buf = (uint8_t*)malloc(transaction->length + 1);
+            if (buf == NULL)
+            {
+                return -2;
+            }
+        }
+        buf[0] = transaction->reg;
+        memcpy(buf + 1, transaction->data, transaction->length);
+        tx = (const char*)buf;
+        tx_length = transaction->length + 1;
+    }
+
+    int ret = -1;
+    _transfer_event = 0;
+    if (transfer(transaction->device, tx, tx_length, rx, rx_length, callback(this, &DevI2C::on_event), I2C_EVENT_ALL, repeated) == 0)
+    {
+        // The worker sleeps while the interrupts move the data
+        if (_transfer_done.wait(I2C_TRANSFER_TIMEOUT_MS) <= 0)
+        {
+            abort_transfer();
+        }
+        else if (_transfer_event == I2C_EVENT_TRANSFER_COMPLETE)
+        {
+            ret = 0;
+        }
+    }
+
+    if (buf != tmp)
+    {
+        free(buf);
+    }
+    return ret;
+}
+#else
+void DevI2C::on_event(int event)
+{
+}
+
+int DevI2C::transfer_async(I2CTransaction *transaction, bool repeated)
+{
+    return transfer_blocking(transaction, repeated);
+}
+#endif
+
+void DevI2C::record(const I2CTransaction *transaction, int result)
+{
+    uint32_t latency = us_ticker_read() - transaction->submitted;
+
+    _queue_mutex.lock();
+    DeviceCounters *counters = NULL;
+    for (int i = 0; i < I2C_DEVICE_STATS_MAX; i++)
+    {
+        if (_counters[i].transactions == 0 || _counters[i].device == transaction->device)
+        {
+            counters = &_counters[i];
+            break;
+        }
+    }
+    if (counters != NULL)
+    {
+        counters->device = transaction->device;
+        counters->transactions++;
+        if (result != 0)
+        {
+            counters->errors++;
+        }
+        counters->total_latency_us += latency;
+        if (latency > counters->max_latency_us)
+        {
+            counters->max_latency_us = latency;
+        }
+    }
+    _queue_mutex.unlock();
+}
+
+void DevI2C::complete(I2CTransaction *transaction, int result)
+{
+    record(transaction, result);
+
+    // The owner may release the descriptor as soon as the result is set, unless it waits for the callback
+    osThreadId owner = transaction->owner;
+    Callback<void(I2CTransaction *)> cb = transaction->callback;
+    transaction->result = result;
+    if (cb)
+    {
+        cb(transaction);
+    }
+    osSignalSet(owner, I2C_DONE_SIGNAL);
+}
+
+void DevI2C::engine(void)
+{
+    _engine_tid = Thread::gettid();
+
+    while (true)
+    {
+        I2CTransaction *transaction = NULL;
+
+        _queue_mutex.lock();
+        for (int i = 0; i < I2C_PRIORITY_COUNT; i++)
+        {
+            if (_head[i] != NULL)
+            {
+                transaction = _head[i];
+                _head[i] = transaction->next;
+                if (_head[i] == NULL)
+                {
+                    _tail[i] = NULL;
+                }
+                break;
+            }
+        }
+        _queue_mutex.unlock();
+
+        if (transaction == NULL)
+        {
+            _queue_signal.wait();
+            continue;
+        }
+
+        // Run the chain back-to-back, every transfer but the last ends with a repeated start
+        int result = 0;
+        lock();
+        for (I2CTransaction *t = transaction; t != NULL; t = t->chain)
+        {
+            if (result == 0)
+            {
+                result = transfer_async(t, t->chain != NULL);
+            }
+            t->status = result;
+        }
+        unlock();
+
+        // Complete them once the bus is released, so that the callbacks can start new transfers
+        while (transaction != NULL)
+        {
+            I2CTransaction *chained = transaction->chain;
+            complete(transaction, transaction->status);
+            transaction = chained;
+        }
+    }
+}
@@ -44,9 +44,64 @@
 #include "mbed.h"
 #include "pinmap.h"
 
+/* Definitions ---------------------------------------------------------------*/
+#define I2C_DEVICE_STATS_MAX    8
+
+/** Priority classes of the queued I2C transactions, higher classes are always served first */
+typedef enum
+{
+    I2C_PRIORITY_HIGH = 0,
+    I2C_PRIORITY_NORMAL,
+    I2C_PRIORITY_LOW,
+    I2C_PRIORITY_COUNT
+} I2CPriority;
+
+/** Descriptor of one register read or write, owned by the caller until it is completed */
+struct I2CTransaction
+{
+    uint8_t device;                 /**< 8-bit slave address */
+    uint8_t reg;                    /**< First register, must be masked for auto-increment if needed */
+    bool read;                      /**< true to read the registers, false to write them */
+    uint8_t *data;                  /**< Data to write, or buffer for the data read */
+    uint16_t length;                /**< Number of bytes */
+    I2CPriority priority;
+    /** Called on the I2C worker thread once the transaction is completed, may be empty */
+    Callback<void(I2CTransaction *)> callback;
+    /** Transaction run right after this one with a repeated start, its priority is ignored */
+    I2CTransaction *chain;
+    /** I2C_PENDING until completed, then 0 if ok or -1 if an I2C error has occurred */
+    volatile int result;
+
+    /* Used by DevI2C */
+    I2CTransaction *next;
+    uint32_t submitted;
+    osThreadId owner;
+    int status;
+};
+
+#define I2C_PENDING             1
+/** Result of a transaction taken off the queue by a timed out wait */
+#define I2C_CANCELED            (-3)
+
+/** Latency counters of one slave device, the latency covers the queuing and the transfer */
+typedef struct
+{
+    uint8_t device;
+    int transactions;
+    int errors;
+    uint32_t avg_latency_us;
+    uint32_t max_latency_us;
+} I2CDeviceStats;
+
 /* Classes -------------------------------------------------------------------*/
 /** Helper class DevI2C providing functions for multi-register I2C communication
  *  common for a series of I2C devices
+ *
+ *  Transactions are queued by priority and run by one worker thread per bus, which
+ *  sleeps while the interrupt driven transfer is in progress. The blocking i2c_read
+ *  and i2c_write go through the same queue, so the threads sharing the bus are served
+ *  in priority order. A thread holding lock() owns the bus, its transactions bypass
+ *  the queue until it calls unlock().
  */
 class DevI2C : public I2C
 {
@@ -56,7 +111,7 @@ public:
      *  @param sda I2C data line pin
      *  @param scl I2C clock line pin
      */
-    DevI2C(PinName sda, PinName scl) : I2C(sda, scl) {}
+    DevI2C(PinName sda, PinName scl) : I2C(sda, scl) { init_engine(); }
 
     /** Create a DevI2C Master interface, connected to the specified pins and set their pin modes
      *
@@ -76,6 +131,7 @@ public:
     DevI2C(PinName sda, int mode_sda, PinName scl, int mode_scl) : I2C(sda, scl) {
         pin_mode(sda, (PinMode)mode_sda);
         pin_mode(scl, (PinMode)mode_scl);
+        init_engine();
     }
 
     /**
@@ -87,26 +143,12 @@ public:
      * @param  NumByteToWrite number of bytes to be written.
      * @retval 0 if ok,
      * @retval -1 if an I2C error has occurred, or
-     * @retval -2 on temporary buffer overflow (i.e. NumByteToWrite was too high)
+     * @retval -2 if there is no memory for the transfer
      * @note   On some devices if NumByteToWrite is greater
      *         than one, the RegisterAddr must be masked correctly!
      */
     int i2c_write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr,
-                  uint16_t NumByteToWrite) {
-        int ret;
-        uint8_t tmp[TEMP_BUF_SIZE];
-
-        if(NumByteToWrite >= TEMP_BUF_SIZE) return -2;
-
-        /* First, send device address. Then, send data and STOP condition */
-        tmp[0] = RegisterAddr;
-        memcpy(tmp+1, pBuffer, NumByteToWrite);
-
-        ret = write(DeviceAddr, (const char*)tmp, NumByteToWrite+1, false);
-
-        if(ret) return -1;
-        return 0;
-    }
+                  uint16_t NumByteToWrite);
 
     /**
      * @brief  Reads a buffer from the I2C peripheral device.
@@ -121,21 +163,79 @@ public:
      *         than one, the RegisterAddr must be masked correctly!
      */
     int i2c_read(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr,
-                 uint16_t NumByteToRead) {
-        int ret;
-
-        /* Send device address, with no STOP condition */
-        ret = write(DeviceAddr, (const char*)&RegisterAddr, 1, true);
-        if(!ret) {
-            /* Read data, with STOP condition  */
-            ret = read(DeviceAddr, (char*)pBuffer, NumByteToRead, false);
-        }
-
-        if(ret) return -1;
-        return 0;
-    }
+                 uint16_t NumByteToRead);
+
+    /**
+     * @brief  Queues a transaction, and the transactions chained to it, without waiting.
+     * @param  transaction the descriptor, it must stay valid until it is completed
+     * @retval 0 if queued,
+     * @retval -1 if the worker thread cannot be started
+     * @note   A failed transfer completes the rest of its chain with an error.
+     */
+    int submit(I2CTransaction *transaction);
+
+    /**
+     * @brief  Waits for a transaction submitted by the calling thread to complete.
+     * @param  transaction the descriptor
+     * @param  timeout in ms
+     * @retval the result of the transaction, or I2C_CANCELED if it was still queued upon timeout
+     * @note   Upon timeout the transaction is taken off the queue, or waited for if the worker
+     *         has already started it, so the descriptor may be released once this returns.
+     */
+    int wait(I2CTransaction *transaction, uint32_t timeout = osWaitForever);
+
+    /**
+     * @brief  Retrieves the latency counters of one slave device.
+     * @param  DeviceAddr the slave address
+     * @param  stats buffer to receive the counters
+     * @retval 0 if ok, -1 if the device has not been accessed
+     */
+    int get_stats(uint8_t DeviceAddr, I2CDeviceStats *stats);
+
+    /** Acquire exclusive access to this I2C bus, the queued transactions wait until unlock()
+     */
+    virtual void lock(void);
+
+    /** Release exclusive access to this I2C bus
+     */
+    virtual void unlock(void);
 
 private:
+    typedef struct
+    {
+        uint8_t device;
+        int transactions;
+        int errors;
+        uint64_t total_latency_us;
+        uint32_t max_latency_us;
+    } DeviceCounters;
+
+    void init_engine(void);
+    int run(I2CTransaction *transaction);
+    bool cancel(I2CTransaction *transaction);
+    int transfer_blocking(I2CTransaction *transaction, bool repeated);
+    int transfer_async(I2CTransaction *transaction, bool repeated);
+    void complete(I2CTransaction *transaction, int result);
+    void record(const I2CTransaction *transaction, int result);
+    void engine(void);
+    void on_event(int event);
+
+    Thread *_engine;
+    volatile osThreadId _engine_tid;
+    Mutex _queue_mutex;
+    Semaphore _queue_signal;
+    I2CTransaction *_head[I2C_PRIORITY_COUNT];
+    I2CTransaction *_tail[I2C_PRIORITY_COUNT];
+
+    Mutex _bus_mutex;
+    volatile osThreadId _bus_owner;
+    int _bus_depth;
+
+    Semaphore _transfer_done;
+    volatile int _transfer_event;
+
+    DeviceCounters _counters[I2C_DEVICE_STATS_MAX];
+
     static const unsigned int TEMP_BUF_SIZE = 32;
 };
 
@@ -18,9 +18,9 @@
 #include "AZ3166WiFi.h"
 #include "EEPROMInterface.h"
 #include "EMW10xxInterface.h"
-#include "SystemTime.h"
+#include "SystemBoot.h"
+#include "SystemDNS.h"
 #include "SystemWiFi.h"
-#include "Telemetry.h"
 #include "utility/wl_definitions.h"
 #include "utility/wl_types.h"
 #include "wiring.h"
@@ -105,15 +105,8 @@ int WiFiClass::begin(char* ssid, const char *passphrase)
     ((EMW10xxInterface*)WiFiInterface())->set_interface(Station);
     if (((EMW10xxInterface*)WiFiInterface())->connect(ssid, passphrase, NSAPI_SECURITY_WPA_WPA2, 0) == 0)
     {
-        // Sync system from NTP time server
-        SyncTime();
-
-        // Initialize the telemetry only after Wi-Fi established
-        telemetry_init();
-
-        // Microsoft collects data to operate effectively and provide you the best experiences with our products.
-        // We collect data about the features you use, how often you use them, and how you use them.
-        send_telemetry_data_async("", "wifi", "Wi-Fi connected");
+        // Sync system time and send the telemetry in background
+        SystemWiFiConnected();
 
         strcpy(this->ssid, ssid);
         is_station_inited = true;
@@ -136,6 +129,8 @@ int WiFiClass::disconnect()
     {
         ((EMW10xxInterface*)WiFiInterface())->set_interface(Station);
         WiFiInterface()->disconnect();
+        SystemClearReady(BOOT_READY_WIFI);
+        SystemDNSFlush();
         is_station_inited = false;
     }
     disconnectAP();
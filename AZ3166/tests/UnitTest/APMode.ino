@@ -23,4 +23,173 @@ test(APMode)
     assertEqual(WL_DISCONNECTED, WiFi.status());
 
     delay(LOOP_DELAY);
-}
\ No newline at end of file
+}
+
+static int formFieldCount;
+static char formValue[64];
+static int formValueLength;
+
+static int formCallback(void *arg, httpd_form_event_t event, const char *name, const char *data, int len)
+{
+    if (event == HTTPD_FORM_FIELD_START && strcmp(name, "PASS") == 0)
+    {
+        formValueLength = 0;
+    }
+    else if (event == HTTPD_FORM_FIELD_DATA && strcmp(name, "PASS") == 0 && formValueLength + len < (int)sizeof(formValue))
+    {
+        memcpy(&formValue[formValueLength], data, len);
+        formValueLength += len;
+    }
+    else if (event == HTTPD_FORM_FIELD_END)
+    {
+        formFieldCount++;
+    }
+    return 0;
+}
+
+test(httpd_form_decoder)
+{
+    static const char multipart[] = "--AaB03x\r\nContent-Disposition: form-data; name=\"SSID\"\r\n\r\nhome\r\n"
+        "--AaB03x\r\nContent-Disposition: form-data; name=\"PASS\"\r\n\r\npa\r\n--Aa\r\n--AaB03x--\r\n";
+    static const char urlencoded[] = "SSID=home&PASS=pa%0D%0A--Aa";
+    httpd_form_t form;
+
+    // Fed byte by byte, so that the delimiter is split everywhere
+    formFieldCount = 0;
+    assertEqual(httpd_form_init(&form, "multipart/form-data; boundary=AaB03x", formCallback, NULL), 0);
+    for (int i = 0; i < (int)sizeof(multipart) - 1; i++)
+    {
+        assertEqual(httpd_form_feed(&form, &multipart[i], 1), 0);
+    }
+    assertEqual(httpd_form_finish(&form), 0);
+    assertEqual(formFieldCount, 2);
+    assertEqual(formValueLength, 8);
+    assertEqual(memcmp(formValue, "pa\r\n--Aa", 8), 0);
+
+    formFieldCount = 0;
+    assertEqual(httpd_form_init(&form, "application/x-www-form-urlencoded", formCallback, NULL), 0);
+    assertEqual(httpd_form_feed(&form, urlencoded, sizeof(urlencoded) - 1), 0);
+    assertEqual(httpd_form_finish(&form), 0);
+    assertEqual(formFieldCount, 2);
+    assertEqual(formValueLength, 8);
+    assertEqual(memcmp(formValue, "pa\r\n--Aa", 8), 0);
+
+    // A body cut before the close delimiter
+    assertEqual(httpd_form_init(&form, "multipart/form-data; boundary=AaB03x", formCallback, NULL), 0);
+    assertEqual(httpd_form_feed(&form, multipart, sizeof(multipart) - 12), 0);
+    assertNotEqual(httpd_form_finish(&form), 0);
+}
+#define HTSYS_TEST_SOCKET 100
+
+// The chunks returned by successive recv() calls, then the connection is closed
+static const char *recvChunks[4];
+static int recvChunkLengths[4];
+static int recvChunkCount;
+static int recvChunkIndex;
+static int recvChunkOffset;
+static int recvCalls;
+
+static int scriptedRecv(int sd, void *buf, size_t n, int flags)
+{
+    recvCalls++;
+    if (recvChunkIndex == recvChunkCount)
+    {
+        return 0;
+    }
+
+    int len = recvChunkLengths[recvChunkIndex] - recvChunkOffset;
+    if (len > (int)n)
+    {
+        len = n;
+    }
+    memcpy(buf, recvChunks[recvChunkIndex] + recvChunkOffset, len);
+    recvChunkOffset += len;
+    if (recvChunkOffset == recvChunkLengths[recvChunkIndex])
+    {
+        recvChunkIndex++;
+        recvChunkOffset = 0;
+    }
+    return len;
+}
+
+static void scriptRecv(const char *chunk0, const char *chunk1 = NULL, const char *chunk2 = NULL)
+{
+    const char *chunks[] = { chunk0, chunk1, chunk2 };
+
+    recvChunkCount = 0;
+    for (int i = 0; i < 3 && chunks[i] != NULL; i++)
+    {
+        recvChunks[recvChunkCount] = chunks[i];
+        recvChunkLengths[recvChunkCount] = strlen(chunks[i]);
+        recvChunkCount++;
+    }
+    recvChunkIndex = recvChunkOffset = recvCalls = 0;
+    htsys_set_recv(scriptedRecv);
+    htsys_recv_reset(HTSYS_TEST_SOCKET);
+}
+
+test(httpd_recv_head_split)
+{
+    const char *head;
+    char line[16];
+
+    scriptRecv("GET /a HTTP/1.1\r\nHo", "st: x\r", "\n\r\nline1\r\nline2\n");
+    assertEqual(htsys_recv_head(HTSYS_TEST_SOCKET, &head), 28);
+    assertEqual(recvCalls, 3);
+    assertEqual(memcmp(head, "GET /a HTTP/1.1\r\nHost: x\r\n\r\n", 28), 0);
+    assertTrue(htsys_head_received(HTSYS_TEST_SOCKET));
+
+    // The bytes after the head stay buffered
+    assertTrue(htsys_recv_pending(HTSYS_TEST_SOCKET));
+    assertEqual(htsys_getln_soc(HTSYS_TEST_SOCKET, line, sizeof(line)), 5);
+    assertEqual(line, "line1");
+    assertEqual(htsys_getln_soc(HTSYS_TEST_SOCKET, line, sizeof(line)), 5);
+    assertEqual(line, "line2");
+    assertFalse(htsys_recv_pending(HTSYS_TEST_SOCKET));
+    assertEqual(htsys_getln_soc(HTSYS_TEST_SOCKET, line, sizeof(line)), 0);
+    htsys_set_recv(NULL);
+}
+
+test(httpd_recv_pipelined)
+{
+    const char *head;
+    char body[4];
+
+    // Two requests and the start of a third one in a single recv()
+    scriptRecv("POST /p HTTP/1.1\r\nContent-Length: 4\r\n\r\nabcd"
+               "GET /q HTTP/1.1\r\n\r\n\r\nGET /r HTTP/1.1\r\n", "\r\n");
+    assertEqual(htsys_recv_head(HTSYS_TEST_SOCKET, &head), 39);
+    assertEqual(memcmp(head, "POST /p ", 8), 0);
+    assertEqual(htsys_recv(HTSYS_TEST_SOCKET, body, 4), 4);
+    assertEqual(memcmp(body, "abcd", 4), 0);
+    assertEqual(recvCalls, 1);
+
+    assertTrue(htsys_recv_pending(HTSYS_TEST_SOCKET));
+    assertEqual(htsys_recv_head(HTSYS_TEST_SOCKET, &head), 19);
+    assertEqual(memcmp(head, "GET /q HTTP/1.1\r\n\r\n", 19), 0);
+    assertEqual(recvCalls, 1);
+
+    // The empty line before the third request is skipped, its head end comes later
+    assertEqual(htsys_recv_head(HTSYS_TEST_SOCKET, &head), 19);
+    assertEqual(memcmp(head, "GET /r HTTP/1.1\r\n\r\n", 19), 0);
+    assertEqual(recvCalls, 2);
+
+    assertFalse(htsys_recv_pending(HTSYS_TEST_SOCKET));
+    assertEqual(htsys_recv_head(HTSYS_TEST_SOCKET, &head), 0);
+    htsys_set_recv(NULL);
+}
+
+test(httpd_recv_head_too_long)
+{
+    static char longHead[HTTPD_RECV_BUFFER_SIZE + 16];
+    const char *head;
+
+    memset(longHead, 'a', sizeof(longHead) - 1);
+    memcpy(longHead, "GET /", 5);
+    longHead[sizeof(longHead) - 1] = 0;
+
+    scriptRecv(longHead, "\r\n\r\n");
+    assertLess(htsys_recv_head(HTSYS_TEST_SOCKET, &head), 0);
+    assertFalse(htsys_head_received(HTSYS_TEST_SOCKET));
+    htsys_set_recv(NULL);
+}
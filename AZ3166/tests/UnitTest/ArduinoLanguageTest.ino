@@ -29,6 +29,39 @@ test(analog_write)
     delay(LOOP_DELAY);
 }
 
+static volatile int captureCount = 0;
+
+static void onAnalogCapture(const uint16_t *samples, int count, void *context)
+{
+    captureCount += count;
+}
+
+test(analog_capture)
+{
+    const uint32_t pins[] = { ARDUINO_PIN_A0 };
+    static uint16_t buffer[2 * 100];
+    ANALOG_CAPTURE_STATS stats;
+
+    captureCount = 0;
+    assertEqual(analogCaptureStart(pins, 1, 10000, buffer, 100, onAnalogCapture, NULL), 0);
+    delay(200);
+    // Single reads still work in between the triggered scans
+    int result = analogRead(ARDUINO_PIN_A0);
+    analogCaptureStats(&stats);
+    analogCaptureStop();
+
+    Serial.printf("Capture: %d scans at %d/sec, jitter %dus, %d overruns\n",
+        stats.frames, stats.achieved_rate, stats.max_jitter_us, stats.overruns);
+    assertMoreOrEqual(result, 0);
+    assertMore((int)stats.frames, 0);
+    assertEqual((int)stats.frames, captureCount);
+    assertMore((int)stats.achieved_rate, 9900);
+    assertLess((int)stats.achieved_rate, 10100);
+    assertEqual((int)stats.overruns, 0);
+
+    delay(LOOP_DELAY);
+}
+
 test(digital_io)
 {
     int val = 0;
@@ -50,6 +83,40 @@ test(digital_io)
     delay(LOOP_DELAY);
 }
 
+test(digital_toggle_rate)
+{
+    const int toggles = 100000;
+    uint32_t start;
+    int rate;
+
+    pinMode(LED_BUILTIN, OUTPUT);
+
+    // Constant pin, inlined into BSRR writes
+    start = micros();
+    for (int i = 0; i < toggles / 2; i++)
+    {
+        digitalWrite(LED_BUILTIN, HIGH);
+        digitalWrite(LED_BUILTIN, LOW);
+    }
+    rate = (int)(toggles * 1000000ULL / (micros() - start));
+    Serial.printf("digitalWrite, constant pin: %d toggles/sec\n", rate);
+    assertMore(rate, 1000000);
+
+    // Pin only known at run time, through the function and the pin table
+    volatile uint32_t pin = LED_BUILTIN;
+    start = micros();
+    for (int i = 0; i < toggles / 2; i++)
+    {
+        digitalWrite(pin, HIGH);
+        digitalWrite(pin, LOW);
+    }
+    rate = (int)(toggles * 1000000ULL / (micros() - start));
+    Serial.printf("digitalWrite, variable pin: %d toggles/sec\n", rate);
+    assertMore(rate, 500000);
+
+    delay(LOOP_DELAY);
+}
+
 test(serial_print)
 {
     int x =0;
@@ -266,6 +333,76 @@ test(chars)
   delay(LOOP_DELAY);
 }
 
+test(string_building)
+{
+    mbed_stats_heap_t heap_info;
+    mbed_stats_heap_get(&heap_info);
+    uint32_t total = heap_info.total_size;
+
+    // Short strings stay inside the String object
+    String s(-42);
+    s += 7;
+    assertEqual(s, "-427");
+    String t = String("t=") + 25 + "," + 1.5;
+    assertEqual(t, "t=25,1.50");
+    mbed_stats_heap_get(&heap_info);
+    assertEqual((int)(heap_info.total_size - total), 0);
+
+    // The builder never allocates
+    char arena[64];
+    String::Builder builder(arena, sizeof(arena));
+    uint32_t start = micros();
+    for (int i = 0; i < 100; i++)
+    {
+        builder.clear();
+        builder += "{\"messageId\":";
+        builder += i;
+        builder += ",\"temperature\":";
+        builder.concat(23.45 + i);
+        builder += "}";
+    }
+    uint32_t elapsed = micros() - start;
+    assertFalse(builder.overflow());
+    assertEqual(builder.c_str(), "{\"messageId\":99,\"temperature\":122.45}");
+    mbed_stats_heap_get(&heap_info);
+    assertEqual((int)(heap_info.total_size - total), 0);
+    Serial.printf("String::Builder: %d us per message\r\n", (int)(elapsed / 100));
+
+    delay(LOOP_DELAY);
+}
+
+test(number_format)
+{
+    char buf[FLOAT_IO_FIXED_SIZE(FLOAT_IO_MAX_DECIMALS)];
+
+    formatFixed(buf, 2.675, 2);
+    assertEqual(buf, "2.67");
+    formatFixed(buf, 1.999, 2);
+    assertEqual(buf, "2.00");
+    formatFixed(buf, -1e10, 1);
+    assertEqual(buf, "-10000000000.0");
+    formatShortestFloat(buf, 23.45f);
+    assertEqual(buf, "23.45");
+    formatShortest(buf, 0.1);
+    assertEqual(buf, "0.1");
+    formatShortest(buf, 1e21);
+    assertEqual(buf, "1e+21");
+    formatUnsigned(buf, 0xBEEF, 16, 1);
+    assertEqual(buf, "BEEF");
+    formatInteger(buf, -2147483648LL);
+    assertEqual(buf, "-2147483648");
+    assertEqual(String(-3.14159, 3), "-3.142");
+
+    uint32_t start = micros();
+    for (int i = 0; i < 1000; i++)
+    {
+        formatShortestFloat(buf, i * 0.37f);
+    }
+    Serial.printf("formatShortestFloat: %d ns per number\r\n", (int)(micros() - start));
+
+    delay(LOOP_DELAY);
+}
+
 test(random)
 {
     randomSeed(analogRead(ARDUINO_PIN_A0));
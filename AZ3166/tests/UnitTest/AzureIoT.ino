@@ -0,0 +1,83 @@
+test(json_path_extract)
+{
+    const char *json = "{\"desired\":{\"fw\":{\"version\":\"1.2\",\"url\":\"http:\\/\\/a\\u00e9\"},\"$version\":7},"
+                       "\"items\":[{\"id\":1},{\"id\":-2.5e1}],\"on\":true,\"off\":null}";
+    JSON_PATH paths[] = {
+        { "desired.fw.version" }, { "desired.fw.url" }, { "desired.$version" },
+        { "items.1.id" }, { "items" }, { "on" }, { "off" }, { "missing" }
+    };
+    assertEqual(DevKitJsonPath_Extract(json, strlen(json), paths, 8), 7);
+    assertEqual(paths[0].type, JSON_PATH_STRING);
+    assertEqual(paths[4].type, JSON_PATH_ARRAY);
+    assertEqual(paths[6].type, JSON_PATH_NULL);
+    assertEqual(paths[7].type, JSON_PATH_NOT_FOUND);
+
+    char text[16];
+    assertEqual(DevKitJsonPath_GetString(&paths[0], text, sizeof(text)), 3);
+    assertEqual(text, "1.2");
+    // The escapes are resolved, \u00e9 to UTF-8
+    assertEqual(DevKitJsonPath_GetString(&paths[1], text, sizeof(text)), 10);
+    assertEqual(text, "http://a\xc3\xa9");
+    assertEqual(DevKitJsonPath_GetString(&paths[1], text, 10), -1);
+    assertEqual(DevKitJsonPath_GetString(&paths[2], text, sizeof(text)), -1);
+    assertEqual((int)DevKitJsonPath_GetNumber(&paths[2], 0), 7);
+    assertEqual((int)DevKitJsonPath_GetNumber(&paths[3], 0), -25);
+    assertEqual((int)DevKitJsonPath_GetNumber(&paths[0], -1), -1);
+    assertEqual(DevKitJsonPath_GetBool(&paths[5], -1), 1);
+    assertEqual(DevKitJsonPath_GetBool(&paths[6], -1), -1);
+
+    JSON_PATH path = { "a" };
+    assertEqual(DevKitJsonPath_Extract("{\"a\":[1,}", 9, &path, 1), -1);
+    assertEqual(DevKitJsonPath_Extract("{\"b\":1 \"a\":2}", 13, &path, 1), -1);
+}
+
+test(json_path_validate)
+{
+    const char *good[] = { "1", " -0.5e+3 ", "\"\\u00e9\\n\"", "[]", "{\"a\":[true,false,null,{}]}" };
+    const char *bad[] = { "", "01", "1.", "\"\\x\"", "\"\\u12\"", "[1,]", "{\"a\"}", "{a:1}", "1 2", "tru" };
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++)
+    {
+        assertEqual(DevKitJsonPath_Validate(good[i], strlen(good[i])), 0);
+    }
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        assertEqual(DevKitJsonPath_Validate(bad[i], strlen(bad[i])), -1);
+    }
+}
+
+test(json_path_write_object)
+{
+    const char *paths[] = { "d", "a.c", "x.y.z", "a.b" };
+    const char *values[] = { "3", "2", "\"v\"", "1" };
+    bool written[4];
+    char buffer[64];
+
+    // Nested by the paths, whatever their order
+    const char *object = "{\"a\":{\"b\":1,\"c\":2},\"d\":3,\"x\":{\"y\":{\"z\":\"v\"}}}";
+    assertEqual(DevKitJsonPath_WriteObject(paths, values, 4, buffer, sizeof(buffer), written), (int)strlen(object));
+    assertEqual(buffer, object);
+    assertEqual(DevKitJsonPath_Validate(buffer, strlen(buffer)), 0);
+    for (int i = 0; i < 4; i++)
+    {
+        assertTrue(written[i]);
+    }
+
+    // What doesn't fit is left out, and written with the rest next time
+    char small[32];
+    assertEqual(DevKitJsonPath_WriteObject(paths, values, 4, small, sizeof(small), written), 25);
+    assertEqual(small, "{\"a\":{\"b\":1,\"c\":2},\"d\":3}");
+    assertTrue(written[0]);
+    assertTrue(written[1]);
+    assertFalse(written[2]);
+    assertTrue(written[3]);
+    assertEqual(DevKitJsonPath_WriteObject(&paths[2], &values[2], 1, small, sizeof(small), written), 21);
+    assertEqual(small, "{\"x\":{\"y\":{\"z\":\"v\"}}}");
+    assertTrue(written[0]);
+
+    // One value is written in a buffer of its member size
+    size_t size = DevKitJsonPath_MemberSize(paths[2], strlen(values[2]));
+    assertEqual(DevKitJsonPath_WriteObject(&paths[2], &values[2], 1, buffer, size, written), 21);
+    assertEqual(DevKitJsonPath_WriteObject(&paths[2], &values[2], 1, buffer, size - 1, written), 0);
+    assertFalse(written[0]);
+    assertEqual(DevKitJsonPath_WriteObject(paths, values, 4, buffer, 2, written), -1);
+}
@@ -0,0 +1,199 @@
+static uint32_t topicMatches;
+
+static void onTopicMatch(void *context, int slot)
+{
+    topicMatches |= (1u << slot);
+}
+
+static uint32_t matchTopic(MQTT::TopicIndex<8> &index, const char *topic)
+{
+    topicMatches = 0;
+    index.match(topic, strlen(topic), onTopicMatch, NULL);
+    return topicMatches;
+}
+
+test(mqtt_topic_wildcards)
+{
+    static MQTT::TopicIndex<8> index;
+    index.clear();
+
+    assertEqual(index.add("s/+/t"), 0);
+    assertEqual(index.add("s/#"), 1);
+    assertEqual(index.add("#"), 2);
+    assertEqual(index.add("$SYS/#"), 3);
+    assertEqual(index.add("+/x"), 4);
+    // Wildcards take a whole level, and '#' is the last one
+    assertEqual(index.add("s/a+"), -1);
+    assertEqual(index.add("s/#/t"), -1);
+
+    assertEqual(matchTopic(index, "s/x/t"), 0x07u);
+    assertEqual(matchTopic(index, "s/x/y/t"), 0x06u);
+    // "s/#" takes the parent level too
+    assertEqual(matchTopic(index, "s"), 0x06u);
+    assertEqual(matchTopic(index, "a/x"), 0x14u);
+    // Wildcards in the first level don't take the topics starting with '$'
+    assertEqual(matchTopic(index, "$SYS/x"), 0x08u);
+    assertEqual(matchTopic(index, "$SYS"), 0x08u);
+}
+
+test(mqtt_topic_remove)
+{
+    static MQTT::TopicIndex<8> index;
+    index.clear();
+
+    // "gwzx" and "16cd" have the same hash and length, so they share a trie node
+    assertEqual(index.add("a/gwzx"), 0);
+    assertEqual(index.add("a/16cd"), 1);
+    assertEqual(matchTopic(index, "a/gwzx"), 0x01u);
+    assertEqual(matchTopic(index, "a/16cd"), 0x02u);
+    assertEqual(index.remove(0), 0);
+    assertEqual(matchTopic(index, "a/gwzx"), 0x00u);
+    assertEqual(matchTopic(index, "a/16cd"), 0x02u);
+    assertEqual(index.remove(0), -1);
+
+    // Siblings probing past each other in the hash table are found after one of them is removed
+    static const char *filters[] = { "p/0", "p/1", "p/2", "p/3", "p/4", "p/5" };
+    index.clear();
+    for (int i = 0; i < 6; i++)
+    {
+        assertEqual(index.add(filters[i]), i);
+    }
+    assertEqual(index.remove(2), 2);
+    assertEqual(index.remove(4), 4);
+    for (int i = 0; i < 6; i++)
+    {
+        assertEqual(matchTopic(index, filters[i]), (i == 2 || i == 4) ? 0u : (1u << i));
+    }
+    // The slots and nodes are free again
+    assertEqual(index.add("p/6"), 2);
+    assertEqual(index.find("p/6"), 2);
+    assertEqual(matchTopic(index, "p/6"), 0x04u);
+}
+
+// In memory network of the QoS1 queue tests: reads the packets queued by the test, and records
+// the packet id and the DUP flag of every PUBLISH written
+class LoopbackNetwork
+{
+public:
+    unsigned char input[64];
+    int inputLength, inputRead;
+    unsigned short published[16];
+    bool duplicate[16];
+    int publishCount;
+
+    LoopbackNetwork() : inputLength(0), inputRead(0), publishCount(0) {}
+
+    // A CONNACK or a PUBACK
+    void queue(int type, unsigned short id)
+    {
+        unsigned char packet[4] = { (unsigned char)(type << 4), 2, (unsigned char)(id >> 8), (unsigned char)id };
+        memcpy(&input[inputLength], packet, sizeof(packet));
+        inputLength += sizeof(packet);
+    }
+
+    int read(unsigned char *buffer, int len, int timeout)
+    {
+        int n = min(len, inputLength - inputRead);
+        memcpy(buffer, &input[inputRead], n);
+        inputRead += n;
+        if (inputRead == inputLength)
+        {
+            inputLength = inputRead = 0;
+        }
+        return n;
+    }
+
+    int write(unsigned char *buffer, int len, int timeout)
+    {
+        // A QoS1 PUBLISH with a short topic: header, remaining length, topic length, topic, packet id
+        if ((buffer[0] >> 4) == PUBLISH && publishCount < 16)
+        {
+            int id = 4 + buffer[3];
+            published[publishCount] = (buffer[id] << 8) | buffer[id + 1];
+            duplicate[publishCount] = ((buffer[0] & 0x08) != 0);
+            publishCount++;
+        }
+        return len;
+    }
+};
+
+static int queueAsync(MQTT::Client<LoopbackNetwork, Countdown> &client, int count)
+{
+    int queued = 0;
+    for (int i = 0; i < count; i++)
+    {
+        MQTT::Message message;
+        memset(&message, 0, sizeof(message));
+        message.qos = MQTT::QOS1;
+        message.payload = (void *)"on";
+        message.payloadlen = message.payloadtotal = 2;
+        if (client.publishAsync("t/a", message) == MQTT::SUCCESS)
+        {
+            queued++;
+        }
+    }
+    return queued;
+}
+
+test(mqtt_qos1_window)
+{
+    static LoopbackNetwork network;
+    static MQTT::Client<LoopbackNetwork, Countdown> client(network, 100);
+    network.queue(CONNACK, 0);
+    assertEqual(client.connect(), 0);
+
+    // Only the window goes out, the rest waits in the queue
+    client.setInflightWindow(2);
+    assertEqual(queueAsync(client, 5), 5);
+    assertEqual(network.publishCount, 2);
+    assertEqual(client.queuedPublishes(), 5);
+
+    // An ack out of order takes its publish out and lets the next one go
+    network.queue(PUBACK, 2);
+    client.yield(20);
+    assertEqual(network.publishCount, 3);
+    assertEqual(network.published[2], 3);
+    assertEqual(client.queuedPublishes(), 4);
+
+    network.queue(PUBACK, 1);
+    network.queue(PUBACK, 3);
+    client.yield(20);
+    assertEqual(network.publishCount, 5);
+    assertEqual(client.queuedPublishes(), 2);
+    for (int i = 0; i < network.publishCount; i++)
+    {
+        assertFalse(network.duplicate[i]);
+    }
+    client.disconnect();
+}
+
+test(mqtt_qos1_resend_on_reconnect)
+{
+    static LoopbackNetwork network;
+    static MQTT::Client<LoopbackNetwork, Countdown> client(network, 100);
+    network.queue(CONNACK, 0);
+    assertEqual(client.connect(), 0);
+
+    assertEqual(queueAsync(client, 3), 3);
+    assertEqual(network.publishCount, 3);
+    network.queue(PUBACK, 2);
+    client.yield(20);
+    client.disconnect();
+
+    // The publishes without an ack are sent again with the DUP flag, in their order
+    network.publishCount = 0;
+    network.queue(CONNACK, 0);
+    assertEqual(client.connect(), 0);
+    assertEqual(network.publishCount, 2);
+    assertEqual(network.published[0], 1);
+    assertEqual(network.published[1], 3);
+    assertTrue(network.duplicate[0]);
+    assertTrue(network.duplicate[1]);
+    assertEqual(client.queuedPublishes(), 2);
+
+    network.queue(PUBACK, 1);
+    network.queue(PUBACK, 3);
+    client.yield(20);
+    assertEqual(client.queuedPublishes(), 0);
+    client.disconnect();
+}
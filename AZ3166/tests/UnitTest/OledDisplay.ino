@@ -23,4 +23,43 @@ test(oledDisplay)
   Screen.clean();
 
   delay(LOOP_DELAY);
-}
\ No newline at end of file
+}
+test(oledDisplay_framebuffer)
+{
+  Screen.init();
+
+  Serial.println("Draw primitives into the framebuffer");
+  Screen.drawRect(0, 0, OLED_WIDTH, OLED_HEIGHT);
+  Screen.drawLine(0, 0, OLED_WIDTH - 1, OLED_HEIGHT - 1);
+  Screen.fillRect(8, 20, 16, 10);
+  Screen.drawText(32, 24, "Frame");
+  assertTrue(Screen.getPixel(0, 0));
+  assertTrue(Screen.getPixel(OLED_WIDTH - 1, 40));
+  assertTrue(Screen.getPixel(10, 25));
+  assertFalse(Screen.getPixel(10, 31));
+
+  OLED_STATS stats;
+  Screen.getStats(&stats, true);
+  Screen.flush(true);
+  Screen.waitFlush();
+  Screen.getStats(&stats);
+  assertMore((int)stats.bytes, 0);
+  Serial.printf("Full flush: %d bytes in %d us\r\n", (int)stats.last_bytes, (int)stats.last_us);
+
+  Serial.println("Redraw the same picture, nothing goes to the screen");
+  Screen.drawRect(0, 0, OLED_WIDTH, OLED_HEIGHT);
+  Screen.drawText(32, 24, "Frame");
+  assertEqual(Screen.flush(), 0);
+
+  Serial.println("Change one character");
+  Screen.drawText(32, 24, "Frams");
+  int bytes = Screen.flush();
+  assertMore(bytes, 0);
+  assertLess(bytes, (int)stats.last_bytes);
+  Serial.printf("Partial flush: %d bytes\r\n", bytes);
+
+  Screen.dumpPBM(Serial);
+  delay(LOOP_DELAY);
+
+  Screen.clean();
+}
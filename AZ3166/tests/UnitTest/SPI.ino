@@ -0,0 +1,50 @@
+test(spi_loopback)
+{
+    // Wire MOSI (PB_15) to MISO (PB_14) to check the received data as well
+    static uint8_t tx[4096];
+    static uint8_t rx[4096];
+    const int rounds = 16;
+    uint32_t start;
+    uint32_t elapsed;
+
+    for (int i = 0; i < (int)sizeof(tx); i++)
+    {
+        tx[i] = (uint8_t)(i * 7);
+    }
+
+    SPI.begin();
+    SPI.beginTransaction(SPISettings(SPI_CLOCK_MAX, MSBFIRST, SPI_MODE0));
+
+    start = micros();
+    for (int i = 0; i < (int)sizeof(tx); i++)
+    {
+        rx[i] = SPI.transfer(tx[i]);
+    }
+    elapsed = micros() - start;
+    Serial.printf("SPI byte by byte: %d KB/s\n", (int)(sizeof(tx) * 1000ULL / elapsed));
+
+    memset(rx, 0, sizeof(rx));
+    start = micros();
+    for (int i = 0; i < rounds; i++)
+    {
+        SPI.transfer(tx, rx, sizeof(tx));
+    }
+    elapsed = micros() - start;
+    int rate = (int)(rounds * sizeof(tx) * 1000ULL / elapsed);
+    Serial.printf("SPI DMA: %d KB/s, bus %d KB/s\n", rate, SPI_CLOCK_MAX / 8 / 1000);
+
+    if (memcmp(tx, rx, sizeof(tx)) == 0)
+    {
+        Serial.println("SPI loopback data verified");
+    }
+    else
+    {
+        Serial.println("No SPI loopback wire, data not checked");
+    }
+    assertMore(rate, SPI_CLOCK_MAX / 8 / 1000 * 8 / 10);
+
+    SPI.endTransaction();
+    SPI.end();
+
+    delay(LOOP_DELAY);
+}
@@ -107,6 +107,43 @@ void gyroscope_test(){
     assertEqual(lsm6dsl->getGSensitivity(&data), RetVal_OK);
 }
 
+test(sensor_i2c_queue)
+{
+    uint8_t hts221_id = 0;
+    uint8_t lsm6dsl_id = 0;
+    I2CDeviceStats stats;
+
+    // Read both WHO_AM_I registers back-to-back in one chain
+    I2CTransaction second = I2CTransaction();
+    second.device = LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW;
+    second.reg = 0x0F;
+    second.read = true;
+    second.data = &lsm6dsl_id;
+    second.length = 1;
+
+    I2CTransaction first = I2CTransaction();
+    first.device = HTS221_I2C_ADDRESS;
+    first.reg = 0x0F;
+    first.read = true;
+    first.data = &hts221_id;
+    first.length = 1;
+    first.priority = I2C_PRIORITY_HIGH;
+    first.chain = &second;
+
+    assertEqual(i2c->submit(&first), RetVal_OK);
+    assertEqual(i2c->wait(&second, 1000), RetVal_OK);
+    assertEqual(first.result, RetVal_OK);
+    assertEqual(hts221_id, 0xBC);
+    assertEqual(lsm6dsl_id, 0x6A);
+
+    // Per-device latency
+    assertEqual(i2c->get_stats(HTS221_I2C_ADDRESS, &stats), RetVal_OK);
+    assertMore(stats.transactions, 0);
+    Serial.printf("HTS221 I2C latency: avg %u us, max %u us\n", stats.avg_latency_us, stats.max_latency_us);
+
+    delay(LOOP_DELAY);
+}
+
 test(sensor_rgbled)
 {
     RGB_LED rgbLed;
@@ -131,4 +168,30 @@ test(sensor_rgbled)
     rgbLed.turnOff();
 
     delay(LOOP_DELAY);
-}
\ No newline at end of file
+}
+
+test(sensor_rgbled_fade)
+{
+    RGB_LED rgbLed;
+
+    // The fade runs on the waveform tracks, the loop is free meanwhile
+    assertEqual(rgbLed.fadeTo(255, 0, 255, 1000), 0);
+    assertTrue(rgbLed.isPlaying());
+    uint32_t start = millis();
+    int spins = 0;
+    while (rgbLed.isPlaying() && millis() - start < 2000)
+    {
+        spins++;
+    }
+    uint32_t elapsed = millis() - start;
+    Serial.printf("Fade took %u ms, %d loop iterations meanwhile\n", elapsed, spins);
+    assertFalse(rgbLed.isPlaying());
+    assertMoreOrEqual((int)elapsed, 900);
+    assertLess((int)elapsed, 1100);
+
+    rgbLed.fadeTo(0, 0, 0, 500);
+    delay(600);
+    rgbLed.turnOff();
+
+    delay(LOOP_DELAY);
+}
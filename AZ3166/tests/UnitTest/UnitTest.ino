@@ -4,7 +4,14 @@
 #include "lis2mdlSensor.h"
 #include "LSM6DSLSensor.h"
 #include "RGB_LED.h"
+#include "AZ3166SPI.h"
 #include "AZ3166WiFi.h"
+#include "httpd_form.h"
+#include "httpd_sys.h"
+#include "DevKitJsonPath.h"
+#include "MQTTClient.h"
+#include "MQTTmbed.h"
+#include "MQTTTopicIndex.h"
 #include "SystemWiFi.h"
 #include "PinNames.h"
 #include "config.h"